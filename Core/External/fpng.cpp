@@ -1160,16 +1160,28 @@ do { \
 		return dst_ofs;
 	}
 
+	// Output of the single pass encoders: a complete zlib stream, or a raw Deflate block for fpng_deflate_filtered_rows()
+	enum
+	{
+		OUTPUT_ZLIB_STREAM,
+		OUTPUT_SYNC_FLUSHED_BLOCK,
+		OUTPUT_FINAL_BLOCK
+	};
+
 	static uint32_t pixel_deflate_dyn_3_rle_one_pass(
 		const uint8_t* pImg, uint32_t w, uint32_t h,
-		uint8_t* pDst, uint32_t dst_buf_size)
+		uint8_t* pDst, uint32_t dst_buf_size, uint32_t output = OUTPUT_ZLIB_STREAM)
 	{
 		const uint32_t bpl = 1 + w * 3;
 
+		// Raw blocks skip the 2 byte zlib header, a sync flushed block also clears the BFINAL bit that follows it
+		const uint32_t prefix_ofs = (output != OUTPUT_ZLIB_STREAM) ? 2 : 0;
 		if (dst_buf_size < sizeof(g_dyn_huff_3))
 			return false;
-		memcpy(pDst, g_dyn_huff_3, sizeof(g_dyn_huff_3));
-		uint32_t dst_ofs = sizeof(g_dyn_huff_3);
+		memcpy(pDst, g_dyn_huff_3 + prefix_ofs, sizeof(g_dyn_huff_3) - prefix_ofs);
+		if (output == OUTPUT_SYNC_FLUSHED_BLOCK)
+			pDst[0] &= ~1;
+		uint32_t dst_ofs = sizeof(g_dyn_huff_3) - prefix_ofs;
 
 		uint64_t bit_buf = DYN_HUFF_3_BITBUF;
 		int bit_buf_size = DYN_HUFF_3_BITBUF_SIZE;
@@ -1177,7 +1189,7 @@ do { \
 		const uint8_t* pSrc = pImg;
 		uint32_t src_ofs = 0;
 
-		uint32_t src_adler32 = fpng_adler32(pImg, bpl * h, FPNG_ADLER32_INIT);
+		uint32_t src_adler32 = (output == OUTPUT_ZLIB_STREAM) ? fpng_adler32(pImg, bpl * h, FPNG_ADLER32_INIT) : 0;
 
 		for (uint32_t y = 0; y < h; y++)
 		{
@@ -1248,8 +1260,23 @@ do { \
 
 		PUT_BITS_CZ(g_dyn_huff_3_codes[256].m_code, g_dyn_huff_3_codes[256].m_code_size);
 
+		if (output == OUTPUT_SYNC_FLUSHED_BLOCK)
+		{
+			// Empty stored block: 3 header bits, padding to the next byte, LEN = 0 and NLEN = 0xFFFF
+			PUT_BITS(0, 3);
+			PUT_BITS_FORCE_FLUSH;
+			if ((dst_ofs + 4) > dst_buf_size)
+				return 0;
+			const uint8_t sync_marker[4] = { 0, 0, 0xFF, 0xFF };
+			memcpy(pDst + dst_ofs, sync_marker, 4);
+			return dst_ofs + 4;
+		}
+
 		PUT_BITS_FORCE_FLUSH;
 
+		if (output == OUTPUT_FINAL_BLOCK)
+			return dst_ofs;
+
 		// Write zlib adler32
 		for (uint32_t i = 0; i < 4; i++)
 		{
@@ -1448,14 +1475,18 @@ do { \
 
 	static uint32_t pixel_deflate_dyn_4_rle_one_pass(
 		const uint8_t* pImg, uint32_t w, uint32_t h,
-		uint8_t* pDst, uint32_t dst_buf_size)
+		uint8_t* pDst, uint32_t dst_buf_size, uint32_t output = OUTPUT_ZLIB_STREAM)
 	{
 		const uint32_t bpl = 1 + w * 4;
 
+		// Raw blocks skip the 2 byte zlib header, a sync flushed block also clears the BFINAL bit that follows it
+		const uint32_t prefix_ofs = (output != OUTPUT_ZLIB_STREAM) ? 2 : 0;
 		if (dst_buf_size < sizeof(g_dyn_huff_4))
 			return false;
-		memcpy(pDst, g_dyn_huff_4, sizeof(g_dyn_huff_4));
-		uint32_t dst_ofs = sizeof(g_dyn_huff_4);
+		memcpy(pDst, g_dyn_huff_4 + prefix_ofs, sizeof(g_dyn_huff_4) - prefix_ofs);
+		if (output == OUTPUT_SYNC_FLUSHED_BLOCK)
+			pDst[0] &= ~1;
+		uint32_t dst_ofs = sizeof(g_dyn_huff_4) - prefix_ofs;
 
 		uint64_t bit_buf = DYN_HUFF_4_BITBUF;
 		int bit_buf_size = DYN_HUFF_4_BITBUF_SIZE;
@@ -1463,7 +1494,7 @@ do { \
 		const uint8_t* pSrc = pImg;
 		uint32_t src_ofs = 0;
 
-		uint32_t src_adler32 = fpng_adler32(pImg, bpl * h, FPNG_ADLER32_INIT);
+		uint32_t src_adler32 = (output == OUTPUT_ZLIB_STREAM) ? fpng_adler32(pImg, bpl * h, FPNG_ADLER32_INIT) : 0;
 
 		for (uint32_t y = 0; y < h; y++)
 		{
@@ -1563,8 +1594,23 @@ do_literals:
 
 		PUT_BITS_CZ(g_dyn_huff_4_codes[256].m_code, g_dyn_huff_4_codes[256].m_code_size);
 
+		if (output == OUTPUT_SYNC_FLUSHED_BLOCK)
+		{
+			// Empty stored block: 3 header bits, padding to the next byte, LEN = 0 and NLEN = 0xFFFF
+			PUT_BITS(0, 3);
+			PUT_BITS_FORCE_FLUSH;
+			if ((dst_ofs + 4) > dst_buf_size)
+				return 0;
+			const uint8_t sync_marker[4] = { 0, 0, 0xFF, 0xFF };
+			memcpy(pDst + dst_ofs, sync_marker, 4);
+			return dst_ofs + 4;
+		}
+
 		PUT_BITS_FORCE_FLUSH;
 
+		if (output == OUTPUT_FINAL_BLOCK)
+			return dst_ofs;
+
 		// Write zlib adler32
 		for (uint32_t i = 0; i < 4; i++)
 		{
@@ -1659,6 +1705,17 @@ do_literals:
 		}
 	}
 
+	uint32_t fpng_deflate_filtered_rows(const uint8_t* pFiltered, uint32_t w, uint32_t h, uint32_t num_chans, uint8_t* pDst, uint32_t dst_buf_size, bool final_block)
+	{
+		if ((!pFiltered) || (!pDst) || (!w) || (!h) || ((num_chans != 3) && (num_chans != 4)))
+			return 0;
+
+		const uint32_t output = final_block ? OUTPUT_FINAL_BLOCK : OUTPUT_SYNC_FLUSHED_BLOCK;
+		if (num_chans == 3)
+			return pixel_deflate_dyn_3_rle_one_pass(pFiltered, w, h, pDst, dst_buf_size, output);
+		return pixel_deflate_dyn_4_rle_one_pass(pFiltered, w, h, pDst, dst_buf_size, output);
+	}
+
 	bool fpng_encode_image_to_memory(const void* pImage, uint32_t w, uint32_t h, uint32_t num_chans, std::vector<uint8_t>& out_buf, uint32_t flags)
 	{
 		if (!endian_check())
@@ -2104,6 +2161,39 @@ do_literals:
 		return true;
 	}
 
+	// Streams written by fpng_deflate_filtered_rows() hold one dynamic block per strip of rows, each one but the last is
+	// followed by a sync flush. At the start of a row, this checks for the end of such a block and prepares the next one.
+	static bool next_strip_block(
+		const uint8_t* pSrc, uint32_t src_len, uint32_t& src_ofs,
+		uint32_t& bit_buf_size, uint64_t& bit_buf,
+		uint32_t* pLit_table, uint32_t num_chans, uint32_t& bfinal)
+	{
+		const uint32_t lit = pLit_table[bit_buf & (FPNG_DECODER_TABLE_SIZE - 1)];
+		const uint32_t lit_len = (lit >> 9) & 15;
+		if ((bfinal) || (!lit_len) || ((lit & 511) != 256))
+			return true;
+		SKIP_BITS(lit_len);
+
+		// Empty stored block: not final, padded to the next byte, LEN = 0 and NLEN = 0xFFFF
+		uint32_t stored_header, len, nlen;
+		GET_BITS(stored_header, 3);
+		if (stored_header != 0)
+			return false;
+		SKIP_BITS(bit_buf_size & 7);
+		GET_BITS(len, 16);
+		GET_BITS(nlen, 16);
+		if ((len != 0) || (nlen != 0xFFFF))
+			return false;
+
+		uint32_t btype;
+		GET_BITS(bfinal, 1);
+		GET_BITS(btype, 2);
+		if (btype != 2)
+			return false;
+
+		return prepare_dynamic_block(pSrc, src_len, src_ofs, bit_buf_size, bit_buf, pLit_table, num_chans);
+	}
+
 	static bool fpng_pixel_zlib_raw_decompress(
 		const uint8_t* pSrc, uint32_t src_len, uint32_t zlib_len,
 		uint8_t* pDst, uint32_t w, uint32_t h,
@@ -2239,8 +2329,8 @@ do_literals:
 		GET_BITS(bfinal, 1);
 		GET_BITS(btype, 2);
 
-		// Must be the final block or it's not valid, and type=2 (dynamic)
-		if ((bfinal != 1) || (btype != 2))
+		// Must be type=2 (dynamic), and the final block unless next_strip_block() finds more
+		if (btype != 2)
 			return false;
 
 		uint32_t lit_table[FPNG_DECODER_TABLE_SIZE];
@@ -2252,6 +2342,9 @@ do_literals:
 
 		for (uint32_t y = 0; y < h; y++)
 		{
+			if ((y) && (!next_strip_block(pSrc, src_len, src_ofs, bit_buf_size, bit_buf, lit_table, 3, bfinal)))
+				return false;
+
 			// At start of PNG scanline, so read the filter literal
 			assert(bit_buf_size >= FPNG_DECODER_TABLE_BITS);
 			uint32_t filter = lit_table[bit_buf & (FPNG_DECODER_TABLE_SIZE - 1)];
@@ -2563,7 +2656,7 @@ do_literals:
 		if (!lit0_len)
 			return false;
 		lit0 &= 511;
-		if (lit0 != 256)
+		if ((lit0 != 256) || (bfinal != 1))
 			return false;
 
 		bit_buf_size -= lit0_len;
@@ -2617,8 +2710,8 @@ do_literals:
 		GET_BITS(bfinal, 1);
 		GET_BITS(btype, 2);
 
-		// Must be the final block or it's not valid, and type=2 (dynamic)
-		if ((bfinal != 1) || (btype != 2))
+		// Must be type=2 (dynamic), and the final block unless next_strip_block() finds more
+		if (btype != 2)
 			return false;
 
 		uint32_t lit_table[FPNG_DECODER_TABLE_SIZE];
@@ -2630,6 +2723,9 @@ do_literals:
 
 		for (uint32_t y = 0; y < h; y++)
 		{
+			if ((y) && (!next_strip_block(pSrc, src_len, src_ofs, bit_buf_size, bit_buf, lit_table, 4, bfinal)))
+				return false;
+
 			// At start of PNG scanline, so read the filter literal
 			assert(bit_buf_size >= FPNG_DECODER_TABLE_BITS);
 			uint32_t filter = lit_table[bit_buf & (FPNG_DECODER_TABLE_SIZE - 1)];
@@ -2879,7 +2975,7 @@ do_literals:
 		if (!lit0_len)
 			return false;
 		lit0 &= 511;
-		if (lit0 != 256)
+		if ((lit0 != 256) || (bfinal != 1))
 			return false;
 
 		bit_buf_size -= lit0_len;
@@ -47,6 +47,15 @@ namespace fpng
 	// num_chans must be 3 or 4.
 	bool fpng_encode_image_to_memory(const void* pImage, uint32_t w, uint32_t h, uint32_t num_chans, std::vector<uint8_t>& out_buf, uint32_t flags = 0);
 
+	// Compresses rows that are already filtered (each row is a filter byte followed by w * num_chans bytes) with the
+	// same single pass as fpng_encode_image_to_memory(). The output is a raw Deflate block that either ends with a sync
+	// flush (an empty stored block), or is marked as final and padded to the next byte. That way, the outputs for
+	// consecutive strips of rows can be concatenated into one zlib stream, which fpng_decode_memory() accepts if the
+	// first row is not filtered and all others use the "up" filter, like the rows of fpng_encode_image_to_memory().
+	// num_chans must be 3 or 4. Returns the number of bytes written, or 0 if the output did not fit into dst_buf_size
+	// (allow 64 bytes more than the input).
+	uint32_t fpng_deflate_filtered_rows(const uint8_t* pFiltered, uint32_t w, uint32_t h, uint32_t num_chans, uint8_t* pDst, uint32_t dst_buf_size, bool final_block);
+
 #ifndef FPNG_NO_STDIO
 	// Fast PNG encoding to the specified file.
 	bool fpng_encode_image_to_file(const char* pFilename, const void* pImage, uint32_t w, uint32_t h, uint32_t num_chans, uint32_t flags = 0);
@@ -0,0 +1,113 @@
+#include "base64.h"
+
+#include "image.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+// pshufb is SSSE3, which is not part of the x86-64 baseline. GCC and clang enable it along with SSE4.1.
+#if defined(__SSSE3__)
+    #define SIIO_SSSE3
+    #include <tmmintrin.h>
+#endif
+
+namespace {
+
+constexpr char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/// Inputs below this size are encoded on the calling thread. Chunks are a multiple of three bytes, so
+/// they can be encoded independently without padding in between.
+constexpr size_t chunkBytes = 3 << 16;
+
+/// Both characters for each 12 bit half of a three byte group, so that the scalar code does two lookups
+/// per group instead of four
+struct PairTable {
+    uint16_t pairs[4096];
+
+    PairTable() {
+        for (int i = 0; i < 4096; ++i) {
+            char c[2] = { alphabet[i >> 6], alphabet[i & 63] };
+            std::memcpy(&pairs[i], c, 2);
+        }
+    }
+};
+
+const PairTable& GetPairTable() {
+    static const PairTable table;
+    return table;
+}
+
+#ifdef SIIO_SSSE3
+/// Encodes 12 bytes from the lower three quarters of the register to 16 characters, following W. Muła and
+/// D. Lemire, "Faster Base64 Encoding and Decoding Using AVX2 Instructions" (2018)
+inline __m128i EncodeBlock(__m128i in) {
+    // Each 32 bit lane gets the three bytes of one group, arranged as [b1, b0, b2, b1]
+    in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+
+    // Move the four 6 bit indices of each group into separate bytes. The multiplications shift the 16 bit
+    // halves of the lanes by different amounts.
+    const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0FC0FC00));
+    const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003F03F0));
+    const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    const __m128i indices = _mm_or_si128(t1, t3);
+
+    // Classify the indices into the ranges of the alphabet and add the offset of their range
+    __m128i range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    const __m128i isUpper = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+    range = _mm_or_si128(range, _mm_and_si128(isUpper, _mm_set1_epi8(13)));
+    const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                          '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                          '/' - 63, 'A', 0, 0);
+    return _mm_add_epi8(_mm_shuffle_epi8(offsets, range), indices);
+}
+#endif
+
+/// Encodes a range of the input that is a multiple of three bytes, except for the very last one
+void EncodeChunk(const uint8_t* data, size_t size, char* out) {
+    size_t i = 0;
+#ifdef SIIO_SSSE3
+    // The loads read 16 bytes of which 12 are used, so the last few groups are left to the scalar code
+    for (; i + 16 <= size; i += 12, out += 16)
+        _mm_storeu_si128((__m128i*) out, EncodeBlock(_mm_loadu_si128((const __m128i*) (data + i))));
+#endif
+
+    const uint16_t* pairs = GetPairTable().pairs;
+    for (; i + 3 <= size; i += 3, out += 4) {
+        const uint32_t group = (uint32_t(data[i]) << 16) | (uint32_t(data[i + 1]) << 8) | data[i + 2];
+        std::memcpy(out, &pairs[group >> 12], 2);
+        std::memcpy(out + 2, &pairs[group & 0xFFF], 2);
+    }
+
+    if (i + 1 == size) {
+        out[0] = alphabet[data[i] >> 2];
+        out[1] = alphabet[(data[i] & 3) << 4];
+        out[2] = '=';
+        out[3] = '=';
+    } else if (i + 2 == size) {
+        out[0] = alphabet[data[i] >> 2];
+        out[1] = alphabet[((data[i] & 3) << 4) | (data[i + 1] >> 4)];
+        out[2] = alphabet[(data[i + 1] & 15) << 2];
+        out[3] = '=';
+    }
+}
+
+} // namespace
+
+void Base64Encode(const uint8_t* data, size_t size, char* out, int numThreads) {
+    const size_t numChunks = (size + chunkBytes - 1) / chunkBytes;
+    if (numThreads <= 1 || numChunks <= 1) {
+        EncodeChunk(data, size, out);
+        return;
+    }
+
+    std::atomic<size_t> nextChunk = 0;
+    IOThreadPool().RunParallel((int) std::min<size_t>(numThreads, numChunks), [&] {
+        for (size_t i; (i = nextChunk++) < numChunks; ) {
+            const size_t offset = i * chunkBytes;
+            EncodeChunk(data + offset, std::min(chunkBytes, size - offset), out + offset / 3 * 4);
+        }
+    });
+}
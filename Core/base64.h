@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/// Number of characters in the base64 encoding of the given number of bytes, including the padding
+constexpr size_t Base64Length(size_t numBytes) {
+    return (numBytes + 2) / 3 * 4;
+}
+
+/// Writes the standard base64 encoding (RFC 4648, with '+', '/', and '=' padding) of the data to out, which
+/// must have room for Base64Length(size) characters. No terminating zero is written. Large inputs are split
+/// into chunks that are encoded concurrently on up to numThreads threads of the I/O pool.
+void Base64Encode(const uint8_t* data, size_t size, char* out, int numThreads = 1);
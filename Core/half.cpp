@@ -0,0 +1,173 @@
+#include "half.h"
+
+#include "image.h"
+
+#include <cstring>
+
+// F16C is not part of the x86-64 baseline. It is implied by AVX2, which is the only way to enable it in MSVC.
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+    #define SIIO_F16C
+    #include <immintrin.h>
+#endif
+
+namespace {
+
+/// Bit patterns of floats used by the conversions
+constexpr uint32_t halfOverflow = (127 + 16) << 23;   // 2^16, rounds to infinity
+constexpr uint32_t floatInfinity = 0x7F800000;
+constexpr uint32_t halfNormalMin = 113 << 23;         // 2^-14, the smallest normal half
+constexpr uint32_t halfExponentMask = 0x7C00 << 13;   // half exponent bits shifted to their float position
+
+/// Adding 0.5 aligns the ten mantissa bits of a half subnormal at the bottom of the float, rounded to
+/// nearest even by the FPU
+constexpr float subnormalMagic = 0.5f;
+constexpr uint32_t subnormalMagicBits = 0x3F000000;
+
+/// Moves the exponent from float bias (127) to half bias (15), as an unsigned wrap-around add. The 0xFFF
+/// plus the lowest kept mantissa bit implement round to nearest even.
+constexpr uint32_t rebiasAndRound = 0xC8000FFF;
+
+/// Scalar conversion after F. Giesen's "float_to_half_fast3_rtne", with NaN payloads kept like F16C
+uint16_t FloatToHalf(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, 4);
+    const uint32_t sign = bits & 0x80000000u;
+    bits ^= sign;
+
+    uint32_t result;
+    if (bits >= halfOverflow) {
+        result = bits > floatInfinity ? 0x7E00 | ((bits >> 13) & 0x3FF) : 0x7C00;
+    } else if (bits < halfNormalMin) {
+        float f;
+        std::memcpy(&f, &bits, 4);
+        f += subnormalMagic;
+        std::memcpy(&bits, &f, 4);
+        result = bits - subnormalMagicBits;
+    } else {
+        const uint32_t mantissaOdd = (bits >> 13) & 1;
+        result = (bits + rebiasAndRound + mantissaOdd) >> 13;
+    }
+    return uint16_t(result | (sign >> 16));
+}
+
+float HalfToFloat(uint16_t half) {
+    uint32_t bits = (half & 0x7FFFu) << 13;
+    const uint32_t exponent = bits & halfExponentMask;
+    bits += (127 - 15) << 23;
+    if (exponent == halfExponentMask) {
+        // Infinity or NaN, which is made quiet like F16C does
+        bits += (128 - 16) << 23;
+        if (bits & 0x7FFFFF) bits |= 0x400000;
+    } else if (exponent == 0) {
+        // Zero or subnormal, renormalize via the FPU
+        bits += 1 << 23;
+        float f, magic;
+        std::memcpy(&f, &bits, 4);
+        std::memcpy(&magic, &halfNormalMin, 4);
+        f -= magic;
+        std::memcpy(&bits, &f, 4);
+    }
+    bits |= uint32_t(half & 0x8000) << 16;
+    float result;
+    std::memcpy(&result, &bits, 4);
+    return result;
+}
+
+#if defined(SIIO_SSE2) && !defined(SIIO_F16C)
+/// Selects a where the mask is set, b elsewhere
+inline __m128i Select(__m128i mask, __m128i a, __m128i b) {
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+/// Four lanes of FloatToHalf(), the results are in the low 16 bits of each lane
+inline __m128i FloatToHalf4(__m128 value) {
+    __m128i bits = _mm_castps_si128(value);
+    const __m128i sign = _mm_and_si128(bits, _mm_set1_epi32(int(0x80000000u)));
+    bits = _mm_xor_si128(bits, sign);
+
+    const __m128i isSpecial = _mm_cmpgt_epi32(bits, _mm_set1_epi32(halfOverflow - 1));
+    const __m128i isNan = _mm_cmpgt_epi32(bits, _mm_set1_epi32(floatInfinity));
+    const __m128i payload = _mm_or_si128(_mm_set1_epi32(0x200), _mm_and_si128(_mm_srli_epi32(bits, 13),
+                                                                              _mm_set1_epi32(0x3FF)));
+    const __m128i special = _mm_or_si128(_mm_set1_epi32(0x7C00), _mm_and_si128(isNan, payload));
+
+    const __m128i isSubnormal = _mm_cmplt_epi32(bits, _mm_set1_epi32(halfNormalMin));
+    const __m128i subnormal = _mm_sub_epi32(
+        _mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(bits), _mm_set1_ps(subnormalMagic))),
+        _mm_set1_epi32(subnormalMagicBits));
+
+    const __m128i mantissaOdd = _mm_and_si128(_mm_srli_epi32(bits, 13), _mm_set1_epi32(1));
+    const __m128i normal = _mm_srli_epi32(
+        _mm_add_epi32(_mm_add_epi32(bits, _mm_set1_epi32(int(rebiasAndRound))), mantissaOdd), 13);
+
+    __m128i result = Select(isSpecial, special, Select(isSubnormal, subnormal, normal));
+    return _mm_or_si128(result, _mm_srli_epi32(sign, 16));
+}
+
+/// Four lanes of HalfToFloat(), the inputs are in the low 16 bits of each lane
+inline __m128 HalfToFloat4(__m128i half) {
+    __m128i bits = _mm_slli_epi32(_mm_and_si128(half, _mm_set1_epi32(0x7FFF)), 13);
+    const __m128i exponent = _mm_and_si128(bits, _mm_set1_epi32(halfExponentMask));
+    bits = _mm_add_epi32(bits, _mm_set1_epi32((127 - 15) << 23));
+
+    const __m128i isSpecial = _mm_cmpeq_epi32(exponent, _mm_set1_epi32(halfExponentMask));
+    const __m128i noPayload = _mm_cmpeq_epi32(_mm_and_si128(bits, _mm_set1_epi32(0x7FFFFF)),
+                                              _mm_setzero_si128());
+    const __m128i quietNan = _mm_andnot_si128(noPayload, _mm_set1_epi32(0x400000));
+    bits = _mm_add_epi32(bits, _mm_and_si128(isSpecial, _mm_set1_epi32((128 - 16) << 23)));
+    bits = _mm_or_si128(bits, _mm_and_si128(isSpecial, quietNan));
+
+    const __m128i isSubnormal = _mm_cmpeq_epi32(exponent, _mm_setzero_si128());
+    const __m128i renormalized = _mm_castps_si128(_mm_sub_ps(
+        _mm_castsi128_ps(_mm_add_epi32(bits, _mm_set1_epi32(1 << 23))),
+        _mm_castsi128_ps(_mm_set1_epi32(halfNormalMin))));
+    bits = Select(isSubnormal, renormalized, bits);
+
+    bits = _mm_or_si128(bits, _mm_slli_epi32(_mm_and_si128(half, _mm_set1_epi32(0x8000)), 16));
+    return _mm_castsi128_ps(bits);
+}
+#endif
+
+} // namespace
+
+void FloatToHalfRow(const float* src, uint16_t* dst, size_t count) {
+    size_t i = 0;
+#if defined(SIIO_F16C)
+    for (; i + 8 <= count; i += 8) {
+        __m128i low = _mm_cvtps_ph(_mm_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+        __m128i high = _mm_cvtps_ph(_mm_loadu_ps(src + i + 4), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128((__m128i*) (dst + i), _mm_unpacklo_epi64(low, high));
+    }
+#elif defined(SIIO_SSE2)
+    for (; i + 8 <= count; i += 8) {
+        // Sign extend the 16 bit results, so the saturating pack keeps them as they are
+        __m128i low = FloatToHalf4(_mm_loadu_ps(src + i));
+        __m128i high = FloatToHalf4(_mm_loadu_ps(src + i + 4));
+        low = _mm_srai_epi32(_mm_slli_epi32(low, 16), 16);
+        high = _mm_srai_epi32(_mm_slli_epi32(high, 16), 16);
+        _mm_storeu_si128((__m128i*) (dst + i), _mm_packs_epi32(low, high));
+    }
+#endif
+    for (; i < count; ++i)
+        dst[i] = FloatToHalf(src[i]);
+}
+
+void HalfToFloatRow(const uint16_t* src, float* dst, size_t count) {
+    size_t i = 0;
+#if defined(SIIO_F16C)
+    for (; i + 8 <= count; i += 8) {
+        __m128i halves = _mm_loadu_si128((const __m128i*) (src + i));
+        _mm_storeu_ps(dst + i, _mm_cvtph_ps(halves));
+        _mm_storeu_ps(dst + i + 4, _mm_cvtph_ps(_mm_unpackhi_epi64(halves, halves)));
+    }
+#elif defined(SIIO_SSE2)
+    for (; i + 8 <= count; i += 8) {
+        __m128i halves = _mm_loadu_si128((const __m128i*) (src + i));
+        __m128i zero = _mm_setzero_si128();
+        _mm_storeu_ps(dst + i, HalfToFloat4(_mm_unpacklo_epi16(halves, zero)));
+        _mm_storeu_ps(dst + i + 4, HalfToFloat4(_mm_unpackhi_epi16(halves, zero)));
+    }
+#endif
+    for (; i < count; ++i)
+        dst[i] = HalfToFloat(src[i]);
+}
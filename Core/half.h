@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/// Converts floats to IEEE 754 half precision, rounded to nearest even. Values beyond the half range become
+/// infinity, NaNs stay quiet NaNs with the upper bits of their payload. This is the same result as the F16C
+/// instruction set and C#'s (Half) cast.
+void FloatToHalfRow(const float* src, uint16_t* dst, size_t count);
+
+/// Converts IEEE 754 half precision values to float, which is exact except that signaling NaNs become quiet
+/// (as with F16C)
+void HalfToFloatRow(const uint16_t* src, float* dst, size_t count);
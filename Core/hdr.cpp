@@ -0,0 +1,381 @@
+#include "hdr.h"
+
+#include "image.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+namespace {
+
+/// Scanlines are encoded and decoded in blocks of at least this many pixels. The encoded scanlines do not
+/// depend on each other, so neither the layout nor the number of threads changes the file.
+constexpr int blockTargetPixels = 1 << 16;
+
+/// Run-length encoding is only used for scanlines of this width range, others are stored flat
+bool IsRunLengthWidth(int width) { return width >= 8 && width < 32768; }
+
+/// Converts a linear RGB color to the shared exponent format, exactly like stb_image_write. Values that do
+/// not fit a byte wrap around (as the conversion does on x86), rather than being undefined.
+void ToRgbe(float r, float g, float b, uint8_t* rgbe) {
+    // Written out rather than std::max, which picks the other operand if one is NaN
+    float maxGB = g > b ? g : b;
+    float maxComp = r > maxGB ? r : maxGB;
+    if (maxComp < 1e-32f) {
+        rgbe[0] = rgbe[1] = rgbe[2] = rgbe[3] = 0;
+    } else {
+        int exponent;
+        float normalize = std::frexp(maxComp, &exponent) * 256.0f / maxComp;
+        rgbe[0] = (uint8_t) (int) (r * normalize);
+        rgbe[1] = (uint8_t) (int) (g * normalize);
+        rgbe[2] = (uint8_t) (int) (b * normalize);
+        rgbe[3] = (uint8_t) (exponent + 128);
+    }
+}
+
+/// Converts a row of pixels to RGBE. Component c of pixel x is written to out[c * planeStride + x * step],
+/// so the result is either interleaved (step 4, planeStride 1) or planar (step 1, planeStride width).
+void RowToRgbe(const float* row, int width, int numChannels, uint8_t* out, size_t step, size_t planeStride) {
+    const int offsetG = numChannels > 2 ? 1 : 0, offsetB = numChannels > 2 ? 2 : 0;
+    int x = 0;
+#ifdef SIIO_SSE2
+    const __m128i mantissaMask = _mm_set1_epi32(0x007FFFFF), byteMask = _mm_set1_epi32(0xFF);
+    const __m128i exponentMask = _mm_set1_epi32(0x7F800000);
+    const __m128i shiftedExponent = _mm_set1_epi32(134 << 23);
+    for (; x + 4 <= width; x += 4) {
+        const float* p = row + x * numChannels;
+        const int n = numChannels;
+        __m128 r = _mm_setr_ps(p[0], p[n], p[2 * n], p[3 * n]);
+        __m128 g = _mm_setr_ps(p[offsetG], p[n + offsetG], p[2 * n + offsetG], p[3 * n + offsetG]);
+        __m128 b = _mm_setr_ps(p[offsetB], p[n + offsetB], p[2 * n + offsetB], p[3 * n + offsetB]);
+
+        // Same operand order as in ToRgbe(), so NaNs propagate the same way
+        __m128 maxComp = _mm_max_ps(r, _mm_max_ps(g, b));
+        __m128i bits = _mm_castps_si128(maxComp);
+        __m128i exponentBits = _mm_and_si128(bits, exponentMask);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(exponentBits, exponentMask))) {
+            // Infinity or NaN, leave these to frexp
+            for (int i = 0; i < 4; ++i) {
+                uint8_t rgbe[4];
+                ToRgbe(p[i * n], p[i * n + offsetG], p[i * n + offsetB], rgbe);
+                for (int c = 0; c < 4; ++c) out[c * planeStride + (x + i) * step] = rgbe[c];
+            }
+            continue;
+        }
+
+        // frexp() times 256 keeps the mantissa and sets the exponent to 2^7
+        __m128 scaledMantissa = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, mantissaMask), shiftedExponent));
+        __m128 normalize = _mm_div_ps(scaledMantissa, maxComp);
+        __m128i isZero = _mm_castps_si128(_mm_cmplt_ps(maxComp, _mm_set1_ps(1e-32f)));
+        __m128i channels[4] = {
+            _mm_and_si128(_mm_cvttps_epi32(_mm_mul_ps(r, normalize)), byteMask),
+            _mm_and_si128(_mm_cvttps_epi32(_mm_mul_ps(g, normalize)), byteMask),
+            _mm_and_si128(_mm_cvttps_epi32(_mm_mul_ps(b, normalize)), byteMask),
+            _mm_and_si128(_mm_add_epi32(_mm_srli_epi32(exponentBits, 23), _mm_set1_epi32(2)), byteMask),
+        };
+        for (auto& c : channels)
+            c = _mm_andnot_si128(isZero, c);
+
+        if (step == 4) {
+            __m128i rgbe = _mm_or_si128(_mm_or_si128(channels[0], _mm_slli_epi32(channels[1], 8)),
+                                        _mm_or_si128(_mm_slli_epi32(channels[2], 16), _mm_slli_epi32(channels[3], 24)));
+            _mm_storeu_si128((__m128i*) (out + x * 4), rgbe);
+        } else {
+            for (int c = 0; c < 4; ++c) {
+                __m128i words = _mm_packs_epi32(channels[c], channels[c]);
+                int bytes = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+                std::memcpy(out + c * planeStride + x, &bytes, 4);
+            }
+        }
+    }
+#endif
+    for (; x < width; ++x) {
+        const float* p = row + x * numChannels;
+        uint8_t rgbe[4];
+        ToRgbe(p[0], p[offsetG], p[offsetB], rgbe);
+        for (int c = 0; c < 4; ++c) out[c * planeStride + x * step] = rgbe[c];
+    }
+}
+
+/// Run-length encodes one component of a scanline like stb_image_write: runs of three or more equal bytes
+/// are stored as runs (of up to 127), everything in between as literal dumps (of up to 128)
+void EncodeComponent(const uint8_t* comp, int width, std::vector<uint8_t>& out) {
+    int x = 0;
+    while (x < width) {
+        // Find the start of the next run
+        int r = x;
+        while (r + 2 < width && !(comp[r] == comp[r + 1] && comp[r] == comp[r + 2]))
+            ++r;
+        if (r + 2 >= width)
+            r = width;
+
+        while (x < r) {
+            int len = std::min(r - x, 128);
+            out.push_back((uint8_t) len);
+            out.insert(out.end(), comp + x, comp + x + len);
+            x += len;
+        }
+
+        if (r + 2 < width) {
+            while (r < width && comp[r] == comp[x])
+                ++r;
+            while (x < r) {
+                int len = std::min(r - x, 127);
+                out.push_back((uint8_t) (len + 128));
+                out.push_back(comp[x]);
+                x += len;
+            }
+        }
+    }
+}
+
+/// Multipliers of the mantissas for each exponent, as computed by stb_image. Zero is mapped to zero, so
+/// black pixels need no special case.
+struct ExponentScales {
+    float scale[256];
+
+    ExponentScales() {
+        scale[0] = 0;
+        for (int e = 1; e < 256; ++e)
+            scale[e] = (float) std::ldexp(1.0f, e - (128 + 8));
+    }
+};
+
+const ExponentScales exponentScales;
+
+/// Expands a row of RGBE pixels to RGB floats. Component c of pixel x is read from
+/// rgbe[c * planeStride + x * step], i.e., the row is interleaved (step 4, planeStride 1) or planar (step 1,
+/// planeStride width).
+void RgbeToRow(const uint8_t* rgbe, int width, size_t step, size_t planeStride, float* dst) {
+    const uint8_t* e = rgbe + 3 * planeStride;
+    int x = 0;
+#ifdef SIIO_SSE2
+    // Every pixel is stored as four floats, the last of which is overwritten by the next pixel. Hence, the
+    // vector loop stops while at least one pixel is left to the scalar code.
+    const __m128i zero = _mm_setzero_si128(), byteMask = _mm_set1_epi32(0xFF);
+    for (; x + 4 < width; x += 4) {
+        __m128i r, g, b;
+        if (step == 4) {
+            __m128i v = _mm_loadu_si128((const __m128i*) (rgbe + x * 4));
+            r = _mm_and_si128(v, byteMask);
+            g = _mm_and_si128(_mm_srli_epi32(v, 8), byteMask);
+            b = _mm_and_si128(_mm_srli_epi32(v, 16), byteMask);
+        } else {
+            auto load = [&](const uint8_t* src) {
+                int bytes;
+                std::memcpy(&bytes, src, 4);
+                return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero), zero);
+            };
+            r = load(rgbe + x);
+            g = load(rgbe + planeStride + x);
+            b = load(rgbe + 2 * planeStride + x);
+        }
+        __m128 scale = _mm_setr_ps(exponentScales.scale[e[x * step]], exponentScales.scale[e[(x + 1) * step]],
+                                   exponentScales.scale[e[(x + 2) * step]], exponentScales.scale[e[(x + 3) * step]]);
+        __m128 red = _mm_mul_ps(_mm_cvtepi32_ps(r), scale);
+        __m128 green = _mm_mul_ps(_mm_cvtepi32_ps(g), scale);
+        __m128 blue = _mm_mul_ps(_mm_cvtepi32_ps(b), scale);
+
+        __m128 rgLow = _mm_unpacklo_ps(red, green), rgHigh = _mm_unpackhi_ps(red, green);
+        __m128 bLow = _mm_unpacklo_ps(blue, blue), bHigh = _mm_unpackhi_ps(blue, blue);
+        float* out = dst + x * 3;
+        _mm_storeu_ps(out, _mm_movelh_ps(rgLow, bLow));
+        _mm_storeu_ps(out + 3, _mm_movehl_ps(bLow, rgLow));
+        _mm_storeu_ps(out + 6, _mm_movelh_ps(rgHigh, bHigh));
+        _mm_storeu_ps(out + 9, _mm_movehl_ps(bHigh, rgHigh));
+    }
+#endif
+    for (; x < width; ++x) {
+        float scale = exponentScales.scale[e[x * step]];
+        dst[x * 3 + 0] = rgbe[x * step] * scale;
+        dst[x * 3 + 1] = rgbe[planeStride + x * step] * scale;
+        dst[x * 3 + 2] = rgbe[2 * planeStride + x * step] * scale;
+    }
+}
+
+/// Finds the end of a run-length encoded scanline that starts at the given offset, by following the run
+/// lengths without decoding anything. Returns 0 if the scanline is invalid or exceeds the data.
+size_t SkipScanline(const uint8_t* data, size_t size, size_t pos, int width) {
+    if (pos + 4 > size || data[pos] != 2 || data[pos + 1] != 2 || (data[pos + 2] & 0x80)
+        || ((data[pos + 2] << 8) | data[pos + 3]) != width)
+        return 0;
+    pos += 4;
+    for (int c = 0; c < 4; ++c) {
+        for (int x = 0; x < width; ) {
+            if (pos >= size) return 0;
+            int count = data[pos];
+            if (count > 128) {
+                count -= 128;
+                pos += 2;
+            } else {
+                pos += 1 + count;
+            }
+            if (count == 0 || count > width - x) return 0;
+            x += count;
+        }
+    }
+    return pos <= size ? pos : 0;
+}
+
+/// Decodes the four components of a scanline that has been validated by SkipScanline() into planes
+void DecodeScanline(const uint8_t* src, int width, uint8_t* planes) {
+    src += 4;
+    for (int c = 0; c < 4; ++c) {
+        uint8_t* plane = planes + c * width;
+        for (int x = 0; x < width; ) {
+            int count = *src++;
+            if (count > 128) {
+                count -= 128;
+                std::memset(plane + x, *src++, count);
+            } else {
+                std::memcpy(plane + x, src, count);
+                src += count;
+            }
+            x += count;
+        }
+    }
+}
+
+/// Parses the header and resolution line like stb_image. Returns the offset of the pixel data, or 0 if this
+/// is not an RGBE file in the standard orientation (top to bottom, left to right).
+size_t ParseHeader(const uint8_t* data, size_t size, int& width, int& height) {
+    size_t pos = 0;
+    auto nextLine = [&] {
+        size_t start = pos;
+        while (pos < size && data[pos] != '\n') ++pos;
+        std::string_view line((const char*) data + start, pos - start);
+        if (pos < size) ++pos;
+        return line;
+    };
+
+    auto magic = nextLine();
+    if (magic != "#?RADIANCE" && magic != "#?RGBE")
+        return 0;
+
+    bool isRgbe = false;
+    for (;;) {
+        if (pos >= size) return 0;
+        auto line = nextLine();
+        if (line.empty()) break;
+        if (line == "FORMAT=32-bit_rle_rgbe") isRgbe = true;
+    }
+    if (!isRgbe) return 0;
+
+    // "-Y <height> +X <width>"
+    auto resolution = nextLine();
+    const char* end = resolution.data() + resolution.size();
+    if (!resolution.starts_with("-Y ")) return 0;
+    auto [heightEnd, heightError] = std::from_chars(resolution.data() + 3, end, height);
+    if (heightError != std::errc() || end - heightEnd < 4 || std::string_view(heightEnd, 4) != " +X ")
+        return 0;
+    auto [widthEnd, widthError] = std::from_chars(heightEnd + 4, end, width);
+    if (widthError != std::errc() || widthEnd != end || width <= 0 || height <= 0)
+        return 0;
+    return pos;
+}
+
+} // namespace
+
+void LinearToRgbeRow(const float* src, uint8_t* dst, size_t numPixels, int numChannels) {
+    RowToRgbe(src, (int) numPixels, numChannels, dst, 4, 1);
+}
+
+void RgbeToLinearRow(const uint8_t* src, float* dst, size_t numPixels) {
+    RgbeToRow(src, (int) numPixels, 4, 1, dst);
+}
+
+bool EncodeHdr(const float* pixels, size_t rowStride, int width, int height, int numChannels,
+               std::vector<uint8_t>& out, int numThreads) {
+    if (width <= 0 || height <= 0 || numChannels < 1 || numChannels > 4) {
+        std::cerr << "ERROR: Cannot encode a " << width << "x" << height << " image with " << numChannels
+                  << " channels as .hdr" << std::endl;
+        return false;
+    }
+
+    const int rowsPerBlock = std::clamp(blockTargetPixels / width, 1, height);
+    const int numBlocks = (height + rowsPerBlock - 1) / rowsPerBlock;
+    std::vector<std::vector<uint8_t>> blocks(numBlocks);
+    std::atomic<int> nextBlock = 0;
+    IOThreadPool().RunParallel(std::min(numThreads, numBlocks), [&] {
+        std::vector<uint8_t> planes((size_t) width * 4);
+        for (int i; (i = nextBlock++) < numBlocks; ) {
+            const int firstRow = i * rowsPerBlock, endRow = std::min(height, firstRow + rowsPerBlock);
+            auto& block = blocks[i];
+            for (int y = firstRow; y < endRow; ++y) {
+                const float* row = pixels + y * rowStride;
+                if (!IsRunLengthWidth(width)) {
+                    size_t offset = block.size();
+                    block.resize(offset + (size_t) width * 4);
+                    RowToRgbe(row, width, numChannels, block.data() + offset, 4, 1);
+                    continue;
+                }
+
+                RowToRgbe(row, width, numChannels, planes.data(), 1, width);
+                const uint8_t header[] = { 2, 2, uint8_t(width >> 8), uint8_t(width) };
+                block.insert(block.end(), header, header + 4);
+                for (int c = 0; c < 4; ++c)
+                    EncodeComponent(planes.data() + c * width, width, block);
+            }
+        }
+    });
+
+    std::string header = "#?RADIANCE\n# Written by SimpleImageIO\nFORMAT=32-bit_rle_rgbe\n"
+                         "EXPOSURE=          1.0000000000000\n\n-Y " + std::to_string(height)
+                       + " +X " + std::to_string(width) + "\n";
+    size_t totalSize = header.size();
+    for (auto& block : blocks) totalSize += block.size();
+    out.reserve(out.size() + totalSize);
+    out.insert(out.end(), header.begin(), header.end());
+    for (auto& block : blocks) {
+        out.insert(out.end(), block.begin(), block.end());
+        std::vector<uint8_t>().swap(block);
+    }
+    return true;
+}
+
+bool DecodeHdr(const uint8_t* data, size_t size, float* dst, size_t dstRowStride, int numThreads) {
+    int width, height;
+    size_t start = ParseHeader(data, size, width, height);
+    if (!start || size - start < 4 || dstRowStride < (size_t) width * 3)
+        return false;
+
+    // Files whose first scanline is not run-length encoded are stored flat
+    std::vector<size_t> offsets;
+    const bool isFlat = !IsRunLengthWidth(width) || data[start] != 2 || data[start + 1] != 2
+                     || (data[start + 2] & 0x80);
+    if (isFlat) {
+        if (size - start < (size_t) width * height * 4) return false;
+    } else {
+        offsets.resize(height);
+        size_t pos = start;
+        for (int y = 0; y < height; ++y) {
+            offsets[y] = pos;
+            if (!(pos = SkipScanline(data, size, pos, width))) return false;
+        }
+    }
+
+    const int rowsPerBlock = std::clamp(blockTargetPixels / width, 1, height);
+    const int numBlocks = (height + rowsPerBlock - 1) / rowsPerBlock;
+    std::atomic<int> nextBlock = 0;
+    IOThreadPool().RunParallel(std::min(numThreads, numBlocks), [&] {
+        std::vector<uint8_t> planes(isFlat ? 0 : (size_t) width * 4);
+        for (int i; (i = nextBlock++) < numBlocks; ) {
+            const int firstRow = i * rowsPerBlock, endRow = std::min(height, firstRow + rowsPerBlock);
+            for (int y = firstRow; y < endRow; ++y) {
+                if (isFlat) {
+                    RgbeToRow(data + start + (size_t) y * width * 4, width, 4, 1, dst + y * dstRowStride);
+                } else {
+                    DecodeScanline(data + offsets[y], width, planes.data());
+                    RgbeToRow(planes.data(), width, 1, width, dst + y * dstRowStride);
+                }
+            }
+        }
+    });
+    return true;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// Encodes float pixels with one to four interleaved channels as a Radiance .hdr file, appended to the
+/// output. Row r starts at pixels + r * rowStride. One and two channel images are stored as gray, alpha is
+/// ignored. The RGBE conversion and the run-length encoding of the scanlines are the same as in
+/// stb_image_write. Blocks of scanlines are encoded concurrently on up to numThreads threads of the I/O
+/// pool. Errors are reported to stderr.
+bool EncodeHdr(const float* pixels, size_t rowStride, int width, int height, int numChannels,
+               std::vector<uint8_t>& out, int numThreads = 1);
+
+/// Decodes a Radiance .hdr file in memory to RGB floats, with the same values as stb_image. Row r is written
+/// to dst + r * dstRowStride. A quick pass over the run lengths finds where each scanline starts, then
+/// blocks of scanlines are decoded concurrently on up to numThreads threads of the I/O pool. Returns false,
+/// without an error, for files it does not handle (e.g., other orientations, old-style run-length encoding,
+/// or truncated data), so the caller can fall back to stb_image.
+bool DecodeHdr(const uint8_t* data, size_t size, float* dst, size_t dstRowStride, int numThreads = 1);
+
+/// Converts a row of pixels with one to four channels to interleaved RGBE bytes, the same as in .hdr files.
+/// One and two channel pixels are converted as gray, alpha is ignored.
+void LinearToRgbeRow(const float* src, uint8_t* dst, size_t numPixels, int numChannels);
+
+/// Expands a row of interleaved RGBE bytes to RGB floats, with the same values as stb_image
+void RgbeToLinearRow(const uint8_t* src, float* dst, size_t numPixels);
@@ -11,6 +11,54 @@
     #define SIIO_API
 #endif
 
+// SSE2 is part of the x86-64 baseline, other architectures use the scalar code paths
+#if defined(__SSE2__) || defined(_M_X64)
+    #define SIIO_SSE2
+    #include <emmintrin.h>
+#endif
+
+#include <algorithm>
+
+/// A rectangle of pixels, e.g., a region of interest within an image
+struct ImageRect {
+    int x, y, width, height;
+
+    bool IsEmpty() const { return width <= 0 || height <= 0; }
+
+    ImageRect Intersect(const ImageRect& other) const {
+        int minX = std::max(x, other.x);
+        int minY = std::max(y, other.y);
+        int maxX = std::min(x + width, other.x + other.width);
+        int maxY = std::min(y + height, other.y + other.height);
+        return { minX, minY, std::max(maxX - minX, 0), std::max(maxY - minY, 0) };
+    }
+};
+
+/// Type of the values stored in an image file (not the type they are loaded as, that is always float)
+enum class PixelType : int {
+    UInt8 = 0,
+    UInt16 = 1,
+    Half = 2,
+    UInt32 = 3,
+    Float = 4,
+};
+
+/// Image metadata as read from the file header by ProbeImage. Shared with the C# and Python wrappers,
+/// so the layout must not change.
+struct ImageInfo {
+    int width, height;
+
+    /// Number of channels that CacheImage would load. For .exr files, these are the channels of the
+    /// layer without a name, which might be zero if all channels belong to named layers.
+    int numChannels;
+
+    /// One of the PixelType values. For files that mix types (only possible in .exr), the widest one.
+    int pixelType;
+
+    /// Number of layers in an .exr file (including the unnamed layer, if it exists), zero for other formats
+    int numLayers;
+};
+
 template<typename Fn>
 inline void ForAllPixels(int width, int height, int numChannels, int rowStrideIn, int rowStrideOut, Fn fn) {
     #pragma omp parallel for
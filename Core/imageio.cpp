@@ -1,4 +1,15 @@
+#include "base64.h"
+#include "half.h"
+#include "hdr.h"
 #include "image.h"
+#include "jpeg.h"
+#include "mappedfile.h"
+#include "png.h"
+#include "pnm.h"
+#include "qoi.h"
+#include "srgb.h"
+#include "threadpool.h"
+#include "tiff.h"
 
 #include <unordered_map>
 #include <unordered_set>
@@ -7,8 +18,24 @@
 #include <string>
 #include <vector>
 #include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <memory>
+#include <variant>
 #include <cassert>
+#include <cstring>
 #include <filesystem>
+#include <functional>
+#include <thread>
+#include <condition_variable>
+#include <algorithm>
+#include <cctype>
+#include <limits>
+#include <optional>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 constexpr float testfloat = -0.0f;
 static const bool systemIsBigEndian = ((const char*)&testfloat)[0] != 0;
@@ -18,7 +45,8 @@ static const bool systemIsBigEndian = ((const char*)&testfloat)[0] != 0;
 #endif
 
 #define TINYEXR_IMPLEMENTATION
-#define TINYEXR_USE_THREAD (1)
+// tinyexr would start new threads in every call, we run its block codec on our own pool instead
+#define TINYEXR_USE_THREAD (0)
 #define TINYEXR_USE_MINIZ (0)
 #include "External/miniz.h"
 #include "External/tinyexr.h"
@@ -41,8 +69,6 @@ static const bool systemIsBigEndian = ((const char*)&testfloat)[0] != 0;
 #define TINY_DNG_LOADER_USE_THREAD
 #define STB_IMAGE_IMPLEMENTATION
 #include "External/tiny_dng_loader.h"
-#define TINY_DNG_WRITER_IMPLEMENTATION
-#include "External/tiny_dng_writer.h"
 
 #include "External/fpng.h"
 
@@ -52,6 +78,16 @@ struct StbImageData {
     float* data;
     int width, height;
     int numChannels;
+
+    StbImageData(float* data, int width, int height, int numChannels)
+    : data(data), width(width), height(height), numChannels(numChannels) {}
+
+    ~StbImageData() {
+        stbi_image_free(data);
+    }
+
+    StbImageData(const StbImageData&) = delete;
+    StbImageData& operator=(const StbImageData&) = delete;
 };
 
 struct ExrChannelLayout {
@@ -71,6 +107,35 @@ struct ExrChannelLayout {
             customChannels.size();
     }
 
+    /// Adds a channel to the layout. Returns false if a channel with that name is already present.
+    bool Add(const std::string& chanName, int idx) {
+        // Handle known channel names R G B and A so we can reorder them
+        // All other channel names will be alphabethically sorted
+        int* fixed = nullptr;
+        if (chanName == "R") fixed = &idxR;
+        else if (chanName == "G") fixed = &idxG;
+        else if (chanName == "B") fixed = &idxB;
+        else if (chanName == "A") fixed = &idxA;
+        else return customChannels.emplace(chanName, idx).second;
+
+        if (*fixed >= 0) return false;
+        *fixed = idx;
+        return true;
+    }
+
+    /// Channel indices in the order they are interleaved: R, G, B, A, then all others sorted by name
+    std::vector<int> ChannelOrder() const {
+        std::vector<int> order;
+        order.reserve(CountChannels());
+        if (idxR >= 0) order.push_back(idxR);
+        if (idxG >= 0) order.push_back(idxG);
+        if (idxB >= 0) order.push_back(idxB);
+        if (idxA >= 0) order.push_back(idxA);
+        for (const auto& [name, idx] : customChannels)
+            order.push_back(idx);
+        return order;
+    }
+
     std::string NameOf(int idx) const {
         int rgbaOffset =
             (idxR >= 0 ? 1 : 0) +
@@ -97,47 +162,163 @@ struct ExrChannelLayout {
     }
 };
 
+/// Splits an .exr channel name of the form "layername.channelname". Plain channels without a layer
+/// belong to the unnamed default layer (e.g., "R", "G", and "B").
+void SplitExrChannelName(const std::string& name, std::string& layerName, std::string& chanName) {
+    size_t idxSep = name.rfind('.');
+    if (idxSep == name.npos) {
+        layerName = "";
+        chanName = name;
+    } else {
+        layerName = name.substr(0, idxSep);
+        chanName = name.substr(idxSep + 1);
+    }
+}
+
+class ExrChunkReader;
+
 struct ExrImageData {
     std::unordered_map<std::string, ExrChannelLayout> channelsPerLayer;
     std::vector<std::string> layerNames;
-    EXRHeader header;
-    EXRImage image;
+    int width = 0, height = 0;
+
+    /// Index in the file header of each selected channel, the channel layouts index into this list
+    std::vector<int> channels;
+
+    /// One full resolution plane per selected channel
+    std::vector<std::unique_ptr<float[]>> planes;
+
+    /// Set if only the header has been read. Then, there are no planes and the pixels are decoded
+    /// straight into the output buffers when the layers are copied.
+    std::shared_ptr<ExrChunkReader> reader;
 };
 
 struct PfmImageData {
     std::vector<float> data;
 };
 
+/// A memory-mapped .pfm file with its parsed header. Cached as is if the pixels are accessed in place.
+struct PfmFile {
+    std::unique_ptr<MappedFile> file;
+    int width = 0, height = 0, numChannels = 0;
+    bool bigEndian = false;
+
+    /// Start of the pixel data, which stores the rows from bottom to top
+    const uint8_t* pixels = nullptr;
+};
+
 struct TiffImageData {
     std::vector<float> data;
 };
 
-static std::mutex cacheMutex;
-static std::unordered_map<int, ExrImageData> exrImages;
-static std::unordered_map<int, StbImageData> stbImages;
-static std::unordered_map<int, PfmImageData> pfmImages;
-static std::unordered_map<int, TiffImageData> tiffImages;
-static int nextIndex = 0;
+/// An image file whose content is already in memory, e.g., because it was received over the network.
+/// Passed to the probe and read functions to decode it from there instead of reading a file from disk,
+/// the file name is then only used in error messages.
+struct InMemoryFile {
+    const uint8_t* data;
+    size_t size;
+};
+
+using CachedImage = std::variant<std::monostate, ExrImageData, StbImageData, PfmImageData, TiffImageData,
+                                 PfmFile>;
+
+/// Thread-safe table of all images that have been loaded but not yet copied out. The entries are
+/// distributed over independently locked shards, and lookups only take a shared lock on a single
+/// shard. Entries are reference counted, so the pixel data can be copied without holding any lock,
+/// even if another thread deletes the entry in the meantime.
+class ImageCache {
+public:
+    int Insert(std::shared_ptr<CachedImage> image) {
+        int id = nextIndex.fetch_add(1, std::memory_order_relaxed);
+        auto& shard = ShardOf(id);
+        std::unique_lock lock(shard.mutex);
+        shard.entries.emplace(id, std::move(image));
+        return id;
+    }
+
+    std::shared_ptr<CachedImage> Find(int id) {
+        if (id < 0) return nullptr;
+        auto& shard = ShardOf(id);
+        std::shared_lock lock(shard.mutex);
+        auto iter = shard.entries.find(id);
+        return iter == shard.entries.end() ? nullptr : iter->second;
+    }
+
+    /// Removes the entry from the table. The data stays alive until the last reference is released.
+    std::shared_ptr<CachedImage> Remove(int id) {
+        if (id < 0) return nullptr;
+        auto& shard = ShardOf(id);
+        std::unique_lock lock(shard.mutex);
+        auto iter = shard.entries.find(id);
+        if (iter == shard.entries.end()) return nullptr;
+        auto result = std::move(iter->second);
+        shard.entries.erase(iter);
+        return result;
+    }
+
+private:
+    static constexpr int NumShards = 64;
+
+    struct alignas(64) Shard {
+        std::shared_mutex mutex;
+        std::unordered_map<int, std::shared_ptr<CachedImage>> entries;
+    };
+
+    Shard& ShardOf(int id) { return shards[id % NumShards]; }
+
+    Shard shards[NumShards];
+    std::atomic<int> nextIndex = 0;
+};
+
+static ImageCache imageCache;
 
-static std::unordered_set<void*> allocedMemory;
+/// Looks up a cached image of a specific type. The returned pointer shares ownership of the cache entry.
+template<typename T>
+std::shared_ptr<T> FindCached(int id) {
+    auto entry = imageCache.Find(id);
+    if (!entry) return nullptr;
+    T* data = std::get_if<T>(entry.get());
+    if (!data) return nullptr;
+    return std::shared_ptr<T>(entry, data);
+}
 
-float LinearToSrgb(float linear);
-float SrgbToLinear(float srgb);
+/// Shared worker threads for all image I/O: the asynchronous reads and writes, and the block-wise
+/// compression and decompression of .exr files. The workers are started on first use and live as long as
+/// the process, the pool is never destroyed since joining threads while the library is unloaded can deadlock.
+ThreadPool& IOThreadPool() {
+    static ThreadPool* pool = new ThreadPool((int) std::thread::hardware_concurrency());
+    return *pool;
+}
 
-uint8_t GammaCorrect(float rgb) {
-    rgb = 255 * LinearToSrgb(rgb);//std::pow(rgb, 1.0f / 2.2f) * 255;
-    float clipped = rgb < 0 ? 0 : rgb;
-    clipped = clipped > 255 ? 255 : clipped;
-    return (uint8_t) clipped;
+/// Number of threads that encode or decode a single image: all cores, unless the calling thread has been
+/// limited via omp_set_num_threads(), as is done for the files of an asynchronous job (see SubmitIOJob)
+int ThreadsPerImage() {
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return std::max((int) std::thread::hardware_concurrency(), 1);
+#endif
 }
 
 /// Converts linear rgb to srgb and maps it to the range [0, 255]
 void ConvertToSrgbByteImage(const float* data, int rowStride, uint8_t* buffer, int width, int height,
                            int numChannels) {
-    ForAllPixels(width, height, numChannels, rowStride, width * numChannels,
-        [&](int idxIn, int idxOut, int col, int row, int chan) {
-            buffer[idxOut] = GammaCorrect(data[idxIn]);
-        });
+    #pragma omp parallel for
+    for (int row = 0; row < height; ++row) {
+        LinearToSrgbBytes(data + (size_t) row * rowStride, buffer + (size_t) row * width * numChannels,
+                          (size_t) width * numChannels);
+    }
+}
+
+/// Converts linear rgb to 8 or 16 bit srgb samples. The alpha channel of gray + alpha and RGBA images is
+/// quantized linearly, as the readers expect it.
+template<typename T>
+void ConvertToSrgbPixels(const float* data, int rowStride, T* buffer, int width, int height, int numChannels) {
+    #pragma omp parallel for
+    for (int row = 0; row < height; ++row) {
+        LinearToSrgbRow(data + (size_t) row * rowStride, buffer + (size_t) row * width * numChannels, width,
+                        numChannels);
+    }
 }
 
 void AlignImage(const float* data, int rowStride, float* buffer, int width, int height, int numChannels) {
@@ -147,308 +328,914 @@ void AlignImage(const float* data, int rowStride, float* buffer, int width, int
         });
 }
 
-int CacheExrImage(const char* filename) {
-    ExrImageData result;
+/// Random access to the chunks (blocks of scanlines or tiles) of a single-part .exr file. The header
+/// and offset table are parsed once, afterwards any subset of chunks can be decoded, in any order and
+/// from multiple threads. The file is memory mapped, so only the chunks that are decoded are read from
+/// disk. Files that are already in memory can be read as well. For tiled files, only the full resolution
+/// level is accessible.
+class ExrChunkReader {
+public:
+    ExrChunkReader() {
+        InitEXRHeader(&header);
+    }
 
-    EXRVersion exrVersion;
-    int ret = ParseEXRVersionFromFile(&exrVersion, filename);
-    if (ret != 0) {
-        std::cerr << "Error loading '" << filename << "': Invalid .exr file. " << std::endl;
-        return -1;
+    ~ExrChunkReader() {
+        FreeEXRHeader(&header);
     }
 
-    const char* err;
-    InitEXRHeader(&result.header);
-    ret = ParseEXRHeaderFromFile(&result.header, &exrVersion, filename, &err);
-    if (ret) {
-        std::cerr << "Error loading '" << filename << "': " << err << std::endl;
-        FreeEXRErrorMessage(err);
-        return -1;
+    ExrChunkReader(const ExrChunkReader&) = delete;
+    ExrChunkReader& operator=(const ExrChunkReader&) = delete;
+
+    /// Maps the file into memory and parses the header and offset table. Errors are reported to stderr.
+    bool Open(const char* filename) {
+        mapping = std::make_unique<MappedFile>(filename);
+        if (!mapping->IsOpen()) {
+            std::cerr << "Error loading '" << filename << "': Could not read file." << std::endl;
+            return false;
+        }
+        return Open(mapping->Data(), mapping->Size(), filename);
+    }
+
+    /// Parses the header and offset table of a file in memory, which must outlive the reader. The name is
+    /// only used in error messages.
+    bool Open(const uint8_t* data, size_t numBytes, const char* name) {
+        filename = name;
+        head = data;
+        size = numBytes;
+
+        std::string err;
+        if (!Parse(err)) {
+            std::cerr << "Error loading '" << filename << "': " << err << std::endl;
+            return false;
+        }
+        return true;
     }
 
-    // Read half as float
-    for (int i = 0; i < result.header.num_channels; i++) {
-        if (result.header.pixel_types[i] == TINYEXR_PIXELTYPE_HALF)
-            result.header.requested_pixel_types[i] = TINYEXR_PIXELTYPE_FLOAT;
+    const EXRHeader& Header() const { return header; }
+    int Width() const { return width; }
+    int Height() const { return height; }
+    int NumChunks() const { return (int) offsets.size(); }
+    const std::string& Filename() const { return filename; }
+
+    /// Position of a chunk within the file
+    size_t ChunkOffset(int idx) const { return (size_t) offsets[idx]; }
+
+    /// Releases the memory of the mapped file pages in a byte range, see MappedFile::Discard(). Does nothing
+    /// if the file was not mapped by the reader.
+    void Discard(size_t begin, size_t end) const {
+        if (mapping) mapping->Discard(begin, end - begin);
     }
 
-    InitEXRImage(&result.image);
-    ret = LoadEXRImageFromFile(&result.image, &result.header, filename, &err);
-    if (ret) {
-        std::cerr << "Error loading '" << filename << "': " << err << std::endl;
-        FreeEXRHeader(&result.header);
-        FreeEXRErrorMessage(err);
-        return -1;
+    /// The pixels covered by a chunk, relative to the top left corner of the data window. Derived from
+    /// the header without touching the chunk itself.
+    ImageRect ChunkRect(int idx) const {
+        if (header.tiled) {
+            int x = (idx % numTilesX) * header.tile_size_x;
+            int y = (idx / numTilesX) * header.tile_size_y;
+            return { x, y, std::min(header.tile_size_x, width - x), std::min(header.tile_size_y, height - y) };
+        } else {
+            int y = idx * linesPerChunk;
+            return { 0, y, width, std::min(linesPerChunk, height - y) };
+        }
     }
 
-    // Read the number of channels in each layer
-    for (int chan = 0; chan < result.header.num_channels; ++chan) {
-        // Extract the layer name by assuming a channel name of the form "layername.channelname"
-        std::string name = result.header.channels[chan].name;
-        size_t len = name.size();
+    /// Decodes a chunk: the value of channel c at (col, row) within the chunk's rectangle is written to
+    /// out[c][row * stride + col]. Half channels are converted to float. The same pointer can be passed
+    /// for multiple channels, in that case, its content is undefined afterwards.
+    bool DecodeChunk(int idx, float* const* out, size_t stride) const {
+        const ImageRect rect = ChunkRect(idx);
+        const unsigned char* chunk = head + offsets[idx];
+        size_t available = size - offsets[idx];
+
+        // The chunk starts with its position (tile coordinates and level, or the first scanline) and size
+        int headerLen = header.tiled ? 20 : 8;
+        if (available < (size_t) headerLen)
+            return false;
+        int coords[5];
+        memcpy(coords, chunk, headerLen);
+        for (int i = 0; i < headerLen / 4; ++i)
+            tinyexr::swap4(&coords[i]);
+
+        if (header.tiled) {
+            if (coords[0] * header.tile_size_x != rect.x || coords[1] * header.tile_size_y != rect.y
+                || coords[2] != 0 || coords[3] != 0)
+                return false;
+        } else if (coords[0] - header.data_window.min_y != rect.y) {
+            return false;
+        }
+
+        int dataLen = coords[headerLen / 4 - 1];
+        if (dataLen <= 0 || (size_t) dataLen > available - headerLen)
+            return false;
 
-        size_t idxSep = name.rfind('.');
-        std::string layerName, chanName;
-        if (idxSep == name.npos) {
-            // Plain channels without a layer will be merged into an unnamed default layer (e.g., "R", "G", and "B")
-            layerName = "";
-            chanName = name;
+        // Rows are always decoded top to bottom, irrespective of the order they are stored in
+        return tinyexr::DecodePixelData((unsigned char**) out, header.requested_pixel_types,
+            chunk + headerLen, (size_t) dataLen, header.compression_type, 0, rect.width, rect.height,
+            (int) stride, 0, 0, rect.height, (size_t) pixelDataSize, (size_t) header.num_custom_attributes,
+            header.custom_attributes, (size_t) header.num_channels, header.channels, channelOffsets);
+    }
+
+private:
+    bool Parse(std::string& err) {
+        EXRVersion version;
+        if (ParseEXRVersionFromMemory(&version, head, size) != TINYEXR_SUCCESS) {
+            err = "Invalid .exr file.";
+            return false;
+        }
+        if (version.multipart || version.non_image) {
+            err = "Multi-part and deep .exr files are not supported.";
+            return false;
+        }
+
+        const char* msg = nullptr;
+        if (ParseEXRHeaderFromMemory(&header, &version, head, size, &msg) != TINYEXR_SUCCESS) {
+            err = msg ? msg : "Invalid .exr header.";
+            FreeEXRErrorMessage(msg);
+            return false;
+        }
+
+        // Read half as float
+        for (int i = 0; i < header.num_channels; i++) {
+            if (header.pixel_types[i] == TINYEXR_PIXELTYPE_HALF)
+                header.requested_pixel_types[i] = TINYEXR_PIXELTYPE_FLOAT;
+        }
+
+        width = header.data_window.max_x - header.data_window.min_x + 1;
+        height = header.data_window.max_y - header.data_window.min_y + 1;
+        if (width <= 0 || height <= 0 || width > TINYEXR_DIMENSION_THRESHOLD || height > TINYEXR_DIMENSION_THRESHOLD
+            || (header.tiled && (header.tile_size_x <= 0 || header.tile_size_y <= 0))) {
+            err = "Invalid data window.";
+            return false;
+        }
+
+        size_t channelOffset;
+        if (!tinyexr::ComputeChannelLayout(&channelOffsets, &pixelDataSize, &channelOffset,
+                                           header.num_channels, header.channels)) {
+            err = "Unsupported pixel type.";
+            return false;
+        }
+
+        // Read the offset table, it directly follows the header
+        const unsigned char* marker = head + header.header_len + 8;
+        tinyexr::OffsetData offsetData;
+        if (header.tiled) {
+            std::vector<int> numTilesXPerLevel, numTilesYPerLevel;
+            if (!tinyexr::PrecalculateTileInfo(numTilesXPerLevel, numTilesYPerLevel, &header)
+                || tinyexr::InitTileOffsets(offsetData, &header, numTilesXPerLevel, numTilesYPerLevel) == 0) {
+                err = "Invalid tile description.";
+                return false;
+            }
+            numTilesX = numTilesXPerLevel[0];
         } else {
-            // Remove channel name from the layer name
-            layerName = name.substr(0, idxSep);
-            chanName = name.substr(idxSep + 1);
+            linesPerChunk = tinyexr::NumScanlines(header.compression_type);
+            tinyexr::InitSingleResolutionOffsets(offsetData, (height + linesPerChunk - 1) / linesPerChunk);
+        }
+
+        const char* offsetErr = nullptr;
+        if (tinyexr::ReadOffsets(offsetData, head, marker, size, &offsetErr) != TINYEXR_SUCCESS) {
+            err = offsetErr ? offsetErr : "Invalid offset table.";
+            FreeEXRErrorMessage(offsetErr);
+            return false;
         }
 
+        // Incomplete files have zeros in their offset table, try to recover by scanning the chunks
+        if (tinyexr::IsAnyOffsetsAreInvalid(offsetData)) {
+            bool recovered = header.tiled
+                ? tinyexr::ReconstructTileOffsets(offsetData, &header, head, marker, size, false, false)
+                : tinyexr::ReconstructLineOffsets(&offsetData.offsets[0][0], offsetData.offsets[0][0].size(),
+                                                  head, marker, size);
+            if (!recovered) {
+                err = "Invalid offset table.";
+                return false;
+            }
+        }
+
+        // Flatten the full resolution level in row-major order
+        for (const auto& row : offsetData.offsets[0])
+            offsets.insert(offsets.end(), row.begin(), row.end());
+        return true;
+    }
+
+    std::string filename;
+    std::unique_ptr<MappedFile> mapping;
+    const unsigned char* head = nullptr;
+    size_t size = 0;
+    EXRHeader header;
+    std::vector<tinyexr::tinyexr_uint64> offsets;
+    std::vector<size_t> channelOffsets;
+    int pixelDataSize = 0;
+    int width = 0, height = 0;
+    int numTilesX = 1;
+    int linesPerChunk = 1;
+};
+
+/// Sets up the channel layouts of the given layers, or of all layers if "layers" is null. Layers that do not
+/// exist are skipped. The layouts index into result.channels, which is filled with the header indices of
+/// the selected channels.
+void SelectExrLayers(const EXRHeader& header, const char* const* layers, int numLayers, ExrImageData& result) {
+    std::unordered_set<std::string> requested;
+    for (int i = 0; layers && i < numLayers; ++i)
+        requested.insert(layers[i]);
+
+    for (int chan = 0; chan < header.num_channels; ++chan) {
+        std::string layerName, chanName;
+        SplitExrChannelName(header.channels[chan].name, layerName, chanName);
+        if (layers && !requested.contains(layerName))
+            continue;
+
         // Update the channel layout info
         auto iter = result.channelsPerLayer.find(layerName);
         if (iter == result.channelsPerLayer.end()) {
-            result.channelsPerLayer[layerName] = ExrChannelLayout();
+            iter = result.channelsPerLayer.emplace(layerName, ExrChannelLayout()).first;
             result.layerNames.emplace_back(layerName);
         }
-        auto& layout = result.channelsPerLayer[layerName];
 
-        // Handle known channel names R G B and A so we can reorder them
-        // All other channel names will be alphabethically sorted
-        if (chanName == "R")
-            layout.idxR = chan;
-        else if (chanName == "G")
-            layout.idxG = chan;
-        else if (chanName == "B")
-            layout.idxB = chan;
-        else if (chanName == "A")
-            layout.idxA = chan;
-        else if (!layout.customChannels.emplace(chanName, chan).second)
+        if (!iter->second.Add(chanName, (int) result.channels.size())) {
             std::cerr << "Duplicate channel '" << chanName << "' in layer '" << layerName << "' ignored." << std::endl;
+            continue;
+        }
+        result.channels.push_back(chan);
     }
+}
 
-    cacheMutex.lock();
-    const int idx = nextIndex;
-    exrImages[idx] = result;
-    nextIndex++;
-    cacheMutex.unlock();
+/// Loads the given layers of an .exr file. Only the channels belonging to these layers are decoded,
+/// layers that do not exist are skipped. If layers is null, all layers are loaded. If a region is given,
+/// only the chunks overlapping it are decoded and the cached image is cropped to the region.
+int CacheExrImage(const char* filename, const char* const* layers, int numLayers,
+                  const ImageRect* region = nullptr) {
+    ExrChunkReader reader;
+    if (!reader.Open(filename))
+        return -1;
 
-    return idx;
-}
+    const ImageRect full = { 0, 0, reader.Width(), reader.Height() };
+    const ImageRect crop = region ? region->Intersect(full) : full;
+    if (crop.IsEmpty()) {
+        std::cerr << "Error loading '" << filename << "': The region does not overlap the image." << std::endl;
+        return -1;
+    }
+
+    auto entry = std::make_shared<CachedImage>();
+    auto& result = entry->emplace<ExrImageData>();
+    result.width = crop.width;
+    result.height = crop.height;
+    const size_t numPixels = (size_t) result.width * result.height;
+
+    // Allocate a plane for each channel of the requested layers
+    const EXRHeader& header = reader.Header();
+    SelectExrLayers(header, layers, numLayers, result);
+    std::vector<int> planeOfChannel(header.num_channels, -1);
+    for (int i = 0; i < (int) result.channels.size(); ++i) {
+        planeOfChannel[result.channels[i]] = i;
+        result.planes.emplace_back(new float[numPixels]);
+    }
+    const int numPlanes = (int) result.planes.size();
+
+    std::vector<int> chunks;
+    for (int i = 0; i < reader.NumChunks() && numPlanes > 0; ++i) {
+        if (!reader.ChunkRect(i).Intersect(crop).IsEmpty())
+            chunks.push_back(i);
+    }
+
+    // Channels that were not requested still need to be decompressed, but they all end up in the same
+    // per-thread scratch buffer. Without cropping, the other channels are decoded straight into the planes.
+    const bool cropped = crop.width != full.width || crop.height != full.height;
+    std::atomic<bool> failed = false;
+    std::atomic<int> nextChunk = 0;
+    IOThreadPool().RunParallel(ThreadsPerImage(), [&] {
+        std::vector<float> scratch;
+        std::vector<float*> out(header.num_channels);
+        for (int i; (i = nextChunk++) < (int) chunks.size(); ) {
+            const ImageRect rect = reader.ChunkRect(chunks[i]);
+            const size_t chunkPixels = (size_t) rect.width * rect.height;
+
+            if (!cropped) {
+                scratch.resize((size_t) rect.height * result.width);
+                for (int c = 0; c < header.num_channels; ++c) {
+                    out[c] = planeOfChannel[c] < 0 ? scratch.data()
+                        : result.planes[planeOfChannel[c]].get() + (size_t) rect.y * result.width + rect.x;
+                }
+                if (!reader.DecodeChunk(chunks[i], out.data(), result.width))
+                    failed = true;
+                continue;
+            }
+
+            scratch.resize((numPlanes + 1) * chunkPixels);
+            for (int c = 0; c < header.num_channels; ++c)
+                out[c] = scratch.data() + (planeOfChannel[c] + 1) * chunkPixels;
+            if (!reader.DecodeChunk(chunks[i], out.data(), rect.width)) {
+                failed = true;
+                continue;
+            }
 
-void DeleteCachedExr(int id) {
-    cacheMutex.lock();
-    auto& img = exrImages[id];
+            // Copy the part that overlaps the region
+            const ImageRect overlap = rect.Intersect(crop);
+            for (int p = 0; p < numPlanes; ++p) {
+                for (int row = overlap.y; row < overlap.y + overlap.height; ++row) {
+                    const float* src = scratch.data() + (p + 1) * chunkPixels
+                        + (size_t) (row - rect.y) * rect.width + (overlap.x - rect.x);
+                    float* dst = result.planes[p].get() + (size_t) (row - crop.y) * crop.width + (overlap.x - crop.x);
+                    std::copy(src, src + overlap.width, dst);
+                }
+            }
+        }
+    });
 
-    FreeEXRImage(&img.image);
-    FreeEXRHeader(&img.header);
+    if (failed) {
+        std::cerr << "Error loading '" << filename << "': Invalid/Corrupted data found when decoding pixels." << std::endl;
+        return -1;
+    }
 
-    exrImages.erase(id);
-    cacheMutex.unlock();
+    return imageCache.Insert(std::move(entry));
 }
 
-bool CopyCachedExrLayer(int id, std::string layerName, float* out) {
-    cacheMutex.lock();
-    auto& img = exrImages[id];
+/// Reads the metadata of an .exr file from its header. The layer names are listed in the order of their
+/// first channel, split the same way as when loading the file. The file is only mapped, so the pixel data
+/// is never read from disk.
+bool ProbeExrImage(const char* filename, ImageInfo* info, std::vector<std::string>* layerNames = nullptr,
+                   const InMemoryFile* memory = nullptr) {
+    std::optional<MappedFile> file;
+    if (!memory) {
+        file.emplace(filename);
+        if (!file->IsOpen()) {
+            std::cerr << "Error loading '" << filename << "': Could not read file." << std::endl;
+            return false;
+        }
+    }
+    const uint8_t* data = memory ? memory->data : file->Data();
+    const size_t size = memory ? memory->size : file->Size();
 
-    if (img.channelsPerLayer.find(layerName) == img.channelsPerLayer.end()) {
-        std::cerr << "ERROR .exr layer '" << layerName << "' does not exist." << std::endl;
-        cacheMutex.unlock();
+    EXRVersion version;
+    if (ParseEXRVersionFromMemory(&version, data, size) != TINYEXR_SUCCESS) {
+        std::cerr << "Error loading '" << filename << "': Invalid .exr file." << std::endl;
+        return false;
+    }
+    if (version.multipart || version.non_image) {
+        std::cerr << "Error loading '" << filename << "': Multi-part and deep .exr files are not supported." << std::endl;
+        return false;
+    }
+
+    EXRHeader header;
+    InitEXRHeader(&header);
+    const char* err = nullptr;
+    if (ParseEXRHeaderFromMemory(&header, &version, data, size, &err) != TINYEXR_SUCCESS) {
+        std::cerr << "Error loading '" << filename << "': " << (err ? err : "Invalid .exr header.") << std::endl;
+        FreeEXRErrorMessage(err);
         return false;
     }
 
-    const auto& layerInfo = img.channelsPerLayer[layerName];
-    int numChannels = layerInfo.CountChannels();
+    info->width = header.data_window.max_x - header.data_window.min_x + 1;
+    info->height = header.data_window.max_y - header.data_window.min_y + 1;
+    info->pixelType = (int) PixelType::UInt8;
 
-    auto swizzle = [numChannels, &layerInfo, &layerName](unsigned char** images, int srcIdx, int dstIdx, float* out) {
-        int offset = 0;
-        auto add = [&](int idx) {
-            auto chanImg = (float*)images[idx];
-            out[dstIdx + offset] = chanImg[srcIdx];
-            offset++;
-        };
+    std::unordered_map<std::string, ExrChannelLayout> channelsPerLayer;
+    std::vector<std::string> names;
+    for (int chan = 0; chan < header.num_channels; ++chan) {
+        std::string layerName, chanName;
+        SplitExrChannelName(header.channels[chan].name, layerName, chanName);
+        auto [iter, isNew] = channelsPerLayer.try_emplace(layerName);
+        if (isNew) names.push_back(layerName);
+        iter->second.Add(chanName, chan);
+
+        PixelType type = header.channels[chan].pixel_type == TINYEXR_PIXELTYPE_FLOAT ? PixelType::Float
+            : (header.channels[chan].pixel_type == TINYEXR_PIXELTYPE_HALF ? PixelType::Half : PixelType::UInt32);
+        info->pixelType = std::max(info->pixelType, (int) type);
+    }
+    FreeEXRHeader(&header);
 
-        if (layerInfo.idxR >= 0)
-            add(layerInfo.idxR);
-        if (layerInfo.idxG >= 0)
-            add(layerInfo.idxG);
-        if (layerInfo.idxB >= 0)
-            add(layerInfo.idxB);
-        if (layerInfo.idxA >= 0)
-            add(layerInfo.idxA);
-        for (auto it = layerInfo.customChannels.begin(); it != layerInfo.customChannels.end(); ++it)
-            add(it->second);
+    auto iter = channelsPerLayer.find("");
+    info->numChannels = iter == channelsPerLayer.end() ? 0 : iter->second.CountChannels();
+    info->numLayers = (int) names.size();
+    if (layerNames) *layerNames = std::move(names);
+    return true;
+}
 
-        return true;
-    };
+/// Interleaves a row of planar channel data. Specialized for a fixed channel count so the inner
+/// loop has a constant stride.
+template<int N>
+inline void InterleaveRow(const float* const* planes, float* out, int count) {
+    for (int i = 0; i < count; ++i)
+        for (int c = 0; c < N; ++c)
+            out[i * N + c] = planes[c][i];
+}
 
-    // Copy image data and convert from SoA to AoS
-    if (img.header.tiled) {
-        int tileWidth = img.header.tile_size_x;
-        int tileHeight = img.header.tile_size_y;
-        for (int tileIdx = 0; tileIdx < img.image.num_tiles; ++tileIdx) {
-            const auto& tile = img.image.tiles[tileIdx];
-            for (int x = 0; x < tile.width; ++x) {
-                for (int y = 0; y < tile.height; ++y) {
-                    int c = tile.offset_x * tileWidth + x;
-                    int r = tile.offset_y * tileHeight + y;
-                    if (c > img.image.width || r > img.image.height)
-                        continue;
-                    int idx = (r * img.image.width + c) * numChannels;
-                    if (img.header.line_order == 0) {
-                        if (!swizzle(tile.images, y * tileWidth + x, idx, out))
-                            return false;
-                    } else {
-                        if (!swizzle(tile.images, (tileHeight - y - 1) * tileWidth + x, idx, out))
-                            return false;
-                    }
-                }
-            }
+#ifdef SIIO_SSE2
+template<>
+inline void InterleaveRow<3>(const float* const* planes, float* out, int count) {
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 r = _mm_loadu_ps(planes[0] + i);
+        __m128 g = _mm_loadu_ps(planes[1] + i);
+        __m128 b = _mm_loadu_ps(planes[2] + i);
+
+        __m128 rgLo = _mm_unpacklo_ps(r, g); // r0 g0 r1 g1
+        __m128 rgHi = _mm_unpackhi_ps(r, g); // r2 g2 r3 g3
+
+        __m128 b0r1 = _mm_shuffle_ps(b, rgLo, _MM_SHUFFLE(2, 2, 0, 0)); // b0 b0 r1 r1
+        __m128 g1b1 = _mm_shuffle_ps(rgLo, b, _MM_SHUFFLE(1, 1, 3, 3)); // g1 g1 b1 b1
+        __m128 b2r3 = _mm_shuffle_ps(b, rgHi, _MM_SHUFFLE(3, 2, 3, 2)); // b2 b3 r3 g3
+
+        _mm_storeu_ps(out + 3 * i + 0, _mm_shuffle_ps(rgLo, b0r1, _MM_SHUFFLE(3, 0, 1, 0))); // r0 g0 b0 r1
+        _mm_storeu_ps(out + 3 * i + 4, _mm_shuffle_ps(g1b1, rgHi, _MM_SHUFFLE(1, 0, 2, 0))); // g1 b1 r2 g2
+        _mm_storeu_ps(out + 3 * i + 8, _mm_shuffle_ps(b2r3, b2r3, _MM_SHUFFLE(1, 3, 2, 0))); // b2 r3 g3 b3
+    }
+    for (; i < count; ++i)
+        for (int c = 0; c < 3; ++c)
+            out[i * 3 + c] = planes[c][i];
+}
+
+template<>
+inline void InterleaveRow<4>(const float* const* planes, float* out, int count) {
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 r = _mm_loadu_ps(planes[0] + i);
+        __m128 g = _mm_loadu_ps(planes[1] + i);
+        __m128 b = _mm_loadu_ps(planes[2] + i);
+        __m128 a = _mm_loadu_ps(planes[3] + i);
+        _MM_TRANSPOSE4_PS(r, g, b, a);
+        _mm_storeu_ps(out + 4 * i + 0, r);
+        _mm_storeu_ps(out + 4 * i + 4, g);
+        _mm_storeu_ps(out + 4 * i + 8, b);
+        _mm_storeu_ps(out + 4 * i + 12, a);
+    }
+    for (; i < count; ++i)
+        for (int c = 0; c < 4; ++c)
+            out[i * 4 + c] = planes[c][i];
+}
+#endif
+
+/// Writes a row of "count" pixels from the given channel planes into interleaved (AoS) layout
+inline void InterleaveRow(const float* const* planes, int numChannels, float* out, int count) {
+    switch (numChannels) {
+        case 1: std::copy(planes[0], planes[0] + count, out); break;
+        case 2: InterleaveRow<2>(planes, out, count); break;
+        case 3: InterleaveRow<3>(planes, out, count); break;
+        case 4: InterleaveRow<4>(planes, out, count); break;
+        default:
+            for (int i = 0; i < count; ++i)
+                for (int c = 0; c < numChannels; ++c)
+                    out[i * numChannels + c] = planes[c][i];
+    }
+}
+
+/// Output buffer for one layer when streaming an .exr file
+struct ExrLayerTarget {
+    /// Header index of each channel, in the order they are interleaved
+    std::vector<int> channels;
+    float* dst;
+    size_t rowStride;
+};
+
+/// Decodes all chunks of an .exr file and interleaves the channels of each target layer into its output
+/// buffer. Each thread decompresses one chunk at a time into a small scratch buffer, and the chunks are
+/// processed in file order in batches, releasing the mapped file pages after each batch. The working
+/// memory is thus bounded by the chunk size times the number of threads, irrespective of the image size.
+bool StreamExrLayers(const ExrChunkReader& reader, const std::vector<ExrLayerTarget>& targets) {
+    const EXRHeader& header = reader.Header();
+
+    // Every decoded channel gets a plane in the scratch buffer, all others share the first plane
+    std::vector<int> planeOfChannel(header.num_channels, 0);
+    int numPlanes = 1;
+    for (const auto& target : targets) {
+        for (int chan : target.channels) {
+            if (planeOfChannel[chan] == 0)
+                planeOfChannel[chan] = numPlanes++;
         }
-    } else {
-        int idx = 0;
-        for (int r = 0; r < img.image.height; ++r) {
-            for (int c = 0; c < img.image.width; ++c) {
-                if (img.header.line_order == 0) {
-                    if (!swizzle(img.image.images, r * img.image.width + c, idx, out))
-                        return false;
-                } else {
-                    if (!swizzle(img.image.images, (img.image.height - r - 1) * img.image.width + c, idx, out))
-                        return false;
+    }
+
+    std::vector<int> chunks(reader.NumChunks());
+    for (int i = 0; i < reader.NumChunks(); ++i)
+        chunks[i] = i;
+    std::sort(chunks.begin(), chunks.end(), [&](int a, int b) {
+        return reader.ChunkOffset(a) < reader.ChunkOffset(b);
+    });
+
+    constexpr size_t batchBytes = 64 * 1024 * 1024;
+    std::atomic<bool> failed = false;
+    for (size_t batchBegin = 0; batchBegin < chunks.size() && !failed; ) {
+        size_t batchEnd = batchBegin + 1;
+        while (batchEnd < chunks.size()
+               && reader.ChunkOffset(chunks[batchEnd]) - reader.ChunkOffset(chunks[batchBegin]) < batchBytes)
+            ++batchEnd;
+
+        std::atomic<int> nextChunk = (int) batchBegin;
+        IOThreadPool().RunParallel(ThreadsPerImage(), [&] {
+            std::vector<float> scratch;
+            std::vector<float*> out(header.num_channels);
+            std::vector<const float*> planes;
+            for (int i; (i = nextChunk++) < (int) batchEnd; ) {
+                const ImageRect rect = reader.ChunkRect(chunks[i]);
+                const size_t chunkPixels = (size_t) rect.width * rect.height;
+                scratch.resize(numPlanes * chunkPixels);
+                for (int c = 0; c < header.num_channels; ++c)
+                    out[c] = scratch.data() + planeOfChannel[c] * chunkPixels;
+                if (!reader.DecodeChunk(chunks[i], out.data(), rect.width)) {
+                    failed = true;
+                    continue;
+                }
+
+                for (const auto& target : targets) {
+                    const int numChannels = (int) target.channels.size();
+                    planes.resize(numChannels);
+                    for (int row = 0; row < rect.height; ++row) {
+                        for (int c = 0; c < numChannels; ++c)
+                            planes[c] = out[target.channels[c]] + (size_t) row * rect.width;
+                        InterleaveRow(planes.data(), numChannels,
+                            target.dst + (size_t) (rect.y + row) * target.rowStride + (size_t) rect.x * numChannels,
+                            rect.width);
+                    }
                 }
-                idx += numChannels;
             }
-        }
+        });
+
+        // All chunks up to the start of the next batch are done
+        size_t end = batchEnd < chunks.size() ? reader.ChunkOffset(chunks[batchEnd]) : SIZE_MAX;
+        reader.Discard(reader.ChunkOffset(chunks[batchBegin]), end);
+        batchBegin = batchEnd;
     }
 
-    cacheMutex.unlock();
+    if (failed) {
+        std::cerr << "Error loading '" << reader.Filename() << "': Invalid/Corrupted data found when decoding pixels."
+                  << std::endl;
+        return false;
+    }
     return true;
 }
 
-void WriteImageToExr(const float** layers, const int* rowStrides, int width, int height, const int* numChannels,
-                     int numLayers, const char** layerNames, const char* filename, unsigned char** memoryOut,
-                     size_t* numBytes, bool writeHalf) {
-    EXRImage image;
-    InitEXRImage(&image);
-    EXRHeader header;
-    InitEXRHeader(&header);
-    header.compression_type = TINYEXR_COMPRESSIONTYPE_PIZ;
-
-    // Count the total number of channels
-    int totalChannels = 0;
-    for (int i = 0; i < numLayers; ++i) totalChannels += numChannels[i];
-
-    header.num_channels = totalChannels;
-    image.num_channels = totalChannels;
-    image.width = width;
-    image.height = height;
-
-    // Convert image data from AoS to SoA (i.e. one image per channel in each layer)
-    std::vector<std::vector<float>> channelImages;
-    for (int layer = 0; layer < numLayers; ++layer) {
-        for (int chan = 0; chan < numChannels[layer]; ++chan) {
-            channelImages.emplace_back(width * height);
-        }
-
-        size_t offset = channelImages.size() - numChannels[layer];
-        for (int r = 0; r < height; ++r) {
-            for (int c = 0; c < width; ++c) {
-                auto start = r * rowStrides[layer] + c * numChannels[layer];
-                for (int chan = 0; chan < numChannels[layer]; ++chan) {
-                    channelImages[offset + chan][r * width + c] = layers[layer][start + chan];
-                }
-            }
+/// Interleaves the channels of a layer into the output. If the row stride is zero, the rows are tightly packed.
+bool CopyCachedExrLayer(const ExrImageData& img, const std::string& layerName, float* out, size_t rowStride = 0) {
+    auto layerIter = img.channelsPerLayer.find(layerName);
+    if (layerIter == img.channelsPerLayer.end()) {
+        std::cerr << "ERROR .exr layer '" << layerName << "' does not exist." << std::endl;
+        return false;
+    }
+
+    // Resolve the channel order once, so the per-row kernels only need to walk a flat array
+    const std::vector<int> channels = layerIter->second.ChannelOrder();
+    const int numChannels = (int) channels.size();
+    const int width = img.width;
+    const int height = img.height;
+    if (rowStride == 0) rowStride = (size_t) width * numChannels;
+
+    // Only the header was read, decode the layer straight into the output
+    if (img.reader) {
+        ExrLayerTarget target { {}, out, rowStride };
+        for (int c : channels)
+            target.channels.push_back(img.channels[c]);
+        return StreamExrLayers(*img.reader, { target });
+    }
+
+    // Copy image data and convert from SoA to AoS
+    #pragma omp parallel
+    {
+        std::vector<const float*> planes(numChannels);
+        #pragma omp for
+        for (int row = 0; row < height; ++row) {
+            for (int c = 0; c < numChannels; ++c)
+                planes[c] = img.planes[channels[c]].get() + (size_t) row * width;
+            InterleaveRow(planes.data(), numChannels, out + row * rowStride, width);
         }
     }
 
-    // Set the channel names
-    std::vector<EXRChannelInfo> channels(totalChannels);
-    int offset = 0;
-    for (int lay = 0; lay < numLayers; ++lay) {
-        char namePrefix[256];
-        size_t prefixLen = 0;
-        if (!layerNames || !layerNames[lay] || layerNames[lay][0] == 0) {
-            prefixLen = 0;
-            namePrefix[0] = 0;
-        } else {
-            prefixLen = strlen(layerNames[lay]) + 1;
-            strncpy(namePrefix, layerNames[lay], 255);
-            namePrefix[prefixLen - 1] = '.';
+    return true;
+}
+
+/// Reads the header of an .exr file and sets up the layouts of the given layers (all, if "layers" is null)
+/// without decoding any pixels. The layers are decoded once they are copied out of the cache.
+int CacheExrHeader(const char* filename, const char* const* layers, int numLayers) {
+    auto reader = std::make_shared<ExrChunkReader>();
+    if (!reader->Open(filename))
+        return -1;
+
+    auto entry = std::make_shared<CachedImage>();
+    auto& result = entry->emplace<ExrImageData>();
+    result.width = reader->Width();
+    result.height = reader->Height();
+    SelectExrLayers(reader->Header(), layers, numLayers, result);
+    result.reader = std::move(reader);
+    return imageCache.Insert(std::move(entry));
+}
+
+/// Decodes all layers of a cached .exr header at once, writing layer i (in the order of layerNames) to
+/// dsts[i], with rowStrides[i] floats between the start of two rows.
+bool ReadCachedExrLayers(const ExrImageData& img, float* const* dsts, const int* rowStrides) {
+    for (size_t i = 0; i < img.layerNames.size(); ++i) {
+        if (rowStrides[i] < img.width * img.channelsPerLayer.at(img.layerNames[i]).CountChannels()) {
+            std::cerr << "ERROR: Row stride too small for .exr layer '" << img.layerNames[i] << "'." << std::endl;
+            return false;
         }
+    }
+
+    // If the pixels have already been decoded, there is nothing to stream
+    if (!img.reader) {
+        for (size_t i = 0; i < img.layerNames.size(); ++i)
+            if (!CopyCachedExrLayer(img, img.layerNames[i], dsts[i], rowStrides[i]))
+                return false;
+        return true;
+    }
 
-        if (numChannels[lay] == 1) {
-            strncpy(channels[offset + 0].name, namePrefix, 255);
-            strncpy(channels[offset + 0].name + prefixLen, "Y", 255 - prefixLen);
-        } else if (numChannels[lay] == 3) {
-            strncpy(channels[offset + 0].name, namePrefix, 255);
-            strncpy(channels[offset + 0].name + prefixLen, "R", 255 - prefixLen);
+    std::vector<ExrLayerTarget> targets;
+    for (size_t i = 0; i < img.layerNames.size(); ++i) {
+        const auto& layout = img.channelsPerLayer.at(img.layerNames[i]);
+        auto& target = targets.emplace_back(ExrLayerTarget { {}, dsts[i], (size_t) rowStrides[i] });
+        for (int c : layout.ChannelOrder())
+            target.channels.push_back(img.channels[c]);
+    }
+    return StreamExrLayers(*img.reader, targets);
+}
+
+/// Decodes the unnamed layer of an .exr file straight into a (strided) buffer
+bool ReadExrInto(const char* filename, float* dst, size_t dstRowStride, const InMemoryFile* memory = nullptr) {
+    ExrChunkReader reader;
+    if (memory ? !reader.Open(memory->data, memory->size, filename) : !reader.Open(filename))
+        return false;
 
-            strncpy(channels[offset + 1].name, namePrefix, 255);
-            strncpy(channels[offset + 1].name + prefixLen, "G", 255 - prefixLen);
+    ExrImageData img;
+    const char* defaultLayer = "";
+    SelectExrLayers(reader.Header(), &defaultLayer, 1, img);
+    if (img.channels.empty()) {
+        std::cerr << "Error loading '" << filename << "': The file has no channels without a layer name." << std::endl;
+        return false;
+    }
+    if (dstRowStride < (size_t) reader.Width() * img.channels.size()) {
+        std::cerr << "Error loading '" << filename << "': Row stride too small for image." << std::endl;
+        return false;
+    }
 
-            strncpy(channels[offset + 2].name, namePrefix, 255);
-            strncpy(channels[offset + 2].name + prefixLen, "B", 255 - prefixLen);
-        } else if (numChannels[lay] == 4) {
-            strncpy(channels[offset + 0].name, namePrefix, 255);
-            strncpy(channels[offset + 0].name + prefixLen, "R", 255 - prefixLen);
+    ExrLayerTarget target { {}, dst, dstRowStride };
+    for (int c : img.channelsPerLayer[""].ChannelOrder())
+        target.channels.push_back(img.channels[c]);
+    return StreamExrLayers(reader, { target });
+}
 
-            strncpy(channels[offset + 1].name, namePrefix, 255);
-            strncpy(channels[offset + 1].name + prefixLen, "G", 255 - prefixLen);
+/// One channel of an .exr file that is being written: a component of an interleaved input layer
+struct ExrChannelSource {
+    const float* data;
+    int rowStride;
+    int numComponents;
+    int component;
+};
 
-            strncpy(channels[offset + 2].name, namePrefix, 255);
-            strncpy(channels[offset + 2].name + prefixLen, "B", 255 - prefixLen);
+/// Uncompressed bytes of scanline blocks that are encoded at once, at least one block per thread is used
+constexpr size_t exrWriteBatchBytes = 64 * 1024 * 1024;
+
+/// Encodes the scanline blocks of an .exr image in parallel and hands them to the output in file order.
+/// Each thread transposes the rows of one block at a time from the interleaved input to the per-channel
+/// layout of the file, so memory use depends only on the block size and number of threads, not on the
+/// image size. The file offset of each block is written to blockOffsets.
+bool EncodeExrBlocks(const std::vector<ExrChannelSource>& sources, const std::vector<tinyexr::ChannelInfo>& channels,
+                     int width, int height, int compression, uint64_t firstBlockOffset,
+                     const std::function<void(const std::vector<unsigned char>&)>& output,
+                     std::vector<uint64_t>& blockOffsets, std::string& error) {
+    const int linesPerBlock = tinyexr::NumScanlines(compression);
+    const int numBlocks = (height + linesPerBlock - 1) / linesPerBlock;
+    const size_t blockPlaneLen = (size_t) width * linesPerBlock;
+
+    std::vector<size_t> channelOffsets(channels.size());
+    size_t pixelDataSize = 0;
+    for (size_t c = 0; c < channels.size(); ++c) {
+        channelOffsets[c] = pixelDataSize;
+        pixelDataSize += channels[c].requested_pixel_type == TINYEXR_PIXELTYPE_HALF ? 2 : 4;
+    }
 
-            strncpy(channels[offset + 3].name, namePrefix, 255);
-            strncpy(channels[offset + 3].name + prefixLen, "A", 255 - prefixLen);
-        } else {
-            std::cerr << "ERROR while writing " << filename
-                    << ": images with " << numChannels << " channels are currently not supported. "
+    const size_t blockBytes = blockPlaneLen * channels.size() * sizeof(float);
+    const int numThreads = ThreadsPerImage();
+    const int blocksPerBatch = (int) std::max<size_t>(numThreads, exrWriteBatchBytes / blockBytes);
+
+    blockOffsets.resize(numBlocks);
+    uint64_t offset = firstBlockOffset;
+    std::vector<std::vector<unsigned char>> encoded(std::min(blocksPerBatch, numBlocks));
+    for (int batchStart = 0; batchStart < numBlocks; batchStart += blocksPerBatch) {
+        const int batchEnd = std::min(numBlocks, batchStart + blocksPerBatch);
+        std::atomic<bool> failed = false;
+        std::atomic<int> nextBlock = batchStart;
+        std::mutex errorMutex;
+
+        IOThreadPool().RunParallel(numThreads, [&] {
+            std::vector<float> planes(blockPlaneLen * channels.size());
+            std::vector<const unsigned char*> images(channels.size());
+            for (size_t c = 0; c < channels.size(); ++c)
+                images[c] = (const unsigned char*) (planes.data() + c * blockPlaneLen);
+            std::string blockError;
+
+            for (int block; (block = nextBlock++) < batchEnd && !failed; ) {
+                int startY = block * linesPerBlock;
+                int numLines = std::min(linesPerBlock, height - startY);
+                for (size_t c = 0; c < channels.size(); ++c) {
+                    const auto& src = sources[c];
+                    float* plane = planes.data() + c * blockPlaneLen;
+                    for (int y = 0; y < numLines; ++y) {
+                        const float* row = src.data + (size_t) (startY + y) * src.rowStride + src.component;
+                        float* dst = plane + (size_t) y * width;
+                        const int stride = src.numComponents;
+                        #pragma omp simd
+                        for (int x = 0; x < width; ++x)
+                            dst[x] = row[(size_t) x * stride];
+                    }
+                }
+
+                // Block header: first scanline and size of the pixel data
+                auto& out = encoded[block - batchStart];
+                out.assign(8, 0);
+                if (!tinyexr::EncodePixelData(out, images.data(), compression, 0, width, linesPerBlock, width, 0,
+                                              numLines, pixelDataSize, channels, channelOffsets, &blockError)) {
+                    failed = true;
+                    std::lock_guard lock(errorMutex);
+                    error += blockError;
+                    continue;
+                }
+                int dataLen = (int) (out.size() - 8);
+                tinyexr::swap4(&startY);
+                tinyexr::swap4(&dataLen);
+                memcpy(&out[0], &startY, 4);
+                memcpy(&out[4], &dataLen, 4);
+            }
+        });
+        if (failed) return false;
+
+        for (int block = batchStart; block < batchEnd; ++block) {
+            auto& out = encoded[block - batchStart];
+            blockOffsets[block] = offset;
+            offset += out.size();
+            output(out);
+        }
+    }
+    return true;
+}
+
+/// Writes one or more layers to an .exr file, or to memory if no filename is given. The compression is one of
+/// the TINYEXR_COMPRESSIONTYPE_* values that tinyexr can encode: NONE, RLE, ZIPS, ZIP, or PIZ.
+/// The header is written with tinyexr's helpers (and identical to what SaveEXRImageToFile writes), the pixels
+/// are streamed block by block, see EncodeExrBlocks().
+bool WriteImageToExr(const float** layers, const int* rowStrides, int width, int height, const int* numChannels,
+                     int numLayers, const char** layerNames, const char* filename, OutBuffer* memoryOut,
+                     bool writeHalf, int compression) {
+    const char* target = filename ? filename : ".exr to memory";
+    if (compression < TINYEXR_COMPRESSIONTYPE_NONE || compression > TINYEXR_COMPRESSIONTYPE_PIZ) {
+        std::cerr << "ERROR while writing " << target
+                  << ": unsupported compression type " << compression << ", no file has been written." << std::endl;
+        return false;
+    }
+    if (width <= 0 || height <= 0) {
+        std::cerr << "ERROR while writing " << target << ": empty image, no file has been written." << std::endl;
+        return false;
+    }
+
+    // Name the channels of each layer: "<layer>.<R|G|B|A|Y>", or just the component if the layer has no name
+    std::vector<tinyexr::ChannelInfo> channels;
+    std::vector<ExrChannelSource> sources;
+    for (int lay = 0; lay < numLayers; ++lay) {
+        const char* components;
+        if (numChannels[lay] == 1)
+            components = "Y";
+        else if (numChannels[lay] == 3)
+            components = "RGB";
+        else if (numChannels[lay] == 4)
+            components = "RGBA";
+        else {
+            std::cerr << "ERROR while writing " << target
+                    << ": images with " << numChannels[lay] << " channels are currently not supported. "
                     << "no file has been written." << std::endl;
-            return;
+            return false;
         }
 
-        offset += numChannels[lay];
+        std::string prefix;
+        if (layerNames && layerNames[lay] && layerNames[lay][0] != 0)
+            prefix = std::string(layerNames[lay]).substr(0, 254) + ".";
+
+        for (int chan = 0; chan < numChannels[lay]; ++chan) {
+            tinyexr::ChannelInfo info;
+            info.name = (prefix + components[chan]).substr(0, 255);
+            info.pixel_type = TINYEXR_PIXELTYPE_FLOAT;
+            info.requested_pixel_type = writeHalf ? TINYEXR_PIXELTYPE_HALF : TINYEXR_PIXELTYPE_FLOAT;
+            info.x_sampling = 1;
+            info.y_sampling = 1;
+            info.p_linear = 0;
+            channels.push_back(info);
+            sources.push_back({ layers[lay], rowStrides[lay], numChannels[lay], chan });
+        }
     }
 
     // Sort channels by the ASCII byte code of their names because thats what OpenEXR expects
     std::vector<int> channelIndices;
-    for (int i = 0; i < totalChannels; ++i) channelIndices.emplace_back(i);
-    std::sort(channelIndices.begin(), channelIndices.end(), [&channels] (int a, int b) {
-        return strcmp(channels[a].name, channels[b].name) < 0;
+    for (int i = 0; i < (int) channels.size(); ++i) channelIndices.emplace_back(i);
+    std::stable_sort(channelIndices.begin(), channelIndices.end(), [&channels] (int a, int b) {
+        return channels[a].name < channels[b].name;
     });
-
-    std::vector<EXRChannelInfo> sortedChannels(totalChannels);
-    float** imagePtr = (float **) alloca(sizeof(float*) * image.num_channels);
-    for (int i = 0; i < totalChannels; ++i) {
-        sortedChannels[i] = channels[channelIndices[i]];
-        imagePtr[i] = channelImages[channelIndices[i]].data();
+    std::vector<tinyexr::ChannelInfo> sortedChannels;
+    std::vector<ExrChannelSource> sortedSources;
+    bool longNames = false;
+    for (int i : channelIndices) {
+        sortedChannels.push_back(channels[i]);
+        sortedSources.push_back(sources[i]);
+        longNames |= channels[i].name.size() > 31;
     }
-    header.channels = sortedChannels.data();
-    image.images = (unsigned char**)imagePtr;
 
-    // Define pixel type of the buffer and requested output pixel type in the file
-    header.pixel_types = (int*) alloca(sizeof(int) * header.num_channels);
-    header.requested_pixel_types = (int*) alloca(sizeof(int) * header.num_channels);
-    for (int i = 0; i < header.num_channels; i++) {
-        header.pixel_types[i] = TINYEXR_PIXELTYPE_FLOAT;
-        header.requested_pixel_types[i] = writeHalf ? TINYEXR_PIXELTYPE_HALF : TINYEXR_PIXELTYPE_FLOAT;
+    // Magic number, version (with the flag for names longer than 31 bytes), and the header attributes
+    std::vector<unsigned char> header = { 0x76, 0x2f, 0x31, 0x01, 2, (unsigned char) (longNames ? 0x4 : 0), 0, 0 };
+    {
+        std::vector<unsigned char> data;
+        tinyexr::WriteChannelInfo(data, sortedChannels);
+        tinyexr::WriteAttributeToMemory(&header, "channels", "chlist", data.data(), (int) data.size());
+
+        unsigned char comp = (unsigned char) compression;
+        tinyexr::WriteAttributeToMemory(&header, "compression", "compression", &comp, 1);
+
+        int window[4] = { 0, 0, width - 1, height - 1 };
+        for (int& v : window) tinyexr::swap4(&v);
+        tinyexr::WriteAttributeToMemory(&header, "dataWindow", "box2i", (const unsigned char*) window, sizeof(window));
+        tinyexr::WriteAttributeToMemory(&header, "displayWindow", "box2i", (const unsigned char*) window, sizeof(window));
+
+        unsigned char lineOrder = 0; // increasing y
+        tinyexr::WriteAttributeToMemory(&header, "lineOrder", "lineOrder", &lineOrder, 1);
+
+        float aspectRatio = 1.0f;
+        tinyexr::swap4(&aspectRatio);
+        tinyexr::WriteAttributeToMemory(&header, "pixelAspectRatio", "float", (const unsigned char*) &aspectRatio,
+                                        sizeof(float));
+
+        float center[2] = { 0.0f, 0.0f };
+        tinyexr::WriteAttributeToMemory(&header, "screenWindowCenter", "v2f", (const unsigned char*) center,
+                                        sizeof(center));
+
+        float screenWidth = 1.0f;
+        tinyexr::swap4(&screenWidth);
+        tinyexr::WriteAttributeToMemory(&header, "screenWindowWidth", "float", (const unsigned char*) &screenWidth,
+                                        sizeof(float));
+        header.push_back(0);
     }
 
-    // Save the file
-    const char* errorMsg = nullptr;
-    int retCode;
-    if (filename != nullptr)
-        retCode = SaveEXRImageToFile(&image, &header, filename, &errorMsg);
-    else {
-        *numBytes = SaveEXRImageToMemory(&image, &header, memoryOut, &errorMsg);
-        retCode = *numBytes == 0 ? 1 : 0;
+    // The offset table follows the header, its entries are filled in once all blocks have been written
+    const int numBlocks = (height + tinyexr::NumScanlines(compression) - 1) / tinyexr::NumScanlines(compression);
+    const size_t tableOffset = header.size();
+    header.resize(tableOffset + numBlocks * sizeof(uint64_t), 0);
+
+    std::vector<uint64_t> blockOffsets;
+    std::string error;
+    bool success;
+    if (filename) {
+        std::ofstream out(std::filesystem::path((const char8_t*) filename), std::ios_base::binary);
+        if (!out) {
+            std::cerr << "ERROR: Could not write file: " << filename << std::endl;
+            return false;
+        }
+        out.write((const char*) header.data(), header.size());
+        success = EncodeExrBlocks(sortedSources, sortedChannels, width, height, compression, header.size(),
+            [&out] (const std::vector<unsigned char>& block) { out.write((const char*) block.data(), block.size()); },
+            blockOffsets, error);
+        if (success) {
+            for (auto& o : blockOffsets) tinyexr::swap8(&o);
+            out.seekp(tableOffset);
+            out.write((const char*) blockOffsets.data(), blockOffsets.size() * sizeof(uint64_t));
+            success = (bool) out;
+            if (!success) error = "Could not write file";
+        }
+    } else {
+        // Reserve the uncompressed size (plus the block headers), so the buffer rarely has to grow
+        OutBuffer& out = *memoryOut;
+        out = std::move(header);
+        out.reserve(out.size() + numBlocks * 8
+            + (size_t) width * height * sortedChannels.size() * (writeHalf ? 2 : 4));
+        success = EncodeExrBlocks(sortedSources, sortedChannels, width, height, compression, out.size(),
+            [&out] (const std::vector<unsigned char>& block) { out.insert(out.end(), block.begin(), block.end()); },
+            blockOffsets, error);
+        if (success) {
+            for (auto& o : blockOffsets) tinyexr::swap8(&o);
+            memcpy(out.data() + tableOffset, blockOffsets.data(), blockOffsets.size() * sizeof(uint64_t));
+        }
     }
 
-    if (retCode != TINYEXR_SUCCESS) {
-        std::cerr << "TinyEXR error (" << retCode << "): " << errorMsg << std::endl;
-        FreeEXRErrorMessage(errorMsg);
+    if (!success)
+        std::cerr << "ERROR while writing " << target << ": " << error << std::endl;
+    return success;
+}
+
+/// Moves the pixels within a region to the start of an interleaved image buffer, so the buffer
+/// afterwards holds an image of the size of the region.
+void CropInPlace(float* data, int width, int numChannels, const ImageRect& crop) {
+    const size_t rowLen = (size_t) crop.width * numChannels;
+    for (int row = 0; row < crop.height; ++row) {
+        const float* src = data + ((size_t) (crop.y + row) * width + crop.x) * numChannels;
+        std::memmove(data + row * rowLen, src, rowLen * sizeof(float));
     }
 }
 
-int CacheTiffImage(int* width, int* height, int* numChannels, const char* filename) {
+/// Decodes a .tiff image with tinydng, used for all files that the strip reader does not support
+bool LoadTiffWithTinyDng(const char* filename, int* width, int* height, int* numChannels,
+                         std::vector<float>& output, const InMemoryFile* memory = nullptr) {
     std::vector<tinydng::DNGImage> images;
     std::vector<tinydng::FieldInfo> custom_field_list;
     std::string warn, err;
-    bool ret = tinydng::LoadDNG(filename, custom_field_list, &images, &warn, &err);
+    bool ret;
+    if (memory) {
+        if (memory->size > std::numeric_limits<unsigned int>::max()) {
+            std::cerr << "ERROR: .tiff file in memory is too large: " << filename << std::endl;
+            return false;
+        }
+        ret = tinydng::LoadDNGFromMemory((const char*) memory->data, (unsigned int) memory->size,
+                                         custom_field_list, &images, &warn, &err);
+    } else {
+        ret = tinydng::LoadDNG(filename, custom_field_list, &images, &warn, &err);
+    }
 
     if (!warn.empty()) {
         std::cout << "WARN: " << warn << std::endl;
@@ -460,7 +1247,7 @@ int CacheTiffImage(int* width, int* height, int* numChannels, const char* filena
 
     if (ret == false) {
         std::cout << "ERROR: failed to load DNG" << std::endl;
-        return -1;
+        return false;
     }
 
     assert(images.size() > 0);
@@ -472,183 +1259,615 @@ int CacheTiffImage(int* width, int* height, int* numChannels, const char* filena
     *width = images[0].width;
     *height = images[0].height;
     *numChannels = images[0].samples_per_pixel;
-    std::vector<float> output((*width) * (*height) * (*numChannels), 0.0f);
+    output.assign((size_t) (*width) * (*height) * (*numChannels), 0.0f);
 
     if (images[0].sample_format == tinydng::SAMPLEFORMAT_IEEEFP && images[0].bits_per_sample == 32) {
         float* first = (float*)images[0].data.data();
         std::copy(first, first + (*width) * (*height) * (*numChannels), output.begin());
-    } else if (images[0].sample_format == tinydng::SAMPLEFORMAT_UINT) {
-        // Convert LDR image to 32 bit floating point HDR (adapted from stb_image)
-        int numChannels = images[0].samples_per_pixel;
-        uint8_t* data = images[0].data.data();
-        int stride = images[0].bits_per_sample / 8;
-        float maxval = static_cast<float>((1 << images[0].bits_per_sample) - 1);
-
-        int numNonAlpha = (numChannels & 1) ? numChannels : (numChannels - 1);
-        for (int i = 0; i < (*width) * (*height); ++i) {
-            for (int k = 0; k < numNonAlpha; ++k) { // map the non-alpha components with gamma correction
-                output[i * numChannels + k] = pow(data[(i * numChannels + k) * stride] / maxval, 2.2f);
-            }
-            if (numNonAlpha < numChannels) { // map alpha linearly to range [0,1]
-                output[i * numChannels + numNonAlpha] = data[(i * numChannels + numNonAlpha) * stride] / maxval;
-            }
+    } else if (images[0].sample_format == tinydng::SAMPLEFORMAT_UINT
+            && (images[0].bits_per_sample == 8 || images[0].bits_per_sample == 16)) {
+        // Convert the LDR samples from sRGB to linear (alpha only to [0, 1]) via a lookup table
+        const uint8_t* data = images[0].data.data();
+        const int bytesPerSample = images[0].bits_per_sample / 8;
+        const size_t rowLen = (size_t) (*width) * (*numChannels);
+        #pragma omp parallel for
+        for (int row = 0; row < *height; ++row) {
+            const uint8_t* src = data + row * rowLen * bytesPerSample;
+            float* out = output.data() + row * rowLen;
+            if (bytesPerSample == 1)
+                SrgbToLinearRow(src, out, *width, *numChannels);
+            else
+                SrgbToLinearRow((const uint16_t*) src, out, *width, *numChannels);
         }
     } else {
         std::cerr << "ERROR: unsupported sample format or bit count. We currently only support 32 bit float "
-                  << "and 8 bit unsigned integer values. (" << images[0].sample_format << " @ "
+                  << "and 8 or 16 bit unsigned integer values. (" << images[0].sample_format << " @ "
                   << images[0].bits_per_sample << " bits)" << std::endl;
-        return -1;
+        return false;
     }
 
-    cacheMutex.lock();
-    const int idx = nextIndex;
-    tiffImages[idx] = TiffImageData { std::move(output) };
-    nextIndex++;
-    cacheMutex.unlock();
-
-    return idx;
+    return true;
 }
 
-void WriteTiffImage(const float* data, int rowStride, int width, int height, int numChannels, const char* filename) {
-    tinydngwriter::DNGImage image;
-    image.SetBigEndian(systemIsBigEndian);
+/// Loads a .tiff image. If a region is given, the cached image is cropped to that region. Strip-based
+/// files in the common formats are read partially, only decoding the strips that overlap the region.
+int CacheTiffImage(int* width, int* height, int* numChannels, const char* filename,
+                   const ImageRect* region = nullptr) {
+    TiffStripReader reader;
+    auto result = reader.Open(filename);
+    if (result == TiffReadResult::Error)
+        return -1;
+    if (result == TiffReadResult::Success) {
+        const ImageRect full = { 0, 0, reader.Width(), reader.Height() };
+        const ImageRect crop = region ? region->Intersect(full) : full;
+        if (crop.IsEmpty()) {
+            std::cerr << "ERROR: The region does not overlap the image in file: " << filename << std::endl;
+            return -1;
+        }
 
-    image.SetSubfileType(false, false, false);
-    image.SetImageWidth(width);
-    image.SetImageLength(height);
-    image.SetRowsPerStrip(height);
-    image.SetSamplesPerPixel(numChannels);
-    std::vector<uint16_t> bps(numChannels, 32);
-    image.SetBitsPerSample(numChannels, bps.data());
-    image.SetPlanarConfig(tinydngwriter::PLANARCONFIG_CONTIG);
-    image.SetCompression(tinydngwriter::COMPRESSION_NONE);
-    image.SetPhotometric(tinydngwriter::PHOTOMETRIC_RGB);
-    std::vector<unsigned short> sampleformat(numChannels, tinydngwriter::SAMPLEFORMAT_IEEEFP);
-    image.SetSampleFormat(numChannels, sampleformat.data());
-    image.SetXResolution(1.0);
-    image.SetYResolution(1.0);
-    image.SetResolutionUnit(tinydngwriter::RESUNIT_NONE);
+        *width = crop.width;
+        *height = crop.height;
+        *numChannels = reader.NumChannels();
+        std::vector<float> output((size_t) crop.width * crop.height * reader.NumChannels());
+        if (!reader.Read(crop, output.data(), (size_t) crop.width * reader.NumChannels(),
+                         ThreadsPerImage()))
+            return -1;
+        auto entry = std::make_shared<CachedImage>(TiffImageData { std::move(output) });
+        return imageCache.Insert(std::move(entry));
+    }
 
-    image.SetImageData((const uint8_t*)data, width * height * numChannels * sizeof(float));
+    // Otherwise, fall back to decoding the full image
+    std::vector<float> output;
+    if (!LoadTiffWithTinyDng(filename, width, height, numChannels, output))
+        return -1;
 
-    tinydngwriter::DNGWriter writer(systemIsBigEndian);
-    if (!writer.AddImage(&image)) {
-        std::cerr << "Error in DNGWriter::AddImage()" << std::endl;
+    if (region) {
+        ImageRect crop = region->Intersect({ 0, 0, *width, *height });
+        if (crop.IsEmpty()) {
+            std::cerr << "ERROR: The region does not overlap the image in file: " << filename << std::endl;
+            return -1;
+        }
+        CropInPlace(output.data(), *width, *numChannels, crop);
+        output.resize((size_t) crop.width * crop.height * (*numChannels));
+        *width = crop.width;
+        *height = crop.height;
     }
 
-    std::string err;
-    std::ofstream out(std::filesystem::path((const char8_t*) filename), std::ios_base::binary);
-    if (!out) {
-        std::cerr << "Could not open file for writing "
-                  << std::filesystem::path((const char8_t*) filename) << std::endl;
-    }
-    writer.WriteToStream(out, &err);
+    auto entry = std::make_shared<CachedImage>(TiffImageData { std::move(output) });
+    return imageCache.Insert(std::move(entry));
+}
 
-    if (!err.empty()) {
-        std::cerr << err << std::endl;
+/// Decodes a .tiff image straight into a (strided) buffer. Files that the strip reader does not
+/// support are decoded with tinydng and copied.
+bool ReadTiffInto(const char* filename, float* dst, size_t dstRowStride, const InMemoryFile* memory = nullptr) {
+    TiffStripReader reader;
+    auto result = memory ? reader.Open(memory->data, memory->size, filename) : reader.Open(filename);
+    if (result == TiffReadResult::Error)
+        return false;
+    if (result == TiffReadResult::Success) {
+        if (dstRowStride < (size_t) reader.Width() * reader.NumChannels()) {
+            std::cerr << "ERROR: Row stride too small for image: " << filename << std::endl;
+            return false;
+        }
+        return reader.Read({ 0, 0, reader.Width(), reader.Height() }, dst, dstRowStride, ThreadsPerImage());
+    }
+
+    int width, height, numChannels;
+    std::vector<float> output;
+    if (!LoadTiffWithTinyDng(filename, &width, &height, &numChannels, output, memory))
+        return false;
+    const size_t rowLen = (size_t) width * numChannels;
+    if (dstRowStride < rowLen) {
+        std::cerr << "ERROR: Row stride too small for image: " << filename << std::endl;
+        return false;
     }
+    for (int row = 0; row < height; ++row)
+        std::copy_n(output.data() + row * rowLen, rowLen, dst + row * dstRowStride);
+    return true;
 }
 
-int CacheStbImage(int* width, int* height, int* numChannels, const char* filename) {
-    float *data = stbi_loadf(filename, width, height, numChannels, 0);
+/// Input of stb_image, either an open file or a file in memory. The file is closed by the destructor.
+class StbInput {
+public:
+    StbInput(const char* filename, const InMemoryFile* memory) : memory(memory) {
+        if (memory) {
+            if (memory->size > (size_t) std::numeric_limits<int>::max())
+                std::cerr << "ERROR: Image file in memory is too large: " << filename << std::endl;
+            else
+                isOpen = true;
+        } else {
+            file = stbi__fopen(filename, "rb");
+            if (!file)
+                std::cerr << "ERROR: Could not read file: " << filename << std::endl;
+            isOpen = file != nullptr;
+        }
+    }
 
-    if (!data) return -1;
+    ~StbInput() { if (file) fclose(file); }
 
-    cacheMutex.lock();
-    const int idx = nextIndex;
-    stbImages[idx] = StbImageData { data, *width, *height, *numChannels };
-    nextIndex++;
-    cacheMutex.unlock();
+    StbInput(const StbInput&) = delete;
+    StbInput& operator=(const StbInput&) = delete;
 
-    return idx;
+    bool IsOpen() const { return isOpen; }
+
+    bool Info(int* width, int* height, int* numChannels) const {
+        return memory ? stbi_info_from_memory(memory->data, (int) memory->size, width, height, numChannels)
+                      : stbi_info_from_file(file, width, height, numChannels);
+    }
+
+    bool IsHdr() const {
+        return memory ? stbi_is_hdr_from_memory(memory->data, (int) memory->size) : stbi_is_hdr_from_file(file);
+    }
+
+    bool Is16Bit() const {
+        return memory ? stbi_is_16_bit_from_memory(memory->data, (int) memory->size)
+                      : stbi_is_16_bit_from_file(file);
+    }
+
+    float* LoadFloat(int* width, int* height, int* numChannels, int desiredChannels) const {
+        return memory ? stbi_loadf_from_memory(memory->data, (int) memory->size, width, height, numChannels,
+                                               desiredChannels)
+                      : stbi_loadf_from_file(file, width, height, numChannels, desiredChannels);
+    }
+
+    stbi_uc* Load(int* width, int* height, int* numChannels, int desiredChannels) const {
+        return memory ? stbi_load_from_memory(memory->data, (int) memory->size, width, height, numChannels,
+                                              desiredChannels)
+                      : stbi_load_from_file(file, width, height, numChannels, desiredChannels);
+    }
+
+    stbi_us* Load16(int* width, int* height, int* numChannels, int desiredChannels) const {
+        return memory ? stbi_load_16_from_memory(memory->data, (int) memory->size, width, height, numChannels,
+                                                 desiredChannels)
+                      : stbi_load_from_file_16(file, width, height, numChannels, desiredChannels);
+    }
+
+private:
+    FILE* file = nullptr;
+    const InMemoryFile* memory;
+    bool isOpen = false;
+};
+
+/// Reads the metadata of any format supported by stb_image from its header
+bool ProbeStbImage(const char* filename, ImageInfo* info, const InMemoryFile* memory = nullptr) {
+    StbInput input(filename, memory);
+    if (!input.IsOpen())
+        return false;
+
+    bool success = input.Info(&info->width, &info->height, &info->numChannels);
+    if (success) {
+        if (input.IsHdr()) info->pixelType = (int) PixelType::Float;
+        else if (input.Is16Bit()) info->pixelType = (int) PixelType::UInt16;
+        else info->pixelType = (int) PixelType::UInt8;
+        info->numLayers = 0;
+    } else {
+        std::cerr << "ERROR: Could not read image header of file: " << filename << " ("
+                  << stbi_failure_reason() << ")" << std::endl;
+    }
+    return success;
 }
 
-void CopyCachedStbImage(int id, float* out) {
-    cacheMutex.lock();
-    StbImageData data = stbImages[id];
-    stbImages.erase(id);
-    cacheMutex.unlock();
+/// Decodes an image via stb_image straight into a (strided) buffer. LDR images are decoded to 8 or 16 bit
+/// and converted row by row, so there is no intermediate float copy of the full image.
+bool ReadStbImageInto(const char* filename, float* dst, size_t dstRowStride, const InMemoryFile* memory = nullptr) {
+    StbInput input(filename, memory);
+    if (!input.IsOpen())
+        return false;
 
-    std::copy(data.data, data.data + data.width * data.height * data.numChannels, out);
-    stbi_image_free(data.data);
+    int width, height, numChannels;
+    if (!input.Info(&width, &height, &numChannels)) {
+        std::cerr << "ERROR: Could not read image header of file: " << filename << " ("
+                  << stbi_failure_reason() << ")" << std::endl;
+        return false;
+    }
+    const size_t rowLen = (size_t) width * numChannels;
+    if (dstRowStride < rowLen) {
+        std::cerr << "ERROR: Row stride too small for image: " << filename << std::endl;
+        return false;
+    }
+
+    // Request the channel count from the header, so the result matches the probed metadata
+    int w, h, n;
+    bool success = false;
+    if (input.IsHdr()) {
+        float* data = input.LoadFloat(&w, &h, &n, numChannels);
+        if (data) {
+            #pragma omp parallel for
+            for (int row = 0; row < height; ++row)
+                std::copy_n(data + row * rowLen, rowLen, dst + row * dstRowStride);
+            stbi_image_free(data);
+            success = true;
+        }
+    } else {
+        // LDR images are decoded to 8 or 16 bit integers and converted from sRGB with a lookup table
+        auto expand = [&](const auto* data) {
+            #pragma omp parallel for
+            for (int row = 0; row < height; ++row)
+                SrgbToLinearRow(data + row * rowLen, dst + row * dstRowStride, width, numChannels);
+            stbi_image_free((void*) data);
+            success = true;
+        };
+        if (input.Is16Bit()) {
+            if (stbi_us* data = input.Load16(&w, &h, &n, numChannels)) expand(data);
+        } else {
+            if (stbi_uc* data = input.Load(&w, &h, &n, numChannels)) expand(data);
+        }
+    }
+
+    if (!success)
+        std::cerr << "ERROR: Could not decode file: " << filename << " (" << stbi_failure_reason() << ")" << std::endl;
+    return success;
 }
 
-void WriteImageWithStbImage(const float* data, int rowStride, int width, int height, int numChannels,
-                            const char* filename, int lossyQuality) {
-    auto fname = std::string(filename);
-    auto fext = fname.substr(fname.size() - 3, 3);
-    if (fext == "hdr") {
-        if (rowStride != width * numChannels) {
-            std::vector<float> buffer(width * height * numChannels);
-            AlignImage(data, rowStride, buffer.data(), width, height, numChannels);
-            stbi_write_hdr(filename, width, height, numChannels, buffer.data());
-        } else
-            stbi_write_hdr(filename, width, height, numChannels, data);
+/// Decodes a .png written by fpng (or by EncodePng from RGB or RGBA strips) with fpng's decoder, which is
+/// several times faster than stb_image for these files, and expands the rows from sRGB with the lookup
+/// table. Returns false, without an error, for any other file, so the caller can fall back to stb_image.
+bool ReadFpngInto(const uint8_t* data, size_t size, float* dst, size_t dstRowStride) {
+    uint32_t width, height, numChannels;
+    if (size > std::numeric_limits<uint32_t>::max()
+        || fpng::fpng_get_info(data, (uint32_t) size, width, height, numChannels) != fpng::FPNG_DECODE_SUCCESS
+        || dstRowStride < (size_t) width * numChannels)
+        return false;
+
+    fpng::fpng_init();
+    std::vector<uint8_t> pixels;
+    if (fpng::fpng_decode_memory(data, (uint32_t) size, pixels, width, height, numChannels, numChannels)
+        != fpng::FPNG_DECODE_SUCCESS)
+        return false;
+
+    const size_t rowLen = (size_t) width * numChannels;
+    #pragma omp parallel for
+    for (int row = 0; row < (int) height; ++row)
+        SrgbToLinearRow(pixels.data() + row * rowLen, dst + row * dstRowStride, width, numChannels);
+    return true;
+}
+
+/// Decodes a .png straight into a (strided) buffer, via fpng if it wrote the file, otherwise via stb_image
+bool ReadPngInto(const char* filename, float* dst, size_t dstRowStride, const InMemoryFile* memory = nullptr) {
+    if (memory) {
+        if (ReadFpngInto(memory->data, memory->size, dst, dstRowStride)) return true;
     } else {
-        std::vector<uint8_t> buffer(width * height * numChannels);
-        ConvertToSrgbByteImage(data, rowStride, buffer.data(), width, height, numChannels);
+        MappedFile file(filename);
+        if (file.IsOpen() && ReadFpngInto(file.Data(), file.Size(), dst, dstRowStride)) return true;
+    }
+    return ReadStbImageInto(filename, dst, dstRowStride, memory);
+}
 
-        if (fext == "png")
-            stbi_write_png(filename, width, height, numChannels, buffer.data(), width * numChannels);
-        else if (fext == "bmp")
-            stbi_write_bmp(filename, width, height, numChannels, buffer.data());
-        else if (fext == "tga")
-            stbi_write_tga(filename, width, height, numChannels, buffer.data());
-        else if (fext == "jpg")
-            stbi_write_jpg(filename, width, height, numChannels, buffer.data(), lossyQuality);
+/// Decodes a Radiance .hdr straight into a (strided) buffer with the parallel decoder, or via stb_image for
+/// files that it does not handle
+bool ReadHdrInto(const char* filename, float* dst, size_t dstRowStride, const InMemoryFile* memory = nullptr) {
+    if (memory) {
+        if (DecodeHdr(memory->data, memory->size, dst, dstRowStride, ThreadsPerImage())) return true;
+    } else {
+        MappedFile file(filename);
+        if (file.IsOpen() && DecodeHdr(file.Data(), file.Size(), dst, dstRowStride, ThreadsPerImage()))
+            return true;
     }
+    return ReadStbImageInto(filename, dst, dstRowStride, memory);
 }
 
-bool WritePngWithFpng(const float* data, int rowStride, int width, int height, int numChannels,
-                      const char* filename) {
-    fpng::fpng_init();
+/// The contents of an image file, either mapped from disk or a file in memory
+class FileContents {
+public:
+    FileContents(const char* filename, const InMemoryFile* memory) {
+        if (memory) {
+            data = memory->data;
+            size = memory->size;
+            return;
+        }
+        file.emplace(filename);
+        if (!file->IsOpen()) {
+            std::cerr << "ERROR: Could not read file: " << filename << std::endl;
+            return;
+        }
+        data = file->Data();
+        size = file->Size();
+    }
+
+    bool IsOpen() const { return data != nullptr; }
+
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+
+private:
+    std::optional<MappedFile> file;
+};
+
+bool ProbeQoiImage(const char* filename, ImageInfo* info, const InMemoryFile* memory = nullptr) {
+    FileContents file(filename, memory);
+    if (!file.IsOpen())
+        return false;
+
+    QoiHeader header;
+    if (!ReadQoiHeader(file.data, file.size, header)) {
+        std::cerr << "ERROR: Invalid .qoi header in file: " << filename << std::endl;
+        return false;
+    }
+    info->width = header.width;
+    info->height = header.height;
+    info->numChannels = header.numChannels;
+    info->pixelType = (int) PixelType::UInt8;
+    info->numLayers = 0;
+    return true;
+}
+
+/// Decodes a .qoi file to bytes and expands the rows in parallel. The stream itself can only be decoded
+/// sequentially.
+bool ReadQoiInto(const char* filename, float* dst, size_t dstRowStride, const InMemoryFile* memory = nullptr) {
+    FileContents file(filename, memory);
+    if (!file.IsOpen())
+        return false;
+
+    QoiHeader header;
+    if (!ReadQoiHeader(file.data, file.size, header)) {
+        std::cerr << "ERROR: Invalid .qoi header in file: " << filename << std::endl;
+        return false;
+    }
+    const size_t rowLen = (size_t) header.width * header.numChannels;
+    if (dstRowStride < rowLen) {
+        std::cerr << "ERROR: Row stride too small for image: " << filename << std::endl;
+        return false;
+    }
+
+    std::vector<uint8_t> pixels(rowLen * header.height);
+    if (!DecodeQoi(file.data, file.size, pixels.data())) {
+        std::cerr << "ERROR: Could not decode file: " << filename << std::endl;
+        return false;
+    }
+
+    #pragma omp parallel for
+    for (int row = 0; row < header.height; ++row) {
+        const uint8_t* src = pixels.data() + row * rowLen;
+        float* out = dst + row * dstRowStride;
+        if (header.isLinear) {
+            for (size_t i = 0; i < rowLen; ++i)
+                out[i] = src[i] / 255.0f;
+        } else {
+            SrgbToLinearRow(src, out, header.width, header.numChannels);
+        }
+    }
+    return true;
+}
+
+/// True for the extensions of binary .pgm, .ppm, and .pam files (and the generic .pnm)
+bool HasPnmExtension(const std::string& fname) {
+    if (fname.size() < 4) return false;
+    auto ext = fname.substr(fname.size() - 4, 4);
+    return ext == ".ppm" || ext == ".pgm" || ext == ".pam" || ext == ".pnm";
+}
+
+bool ProbePnmImage(const char* filename, ImageInfo* info, const InMemoryFile* memory = nullptr) {
+    FileContents file(filename, memory);
+    if (!file.IsOpen())
+        return false;
+
+    PnmHeader header;
+    if (!ReadPnmHeader(file.data, file.size, header, filename))
+        return false;
+    info->width = header.width;
+    info->height = header.height;
+    info->numChannels = header.numChannels;
+    info->pixelType = (int) (header.maxValue > 255 ? PixelType::UInt16 : PixelType::UInt8);
+    info->numLayers = 0;
+    return true;
+}
+
+/// Expands the rows of a binary .pgm, .ppm, or .pam file in parallel, straight from the mapped file. Other
+/// sample ranges than 255 and 65535 are rescaled to 16 bit first.
+bool ReadPnmInto(const char* filename, float* dst, size_t dstRowStride, const InMemoryFile* memory = nullptr) {
+    FileContents file(filename, memory);
+    if (!file.IsOpen())
+        return false;
+
+    PnmHeader header;
+    if (!ReadPnmHeader(file.data, file.size, header, filename))
+        return false;
+    const size_t rowLen = (size_t) header.width * header.numChannels;
+    if (dstRowStride < rowLen) {
+        std::cerr << "ERROR: Row stride too small for image: " << filename << std::endl;
+        return false;
+    }
 
-    if (numChannels != 3 && numChannels != 4) {
-        // TODO uplift mono -> RGB instead
-        WriteImageWithStbImage(data, rowStride, width, height, numChannels, filename, 0);
+    const uint8_t* pixels = file.data + header.dataOffset;
+    if (header.maxValue == 255) {
+        #pragma omp parallel for
+        for (int row = 0; row < header.height; ++row)
+            SrgbToLinearRow(pixels + row * rowLen, dst + row * dstRowStride, header.width, header.numChannels);
         return true;
     }
 
-    auto path = std::filesystem::path((const char8_t*) filename);
+    const size_t rowBytes = header.RowBytes();
+    const bool sixteenBit = header.BytesPerSample() == 2;
+    const uint32_t maxValue = header.maxValue;
+    #pragma omp parallel
+    {
+        std::vector<uint16_t> samples(rowLen);
+        #pragma omp for
+        for (int row = 0; row < header.height; ++row) {
+            const uint8_t* src = pixels + row * rowBytes;
+            for (size_t i = 0; i < rowLen; ++i) {
+                // Samples are big-endian, values above the maximum are clamped
+                uint32_t v = sixteenBit ? (uint32_t(src[2 * i]) << 8) | src[2 * i + 1] : src[i];
+                if (maxValue != 65535)
+                    v = (std::min(v, maxValue) * 65535 + maxValue / 2) / maxValue;
+                samples[i] = (uint16_t) v;
+            }
+            SrgbToLinearRow(samples.data(), dst + row * dstRowStride, header.width, header.numChannels);
+        }
+    }
+    return true;
+}
+
+/// Loads an image via stb_image, or fpng for .png files it wrote, or the parallel decoders for .hdr, .qoi, and
+/// binary .pgm, .ppm, and .pam files. If a region is given, the cached image is cropped to that region.
+int CacheStbImage(int* width, int* height, int* numChannels, const char* filename,
+                  const ImageRect* region = nullptr) {
+    auto fname = std::string(filename);
+    auto hasExtension = [&](const char* ext) {
+        return fname.size() >= 4 && fname.compare(fname.size() - 4, 4, ext) == 0;
+    };
+    auto probe = hasExtension(".qoi") ? ProbeQoiImage : HasPnmExtension(fname) ? ProbePnmImage : ProbeStbImage;
+    auto read = hasExtension(".png") ? ReadPngInto : hasExtension(".hdr") ? ReadHdrInto
+              : hasExtension(".qoi") ? ReadQoiInto : HasPnmExtension(fname) ? ReadPnmInto : ReadStbImageInto;
+
+    ImageInfo info;
+    if (!probe(filename, &info, nullptr)) return -1;
+    float* data = (float*) malloc(std::max((size_t) info.width * info.height * info.numChannels, (size_t) 1)
+                                  * sizeof(float));
+    if (!read(filename, data, (size_t) info.width * info.numChannels, nullptr)) {
+        free(data);
+        return -1;
+    }
+    *width = info.width;
+    *height = info.height;
+    *numChannels = info.numChannels;
+
+    if (region) {
+        ImageRect crop = region->Intersect({ 0, 0, *width, *height });
+        if (crop.IsEmpty()) {
+            std::cerr << "ERROR: The region does not overlap the image in file: " << filename << std::endl;
+            free(data);
+            return -1;
+        }
+        CropInPlace(data, *width, *numChannels, crop);
+        *width = crop.width;
+        *height = crop.height;
+    }
+
+    auto entry = std::make_shared<CachedImage>();
+    entry->emplace<StbImageData>(data, *width, *height, *numChannels);
+    return imageCache.Insert(std::move(entry));
+}
 
+void CopyCachedStbImage(const StbImageData& data, float* out) {
+    std::copy(data.data, data.data + data.width * data.height * data.numChannels, out);
+}
+
+bool WriteImageWithStbImage(const float* data, int rowStride, int width, int height, int numChannels,
+                            const char* filename, int lossyQuality) {
+    auto fname = std::string(filename);
+    auto fext = fname.substr(fname.size() - 3, 3);
+    int success = 0;
     std::vector<uint8_t> buffer(width * height * numChannels);
     ConvertToSrgbByteImage(data, rowStride, buffer.data(), width, height, numChannels);
 
-    std::vector<uint8_t> out_buf;
-    if (!fpng::fpng_encode_image_to_memory(buffer.data(), width, height, numChannels, out_buf)) {
-        std::cerr << "ERROR: png encoding failed when writing file: " << path << std::endl;
-        return false;
+    if (fext == "bmp")
+        success = stbi_write_bmp(filename, width, height, numChannels, buffer.data());
+    else if (fext == "tga")
+        success = stbi_write_tga(filename, width, height, numChannels, buffer.data());
+
+    if (!success)
+        std::cerr << "ERROR: Could not write file: " << filename << std::endl;
+    return success != 0;
+}
+
+/// Encodes a .png in memory. If sixteenBit is set, the values are stored with 16 instead of 8 bit. With a
+/// single thread, 8 bit RGB and RGBA images are encoded with fpng, everything else (and what fpng rejects)
+/// with EncodePng, which compresses strips of rows in parallel.
+bool EncodePngToMemory(const float* data, int rowStride, int width, int height, int numChannels,
+                       bool sixteenBit, OutBuffer& out) {
+    const size_t numValues = (size_t) width * height * numChannels;
+    const int numThreads = ThreadsPerImage();
+    if (sixteenBit) {
+        std::vector<uint16_t> buffer(numValues);
+        ConvertToSrgbPixels(data, rowStride, buffer.data(), width, height, numChannels);
+        return EncodePng(buffer.data(), width, height, numChannels, 16, out, numThreads);
     }
 
+    std::vector<uint8_t> buffer(numValues);
+    ConvertToSrgbPixels(data, rowStride, buffer.data(), width, height, numChannels);
+    if ((numChannels == 3 || numChannels == 4) && numThreads == 1) {
+        fpng::fpng_init();
+        if (fpng::fpng_encode_image_to_memory(buffer.data(), width, height, numChannels, out))
+            return true;
+        out.clear();
+    }
+    return EncodePng(buffer.data(), width, height, numChannels, 8, out, numThreads);
+}
+
+/// Writes an image that was encoded in memory to a file
+bool WriteEncodedFile(const OutBuffer& encoded, const std::filesystem::path& path) {
     std::ofstream out(path, std::ios_base::binary);
     if (!out) {
         std::cerr << "ERROR: Could not open file for writing: " << path << std::endl;
         return false;
     }
 
-    out.write((const char*) out_buf.data(), out_buf.size());
+    out.write((const char*) encoded.data(), encoded.size());
 
-    return true;
+    return (bool) out;
 }
 
-bool WritePngWithFpngToMemory(std::vector<uint8_t>& data, int rowStride, int width, int height, int numChannels,
-                              OutBuffer& outBuffer) {
-    fpng::fpng_init();
-    if (numChannels != 3 && numChannels != 4) {
-        // TODO uplift mono -> RGB instead
+/// Sample type of a .tif written with the given quality: 0 writes half precision floats (as for .exr), 16
+/// writes 16 bit integers (as for .png), everything else 32 bit floats
+TiffSampleType TiffSampleTypeOf(int lossyQuality) {
+    if (lossyQuality == 0) return TiffSampleType::Half;
+    if (lossyQuality == 16) return TiffSampleType::UInt16;
+    return TiffSampleType::Float;
+}
+
+bool WriteTiffImage(const float* data, int rowStride, int width, int height, int numChannels, const char* filename,
+                    int lossyQuality) {
+    auto path = std::filesystem::path((const char8_t*) filename);
+
+    OutBuffer encoded;
+    if (!EncodeTiff(data, rowStride, width, height, numChannels, TiffSampleTypeOf(lossyQuality), encoded,
+                    ThreadsPerImage())) {
+        std::cerr << "ERROR: tif encoding failed when writing file: " << path << std::endl;
         return false;
     }
+    return WriteEncodedFile(encoded, path);
+}
 
-    return fpng::fpng_encode_image_to_memory(data.data(), width, height, numChannels, outBuffer);
+bool WritePngImage(const float* data, int rowStride, int width, int height, int numChannels,
+                   const char* filename, bool sixteenBit) {
+    auto path = std::filesystem::path((const char8_t*) filename);
+
+    OutBuffer encoded;
+    if (!EncodePngToMemory(data, rowStride, width, height, numChannels, sixteenBit, encoded)) {
+        std::cerr << "ERROR: png encoding failed when writing file: " << path << std::endl;
+        return false;
+    }
+    return WriteEncodedFile(encoded, path);
 }
 
-int CachePfmImage(int* width, int* height, int* numChannels, const char* filename) {
-    std::ifstream in(std::filesystem::path((const char8_t*) filename), std::ios_base::binary);
-    if (!in) {
-        std::cerr << "ERROR: Could not read file: " << filename << std::endl;
-        return -1;
+/// Encodes a .jpg in memory with the given quality (1 to 100, 0 for the default of 90). Stripes of the
+/// image are encoded in parallel.
+bool EncodeJpegToMemory(const float* data, int rowStride, int width, int height, int numChannels,
+                        int quality, OutBuffer& out) {
+    std::vector<uint8_t> buffer((size_t) width * height * numChannels);
+    ConvertToSrgbByteImage(data, rowStride, buffer.data(), width, height, numChannels);
+    return EncodeJpeg(buffer.data(), width, height, numChannels, quality, out, ThreadsPerImage());
+}
+
+bool WriteHdrImage(const float* data, int rowStride, int width, int height, int numChannels,
+                   const char* filename) {
+    auto path = std::filesystem::path((const char8_t*) filename);
+
+    OutBuffer encoded;
+    if (!EncodeHdr(data, rowStride, width, height, numChannels, encoded, ThreadsPerImage())) {
+        std::cerr << "ERROR: hdr encoding failed when writing file: " << path << std::endl;
+        return false;
+    }
+    return WriteEncodedFile(encoded, path);
+}
+
+bool WriteJpegImage(const float* data, int rowStride, int width, int height, int numChannels,
+                    const char* filename, int quality) {
+    auto path = std::filesystem::path((const char8_t*) filename);
+
+    OutBuffer encoded;
+    if (!EncodeJpegToMemory(data, rowStride, width, height, numChannels, quality, encoded)) {
+        std::cerr << "ERROR: jpg encoding failed when writing file: " << path << std::endl;
+        return false;
     }
+    return WriteEncodedFile(encoded, path);
+}
 
+/// Parses the three header lines of a .pfm file, the stream is positioned at the start of the pixel data
+/// afterwards. Errors are reported to stderr.
+bool ReadPfmHeader(std::istream& in, const char* filename, int* width, int* height, int* numChannels,
+                   bool* fileIsBigEndian) {
     // Read the header (three lines of text)
     std::string typeStr;
     std::getline(in, typeStr);
@@ -664,57 +1883,170 @@ int CachePfmImage(int* width, int* height, int* numChannels, const char* filenam
         *numChannels = 3;
     } else {
         std::cerr << "ERROR: Could not read file: " << filename << ". Invalid type: " << typeStr << std::endl;
-        return -1;
+        return false;
     }
 
+    *width = *height = 0;
     std::istringstream str(resStr);
     str >> *width >> *height;
 
     if (*width <= 0 || *height <= 0) {
         std::cerr << "ERROR: Invalid image dimensions in file: " << filename << ". Width is "
                   << *width << ", and height is " << *height << std::endl;
-        return -1;
+        return false;
     }
 
-    // Check if there is a difference in the endianness of the file and the system
+    // The sign of the scale factor encodes the byte order
     str = std::istringstream(byteorderStr);
     float byteorder;
     str >> byteorder;
-    bool fileIsBigEndian = byteorder > 0;
-
-    // Read the file in reverse line order (our convention is top to bottom, pfm is bottom to top)
-    std::vector<float> buffer((*width) * (*height) * (*numChannels));
-    for (int row = (*height) - 1; row >= 0; --row) {
-        int offset = (*width) * (*numChannels) * row;
-        if (fileIsBigEndian && !systemIsBigEndian) {
-            // Read individual floats and reverse byte order
-            for (int i = 0; i < (*width) * (*numChannels); ++i) {
-                char fltbuf[4];
-                in.read(fltbuf, 4);
-                char fltswap[4];
-                fltswap[3] = fltbuf[0];
-                fltswap[2] = fltbuf[1];
-                fltswap[1] = fltbuf[2];
-                fltswap[0] = fltbuf[3];
-                buffer[offset + i] = *((float*)fltswap);
-            }
-        } else {
-            in.read((char*)(buffer.data() + offset), (*width) * (*numChannels) * 4);
-        }
+    *fileIsBigEndian = byteorder > 0;
+    return true;
+}
+
+/// Parses the header of a .pfm file in memory and points pfm.pixels at the pixel data. Errors are
+/// reported to stderr.
+bool ParsePfm(const uint8_t* data, size_t size, const char* filename, PfmFile& pfm) {
+    // The header consists of three short lines of text
+    std::istringstream in(std::string((const char*) data, std::min<size_t>(size, 1024)));
+    if (!ReadPfmHeader(in, filename, &pfm.width, &pfm.height, &pfm.numChannels, &pfm.bigEndian))
+        return false;
+
+    std::streamoff headerLen = in.tellg();
+    size_t dataLen = (size_t) pfm.width * pfm.height * pfm.numChannels * 4;
+    if (headerLen < 0 || size - (size_t) headerLen < dataLen) {
+        std::cerr << "ERROR: Could not read pixel data from file: " << filename << std::endl;
+        return false;
     }
+    pfm.pixels = data + headerLen;
+    return true;
+}
 
-    cacheMutex.lock();
-    const int idx = nextIndex;
-    pfmImages.emplace(idx, std::move(PfmImageData{std::move(buffer)}));
-    nextIndex++;
-    cacheMutex.unlock();
+/// Maps a .pfm file and parses its header. Errors are reported to stderr.
+bool OpenPfm(const char* filename, PfmFile& pfm) {
+    pfm.file = std::make_unique<MappedFile>(filename);
+    if (!pfm.file->IsOpen()) {
+        std::cerr << "ERROR: Could not read file: " << filename << std::endl;
+        return false;
+    }
+    return ParsePfm(pfm.file->Data(), pfm.file->Size(), filename, pfm);
+}
 
-    return idx;
+bool ProbePfmImage(const char* filename, ImageInfo* info, const InMemoryFile* memory = nullptr) {
+    if (memory) {
+        PfmFile pfm;
+        if (!ParsePfm(memory->data, memory->size, filename, pfm))
+            return false;
+        info->width = pfm.width;
+        info->height = pfm.height;
+        info->numChannels = pfm.numChannels;
+        info->pixelType = (int) PixelType::Float;
+        info->numLayers = 0;
+        return true;
+    }
+
+    std::ifstream in(std::filesystem::path((const char8_t*) filename), std::ios_base::binary);
+    if (!in) {
+        std::cerr << "ERROR: Could not read file: " << filename << std::endl;
+        return false;
+    }
+
+    bool fileIsBigEndian;
+    if (!ReadPfmHeader(in, filename, &info->width, &info->height, &info->numChannels, &fileIsBigEndian))
+        return false;
+    info->pixelType = (int) PixelType::Float;
+    info->numLayers = 0;
+    return true;
+}
+
+/// Reverses the byte order of each 32 bit value in an array
+void SwapBytes32(uint32_t* values, size_t count) {
+    #pragma omp simd
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t v = values[i];
+        values[i] = (v >> 24) | ((v >> 8) & 0xFF00) | ((v << 8) & 0xFF0000) | (v << 24);
+    }
 }
 
-void WritePfmImage(const float* data, int rowStride, int width, int height, int numChannels, const char* filename) {
-    std::ofstream out(std::filesystem::path((const char8_t*) filename), std::ios_base::binary);
+/// Rows are only copied in parallel if there are enough of them to outweigh the cost of waking the threads
+constexpr size_t parallelCopyMinBytes = 1 << 20;
+
+/// Copies the pixels of a .pfm file that lie within a region. Row r of the region is written to
+/// dst + r * dstRowStride. The row order is flipped (our convention is top to bottom, pfm is bottom to top)
+/// and the bytes are swapped if the file does not use the byte order of the system.
+void ReadPfmPixels(const PfmFile& pfm, const ImageRect& crop, float* dst, size_t dstRowStride) {
+    const size_t rowLen = (size_t) crop.width * pfm.numChannels;
+    const bool swapBytes = pfm.bigEndian != systemIsBigEndian;
+    #pragma omp parallel for if (rowLen * crop.height * 4 >= parallelCopyMinBytes)
+    for (int row = crop.y; row < crop.y + crop.height; ++row) {
+        size_t fileOffset = ((size_t) (pfm.height - 1 - row) * pfm.width + crop.x) * pfm.numChannels * 4;
+        float* out = dst + dstRowStride * (row - crop.y);
+        std::memcpy(out, pfm.pixels + fileOffset, rowLen * 4);
+        if (swapBytes)
+            SwapBytes32((uint32_t*) out, rowLen);
+    }
+}
+
+/// Loads a .pfm image. If a region is given, only the rows overlapping it are read from the file and the
+/// cached image is cropped to the region. The dimensions of the cached image are returned.
+int CachePfmImage(int* width, int* height, int* numChannels, const char* filename,
+                  const ImageRect* region = nullptr) {
+    PfmFile pfm;
+    if (!OpenPfm(filename, pfm))
+        return -1;
+
+    const ImageRect full = { 0, 0, pfm.width, pfm.height };
+    const ImageRect crop = region ? region->Intersect(full) : full;
+    if (crop.IsEmpty()) {
+        std::cerr << "ERROR: The region does not overlap the image in file: " << filename << std::endl;
+        return -1;
+    }
+
+    const size_t rowLen = (size_t) crop.width * pfm.numChannels;
+    std::vector<float> buffer(rowLen * crop.height);
+    ReadPfmPixels(pfm, crop, buffer.data(), rowLen);
+
+    *width = crop.width;
+    *height = crop.height;
+    *numChannels = pfm.numChannels;
+    auto entry = std::make_shared<CachedImage>(PfmImageData { std::move(buffer) });
+    return imageCache.Insert(std::move(entry));
+}
+
+/// Caches a memory-mapped .pfm file whose pixels can be used in place, without any copy. This requires
+/// that the file uses the byte order of the system and that the pixel data is aligned to 4 bytes, which
+/// is always the case for files written by WritePfmImage(). Returns -1 otherwise, without an error
+/// message, so the caller can fall back to loading the file.
+int CachePfmView(int* width, int* height, int* numChannels, const float** data, const char* filename) {
+    PfmFile pfm;
+    if (!OpenPfm(filename, pfm))
+        return -1;
+    if (pfm.bigEndian != systemIsBigEndian || (uintptr_t) pfm.pixels % alignof(float) != 0)
+        return -1;
+
+    *width = pfm.width;
+    *height = pfm.height;
+    *numChannels = pfm.numChannels;
+    *data = (const float*) pfm.pixels;
+    return imageCache.Insert(std::make_shared<CachedImage>(std::move(pfm)));
+}
+
+/// Decodes a .pfm image straight into a (strided) buffer
+bool ReadPfmInto(const char* filename, float* dst, size_t dstRowStride, const InMemoryFile* memory = nullptr) {
+    PfmFile pfm;
+    if (memory ? !ParsePfm(memory->data, memory->size, filename, pfm) : !OpenPfm(filename, pfm))
+        return false;
+
+    if (dstRowStride < (size_t) pfm.width * pfm.numChannels) {
+        std::cerr << "ERROR: Row stride too small for image: " << filename << std::endl;
+        return false;
+    }
+
+    ReadPfmPixels(pfm, { 0, 0, pfm.width, pfm.height }, dst, dstRowStride);
+    return true;
+}
 
+bool WritePfmImage(const float* data, int rowStride, int width, int height, int numChannels, const char* filename) {
     std::ostringstream str;
     if (numChannels == 1)
         str << "Pf\n";
@@ -722,289 +2054,834 @@ void WritePfmImage(const float* data, int rowStride, int width, int height, int
         str << "PF\n";
     else {
         std::cerr << "ERROR: .pfm format does not support " << numChannels << " channel images" << std::endl;
-        return;
+        return false;
     }
     str << width << " " << height << "\n";
-    str << (systemIsBigEndian ? "1.0" : "-1.0") << "\n";
+
+    // The scale factor is padded with zeros such that the pixel data is aligned to 16 bytes. Other readers
+    // parse the same value, but we can use the floats in the mapped file directly (see CachePfmView)
+    std::string byteorder = systemIsBigEndian ? "1.0" : "-1.0";
+    size_t headerLen = str.str().size() + byteorder.size() + 1;
+    byteorder.append((16 - headerLen % 16) % 16, '0');
+    str << byteorder << "\n";
     auto header = str.str();
 
-    out << header;
+    const size_t rowBytes = (size_t) width * numChannels * 4;
+    MappedOutputFile file(filename, header.size() + rowBytes * height);
+    if (!file.IsOpen()) {
+        std::cerr << "ERROR: Could not write file: " << filename << std::endl;
+        return false;
+    }
+    std::memcpy(file.Data(), header.data(), header.size());
 
-    for (int row = height - 1; row >= 0; --row) {
-        int offset = width * numChannels * row;
-        out.write((const char*)(data + offset), width * numChannels * 4);
+    // Rows are stored from bottom to top
+    uint8_t* pixels = file.Data() + header.size();
+    #pragma omp parallel for if (rowBytes * height >= parallelCopyMinBytes)
+    for (int row = 0; row < height; ++row)
+        std::memcpy(pixels + rowBytes * (height - 1 - row), data + (size_t) rowStride * row, rowBytes);
+    return true;
+}
+
+/// Encodes a .qoi in memory, blocks of rows are compressed in parallel
+bool EncodeQoiToMemory(const float* data, int rowStride, int width, int height, int numChannels,
+                       OutBuffer& out) {
+    std::vector<uint8_t> buffer((size_t) width * height * numChannels);
+    ConvertToSrgbPixels(data, rowStride, buffer.data(), width, height, numChannels);
+    return EncodeQoi(buffer.data(), width, height, numChannels, out, ThreadsPerImage());
+}
+
+bool WriteQoiImage(const float* data, int rowStride, int width, int height, int numChannels,
+                   const char* filename) {
+    auto path = std::filesystem::path((const char8_t*) filename);
+
+    OutBuffer encoded;
+    if (!EncodeQoiToMemory(data, rowStride, width, height, numChannels, encoded)) {
+        std::cerr << "ERROR: qoi encoding failed when writing file: " << path << std::endl;
+        return false;
     }
+    return WriteEncodedFile(encoded, path);
 }
 
-extern "C" {
+/// Converts the pixels of a binary .pgm, .ppm, or .pam file to sRGB (alpha stays linear), row by row in
+/// parallel. 16 bit samples are stored big-endian.
+void ConvertToPnmPixels(const float* data, int rowStride, int width, int height, int numChannels,
+                        bool sixteenBit, uint8_t* pixels) {
+    const size_t rowLen = (size_t) width * numChannels;
+    if (!sixteenBit) {
+        ConvertToSrgbPixels(data, rowStride, pixels, width, height, numChannels);
+        return;
+    }
 
-SIIO_API void WriteLayeredExr(const float** datas, int* strides, int width, int height, const int* numChannels,
-                              int numLayers, const char** names, const char* filename, bool writeHalf) {
-    WriteImageToExr(datas, strides, width, height, numChannels, numLayers, names, filename, nullptr, nullptr, writeHalf);
+    #pragma omp parallel
+    {
+        std::vector<uint16_t> samples(rowLen);
+        #pragma omp for
+        for (int row = 0; row < height; ++row) {
+            LinearToSrgbRow(data + (size_t) row * rowStride, samples.data(), width, numChannels);
+            uint8_t* out = pixels + row * rowLen * 2;
+            for (size_t i = 0; i < rowLen; ++i) {
+                out[2 * i] = uint8_t(samples[i] >> 8);
+                out[2 * i + 1] = uint8_t(samples[i]);
+            }
+        }
+    }
 }
 
-SIIO_API void WriteImage(const float* data, int rowStride, int width, int height, int numChannels,
-                         const char* filename, int lossyQuality) {
+/// Encodes a binary .pgm, .ppm, or .pam in memory, depending on the number of channels
+bool EncodePnmToMemory(const float* data, int rowStride, int width, int height, int numChannels,
+                       bool sixteenBit, OutBuffer& out) {
+    if (numChannels < 1 || numChannels > 4) {
+        std::cerr << "ERROR: .ppm format does not support " << numChannels << " channel images" << std::endl;
+        return false;
+    }
+    WritePnmHeader(width, height, numChannels, sixteenBit ? 65535 : 255, out);
+    const size_t offset = out.size();
+    out.resize(offset + (size_t) width * height * numChannels * (sixteenBit ? 2 : 1));
+    ConvertToPnmPixels(data, rowStride, width, height, numChannels, sixteenBit, out.data() + offset);
+    return true;
+}
+
+/// Writes a binary .pgm, .ppm, or .pam file. The pixels are converted straight into the mapped file.
+bool WritePnmImage(const float* data, int rowStride, int width, int height, int numChannels,
+                   const char* filename, bool sixteenBit) {
+    if (numChannels < 1 || numChannels > 4) {
+        std::cerr << "ERROR: .ppm format does not support " << numChannels << " channel images" << std::endl;
+        return false;
+    }
+    std::vector<uint8_t> header;
+    WritePnmHeader(width, height, numChannels, sixteenBit ? 65535 : 255, header);
+
+    MappedOutputFile file(filename, header.size() + (size_t) width * height * numChannels * (sixteenBit ? 2 : 1));
+    if (!file.IsOpen()) {
+        std::cerr << "ERROR: Could not write file: " << filename << std::endl;
+        return false;
+    }
+    std::memcpy(file.Data(), header.data(), header.size());
+    ConvertToPnmPixels(data, rowStride, width, height, numChannels, sixteenBit, file.Data() + header.size());
+    return true;
+}
+
+std::string ExrChannelNameOf(int id, const char* layerName, int channelIdx) {
+    auto img = FindCached<ExrImageData>(id);
+    if (!img) return "";
+    auto iter = img->channelsPerLayer.find(layerName);
+    return iter == img->channelsPerLayer.end() ? "" : iter->second.NameOf(channelIdx);
+}
+
+/// Shared implementation of CacheImage and CacheImageRegion, region is null if the full image is loaded
+int CacheImageOrRegion(int* width, int* height, int* numChannels, const char* filename, const ImageRect* region) {
     auto fname = std::string(filename);
     if (fname.compare(fname.size() - 4, 4, ".exr") == 0) {
-        // This is an .exr image, write it with tinyexr
-        WriteImageToExr(&data, &rowStride, width, height, &numChannels, 1, nullptr, filename, nullptr, nullptr, lossyQuality == 0);
+        // This is an .exr image, load it with tinyexr
+        // Loading this as a non-layered image only needs the layer without any name
+        const char* defaultLayer = "";
+        int idx = CacheExrImage(filename, &defaultLayer, 1, region);
+        if (idx < 0) return idx;
+
+        auto img = FindCached<ExrImageData>(idx);
+        *width = img->width;
+        *height = img->height;
+        auto iter = img->channelsPerLayer.find("");
+        if (iter != img->channelsPerLayer.end()) {
+            *numChannels = iter->second.CountChannels();
+        } else {
+            // If "" does not exist, loading as an image will fail
+            *numChannels = 0;
+        }
+
+        return idx;
+    } else if (fname.compare(fname.size() - 4, 4, ".pfm") == 0) {
+        return CachePfmImage(width, height, numChannels, filename, region);
+    } else if (fname.compare(fname.size() - 4, 4, ".tif") == 0
+            || fname.compare(fname.size() - 5, 5, ".tiff") == 0) {
+        return CacheTiffImage(width, height, numChannels, filename, region);
+    } else {
+        // This is some other format, assume that stb_image can handle it
+        return CacheStbImage(width, height, numChannels, filename, region);
+    }
+}
+
+/// Reads the metadata of an image file, the format is determined by the extension. The layer names are
+/// only listed for .exr files.
+bool ProbeImageFile(const char* filename, ImageInfo* info, std::vector<std::string>* layerNames,
+                    const InMemoryFile* memory = nullptr) {
+    auto fname = std::string(filename);
+    if (fname.compare(fname.size() - 4, 4, ".exr") == 0) {
+        return ProbeExrImage(filename, info, layerNames, memory);
     } else if (fname.compare(fname.size() - 4, 4, ".pfm") == 0) {
-        WritePfmImage(data, rowStride, width, height, numChannels, filename);
+        return ProbePfmImage(filename, info, memory);
     } else if (fname.compare(fname.size() - 4, 4, ".tif") == 0
             || fname.compare(fname.size() - 5, 5, ".tiff") == 0) {
-        WriteTiffImage(data, rowStride, width, height, numChannels, filename);
+        return memory ? ProbeTiff(memory->data, memory->size, filename, info) : ProbeTiff(filename, info);
+    } else if (fname.compare(fname.size() - 4, 4, ".qoi") == 0) {
+        return ProbeQoiImage(filename, info, memory);
+    } else if (HasPnmExtension(fname)) {
+        return ProbePnmImage(filename, info, memory);
+    } else {
+        // This is some other format, assume that stb_image can handle it
+        return ProbeStbImage(filename, info, memory);
+    }
+}
+
+/// Decodes an image file straight into a (strided) buffer, the format is determined by the extension
+bool ReadImageFile(const char* filename, float* dst, int dstRowStride, const InMemoryFile* memory = nullptr) {
+    auto fname = std::string(filename);
+    if (fname.compare(fname.size() - 4, 4, ".exr") == 0) {
+        return ReadExrInto(filename, dst, dstRowStride, memory);
+    } else if (fname.compare(fname.size() - 4, 4, ".pfm") == 0) {
+        return ReadPfmInto(filename, dst, dstRowStride, memory);
+    } else if (fname.compare(fname.size() - 4, 4, ".tif") == 0
+            || fname.compare(fname.size() - 5, 5, ".tiff") == 0) {
+        return ReadTiffInto(filename, dst, dstRowStride, memory);
     } else if (fname.compare(fname.size() - 4, 4, ".png") == 0) {
-        WritePngWithFpng(data, rowStride, width, height, numChannels, filename);
+        return ReadPngInto(filename, dst, dstRowStride, memory);
+    } else if (fname.compare(fname.size() - 4, 4, ".hdr") == 0) {
+        return ReadHdrInto(filename, dst, dstRowStride, memory);
+    } else if (fname.compare(fname.size() - 4, 4, ".qoi") == 0) {
+        return ReadQoiInto(filename, dst, dstRowStride, memory);
+    } else if (HasPnmExtension(fname)) {
+        return ReadPnmInto(filename, dst, dstRowStride, memory);
     } else {
         // This is some other format, assume that stb_image can handle it
-        WriteImageWithStbImage(data, rowStride, width, height, numChannels, filename, lossyQuality);
+        return ReadStbImageInto(filename, dst, dstRowStride, memory);
+    }
+}
+
+/// Probes an image file and decodes it into a new buffer that is kept in the cache. This is the same
+/// (faster) path as ReadImageInto, without the intermediate copies that CacheImage makes for some formats.
+int CacheDecodedImage(int* width, int* height, int* numChannels, const char* filename,
+                      const InMemoryFile* memory = nullptr) {
+    ImageInfo info;
+    if (!ProbeImageFile(filename, &info, nullptr, memory)) return -1;
+    size_t numValues = (size_t) info.width * info.height * info.numChannels;
+    float* data = (float*) malloc(std::max(numValues, (size_t) 1) * sizeof(float));
+    if (numValues > 0 && !ReadImageFile(filename, data, info.width * info.numChannels, memory)) {
+        free(data);
+        return -1;
+    }
+
+    *width = info.width;
+    *height = info.height;
+    *numChannels = info.numChannels;
+    return imageCache.Insert(std::make_shared<CachedImage>(
+        std::in_place_type<StbImageData>, data, info.width, info.height, info.numChannels));
+}
+
+/// Determines the format of an image file in memory from the magic number at its start. Returns the
+/// matching file extension, or an empty string if the format is none of those that we decode ourselves.
+/// These are left to stb_image, which identifies them by itself.
+std::string SniffImageFormat(const uint8_t* data, size_t size) {
+    auto startsWith = [&](const char* magic, size_t len) {
+        return size >= len && std::memcmp(data, magic, len) == 0;
+    };
+    if (startsWith("\x76\x2f\x31\x01", 4))
+        return ".exr";
+    if (startsWith("II*\0", 4) || startsWith("MM\0*", 4))
+        return ".tif";
+    if ((startsWith("PF", 2) || startsWith("Pf", 2)) && size > 2 && std::isspace(data[2]))
+        return ".pfm";
+    if (startsWith("#?RADIANCE", 10) || startsWith("#?RGBE", 6))
+        return ".hdr";
+    if (startsWith("qoif", 4))
+        return ".qoi";
+    if ((startsWith("P5", 2) || startsWith("P6", 2) || startsWith("P7", 2)) && size > 2 && std::isspace(data[2]))
+        return ".pnm";
+    return "";
+}
+
+/// Copies a list of names into a newly allocated array of C strings, freed by DeleteExrLayerNames
+char** NewNameArray(const std::vector<std::string>& names) {
+    char** result = new char*[names.size()];
+    for (size_t i = 0; i < names.size(); ++i) {
+        result[i] = new char[names[i].size() + 1];
+        std::copy(names[i].begin(), names[i].end(), result[i]);
+        result[i][names[i].size()] = 0;
     }
+    return result;
 }
 
+/// Appends the data written by stb_image_write to an OutBuffer
 void StbWriteFunc(void* context, void* data, int size) {
-    OutBuffer* outBuffer = (OutBuffer*)context;
-    size_t oldCount = outBuffer->size();
-    outBuffer->resize(oldCount + size);
-    const unsigned char* d = (unsigned char*) data;
-    std::copy(d, d + size, outBuffer->begin() + oldCount);
+    OutBuffer* outBuffer = (OutBuffer*) context;
+    const unsigned char* d = (const unsigned char*) data;
+    outBuffer->insert(outBuffer->end(), d, d + size);
 }
 
-SIIO_API unsigned char* WriteToMemory(const float* data, int rowStride, int width, int height,
-                                      int numChannels, const char* extension, int lossyQuality,
-                                      int* numBytes) {
+/// Encodes an image in the format given by the file extension (e.g., ".exr") and writes the file contents
+/// to a buffer. Returns false on error, or if the format cannot be written to memory.
+bool EncodeToMemory(const float* data, int rowStride, int width, int height, int numChannels,
+                    const char* extension, int lossyQuality, int exrCompression, OutBuffer& outBuffer) {
     if (!strncmp(extension, ".exr", 4)) {
-        unsigned char* result;
-        size_t num;
-        WriteImageToExr(&data, &rowStride, width, height, &numChannels, 1, nullptr, nullptr, &result, &num, lossyQuality == 0);
-        *numBytes = (int) num;
-
-        cacheMutex.lock();
-        allocedMemory.insert(result);
-        cacheMutex.unlock();
-        return result;
+        return WriteImageToExr(&data, &rowStride, width, height, &numChannels, 1, nullptr, nullptr, &outBuffer,
+                               lossyQuality == 0, exrCompression);
     }
 
-    // write hdr via stb_image_write
-    OutBuffer outBuffer;
-    if (!strncmp(extension, ".hdr", 4)) {
-        stbi_write_hdr_to_func(StbWriteFunc, &outBuffer, width, height, numChannels, data);
+    if (!strncmp(extension, ".hdr", 4))
+        return EncodeHdr(data, rowStride, width, height, numChannels, outBuffer, ThreadsPerImage());
 
-        unsigned char* result = new unsigned char[outBuffer.size()];
-        std::copy(outBuffer.begin(), outBuffer.end(), result);
-        *numBytes = (int)outBuffer.size();
-        return result;
+    if (!strncmp(extension, ".png", 4))
+        return EncodePngToMemory(data, rowStride, width, height, numChannels, lossyQuality == 16, outBuffer);
+
+    if (!strncmp(extension, ".jpg", 4) || !strncmp(extension, ".jpeg", 5))
+        return EncodeJpegToMemory(data, rowStride, width, height, numChannels, lossyQuality, outBuffer);
+
+    if (!strncmp(extension, ".tif", 4)) {
+        return EncodeTiff(data, rowStride, width, height, numChannels, TiffSampleTypeOf(lossyQuality), outBuffer,
+                          ThreadsPerImage());
     }
 
+    if (!strncmp(extension, ".qoi", 4))
+        return EncodeQoiToMemory(data, rowStride, width, height, numChannels, outBuffer);
+
+    if (HasPnmExtension(extension))
+        return EncodePnmToMemory(data, rowStride, width, height, numChannels, lossyQuality == 16, outBuffer);
+
     // LDR formats handled by stb_image_write need a buffer of byte values
-    std::vector<uint8_t> buffer(width * height * numChannels);
+    const size_t numPixels = (size_t) width * height;
+    std::vector<uint8_t> buffer(numPixels * numChannels);
     ConvertToSrgbByteImage(data, rowStride, buffer.data(), width, height, numChannels);
 
-    // Try to write the .png with fpng. If it fails, we fall back to stb_image below
-    if (!strncmp(extension, ".png", 4)) {
-        if (!WritePngWithFpngToMemory(buffer, rowStride, width, height, numChannels, outBuffer))
-            stbi_write_png_to_func(StbWriteFunc, &outBuffer, width, height, numChannels, buffer.data(), width * numChannels);
-    }
-
-    if (!strncmp(extension, ".jpg", 4)) {
-        stbi_write_jpg_to_func(StbWriteFunc, &outBuffer, width, height, numChannels, buffer.data(), lossyQuality);
-    } else if (!strncmp(extension, ".bmp", 4)) {
-        stbi_write_bmp_to_func(StbWriteFunc, &outBuffer, width, height, numChannels, buffer.data());
+    // The stb_image_write encoders append in small pieces. Reserving the uncompressed size up front (plus
+    // some room for the header) means that the buffer hardly ever needs to be reallocated and copied.
+    if (!strncmp(extension, ".bmp", 4)) {
+        outBuffer.reserve(numPixels * 4 + 1024);
+        return stbi_write_bmp_to_func(StbWriteFunc, &outBuffer, width, height, numChannels, buffer.data());
     } else if (!strncmp(extension, ".tga", 4)) {
-        stbi_write_tga_to_func(StbWriteFunc, &outBuffer, width, height, numChannels, buffer.data());
-    } else if (outBuffer.empty()) {
-        // Writing TIFF to memory is not supported by tiny_dng_writer. Writing .pfm to memory
-        // is not implemented as it doesn't make much sense, being a pure binary dump.
-        std::cout << "Writing " << extension << " to memory is not supported" << std::endl;
-        return nullptr;
+        outBuffer.reserve(buffer.size() + 1024);
+        return stbi_write_tga_to_func(StbWriteFunc, &outBuffer, width, height, numChannels, buffer.data());
     }
 
-    unsigned char* result = new unsigned char[outBuffer.size()];
-    std::copy(outBuffer.begin(), outBuffer.end(), result);
-    *numBytes = (int)outBuffer.size();
-    return result;
+    // Writing .pfm to memory is not implemented as it doesn't make much sense, being a pure binary dump.
+    std::cout << "Writing " << extension << " to memory is not supported" << std::endl;
+    return false;
 }
 
-SIIO_API void FreeMemory(unsigned char* mem) {
-    cacheMutex.lock();
-    if (allocedMemory.find(mem) != allocedMemory.end()) {
-        free(mem);
-        allocedMemory.erase(mem);
-    } else {
-        delete[] mem;
+/// Converts a row of pixels to one of the raw payloads of the flip book viewer
+typedef void (*PayloadRowFunc)(const float* src, uint8_t* dst, int width, int numChannels);
+
+/// Row conversion and bytes per pixel of a raw payload format ("rgbe", "half", or "float"), or nullptr if
+/// the format is not one of them
+PayloadRowFunc GetPayloadFormat(const char* format, int numChannels, int& bytesPerPixel) {
+    if (!strcmp(format, "rgbe")) {
+        bytesPerPixel = 4;
+        return [](const float* src, uint8_t* dst, int width, int numChannels) {
+            LinearToRgbeRow(src, dst, width, numChannels);
+        };
+    } else if (!strcmp(format, "half")) {
+        bytesPerPixel = 2 * numChannels;
+        return [](const float* src, uint8_t* dst, int width, int numChannels) {
+            FloatToHalfRow(src, (uint16_t*) dst, (size_t) width * numChannels);
+        };
+    } else if (!strcmp(format, "float")) {
+        bytesPerPixel = 4 * numChannels;
+        return [](const float* src, uint8_t* dst, int width, int numChannels) {
+            std::memcpy(dst, src, (size_t) width * numChannels * sizeof(float));
+        };
     }
-    cacheMutex.unlock();
+    return nullptr;
 }
 
-SIIO_API int CacheImage(int* width, int* height, int* numChannels, const char* filename) {
-    auto fname = std::string(filename);
-    if (fname.compare(fname.size() - 4, 4, ".exr") == 0) {
-        // This is an .exr image, load it with tinyexr
-        int idx = CacheExrImage(filename);
-        if (idx < 0) return idx;
+/// Media type of a data URI with an encoded file. Formats without a registered type use the common
+/// unofficial one, or the generic binary type.
+const char* MediaType(const char* format) {
+    if (!strcmp(format, ".png")) return "image/png";
+    if (!strcmp(format, ".jpg") || !strcmp(format, ".jpeg")) return "image/jpeg";
+    if (!strcmp(format, ".bmp")) return "image/bmp";
+    if (!strcmp(format, ".tif") || !strcmp(format, ".tiff")) return "image/tiff";
+    if (!strcmp(format, ".qoi")) return "image/qoi";
+    if (!strcmp(format, ".tga")) return "image/x-tga";
+    if (!strcmp(format, ".exr")) return "image/x-exr";
+    if (!strcmp(format, ".hdr")) return "image/vnd.radiance";
+    if (!strcmp(format, ".ppm")) return "image/x-portable-pixmap";
+    if (!strcmp(format, ".pgm")) return "image/x-portable-graymap";
+    return "application/octet-stream";
+}
 
-        cacheMutex.lock();
-        auto& img = exrImages[idx];
-        *width = img.image.width;
-        *height = img.image.height;
-        auto iter = img.channelsPerLayer.find("");
-        if (iter != img.channelsPerLayer.end()) {
-            // Loading this as a non-layered image will return the layer without any name, if it exists
-            auto& defLayout = img.channelsPerLayer[""];
-            *numChannels = defLayout.CountChannels();
-        } else {
-            // If "" does not exist, loading as an image will fail
-            *numChannels = 0;
+/// Encodes an image as base64 text, optionally as a data URI ("data:image/png;base64,..."). The format is
+/// either a file extension supported by EncodeToMemory(), or one of the raw payloads "rgbe", "half", and
+/// "float" of the flip book viewer. Raw payloads are converted and base64-encoded in a single pass over
+/// blocks of rows, without an intermediate binary copy of the image.
+bool EncodeBase64ToMemory(const float* data, int rowStride, int width, int height, int numChannels,
+                          const char* format, int lossyQuality, int exrCompression, bool dataUri,
+                          OutBuffer& text) {
+    std::string prefix;
+    int bytesPerPixel = 0;
+    PayloadRowFunc payloadRow = GetPayloadFormat(format, numChannels, bytesPerPixel);
+    if (dataUri)
+        prefix = std::string("data:") + (payloadRow ? "" : MediaType(format)) + ";base64,";
+
+    if (!payloadRow) {
+        OutBuffer encoded;
+        if (!EncodeToMemory(data, rowStride, width, height, numChannels, format, lossyQuality, exrCompression,
+                            encoded))
+            return false;
+        text.resize(prefix.size() + Base64Length(encoded.size()));
+        std::memcpy(text.data(), prefix.data(), prefix.size());
+        Base64Encode(encoded.data(), encoded.size(), (char*) text.data() + prefix.size(), ThreadsPerImage());
+        return true;
+    }
+
+    // A multiple of three rows is a multiple of three bytes, so blocks do not share a base64 group
+    const size_t rowBytes = (size_t) width * bytesPerPixel;
+    const int rowsPerBlock = 3 * std::max(1, (1 << 16) / std::max(width, 1));
+    const int numBlocks = (height + rowsPerBlock - 1) / rowsPerBlock;
+    text.resize(prefix.size() + Base64Length(rowBytes * height));
+    std::memcpy(text.data(), prefix.data(), prefix.size());
+    char* out = (char*) text.data() + prefix.size();
+
+    std::atomic<int> nextBlock = 0;
+    IOThreadPool().RunParallel(std::min(ThreadsPerImage(), numBlocks), [&] {
+        std::vector<uint8_t> block(rowBytes * rowsPerBlock);
+        for (int i; (i = nextBlock++) < numBlocks; ) {
+            const int firstRow = i * rowsPerBlock, endRow = std::min(height, firstRow + rowsPerBlock);
+            for (int y = firstRow; y < endRow; ++y)
+                payloadRow(data + (size_t) y * rowStride, block.data() + (y - firstRow) * rowBytes, width,
+                           numChannels);
+            Base64Encode(block.data(), (endRow - firstRow) * rowBytes, out + firstRow * rowBytes / 3 * 4);
         }
-        cacheMutex.unlock();
+    });
+    return true;
+}
 
-        return idx;
+/// Writes an image to a file, the format is determined by the extension. Returns false on error.
+bool WriteImageFile(const float* data, int rowStride, int width, int height, int numChannels,
+                    const char* filename, int lossyQuality, int exrCompression) {
+    auto fname = std::string(filename);
+    if (fname.compare(fname.size() - 4, 4, ".exr") == 0) {
+        // This is an .exr image, write it with tinyexr
+        return WriteImageToExr(&data, &rowStride, width, height, &numChannels, 1, nullptr, filename, nullptr,
+                               lossyQuality == 0, exrCompression);
     } else if (fname.compare(fname.size() - 4, 4, ".pfm") == 0) {
-        return CachePfmImage(width, height, numChannels, filename);
+        return WritePfmImage(data, rowStride, width, height, numChannels, filename);
     } else if (fname.compare(fname.size() - 4, 4, ".tif") == 0
             || fname.compare(fname.size() - 5, 5, ".tiff") == 0) {
-        return CacheTiffImage(width, height, numChannels, filename);
+        return WriteTiffImage(data, rowStride, width, height, numChannels, filename, lossyQuality);
+    } else if (fname.compare(fname.size() - 4, 4, ".png") == 0) {
+        return WritePngImage(data, rowStride, width, height, numChannels, filename, lossyQuality == 16);
+    } else if (fname.compare(fname.size() - 4, 4, ".jpg") == 0
+            || fname.compare(fname.size() - 5, 5, ".jpeg") == 0) {
+        return WriteJpegImage(data, rowStride, width, height, numChannels, filename, lossyQuality);
+    } else if (fname.compare(fname.size() - 4, 4, ".hdr") == 0) {
+        return WriteHdrImage(data, rowStride, width, height, numChannels, filename);
+    } else if (fname.compare(fname.size() - 4, 4, ".qoi") == 0) {
+        return WriteQoiImage(data, rowStride, width, height, numChannels, filename);
+    } else if (HasPnmExtension(fname)) {
+        return WritePnmImage(data, rowStride, width, height, numChannels, filename, lossyQuality == 16);
     } else {
         // This is some other format, assume that stb_image can handle it
-        return CacheStbImage(width, height, numChannels, filename);
+        return WriteImageWithStbImage(data, rowStride, width, height, numChannels, filename, lossyQuality);
     }
 }
 
+/// Called once for every file of an asynchronous job when it is done, and once more with fileIndex = -1
+/// after all files are done. success is then true if all files were read or written successfully.
+typedef void (*IOJobCallback)(int job, int fileIndex, bool success, void* userData);
+
+/// Progress and results of an asynchronous batch of reads or writes, see SubmitRead() and SubmitWrite()
+struct IOJob {
+    struct FileResult {
+        int cacheId = -1;
+        int width = 0, height = 0, numChannels = 0;
+        bool success = false;
+        bool claimed = false;
+    };
+
+    std::vector<FileResult> results;
+    IOJobCallback callback = nullptr;
+    void* userData = nullptr;
+
+    std::atomic<int> numDone = 0;
+
+    /// Set (under the mutex) once the last callback has returned
+    bool complete = false;
+    std::mutex mutex;
+    std::condition_variable finished;
+};
+
+static std::mutex ioJobMutex;
+static std::unordered_map<int, std::shared_ptr<IOJob>> ioJobs;
+static int nextIOJobId = 0;
+
+std::shared_ptr<IOJob> FindIOJob(int id) {
+    std::lock_guard lock(ioJobMutex);
+    auto iter = ioJobs.find(id);
+    return iter == ioJobs.end() ? nullptr : iter->second;
+}
+
+/// Waits until all files of a job are done and all callbacks have returned. Must not be called from
+/// within a callback of the same job.
+void WaitForIOJob(IOJob& job) {
+    std::unique_lock lock(job.mutex);
+    job.finished.wait(lock, [&job] { return job.complete; });
+}
+
+/// Creates a job that runs work(job, i) for every file i on the I/O thread pool, and returns its id.
+/// The work function returns whether the file was processed successfully.
+int SubmitIOJob(int numFiles, IOJobCallback callback, void* userData,
+                std::function<bool(IOJob&, int)> work) {
+    if (numFiles <= 0) return -1;
+
+    auto job = std::make_shared<IOJob>();
+    job->results.resize(numFiles);
+    job->callback = callback;
+    job->userData = userData;
+
+    int id;
+    {
+        std::lock_guard lock(ioJobMutex);
+        id = nextIOJobId++;
+        ioJobs[id] = job;
+    }
+
+    // The files are processed concurrently. If there are fewer files than cores, each of them may use
+    // multiple threads for its OpenMP loops, so small batches also use all cores but large ones do not
+    // oversubscribe.
+    ThreadPool& pool = IOThreadPool();
+    int numCores = std::max((int) std::thread::hardware_concurrency(), 1);
+    int threadsPerFile = std::max(numCores / std::min(numFiles, pool.MaxActive()), 1);
+
+    auto sharedWork = std::make_shared<std::function<bool(IOJob&, int)>>(std::move(work));
+    for (int i = 0; i < numFiles; ++i) {
+        pool.Submit([id, job, sharedWork, i, threadsPerFile] {
+            // The thread limit is per worker thread, so it is restored for whatever the worker runs next
+#ifdef _OPENMP
+            int prevThreads = omp_get_max_threads();
+            omp_set_num_threads(threadsPerFile);
+#endif
+            bool success = false;
+            try {
+                success = (*sharedWork)(*job, i);
+            } catch (const std::exception& e) {
+                std::cerr << "ERROR in asynchronous I/O: " << e.what() << std::endl;
+            }
+#ifdef _OPENMP
+            omp_set_num_threads(prevThreads);
+#endif
+            job->results[i].success = success;
+
+            if (job->callback) job->callback(id, i, success, job->userData);
+            if (job->numDone.fetch_add(1) + 1 < (int) job->results.size()) return;
+
+            // This was the last file of the job
+            if (job->callback) {
+                bool allSucceeded = std::all_of(job->results.begin(), job->results.end(),
+                                                [] (auto& r) { return r.success; });
+                job->callback(id, -1, allSucceeded, job->userData);
+            }
+            {
+                std::lock_guard lock(job->mutex);
+                job->complete = true;
+            }
+            job->finished.notify_all();
+        });
+    }
+    return id;
+}
+
+extern "C" {
+
+SIIO_API void WriteLayeredExr(const float** datas, int* strides, int width, int height, const int* numChannels,
+                              int numLayers, const char** names, const char* filename, bool writeHalf,
+                              int exrCompression) {
+    WriteImageToExr(datas, strides, width, height, numChannels, numLayers, names, filename, nullptr, writeHalf,
+                    exrCompression);
+}
+
+/// Writes an image in the format given by the file name extension. The meaning of lossyQuality depends on
+/// the format, it also selects the sample type of some lossless formats:
+///   .jpg:                   compression quality between 1 and 100
+///   .exr:                   0 writes 16 bit half precision floats, other values 32 bit floats
+///   .png, .ppm, .pgm, .pam: 16 writes 16 bit per channel, other values 8 bit
+///   .tif:                   0 writes 16 bit half precision floats, 16 writes 16 bit integers, other values
+///                           32 bit floats
+/// Other formats ignore it. The same applies to WriteToMemory, WriteBase64ToMemory, and the files of
+/// SubmitWrite.
+SIIO_API void WriteImage(const float* data, int rowStride, int width, int height, int numChannels,
+                         const char* filename, int lossyQuality, int exrCompression) {
+    WriteImageFile(data, rowStride, width, height, numChannels, filename, lossyQuality, exrCompression);
+}
+
+SIIO_API OutBuffer* WriteToMemory(const float* data, int rowStride, int width, int height, int numChannels,
+                                  const char* extension, int lossyQuality, int exrCompression,
+                                  const unsigned char** bytes, int* numBytes) {
+    // The encoded file is handed over in the buffer that it was written to, there is no copy
+    auto buffer = std::make_unique<OutBuffer>();
+    if (!EncodeToMemory(data, rowStride, width, height, numChannels, extension, lossyQuality, exrCompression,
+                        *buffer))
+        return nullptr;
+    *bytes = buffer->data();
+    *numBytes = (int) buffer->size();
+    return buffer.release();
+}
+
+SIIO_API OutBuffer* WriteBase64ToMemory(const float* data, int rowStride, int width, int height,
+                                        int numChannels, const char* format, int lossyQuality,
+                                        int exrCompression, bool dataUri, const char** text, int* numChars) {
+    auto buffer = std::make_unique<OutBuffer>();
+    if (!EncodeBase64ToMemory(data, rowStride, width, height, numChannels, format, lossyQuality,
+                              exrCompression, dataUri, *buffer))
+        return nullptr;
+    *text = (const char*) buffer->data();
+    *numChars = (int) buffer->size();
+    return buffer.release();
+}
+
+SIIO_API void FreeMemory(OutBuffer* buffer) {
+    delete buffer;
+}
+
+SIIO_API int CacheImage(int* width, int* height, int* numChannels, const char* filename) {
+    return CacheImageOrRegion(width, height, numChannels, filename, nullptr);
+}
+
+SIIO_API int CacheImageFromMemory(int* width, int* height, int* numChannels, const uint8_t* data,
+                                  size_t numBytes, const char* formatHint) {
+    // The magic number takes precedence, so a wrong hint does not matter for the formats we recognize
+    std::string extension = SniffImageFormat(data, numBytes);
+    if (extension.empty() && formatHint) {
+        extension = formatHint;
+        std::transform(extension.begin(), extension.end(), extension.begin(),
+                       [](unsigned char c) { return (char) std::tolower(c); });
+        if (!extension.empty() && extension[0] != '.')
+            extension.insert(extension.begin(), '.');
+    }
+    std::string name = "<memory>" + extension;
+    InMemoryFile memory { data, numBytes };
+    return CacheDecodedImage(width, height, numChannels, name.c_str(), &memory);
+}
+
+SIIO_API int CacheImageRegion(int* width, int* height, int* numChannels, const char* filename,
+                              int x, int y, int regionWidth, int regionHeight) {
+    ImageRect region = { x, y, regionWidth, regionHeight };
+    return CacheImageOrRegion(width, height, numChannels, filename, &region);
+}
+
+SIIO_API int MapPfmImage(int* width, int* height, int* numChannels, const float** data, const char* filename) {
+    return CachePfmView(width, height, numChannels, data, filename);
+}
+
+SIIO_API int CacheExrLayers(int* width, int* height, const char* filename, const char** layerNames,
+                            int numLayers) {
+    int idx = CacheExrImage(filename, layerNames, numLayers);
+    if (idx < 0) return idx;
+
+    auto img = FindCached<ExrImageData>(idx);
+    *width = img->width;
+    *height = img->height;
+    return idx;
+}
+
+SIIO_API int OpenExrLayers(int* width, int* height, const char* filename, const char** layerNames,
+                           int numLayers) {
+    int idx = CacheExrHeader(filename, layerNames, numLayers);
+    if (idx < 0) return idx;
+
+    auto img = FindCached<ExrImageData>(idx);
+    *width = img->width;
+    *height = img->height;
+    return idx;
+}
+
+SIIO_API bool ReadExrLayersInto(int id, float** dsts, const int* rowStrides) {
+    auto img = FindCached<ExrImageData>(id);
+    if (!img) {
+        std::cerr << "ERROR: attempted to read non-existing image id " << id << std::endl;
+        return false;
+    }
+    return ReadCachedExrLayers(*img, dsts, rowStrides);
+}
+
 SIIO_API int GetExrLayerCount(int id) {
-    cacheMutex.lock();
-    int num = (int) exrImages[id].channelsPerLayer.size();
-    cacheMutex.unlock();
-    return num;
+    auto img = FindCached<ExrImageData>(id);
+    return img ? (int) img->channelsPerLayer.size() : 0;
 }
 
 SIIO_API int GetExrLayerChannelCount(int id, const char* name) {
-    cacheMutex.lock();
-    int num = exrImages[id].channelsPerLayer[name].CountChannels();
-    cacheMutex.unlock();
-    return num;
+    auto img = FindCached<ExrImageData>(id);
+    if (!img) return 0;
+    auto iter = img->channelsPerLayer.find(name);
+    return iter == img->channelsPerLayer.end() ? 0 : iter->second.CountChannels();
 }
 
 SIIO_API int GetExrLayerNameLen(int id, int layerIdx) {
-    cacheMutex.lock();
-    int len = (int) exrImages[id].layerNames[layerIdx].size();
-    cacheMutex.unlock();
-    return len;
+    auto img = FindCached<ExrImageData>(id);
+    if (!img) return 0;
+    if (layerIdx < 0 || layerIdx >= (int) img->layerNames.size()) return -1;
+    return (int) img->layerNames[layerIdx].size();
 }
 
-SIIO_API void GetExrLayerName(int id, int layerIdx, char* out) {
-    cacheMutex.lock();
-    strcpy(out, exrImages[id].layerNames[layerIdx].c_str());
-    cacheMutex.unlock();
+SIIO_API bool GetExrLayerName(int id, int layerIdx, char* out) {
+    auto img = FindCached<ExrImageData>(id);
+    if (!img || layerIdx < 0 || layerIdx >= (int) img->layerNames.size()) {
+        out[0] = 0;
+        return false;
+    }
+    strcpy(out, img->layerNames[layerIdx].c_str());
+    return true;
 }
 
 SIIO_API int GetExrChannelNameLen(int id, const char* layerName, int channelIdx) {
-    cacheMutex.lock();
-    const auto& chanName = exrImages[id].channelsPerLayer[layerName].NameOf(channelIdx);
-    cacheMutex.unlock();
-    return chanName.size();
+    return (int) ExrChannelNameOf(id, layerName, channelIdx).size();
 }
 
 SIIO_API void GetExrChannelName(int id, const char* layerName, int channelIdx, char* out) {
-    cacheMutex.lock();
-    const auto& chanName = exrImages[id].channelsPerLayer[layerName].NameOf(channelIdx);
-    strcpy(out, chanName.c_str());
-    cacheMutex.unlock();
+    strcpy(out, ExrChannelNameOf(id, layerName, channelIdx).c_str());
 }
 
 SIIO_API bool CopyCachedLayer(int id, const char* name, float* out) {
-    return CopyCachedExrLayer(id, name, out);
+    auto img = FindCached<ExrImageData>(id);
+    if (!img) {
+        std::cerr << "ERROR: attempted to copy non-existing image id " << id << std::endl;
+        return false;
+    }
+    return CopyCachedExrLayer(*img, name, out);
 }
 
 SIIO_API void DeleteCachedImage(int id) {
-    cacheMutex.lock();
-    if (exrImages.find(id) != exrImages.end()) {
-        cacheMutex.unlock();
-        DeleteCachedExr(id);
-    } else if (stbImages.find(id) != stbImages.end()) {
-        stbImages.erase(id);
-        cacheMutex.unlock();
-    } else if (tiffImages.find(id) != tiffImages.end()) {
-        tiffImages.erase(id);
-        cacheMutex.unlock();
-    } else {
-        cacheMutex.unlock();
+    if (!imageCache.Remove(id))
         std::cerr << "ERROR: attempted to delete non-existing image id " << id << std::endl;
-    }
 }
 
 SIIO_API void CopyCachedImage(int id, float* out) {
-    cacheMutex.lock();
-    if (exrImages.find(id) != exrImages.end()) {
-        cacheMutex.unlock();
-        CopyCachedExrLayer(id, "", out);
-        DeleteCachedExr(id);
-    } else if (stbImages.find(id) != stbImages.end()) {
-        cacheMutex.unlock();
-        CopyCachedStbImage(id, out);
-    } else if (pfmImages.find(id) != pfmImages.end()) {
-        std::copy(pfmImages[id].data.begin(), pfmImages[id].data.end(), out);
-        pfmImages.erase(id);
-        cacheMutex.unlock();
-    } else if (tiffImages.find(id) != tiffImages.end()) {
-        std::copy(tiffImages[id].data.begin(), tiffImages[id].data.end(), out);
-        tiffImages.erase(id);
-        cacheMutex.unlock();
-    } else {
-        cacheMutex.unlock();
+    auto entry = imageCache.Remove(id);
+    if (!entry) {
         std::cerr << "ERROR: attempted to copy non-existing image id " << id << std::endl;
+        return;
     }
+
+    if (auto exr = std::get_if<ExrImageData>(entry.get()))
+        CopyCachedExrLayer(*exr, "", out);
+    else if (auto stb = std::get_if<StbImageData>(entry.get()))
+        CopyCachedStbImage(*stb, out);
+    else if (auto pfm = std::get_if<PfmImageData>(entry.get()))
+        std::copy(pfm->data.begin(), pfm->data.end(), out);
+    else if (auto tiff = std::get_if<TiffImageData>(entry.get()))
+        std::copy(tiff->data.begin(), tiff->data.end(), out);
+    else if (auto pfm = std::get_if<PfmFile>(entry.get()))
+        ReadPfmPixels(*pfm, { 0, 0, pfm->width, pfm->height }, out, (size_t) pfm->width * pfm->numChannels);
+}
+
+
+SIIO_API bool ProbeImage(const char* filename, ImageInfo* info, char*** layerNames) {
+    std::vector<std::string> names;
+    bool success = ProbeImageFile(filename, info, &names);
+    if (layerNames)
+        *layerNames = success && !names.empty() ? NewNameArray(names) : nullptr;
+    return success;
 }
 
+SIIO_API bool ReadImageInto(const char* filename, float* dst, int dstRowStride) {
+    return ReadImageFile(filename, dst, dstRowStride);
+}
 
 SIIO_API int GetExrLayerNames(const char* filename, char*** names) {
-    EXRVersion exrVersion;
-    int ret = ParseEXRVersionFromFile(&exrVersion, filename);
-    if (ret != 0) {
-        std::cerr << "Error loading '" << filename << "': Invalid .exr file. " << std::endl;
+    ImageInfo info;
+    std::vector<std::string> layerNames;
+    if (!ProbeExrImage(filename, &info, &layerNames))
         return -1;
-    }
 
-    const char* err;
-    EXRHeader header;
-    InitEXRHeader(&header);
-    ret = ParseEXRHeaderFromFile(&header, &exrVersion, filename, &err);
-    if (ret) {
-        std::cerr << "Error loading '" << filename << "': " << err << std::endl;
-        FreeEXRErrorMessage(err);
-        return -1;
-    }
+    *names = NewNameArray(layerNames);
+    return (int) layerNames.size();
+}
 
-    // Read the number of channels in each layer
-    std::unordered_set<std::string> layerNames;
-    for (int chan = 0; chan < header.num_channels; ++chan) {
-        // Extract the layer name by assuming a channel name of the form "layername.R", "layername.B" and so on
-        size_t len = strlen(header.channels[chan].name);
-        std::string layerName;
-        if (len <= 2) layerName = "";
-        else if (header.channels[chan].name[len - 2] != '.') layerName = std::string(header.channels[chan].name, len);
-        else layerName = std::string(header.channels[chan].name, len - 2);
-        layerNames.insert(layerName);
+SIIO_API void DeleteExrLayerNames(int num, const char** names) {
+    for (int i = 0; i < num; ++i) {
+        delete[] names[i];
     }
+    delete[] names;
+}
 
-    FreeEXRHeader(&header);
+SIIO_API int SubmitRead(const char** filenames, int numFiles, IOJobCallback callback, void* userData) {
+    std::vector<std::string> names(filenames, filenames + std::max(numFiles, 0));
+    return SubmitIOJob(numFiles, callback, userData, [names = std::move(names)] (IOJob& job, int i) {
+        auto& r = job.results[i];
+        r.cacheId = CacheDecodedImage(&r.width, &r.height, &r.numChannels, names[i].c_str());
+        return r.cacheId >= 0;
+    });
+}
 
-    int num = (int)layerNames.size();
-    *names = new char*[num];
-    auto iter = layerNames.begin();
-    for (int i = 0; i < num; ++i) {
-        (*names)[i] = new char[iter->size() + 1];
-        std::copy(iter->begin(), iter->end(), (*names)[i]);
-        (*names)[i][iter->size()] = 0;
-        iter++;
+SIIO_API int SubmitWrite(const float** datas, const int* rowStrides, const int* widths, const int* heights,
+                         const int* numChannels, const char** filenames, const int* lossyQualities, int numFiles,
+                         int exrCompression, IOJobCallback callback, void* userData) {
+    struct WriteInput {
+        const float* data;
+        int rowStride, width, height, numChannels;
+        std::string filename;
+        int lossyQuality;
+    };
+    std::vector<WriteInput> inputs;
+    for (int i = 0; i < numFiles; ++i) {
+        inputs.push_back({ datas[i], rowStrides[i], widths[i], heights[i], numChannels[i], filenames[i],
+                           lossyQualities[i] });
     }
-    return num;
+
+    return SubmitIOJob(numFiles, callback, userData,
+        [inputs = std::move(inputs), exrCompression] (IOJob&, int i) {
+            auto& in = inputs[i];
+            return WriteImageFile(in.data, in.rowStride, in.width, in.height, in.numChannels,
+                                  in.filename.c_str(), in.lossyQuality, exrCompression);
+        });
 }
 
-SIIO_API void DeleteExrLayerNames(int num, const char** names) {
-    for (int i = 0; i < num; ++i) {
-        delete[] names[i];
+SIIO_API void SetIOThreadLimit(int numThreads) {
+    IOThreadPool().SetMaxActive(numThreads);
+}
+
+SIIO_API int PollJob(int job) {
+    auto j = FindIOJob(job);
+    return j ? j->numDone.load() : -1;
+}
+
+SIIO_API bool WaitJob(int job) {
+    auto j = FindIOJob(job);
+    if (!j) return false;
+    WaitForIOJob(*j);
+    return std::all_of(j->results.begin(), j->results.end(), [] (auto& r) { return r.success; });
+}
+
+SIIO_API bool GetJobFileSuccess(int job, int fileIndex) {
+    auto j = FindIOJob(job);
+    if (!j || fileIndex < 0 || fileIndex >= (int) j->results.size()) return false;
+    WaitForIOJob(*j);
+    return j->results[fileIndex].success;
+}
+
+SIIO_API bool GetReadResult(int job, int fileIndex, int* cacheId, int* width, int* height, int* numChannels) {
+    auto j = FindIOJob(job);
+    if (!j || fileIndex < 0 || fileIndex >= (int) j->results.size()) return false;
+    WaitForIOJob(*j);
+
+    std::lock_guard lock(j->mutex);
+    auto& r = j->results[fileIndex];
+    if (!r.success || r.claimed) return false;
+
+    // The cached image now belongs to the caller
+    r.claimed = true;
+    *cacheId = r.cacheId;
+    *width = r.width;
+    *height = r.height;
+    *numChannels = r.numChannels;
+    return true;
+}
+
+SIIO_API void DeleteJob(int job) {
+    std::shared_ptr<IOJob> j;
+    {
+        std::lock_guard lock(ioJobMutex);
+        auto iter = ioJobs.find(job);
+        if (iter == ioJobs.end()) {
+            std::cerr << "ERROR: attempted to delete non-existing job id " << job << std::endl;
+            return;
+        }
+        j = iter->second;
+        ioJobs.erase(iter);
     }
-    delete[] names;
+
+    // Images that were read but never retrieved by GetReadResult() are released with the job
+    WaitForIOJob(*j);
+    for (auto& r : j->results)
+        if (r.cacheId >= 0 && !r.claimed)
+            imageCache.Remove(r.cacheId);
 }
 
 } // extern "C"
@@ -0,0 +1,440 @@
+#include "jpeg.h"
+
+#include "image.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <iostream>
+
+namespace {
+
+const uint8_t zigZag[64] = {
+    0, 1, 5, 6, 14, 15, 27, 28, 2, 4, 7, 13, 16, 26, 29, 42, 3, 8, 12, 17, 25, 30, 41, 43, 9, 11, 18, 24, 31, 40,
+    44, 53, 10, 19, 23, 32, 39, 45, 52, 54, 20, 22, 33, 38, 46, 51, 55, 60, 21, 34, 37, 47, 50, 56, 59, 61, 35,
+    36, 48, 49, 57, 58, 62, 63
+};
+
+const int lumaQuantization[64] = {
+    16, 11, 10, 16, 24, 40, 51, 61, 12, 12, 14, 19, 26, 58, 60, 55, 14, 13, 16, 24, 40, 57, 69, 56, 14, 17, 22,
+    29, 51, 87, 80, 62, 18, 22, 37, 56, 68, 109, 103, 77, 24, 35, 55, 64, 81, 104, 113, 92, 49, 64, 78, 87, 103,
+    121, 120, 101, 72, 92, 95, 98, 112, 100, 103, 99
+};
+
+const int chromaQuantization[64] = {
+    17, 18, 24, 47, 99, 99, 99, 99, 18, 21, 26, 66, 99, 99, 99, 99, 24, 26, 56, 99, 99, 99, 99, 99, 47, 66, 99,
+    99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99, 99, 99
+};
+
+/// Scale factors of the AAN DCT (times sqrt(8)), the quantization divides them out
+const float dctScales[8] = {
+    1.0f * 2.828427125f, 1.387039845f * 2.828427125f, 1.306562965f * 2.828427125f, 1.175875602f * 2.828427125f,
+    1.0f * 2.828427125f, 0.785694958f * 2.828427125f, 0.541196100f * 2.828427125f, 0.275899379f * 2.828427125f
+};
+
+// The standard Huffman tables from the JPEG specification (K.3): the number of codes of each length from
+// 1 to 16, followed by the symbols in order of their codes
+const uint8_t lumaDcCounts[16] = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+const uint8_t lumaDcSymbols[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+const uint8_t chromaDcCounts[16] = { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+const uint8_t chromaDcSymbols[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+const uint8_t lumaAcCounts[16] = { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+const uint8_t lumaAcSymbols[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07, 0x22, 0x71,
+    0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0, 0x24, 0x33, 0x62, 0x72,
+    0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x34, 0x35, 0x36, 0x37,
+    0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
+    0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83,
+    0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3,
+    0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa
+};
+const uint8_t chromaAcCounts[16] = { 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
+const uint8_t chromaAcSymbols[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71, 0x13, 0x22,
+    0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0, 0x15, 0x62, 0x72, 0xd1,
+    0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x35, 0x36,
+    0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58,
+    0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a,
+    0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a,
+    0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba,
+    0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa
+};
+
+/// Stripes of MCU rows are encoded independently, each with at least this many pixels. The layout does not
+/// depend on the number of threads, so neither does the file.
+constexpr int stripeTargetPixels = 1 << 16;
+
+/// Code and length of every symbol of a Huffman table
+struct HuffmanCodes {
+    uint16_t code[256] = {};
+    uint8_t length[256] = {};
+
+    /// Assigns the canonical codes of the specification (Annex C) in order of increasing length
+    HuffmanCodes(const uint8_t* counts, const uint8_t* symbols) {
+        int code = 0, k = 0;
+        for (int len = 1; len <= 16; ++len, code <<= 1) {
+            for (int i = 0; i < counts[len - 1]; ++i, ++code, ++k) {
+                this->code[symbols[k]] = (uint16_t) code;
+                length[symbols[k]] = (uint8_t) len;
+            }
+        }
+    }
+};
+
+const HuffmanCodes lumaDcCodes(lumaDcCounts, lumaDcSymbols);
+const HuffmanCodes lumaAcCodes(lumaAcCounts, lumaAcSymbols);
+const HuffmanCodes chromaDcCodes(chromaDcCounts, chromaDcSymbols);
+const HuffmanCodes chromaAcCodes(chromaAcCounts, chromaAcSymbols);
+
+/// Writes entropy coded data most significant bit first. A 0xFF byte is followed by a zero byte, so it
+/// cannot be mistaken for a marker.
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<uint8_t>& out) : out(out) { }
+
+    void Write(uint32_t bits, int length) {
+        count += length;
+        buffer |= bits << (24 - count);
+        while (count >= 8) {
+            uint8_t c = uint8_t(buffer >> 16);
+            out.push_back(c);
+            if (c == 0xFF) out.push_back(0);
+            buffer <<= 8;
+            count -= 8;
+        }
+    }
+
+    void Write(const HuffmanCodes& codes, int symbol) { Write(codes.code[symbol], codes.length[symbol]); }
+
+    /// Pads the last byte with one bits
+    void Flush() { Write(0x7F, 7); }
+
+private:
+    std::vector<uint8_t>& out;
+    uint32_t buffer = 0;
+    int count = 0;
+};
+
+/// One dimensional AAN DCT of eight values with the given stride, the same operations as stb_image_write
+/// (and thus the same results) for floats, or four transforms at once for SIMD vectors
+template<typename T>
+void Dct8(T* d, int stride) {
+    T d0 = d[0], d1 = d[stride], d2 = d[2 * stride], d3 = d[3 * stride];
+    T d4 = d[4 * stride], d5 = d[5 * stride], d6 = d[6 * stride], d7 = d[7 * stride];
+
+    T tmp0 = d0 + d7, tmp7 = d0 - d7;
+    T tmp1 = d1 + d6, tmp6 = d1 - d6;
+    T tmp2 = d2 + d5, tmp5 = d2 - d5;
+    T tmp3 = d3 + d4, tmp4 = d3 - d4;
+
+    // Even part
+    T tmp10 = tmp0 + tmp3, tmp13 = tmp0 - tmp3;
+    T tmp11 = tmp1 + tmp2, tmp12 = tmp1 - tmp2;
+    d[0] = tmp10 + tmp11;
+    d[4 * stride] = tmp10 - tmp11;
+    T z1 = (tmp12 + tmp13) * 0.707106781f;
+    d[2 * stride] = tmp13 + z1;
+    d[6 * stride] = tmp13 - z1;
+
+    // Odd part
+    tmp10 = tmp4 + tmp5;
+    tmp11 = tmp5 + tmp6;
+    tmp12 = tmp6 + tmp7;
+    T z5 = (tmp10 - tmp12) * 0.382683433f;
+    T z2 = tmp10 * 0.541196100f + z5;
+    T z4 = tmp12 * 1.306562965f + z5;
+    T z3 = tmp11 * 0.707106781f;
+    T z11 = tmp7 + z3, z13 = tmp7 - z3;
+    d[5 * stride] = z13 + z2;
+    d[3 * stride] = z13 - z2;
+    d[1 * stride] = z11 + z4;
+    d[7 * stride] = z11 - z4;
+}
+
+#ifdef SIIO_SSE2
+/// Four floats with the arithmetic operators that Dct8() needs
+struct Float4 {
+    __m128 v;
+};
+
+inline Float4 operator+(Float4 a, Float4 b) { return { _mm_add_ps(a.v, b.v) }; }
+inline Float4 operator-(Float4 a, Float4 b) { return { _mm_sub_ps(a.v, b.v) }; }
+inline Float4 operator*(Float4 a, float b) { return { _mm_mul_ps(a.v, _mm_set1_ps(b)) }; }
+
+inline void Transpose(Float4& a, Float4& b, Float4& c, Float4& d) { _MM_TRANSPOSE4_PS(a.v, b.v, c.v, d.v); }
+#endif
+
+/// Two dimensional DCT of an 8x8 block with the given row stride, in place: first all rows, then all
+/// columns, as stb_image_write does
+void ForwardDct(float* block, int stride) {
+#ifdef SIIO_SSE2
+    // Left and right half of every row
+    Float4 left[8], right[8];
+    for (int r = 0; r < 8; ++r) {
+        left[r] = { _mm_loadu_ps(block + r * stride) };
+        right[r] = { _mm_loadu_ps(block + r * stride + 4) };
+    }
+
+    // After transposing, vector c holds column c of the upper or lower four rows, so the row transforms
+    // run in the lanes
+    Float4 upper[8] = { left[0], left[1], left[2], left[3], right[0], right[1], right[2], right[3] };
+    Float4 lower[8] = { left[4], left[5], left[6], left[7], right[4], right[5], right[6], right[7] };
+    Transpose(upper[0], upper[1], upper[2], upper[3]);
+    Transpose(upper[4], upper[5], upper[6], upper[7]);
+    Transpose(lower[0], lower[1], lower[2], lower[3]);
+    Transpose(lower[4], lower[5], lower[6], lower[7]);
+    Dct8(upper, 1);
+    Dct8(lower, 1);
+
+    // Back to rows, now the column transforms run in the lanes
+    Transpose(upper[0], upper[1], upper[2], upper[3]);
+    Transpose(upper[4], upper[5], upper[6], upper[7]);
+    Transpose(lower[0], lower[1], lower[2], lower[3]);
+    Transpose(lower[4], lower[5], lower[6], lower[7]);
+    Float4 rowsLeft[8] = { upper[0], upper[1], upper[2], upper[3], lower[0], lower[1], lower[2], lower[3] };
+    Float4 rowsRight[8] = { upper[4], upper[5], upper[6], upper[7], lower[4], lower[5], lower[6], lower[7] };
+    Dct8(rowsLeft, 1);
+    Dct8(rowsRight, 1);
+
+    for (int r = 0; r < 8; ++r) {
+        _mm_storeu_ps(block + r * stride, rowsLeft[r].v);
+        _mm_storeu_ps(block + r * stride + 4, rowsRight[r].v);
+    }
+#else
+    for (int r = 0; r < 8; ++r)
+        Dct8(block + r * stride, 1);
+    for (int c = 0; c < 8; ++c)
+        Dct8(block + c, stride);
+#endif
+}
+
+/// Scales the DCT coefficients by the quantization factors, rounds half away from zero, and stores them in
+/// zig-zag order
+void Quantize(const float* block, int stride, const float* scales, int* coefficients) {
+    for (int y = 0; y < 8; ++y) {
+        const float* row = block + y * stride;
+        const float* rowScales = scales + y * 8;
+        int quantized[8];
+#ifdef SIIO_SSE2
+        const __m128 signMask = _mm_set1_ps(-0.0f);
+        const __m128 half = _mm_set1_ps(0.5f);
+        for (int x = 0; x < 8; x += 4) {
+            __m128 v = _mm_mul_ps(_mm_loadu_ps(row + x), _mm_loadu_ps(rowScales + x));
+            v = _mm_add_ps(v, _mm_or_ps(half, _mm_and_ps(v, signMask)));
+            _mm_storeu_si128((__m128i*) (quantized + x), _mm_cvttps_epi32(v));
+        }
+#else
+        for (int x = 0; x < 8; ++x) {
+            float v = row[x] * rowScales[x];
+            quantized[x] = (int) (v < 0 ? v - 0.5f : v + 0.5f);
+        }
+#endif
+        for (int x = 0; x < 8; ++x)
+            coefficients[zigZag[y * 8 + x]] = quantized[x];
+    }
+}
+
+/// Writes a nonzero value as the magnitude category, coded via the given table and symbol offset, followed
+/// by the low bits of the value (minus one if negative)
+void WriteValue(BitWriter& writer, const HuffmanCodes& codes, int symbolOffset, int value) {
+    int length = std::bit_width((unsigned) (value < 0 ? -value : value));
+    writer.Write(codes, symbolOffset + length);
+    writer.Write(unsigned(value < 0 ? value - 1 : value) & ((1u << length) - 1), length);
+}
+
+/// Transforms, quantizes, and entropy codes an 8x8 block, the data is overwritten. Returns the quantized DC
+/// coefficient, which the next block of the same component is predicted from.
+int EncodeBlock(BitWriter& writer, float* block, int stride, const float* scales, int previousDc,
+                const HuffmanCodes& dcCodes, const HuffmanCodes& acCodes) {
+    ForwardDct(block, stride);
+    int coefficients[64];
+    Quantize(block, stride, scales, coefficients);
+
+    int diff = coefficients[0] - previousDc;
+    if (diff == 0)
+        writer.Write(dcCodes, 0);
+    else
+        WriteValue(writer, dcCodes, 0, diff);
+
+    // Runs of zeros followed by a nonzero value, trailing zeros are replaced by the end of block code
+    int last = 63;
+    while (last > 0 && coefficients[last] == 0) --last;
+    for (int i = 1; i <= last; ++i) {
+        int run = 0;
+        for (; coefficients[i] == 0; ++i) ++run;
+        for (; run >= 16; run -= 16)
+            writer.Write(acCodes, 0xF0);
+        WriteValue(writer, acCodes, run << 4, coefficients[i]);
+    }
+    if (last != 63)
+        writer.Write(acCodes, 0x00);
+    return coefficients[0];
+}
+
+/// Everything the stripes of an image share
+struct JpegEncoder {
+    const uint8_t* pixels;
+    int width, height, numChannels;
+    bool subsample;
+    float lumaScales[64], chromaScales[64];
+
+    /// Converts the pixels of a square of the given size to YCbCr, repeating the last row and column at the
+    /// border. Gray images (with or without alpha) use the first channel for all three colors.
+    void ConvertToYCbCr(int x, int y, int size, float* luma, float* cb, float* cr) const {
+        const int offsetG = numChannels > 2 ? 1 : 0, offsetB = numChannels > 2 ? 2 : 0;
+        for (int row = y, pos = 0; row < y + size; ++row) {
+            const uint8_t* src = pixels + (size_t) std::min(row, height - 1) * width * numChannels;
+            for (int col = x; col < x + size; ++col, ++pos) {
+                const uint8_t* p = src + std::min(col, width - 1) * numChannels;
+                float r = p[0], g = p[offsetG], b = p[offsetB];
+                luma[pos] = +0.29900f * r + 0.58700f * g + 0.11400f * b - 128;
+                cb[pos] = -0.16874f * r - 0.33126f * g + 0.50000f * b;
+                cr[pos] = +0.50000f * r - 0.41869f * g - 0.08131f * b;
+            }
+        }
+    }
+
+    /// Encodes the MCUs of a stripe of rows, the DC predictions start over at zero
+    void EncodeStripe(int firstMcuRow, int numMcuRows, std::vector<uint8_t>& out) const {
+        BitWriter writer(out);
+        int dcY = 0, dcU = 0, dcV = 0;
+        const int mcuSize = subsample ? 16 : 8;
+        for (int y = firstMcuRow * mcuSize; y < (firstMcuRow + numMcuRows) * mcuSize; y += mcuSize) {
+            for (int x = 0; x < width; x += mcuSize) {
+                if (subsample) {
+                    float Y[256], U[256], V[256];
+                    ConvertToYCbCr(x, y, 16, Y, U, V);
+                    dcY = EncodeBlock(writer, Y, 16, lumaScales, dcY, lumaDcCodes, lumaAcCodes);
+                    dcY = EncodeBlock(writer, Y + 8, 16, lumaScales, dcY, lumaDcCodes, lumaAcCodes);
+                    dcY = EncodeBlock(writer, Y + 128, 16, lumaScales, dcY, lumaDcCodes, lumaAcCodes);
+                    dcY = EncodeBlock(writer, Y + 136, 16, lumaScales, dcY, lumaDcCodes, lumaAcCodes);
+
+                    // Average the chroma of 2x2 pixels
+                    float subU[64], subV[64];
+                    for (int yy = 0, pos = 0; yy < 8; ++yy) {
+                        for (int xx = 0; xx < 8; ++xx, ++pos) {
+                            int j = yy * 32 + xx * 2;
+                            subU[pos] = (U[j + 0] + U[j + 1] + U[j + 16] + U[j + 17]) * 0.25f;
+                            subV[pos] = (V[j + 0] + V[j + 1] + V[j + 16] + V[j + 17]) * 0.25f;
+                        }
+                    }
+                    dcU = EncodeBlock(writer, subU, 8, chromaScales, dcU, chromaDcCodes, chromaAcCodes);
+                    dcV = EncodeBlock(writer, subV, 8, chromaScales, dcV, chromaDcCodes, chromaAcCodes);
+                } else {
+                    float Y[64], U[64], V[64];
+                    ConvertToYCbCr(x, y, 8, Y, U, V);
+                    dcY = EncodeBlock(writer, Y, 8, lumaScales, dcY, lumaDcCodes, lumaAcCodes);
+                    dcU = EncodeBlock(writer, U, 8, chromaScales, dcU, chromaDcCodes, chromaAcCodes);
+                    dcV = EncodeBlock(writer, V, 8, chromaScales, dcV, chromaDcCodes, chromaAcCodes);
+                }
+            }
+        }
+        writer.Flush();
+    }
+};
+
+void Append(std::vector<uint8_t>& out, const uint8_t* data, size_t len) {
+    out.insert(out.end(), data, data + len);
+}
+
+} // namespace
+
+bool EncodeJpeg(const uint8_t* pixels, int width, int height, int numChannels, int quality,
+                std::vector<uint8_t>& out, int numThreads) {
+    if (width <= 0 || height <= 0 || width > 65535 || height > 65535 || numChannels < 1 || numChannels > 4) {
+        std::cerr << "ERROR: Cannot encode a " << width << "x" << height << " image with " << numChannels
+                  << " channels as .jpg" << std::endl;
+        return false;
+    }
+
+    JpegEncoder encoder { pixels, width, height, numChannels };
+
+    // Same mapping of the quality to the quantization tables as stb_image_write
+    quality = quality ? quality : 90;
+    encoder.subsample = quality <= 90;
+    quality = std::clamp(quality, 1, 100);
+    quality = quality < 50 ? 5000 / quality : 200 - quality * 2;
+    uint8_t lumaTable[64], chromaTable[64];
+    for (int i = 0; i < 64; ++i) {
+        lumaTable[zigZag[i]] = (uint8_t) std::clamp((lumaQuantization[i] * quality + 50) / 100, 1, 255);
+        chromaTable[zigZag[i]] = (uint8_t) std::clamp((chromaQuantization[i] * quality + 50) / 100, 1, 255);
+    }
+    for (int row = 0, k = 0; row < 8; ++row) {
+        for (int col = 0; col < 8; ++col, ++k) {
+            encoder.lumaScales[k] = 1 / (lumaTable[zigZag[k]] * dctScales[row] * dctScales[col]);
+            encoder.chromaScales[k] = 1 / (chromaTable[zigZag[k]] * dctScales[row] * dctScales[col]);
+        }
+    }
+
+    // The restart interval counts MCUs and must fit in 16 bit
+    const int mcuSize = encoder.subsample ? 16 : 8;
+    const int mcusPerRow = (width + mcuSize - 1) / mcuSize;
+    const int numMcuRows = (height + mcuSize - 1) / mcuSize;
+    const int rowsPerStripe = std::clamp(stripeTargetPixels / (mcuSize * mcusPerRow * mcuSize), 1,
+                                         std::min(numMcuRows, 65535 / mcusPerRow));
+    const int numStripes = (numMcuRows + rowsPerStripe - 1) / rowsPerStripe;
+
+    std::vector<std::vector<uint8_t>> stripes(numStripes);
+    std::atomic<int> nextStripe = 0;
+    IOThreadPool().RunParallel(std::min(numThreads, numStripes), [&] {
+        for (int s; (s = nextStripe++) < numStripes; ) {
+            int firstRow = s * rowsPerStripe;
+            stripes[s].reserve((size_t) rowsPerStripe * mcuSize * width * numChannels / 4);
+            encoder.EncodeStripe(firstRow, std::min(rowsPerStripe, numMcuRows - firstRow), stripes[s]);
+        }
+    });
+
+    // Headers as written by stb_image_write: JFIF, quantization tables, frame, Huffman tables, and scan
+    const uint8_t jfifHeader[] = {
+        0xFF, 0xD8, 0xFF, 0xE0, 0, 0x10, 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0, 0xFF, 0xDB, 0, 0x84, 0
+    };
+    const uint8_t frameHeader[] = {
+        0xFF, 0xC0, 0, 0x11, 8, uint8_t(height >> 8), uint8_t(height), uint8_t(width >> 8), uint8_t(width),
+        3, 1, uint8_t(encoder.subsample ? 0x22 : 0x11), 0, 2, 0x11, 1, 3, 0x11, 1, 0xFF, 0xC4, 0x01, 0xA2, 0
+    };
+    const int restartInterval = rowsPerStripe * mcusPerRow;
+    const uint8_t restartHeader[] = { 0xFF, 0xDD, 0, 4, uint8_t(restartInterval >> 8), uint8_t(restartInterval) };
+    const uint8_t scanHeader[] = { 0xFF, 0xDA, 0, 0xC, 3, 1, 0, 2, 0x11, 3, 0x11, 0, 0x3F, 0 };
+
+    size_t totalSize = 1024;
+    for (auto& stripe : stripes) totalSize += stripe.size() + 2;
+    out.reserve(out.size() + totalSize);
+
+    Append(out, jfifHeader, sizeof(jfifHeader));
+    Append(out, lumaTable, 64);
+    out.push_back(1);
+    Append(out, chromaTable, 64);
+    Append(out, frameHeader, sizeof(frameHeader));
+    Append(out, lumaDcCounts, 16);
+    Append(out, lumaDcSymbols, sizeof(lumaDcSymbols));
+    out.push_back(0x10);
+    Append(out, lumaAcCounts, 16);
+    Append(out, lumaAcSymbols, sizeof(lumaAcSymbols));
+    out.push_back(0x01);
+    Append(out, chromaDcCounts, 16);
+    Append(out, chromaDcSymbols, sizeof(chromaDcSymbols));
+    out.push_back(0x11);
+    Append(out, chromaAcCounts, 16);
+    Append(out, chromaAcSymbols, sizeof(chromaAcSymbols));
+    if (numStripes > 1)
+        Append(out, restartHeader, sizeof(restartHeader));
+    Append(out, scanHeader, sizeof(scanHeader));
+
+    // The stripes are separated by the restart markers RST0 to RST7, in turn
+    for (int s = 0; s < numStripes; ++s) {
+        if (s > 0) {
+            out.push_back(0xFF);
+            out.push_back(uint8_t(0xD0 + (s - 1) % 8));
+        }
+        Append(out, stripes[s].data(), stripes[s].size());
+        std::vector<uint8_t>().swap(stripes[s]);
+    }
+    out.push_back(0xFF);
+    out.push_back(0xD9);
+    return true;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+/// Encodes 8 bit pixels with one to four interleaved channels as a baseline .jpg file, appended to the
+/// output. Quality scaling, tables, color conversion, and chroma subsampling (for quality 90 and below) are
+/// the same as in stb_image_write. Gray images are stored as YCbCr, alpha is ignored. Stripes of MCU rows
+/// are separated by restart markers, so they are transformed and entropy coded concurrently on up to
+/// numThreads threads of the I/O pool, the file is the same for any number of threads. Errors are reported
+/// to stderr.
+bool EncodeJpeg(const uint8_t* pixels, int width, int height, int numChannels, int quality,
+                std::vector<uint8_t>& out, int numThreads = 1);
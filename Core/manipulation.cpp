@@ -1,8 +1,15 @@
+#include "half.h"
+#include "hdr.h"
 #include "image.h"
+#include "srgb.h"
 
+#include <bit>
 #include <cmath>
 #include <cstdint>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <vector>
 
 float LinearToSrgb(float linear) {
     if (linear > 0.0031308) {
@@ -20,6 +27,164 @@ float SrgbToLinear(float srgb) {
     }
 }
 
+namespace {
+
+/// Reference quantization of a linear value to an 8 bit sRGB value, LinearToSrgbBytes() matches it exactly
+uint8_t SrgbByteReference(float linear) {
+    float v = 255 * LinearToSrgb(linear);
+    if (!(v > 0)) return 0;
+    return v > 255 ? 255 : (uint8_t) v;
+}
+
+/// Lookup tables for LinearToSrgbBytes(). Since the quantized value grows monotonically with the input,
+/// it is fully described by the 255 thresholds where it increases by one. These are found once by
+/// bisection over the float bit patterns. An additional table indexed by the top bits of the input
+/// (exponent and seven bits of mantissa) yields a lower bound that is at most one step below the result.
+struct SrgbByteTables {
+    static constexpr int IndexShift = 16;
+    static constexpr float MaxInput = 1.99999988f; // largest float below 2
+
+    /// thresholds[k] is the smallest float that maps to k or more, for k in [1, 255]. The last entry is
+    /// infinite, so the lookup can always compare against the next threshold.
+    float thresholds[257];
+
+    /// Value of the smallest float with the given top bits, for all floats in [0, 2). Due to rounding,
+    /// LinearToSrgb(1) is slightly below one, so the last threshold is not at 1 but just above it.
+    uint8_t start[(0x40000000 >> IndexShift) + 1];
+
+    SrgbByteTables() {
+        thresholds[0] = 0;
+        uint32_t lo = 0;
+        for (int k = 1; k < 256; ++k) {
+            uint32_t hi = std::bit_cast<uint32_t>(2.0f);
+            while (lo < hi) {
+                uint32_t mid = lo + (hi - lo) / 2;
+                if (SrgbByteReference(std::bit_cast<float>(mid)) >= k) hi = mid;
+                else lo = mid + 1;
+            }
+            thresholds[k] = std::bit_cast<float>(lo);
+        }
+        thresholds[256] = std::numeric_limits<float>::infinity();
+
+        for (uint32_t i = 0; i < std::size(start); ++i)
+            start[i] = SrgbByteReference(std::bit_cast<float>(i << IndexShift));
+    }
+};
+
+const SrgbByteTables& GetSrgbByteTables() {
+    static const SrgbByteTables tables;
+    return tables;
+}
+
+} // namespace
+
+void LinearToSrgbBytes(const float* values, uint8_t* result, size_t count) {
+    const SrgbByteTables& tables = GetSrgbByteTables();
+    size_t i = 0;
+#ifdef SIIO_SSE2
+    // Clamping, indexing, and comparing four values at once, only the table reads are scalar
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 maxInput = _mm_set1_ps(SrgbByteTables::MaxInput);
+    for (; i + 4 <= count; i += 4) {
+        // maxps returns the second operand if the first is NaN
+        __m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(values + i), zero), maxInput);
+        alignas(16) uint32_t idx[4];
+        _mm_store_si128((__m128i*) idx, _mm_srli_epi32(_mm_castps_si128(v), SrgbByteTables::IndexShift));
+        int k0 = tables.start[idx[0]], k1 = tables.start[idx[1]];
+        int k2 = tables.start[idx[2]], k3 = tables.start[idx[3]];
+        __m128 next = _mm_setr_ps(tables.thresholds[k0 + 1], tables.thresholds[k1 + 1],
+                                  tables.thresholds[k2 + 1], tables.thresholds[k3 + 1]);
+        int up = _mm_movemask_ps(_mm_cmpge_ps(v, next));
+        result[i + 0] = (uint8_t) (k0 + (up & 1));
+        result[i + 1] = (uint8_t) (k1 + ((up >> 1) & 1));
+        result[i + 2] = (uint8_t) (k2 + ((up >> 2) & 1));
+        result[i + 3] = (uint8_t) (k3 + (up >> 3));
+    }
+#endif
+    for (; i < count; ++i) {
+        // Clamp to [0, 2) without branches, NaN becomes 0. Everything from 1.0000002 on maps to 255.
+        float v = values[i] > 0 ? values[i] : 0;
+        v = v < SrgbByteTables::MaxInput ? v : SrgbByteTables::MaxInput;
+        int k = tables.start[std::bit_cast<uint32_t>(v) >> SrgbByteTables::IndexShift];
+        result[i] = (uint8_t) (k + (v >= tables.thresholds[k + 1]));
+    }
+}
+
+void LinearToSrgb16(const float* values, uint16_t* result, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        float v = 65535 * LinearToSrgb(values[i]) + 0.5f;
+        result[i] = !(v > 0) ? 0 : (v >= 65535 ? 65535 : (uint16_t) v);
+    }
+}
+
+namespace {
+
+/// Overwrites the last channel of every pixel with its linear value, rounded to the nearest sample
+template<typename T>
+void QuantizeAlphaLinear(const float* src, T* dst, size_t numPixels, int numChannels) {
+    constexpr float maxValue = std::numeric_limits<T>::max();
+    const int alpha = numChannels - 1;
+    for (size_t p = 0; p < numPixels; ++p) {
+        float v = maxValue * src[p * numChannels + alpha] + 0.5f;
+        dst[p * numChannels + alpha] = !(v > 0) ? 0 : (v >= maxValue ? (T) maxValue : (T) v);
+    }
+}
+
+} // namespace
+
+void LinearToSrgbRow(const float* src, uint8_t* dst, size_t numPixels, int numChannels) {
+    LinearToSrgbBytes(src, dst, numPixels * numChannels);
+    if (!(numChannels & 1)) QuantizeAlphaLinear(src, dst, numPixels, numChannels);
+}
+
+void LinearToSrgbRow(const float* src, uint16_t* dst, size_t numPixels, int numChannels) {
+    LinearToSrgb16(src, dst, numPixels * numChannels);
+    if (!(numChannels & 1)) QuantizeAlphaLinear(src, dst, numPixels, numChannels);
+}
+
+namespace {
+
+/// Linear value of every possible sRGB sample of the given type
+template<typename T>
+const float* SrgbToLinearTable() {
+    static const std::vector<float> table = [] {
+        constexpr int maxValue = std::numeric_limits<T>::max();
+        std::vector<float> t(maxValue + 1);
+        for (int i = 0; i <= maxValue; ++i)
+            t[i] = SrgbToLinear(i / (float) maxValue);
+        return t;
+    }();
+    return table.data();
+}
+
+template<typename T>
+void ExpandSrgbRow(const T* src, float* dst, size_t numPixels, int numChannels) {
+    const float* table = SrgbToLinearTable<T>();
+    if (numChannels & 1) {
+        for (size_t i = 0; i < numPixels * numChannels; ++i)
+            dst[i] = table[src[i]];
+        return;
+    }
+
+    constexpr float maxValue = std::numeric_limits<T>::max();
+    const int alpha = numChannels - 1;
+    for (size_t p = 0; p < numPixels; ++p, src += numChannels, dst += numChannels) {
+        for (int c = 0; c < alpha; ++c)
+            dst[c] = table[src[c]];
+        dst[alpha] = src[alpha] / maxValue;
+    }
+}
+
+} // namespace
+
+void SrgbToLinearRow(const uint8_t* src, float* dst, size_t numPixels, int numChannels) {
+    ExpandSrgbRow(src, dst, numPixels, numChannels);
+}
+
+void SrgbToLinearRow(const uint16_t* src, float* dst, size_t numPixels, int numChannels) {
+    ExpandSrgbRow(src, dst, numPixels, numChannels);
+}
+
 extern "C" {
 
 SIIO_API void AdjustExposure(float* image, int imgStride, float* result, int resStride, int width,
@@ -57,6 +222,49 @@ SIIO_API void ToByteImage(float* image, int imgStride, uint8_t* result, int resS
         });
 }
 
+SIIO_API void LinearToSrgbByteImage(float* image, int imgStride, uint8_t* result, int resStride,
+                                   int width, int height, int numChans) {
+    #pragma omp parallel for
+    for (int row = 0; row < height; ++row) {
+        LinearToSrgbBytes(image + (size_t) row * imgStride, result + (size_t) row * resStride,
+                          (size_t) width * numChans);
+    }
+}
+
+SIIO_API void LinearToRgbe(float* image, int imgStride, uint8_t* result, int resStride,
+                           int width, int height, int numChans) {
+    #pragma omp parallel for
+    for (int row = 0; row < height; ++row) {
+        LinearToRgbeRow(image + (size_t) row * imgStride, result + (size_t) row * resStride,
+                        width, numChans);
+    }
+}
+
+SIIO_API void RgbeToLinear(uint8_t* image, int imgStride, float* result, int resStride,
+                           int width, int height) {
+    #pragma omp parallel for
+    for (int row = 0; row < height; ++row)
+        RgbeToLinearRow(image + (size_t) row * imgStride, result + (size_t) row * resStride, width);
+}
+
+SIIO_API void FloatToHalf(float* image, int imgStride, uint16_t* result, int resStride,
+                          int width, int height, int numChans) {
+    #pragma omp parallel for
+    for (int row = 0; row < height; ++row) {
+        FloatToHalfRow(image + (size_t) row * imgStride, result + (size_t) row * resStride,
+                       (size_t) width * numChans);
+    }
+}
+
+SIIO_API void HalfToFloat(uint16_t* image, int imgStride, float* result, int resStride,
+                          int width, int height, int numChans) {
+    #pragma omp parallel for
+    for (int row = 0; row < height; ++row) {
+        HalfToFloatRow(image + (size_t) row * imgStride, result + (size_t) row * resStride,
+                       (size_t) width * numChans);
+    }
+}
+
 SIIO_API void ZoomWithNearestInterp(float* image, int imgStride, float* result, int resStride,
                                     int origWidth, int origHeight, int numChans, int scale) {
     #pragma omp parallel for
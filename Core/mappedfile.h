@@ -0,0 +1,156 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+#ifdef _WIN32
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+/// Read-only memory mapping of an entire file. Pages are only loaded once they are accessed, so reading
+/// a small part of a large file only costs I/O for that part. Can be accessed from multiple threads.
+class MappedFile {
+public:
+    /// Maps the file with the given UTF-8 encoded name. Check IsOpen() for success.
+    explicit MappedFile(const char* filename) {
+#ifdef _WIN32
+        auto path = std::filesystem::path((const char8_t*) filename);
+        HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return;
+
+        LARGE_INTEGER fileSize;
+        if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0) {
+            HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping) {
+                data = (const uint8_t*) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                if (data) size = (size_t) fileSize.QuadPart;
+                CloseHandle(mapping);
+            }
+        }
+        CloseHandle(file);
+#else
+        int fd = open(filename, O_RDONLY);
+        if (fd < 0) return;
+
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0) {
+            void* ptr = mmap(nullptr, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (ptr != MAP_FAILED) {
+                data = (const uint8_t*) ptr;
+                size = (size_t) info.st_size;
+            }
+        }
+        close(fd);
+#endif
+    }
+
+    ~MappedFile() {
+        if (!data) return;
+#ifdef _WIN32
+        UnmapViewOfFile(data);
+#else
+        munmap((void*) data, size);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool IsOpen() const { return data != nullptr; }
+    const uint8_t* Data() const { return data; }
+    size_t Size() const { return size; }
+
+    /// Hints that a byte range will not be accessed again. Its pages are removed from the working set of
+    /// the process (but stay in the OS file cache), so reading a huge file front to back only keeps a
+    /// bounded part of it resident. Accessing the range again afterwards is still valid.
+    void Discard(size_t offset, size_t length) const {
+        // Only whole pages inside the range are released. 64 KiB is a multiple of all common page sizes.
+        constexpr size_t granularity = 64 * 1024;
+        size_t begin = (offset + granularity - 1) / granularity * granularity;
+        size_t end = std::min(offset + length, size) / granularity * granularity;
+        if (!data || end <= begin) return;
+#ifdef _WIN32
+        // Unlocking pages that are not locked removes them from the working set
+        VirtualUnlock((LPVOID) (data + begin), end - begin);
+#else
+        madvise((void*) (data + begin), end - begin, MADV_DONTNEED);
+#endif
+    }
+
+private:
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+};
+
+/// Writable memory mapping of a newly created file with a fixed size. An existing file is overwritten.
+/// Distinct parts of the file can be written from multiple threads, the data is flushed by the OS once
+/// the mapping is destroyed.
+class MappedOutputFile {
+public:
+    /// Creates the file with the given UTF-8 encoded name and size. Check IsOpen() for success.
+    MappedOutputFile(const char* filename, size_t size) {
+        if (size == 0) return;
+#ifdef _WIN32
+        auto path = std::filesystem::path((const char8_t*) filename);
+        HANDLE file = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                                  FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return;
+
+        // Creating the mapping with a size larger than the (empty) file also resizes the file
+        HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READWRITE, (DWORD) ((uint64_t) size >> 32),
+                                            (DWORD) (size & 0xFFFFFFFF), nullptr);
+        if (mapping) {
+            data = (uint8_t*) MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, size);
+            if (data) this->size = size;
+            CloseHandle(mapping);
+        }
+        CloseHandle(file);
+#else
+        int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0666);
+        if (fd < 0) return;
+
+        if (ftruncate(fd, (off_t) size) == 0) {
+            void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (ptr != MAP_FAILED) {
+                data = (uint8_t*) ptr;
+                this->size = size;
+            }
+        }
+        close(fd);
+#endif
+    }
+
+    ~MappedOutputFile() {
+        if (!data) return;
+#ifdef _WIN32
+        UnmapViewOfFile(data);
+#else
+        munmap((void*) data, size);
+#endif
+    }
+
+    MappedOutputFile(const MappedOutputFile&) = delete;
+    MappedOutputFile& operator=(const MappedOutputFile&) = delete;
+
+    bool IsOpen() const { return data != nullptr; }
+    uint8_t* Data() const { return data; }
+    size_t Size() const { return size; }
+
+private:
+    uint8_t* data = nullptr;
+    size_t size = 0;
+};
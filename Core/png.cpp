@@ -0,0 +1,203 @@
+#include "png.h"
+
+#include "threadpool.h"
+#include "External/fpng.h"
+#include "External/miniz.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+namespace {
+
+const uint8_t pngSignature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+/// Contents of fpng's private "fdEC" chunk, which tells fpng_decode_memory() that it can decode the file
+const uint8_t fpngMarker[] = { 82, 36, 147, 227, 0 };
+
+/// The length of a chunk must fit in 31 bits, larger image data is split over multiple IDAT chunks
+constexpr size_t maxChunkLength = size_t(1) << 30;
+
+void AppendBigEndian(std::vector<uint8_t>& out, uint32_t v) {
+    uint8_t bytes[] = { uint8_t(v >> 24), uint8_t(v >> 16), uint8_t(v >> 8), uint8_t(v) };
+    out.insert(out.end(), bytes, bytes + 4);
+}
+
+/// Appends a chunk: length, type, data, and the CRC of type and data
+void AppendChunk(std::vector<uint8_t>& out, const char* type, const uint8_t* data, size_t len) {
+    AppendBigEndian(out, (uint32_t) len);
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data, data + len);
+    AppendBigEndian(out, fpng::fpng_crc32(out.data() + start, len + 4));
+}
+
+/// Writes the filter type byte and the filtered samples of a row: the byte-wise difference to the row
+/// above ("up" filter), or the samples as they are for the first row. 16 bit samples are stored in big
+/// endian order.
+template<typename T>
+void FilterRow(const T* row, const T* above, size_t count, uint8_t* out) {
+    *out++ = above ? 2 : 0;
+    if constexpr (sizeof(T) == 1) {
+        if (above) {
+            for (size_t i = 0; i < count; ++i)
+                out[i] = uint8_t(row[i] - above[i]);
+        } else {
+            std::memcpy(out, row, count);
+        }
+    } else {
+        for (size_t i = 0; i < count; ++i) {
+            uint16_t up = above ? above[i] : 0;
+            out[2 * i] = uint8_t((row[i] >> 8) - (up >> 8));
+            out[2 * i + 1] = uint8_t(row[i] - up);
+        }
+    }
+}
+
+mz_bool AppendDeflated(const void* data, int len, void* user) {
+    auto& out = *(std::vector<uint8_t>*) user;
+    out.insert(out.end(), (const uint8_t*) data, (const uint8_t*) data + len);
+    return MZ_TRUE;
+}
+
+/// Strips of rows are compressed independently, each into about this many bytes of filtered data. The
+/// layout does not depend on the number of threads, so neither does the file.
+constexpr size_t stripTargetSize = size_t(256) << 10;
+
+/// Adler-32 of two consecutive pieces of data, given the checksums of each and the length of the second,
+/// as computed by zlib's adler32_combine
+uint32_t Adler32Combine(uint32_t adler1, uint32_t adler2, size_t len2) {
+    constexpr uint32_t base = 65521;
+    const uint32_t rem = uint32_t(len2 % base);
+    uint32_t sum1 = adler1 & 0xFFFF;
+    uint32_t sum2 = uint32_t(uint64_t(rem) * sum1 % base);
+    sum1 += (adler2 & 0xFFFF) + base - 1;
+    sum2 += (adler1 >> 16) + (adler2 >> 16) + base - rem;
+    if (sum1 >= base) sum1 -= base;
+    if (sum1 >= base) sum1 -= base;
+    if (sum2 >= 2 * base) sum2 -= 2 * base;
+    if (sum2 >= base) sum2 -= base;
+    return sum1 | (sum2 << 16);
+}
+
+/// Compressed data of a strip of rows: raw deflate blocks that end with a sync flush (an empty stored
+/// block), so the strips can be concatenated in order. The last strip ends the stream instead.
+struct Strip {
+    std::vector<uint8_t> deflated;
+    uint32_t adler;
+    size_t size;
+    bool isFpng = false;
+};
+
+/// Filters and compresses one strip of rows. 8 bit RGB and RGBA use fpng's single pass, everything else
+/// (and what fpng fails to compress) goes through miniz, restricted to runs like fpng.
+bool CompressStrip(const void* pixels, int firstRow, int numRows, bool isLast, size_t rowLen, int bitDepth,
+                   int width, int numChannels, std::vector<uint8_t>& filtered, tdefl_compressor& compressor,
+                   Strip& strip) {
+    const size_t filteredRowLen = rowLen * (bitDepth / 8) + 1;
+    filtered.resize(filteredRowLen * numRows);
+    for (int i = 0; i < numRows; ++i) {
+        const int row = firstRow + i;
+        uint8_t* dst = filtered.data() + i * filteredRowLen;
+        if (bitDepth == 8) {
+            auto src = (const uint8_t*) pixels + row * rowLen;
+            FilterRow(src, row > 0 ? src - rowLen : nullptr, rowLen, dst);
+        } else {
+            auto src = (const uint16_t*) pixels + row * rowLen;
+            FilterRow(src, row > 0 ? src - rowLen : nullptr, rowLen, dst);
+        }
+    }
+    strip.size = filtered.size();
+    strip.adler = fpng::fpng_adler32(filtered.data(), filtered.size());
+
+    if (bitDepth == 8 && (numChannels == 3 || numChannels == 4)) {
+        strip.deflated.resize(filtered.size() + 64);
+        uint32_t len = fpng::fpng_deflate_filtered_rows(filtered.data(), width, numRows, numChannels,
+                                                        strip.deflated.data(), (uint32_t) strip.deflated.size(),
+                                                        isLast);
+        strip.deflated.resize(len);
+        strip.isFpng = len > 0;
+        if (strip.isFpng) return true;
+    }
+
+    strip.deflated.reserve(filtered.size() / 2);
+    if (tdefl_init(&compressor, AppendDeflated, &strip.deflated, TDEFL_RLE_MATCHES | 1) != TDEFL_STATUS_OKAY)
+        return false;
+    auto status = tdefl_compress_buffer(&compressor, filtered.data(), filtered.size(),
+                                        isLast ? TDEFL_FINISH : TDEFL_SYNC_FLUSH);
+    return status == (isLast ? TDEFL_STATUS_DONE : TDEFL_STATUS_OKAY);
+}
+
+} // namespace
+
+bool EncodePng(const void* pixels, int width, int height, int numChannels, int bitDepth,
+               std::vector<uint8_t>& out, int numThreads) {
+    if (width <= 0 || height <= 0 || numChannels < 1 || numChannels > 4 || (bitDepth != 8 && bitDepth != 16)) {
+        std::cerr << "ERROR: Cannot encode a " << width << "x" << height << " image with " << numChannels
+                  << " channels and " << bitDepth << " bit as .png" << std::endl;
+        return false;
+    }
+    fpng::fpng_init();
+
+    const size_t rowLen = (size_t) width * numChannels;
+    const size_t filteredRowLen = rowLen * (bitDepth / 8) + 1;
+    const int rowsPerStrip = (int) std::clamp<size_t>(stripTargetSize / filteredRowLen, 1, height);
+    const int numStrips = (height + rowsPerStrip - 1) / rowsPerStrip;
+
+    std::vector<Strip> strips(numStrips);
+    std::atomic<int> nextStrip = 0;
+    std::atomic<bool> failed = false;
+    IOThreadPool().RunParallel(std::min(numThreads, numStrips), [&] {
+        // The compressor state is several hundred KB, so every thread reuses its own
+        auto compressor = std::make_unique<tdefl_compressor>();
+        std::vector<uint8_t> filtered;
+        for (int s; (s = nextStrip++) < numStrips; ) {
+            const int firstRow = s * rowsPerStrip;
+            if (!CompressStrip(pixels, firstRow, std::min(rowsPerStrip, height - firstRow), s == numStrips - 1,
+                               rowLen, bitDepth, width, numChannels, filtered, *compressor, strips[s]))
+                failed = true;
+        }
+    });
+    if (failed) {
+        std::cerr << "ERROR: Compressing the .png data failed" << std::endl;
+        return false;
+    }
+
+    // zlib stream: header (deflate, 32K window, fastest), the strips, and the Adler-32 of all filtered data
+    size_t compressedSize = 2 + 4;
+    for (auto& strip : strips) compressedSize += strip.deflated.size();
+    std::vector<uint8_t> compressed;
+    compressed.reserve(compressedSize);
+    compressed.push_back(0x78);
+    compressed.push_back(0x01);
+    uint32_t adler = 1;
+    bool isFpng = true;
+    for (auto& strip : strips) {
+        isFpng &= strip.isFpng;
+        compressed.insert(compressed.end(), strip.deflated.begin(), strip.deflated.end());
+        adler = Adler32Combine(adler, strip.adler, strip.size);
+        std::vector<uint8_t>().swap(strip.deflated);
+    }
+    AppendBigEndian(compressed, adler);
+
+    // Color type: gray, gray + alpha, RGB, or RGBA
+    const uint8_t colorTypes[] = { 0, 4, 2, 6 };
+    uint8_t header[13] = {
+        uint8_t(width >> 24), uint8_t(width >> 16), uint8_t(width >> 8), uint8_t(width),
+        uint8_t(height >> 24), uint8_t(height >> 16), uint8_t(height >> 8), uint8_t(height),
+        uint8_t(bitDepth), colorTypes[numChannels - 1],
+        0, 0, 0 // deflate, adaptive filtering, no interlacing
+    };
+
+    out.reserve(out.size() + sizeof(pngSignature) + compressed.size() + 64);
+    out.insert(out.end(), pngSignature, pngSignature + sizeof(pngSignature));
+    AppendChunk(out, "IHDR", header, sizeof(header));
+    if (isFpng && compressed.size() <= maxChunkLength)
+        AppendChunk(out, "fdEC", fpngMarker, sizeof(fpngMarker));
+    for (size_t offset = 0; offset < compressed.size(); offset += maxChunkLength)
+        AppendChunk(out, "IDAT", compressed.data() + offset, std::min(maxChunkLength, compressed.size() - offset));
+    AppendChunk(out, "IEND", nullptr, 0);
+    return true;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+/// Encodes 8 or 16 bit pixels with one to four interleaved channels (gray, gray + alpha, RGB, RGBA) as a
+/// .png file, appended to the output. 16 bit samples are in native byte order. Rows are filtered by their
+/// difference to the row above and compressed with a deflate that only looks for runs, like fpng does. That
+/// is several times faster than stb_image_write, and usually compresses better. Strips of rows are filtered
+/// and compressed concurrently on up to numThreads threads of the I/O pool, the file is the same for any
+/// number of threads. If every strip of an RGB or RGBA image compressed, the file is marked so that
+/// fpng_decode_memory() can decode it. Errors are reported to stderr.
+bool EncodePng(const void* pixels, int width, int height, int numChannels, int bitDepth,
+               std::vector<uint8_t>& out, int numThreads = 1);
@@ -0,0 +1,116 @@
+#include "pnm.h"
+
+#include <cctype>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+namespace {
+
+/// Reads the whitespace separated tokens of a header, skipping comments that start with '#'
+struct HeaderTokenizer {
+    const uint8_t* pos;
+    const uint8_t* end;
+
+    void SkipSpaceAndComments() {
+        while (pos < end) {
+            if (*pos == '#') {
+                while (pos < end && *pos != '\n') ++pos;
+            } else if (std::isspace(*pos)) {
+                ++pos;
+            } else {
+                break;
+            }
+        }
+    }
+
+    std::string_view Word() {
+        SkipSpaceAndComments();
+        const uint8_t* start = pos;
+        while (pos < end && !std::isspace(*pos)) ++pos;
+        return { (const char*) start, size_t(pos - start) };
+    }
+
+    /// Parses a positive number, returns -1 if there is none or it is too large
+    int Number() {
+        std::string_view word = Word();
+        if (word.empty() || word.size() > 9) return -1;
+        int value = 0;
+        for (char c : word) {
+            if (c < '0' || c > '9') return -1;
+            value = value * 10 + (c - '0');
+        }
+        return value;
+    }
+};
+
+/// Parses the header lines of a .pam file, from after the magic number to ENDHDR
+bool ReadPamHeader(HeaderTokenizer& tokens, PnmHeader& header) {
+    header = {};
+    while (true) {
+        std::string_view key = tokens.Word();
+        if (key.empty()) return false;
+        if (key == "ENDHDR") break;
+        if (key == "WIDTH") header.width = tokens.Number();
+        else if (key == "HEIGHT") header.height = tokens.Number();
+        else if (key == "DEPTH") header.numChannels = tokens.Number();
+        else if (key == "MAXVAL") header.maxValue = tokens.Number();
+        else if (key == "TUPLTYPE") tokens.Word();
+        else return false;
+    }
+
+    // ENDHDR is the last thing on its line
+    while (tokens.pos < tokens.end && *tokens.pos != '\n') ++tokens.pos;
+    ++tokens.pos;
+    return true;
+}
+
+} // namespace
+
+bool ReadPnmHeader(const uint8_t* data, size_t size, PnmHeader& header, const char* filename) {
+    HeaderTokenizer tokens { data, data + size };
+    std::string_view magic = tokens.Word();
+    bool valid;
+    if (magic == "P5" || magic == "P6") {
+        header.numChannels = magic == "P5" ? 1 : 3;
+        header.width = tokens.Number();
+        header.height = tokens.Number();
+        header.maxValue = tokens.Number();
+
+        // A single whitespace character separates the header from the pixel data
+        ++tokens.pos;
+        valid = true;
+    } else if (magic == "P7") {
+        valid = ReadPamHeader(tokens, header);
+    } else {
+        std::cerr << "ERROR: Not a binary .pgm, .ppm, or .pam file: " << filename << std::endl;
+        return false;
+    }
+
+    if (!valid || header.width <= 0 || header.height <= 0 || header.numChannels < 1 || header.numChannels > 4
+        || header.maxValue <= 0 || header.maxValue > 65535 || tokens.pos > tokens.end) {
+        std::cerr << "ERROR: Invalid header in file: " << filename << std::endl;
+        return false;
+    }
+
+    header.dataOffset = tokens.pos - data;
+    if (size - header.dataOffset < header.RowBytes() * header.height) {
+        std::cerr << "ERROR: The pixel data is incomplete in file: " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void WritePnmHeader(int width, int height, int numChannels, int maxValue, std::vector<uint8_t>& out) {
+    std::string header;
+    if (numChannels == 1 || numChannels == 3) {
+        header = (numChannels == 1 ? "P5\n" : "P6\n") + std::to_string(width) + " " + std::to_string(height)
+               + "\n" + std::to_string(maxValue) + "\n";
+    } else {
+        header = "P7\nWIDTH " + std::to_string(width) + "\nHEIGHT " + std::to_string(height)
+               + "\nDEPTH " + std::to_string(numChannels) + "\nMAXVAL " + std::to_string(maxValue)
+               + "\nTUPLTYPE " + (numChannels == 2 ? "GRAYSCALE_ALPHA" : "RGB_ALPHA") + "\nENDHDR\n";
+    }
+    out.insert(out.end(), header.begin(), header.end());
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// Metadata from the header of a binary .pgm (P5), .ppm (P6), or .pam (P7) file
+struct PnmHeader {
+    int width, height, numChannels;
+    int maxValue;       // Samples up to 255 are bytes, larger ones are 16 bit big-endian
+    size_t dataOffset;  // Start of the pixel data, rows follow each other without padding
+
+    size_t BytesPerSample() const { return maxValue > 255 ? 2 : 1; }
+    size_t RowBytes() const { return (size_t) width * numChannels * BytesPerSample(); }
+};
+
+/// Parses the header of a binary .pgm, .ppm, or .pam file in memory, and checks that the pixel data is
+/// complete. PAM files with one to four channels are supported, the tuple type is ignored. Errors are
+/// reported to stderr.
+bool ReadPnmHeader(const uint8_t* data, size_t size, PnmHeader& header, const char* filename);
+
+/// Appends the header of a binary file with the given sample range. Gray and RGB images are written as .pgm
+/// (P5) and .ppm (P6), gray + alpha and RGBA as .pam (P7), since the other two cannot store alpha. The pixel
+/// data is appended by the caller.
+void WritePnmHeader(int width, int height, int numChannels, int maxValue, std::vector<uint8_t>& out);
@@ -0,0 +1,258 @@
+#include "qoi.h"
+
+#include "threadpool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+/// Blocks of rows with about this many pixels are encoded independently. The block layout only depends
+/// on the image size, so the number of threads does not change the file.
+constexpr int blockTargetPixels = 1 << 16;
+
+constexpr size_t headerSize = 14;
+constexpr uint8_t endMarker[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+
+constexpr uint8_t opIndex = 0x00, opDiff = 0x40, opLuma = 0x80, opRun = 0xC0;
+constexpr uint8_t opRgb = 0xFE, opRgba = 0xFF;
+constexpr uint8_t opMask = 0xC0;
+constexpr int maxRun = 62;
+
+/// A pixel as it is seen by the codec, gray is expanded to RGB
+struct Rgba {
+    uint8_t r, g, b, a;
+
+    bool operator==(const Rgba& other) const = default;
+    int Hash() const { return (r * 3 + g * 5 + b * 7 + a * 11) & 63; }
+};
+
+template<int NumChannels>
+Rgba LoadPixel(const uint8_t* p) {
+    if constexpr (NumChannels == 1) return { p[0], p[0], p[0], 255 };
+    if constexpr (NumChannels == 2) return { p[0], p[0], p[0], p[1] };
+    if constexpr (NumChannels == 3) return { p[0], p[1], p[2], 255 };
+    return { p[0], p[1], p[2], p[3] };
+}
+
+void StoreBigEndian(uint8_t* dst, uint32_t value) {
+    dst[0] = uint8_t(value >> 24);
+    dst[1] = uint8_t(value >> 16);
+    dst[2] = uint8_t(value >> 8);
+    dst[3] = uint8_t(value);
+}
+
+uint32_t LoadBigEndian(const uint8_t* src) {
+    return (uint32_t(src[0]) << 24) | (uint32_t(src[1]) << 16) | (uint32_t(src[2]) << 8) | src[3];
+}
+
+/// Encodes numPixels pixels that follow prev in the image, out needs room for five bytes per pixel. Index
+/// entries are only used if they were set within the block, except for the first block where the decoder
+/// starts with an all-zero index, too. Returns the number of bytes written.
+template<int NumChannels>
+size_t EncodeBlock(const uint8_t* pixels, size_t numPixels, Rgba prev, bool isFirst, uint8_t* out) {
+    // The decoder put prev into its index, but the initial prev of the first block is not in there
+    Rgba index[64] = {};
+    uint64_t valid = ~uint64_t(0);
+    if (!isFirst) {
+        valid = uint64_t(1) << prev.Hash();
+        index[prev.Hash()] = prev;
+    }
+
+    uint8_t* dst = out;
+    int run = 0;
+    for (size_t i = 0; i < numPixels; ++i) {
+        const Rgba px = LoadPixel<NumChannels>(pixels + i * NumChannels);
+        if (px == prev) {
+            if (++run == maxRun) {
+                *dst++ = uint8_t(opRun | (run - 1));
+                run = 0;
+            }
+            continue;
+        }
+        if (run > 0) {
+            *dst++ = uint8_t(opRun | (run - 1));
+            run = 0;
+        }
+
+        const int hash = px.Hash();
+        if ((valid >> hash & 1) && index[hash] == px) {
+            *dst++ = uint8_t(opIndex | hash);
+        } else {
+            index[hash] = px;
+            valid |= uint64_t(1) << hash;
+
+            if (px.a == prev.a) {
+                const int8_t dr = int8_t(px.r - prev.r), dg = int8_t(px.g - prev.g), db = int8_t(px.b - prev.b);
+                const int8_t drg = int8_t(dr - dg), dbg = int8_t(db - dg);
+                if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                    *dst++ = uint8_t(opDiff | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+                } else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7) {
+                    *dst++ = uint8_t(opLuma | (dg + 32));
+                    *dst++ = uint8_t((drg + 8) << 4 | (dbg + 8));
+                } else {
+                    *dst++ = opRgb;
+                    *dst++ = px.r;
+                    *dst++ = px.g;
+                    *dst++ = px.b;
+                }
+            } else {
+                *dst++ = opRgba;
+                *dst++ = px.r;
+                *dst++ = px.g;
+                *dst++ = px.b;
+                *dst++ = px.a;
+            }
+        }
+        prev = px;
+    }
+    if (run > 0)
+        *dst++ = uint8_t(opRun | (run - 1));
+    return dst - out;
+}
+
+template<int NumChannels>
+bool DecodePixels(const uint8_t* data, const uint8_t* end, uint8_t* pixels, size_t numPixels) {
+    Rgba index[64] = {};
+    Rgba px = { 0, 0, 0, 255 };
+    uint8_t* dst = pixels;
+    uint8_t* const dstEnd = pixels + numPixels * NumChannels;
+
+    // Every op is at most five bytes, so the loop only needs to check the bounds once per op
+    const uint8_t* const safeEnd = end - 5;
+    while (dst < dstEnd) {
+        if (data > safeEnd)
+            return false;
+
+        const uint8_t op = *data++;
+        int run = 1;
+        if (op == opRgb) {
+            px.r = data[0];
+            px.g = data[1];
+            px.b = data[2];
+            data += 3;
+        } else if (op == opRgba) {
+            px = { data[0], data[1], data[2], data[3] };
+            data += 4;
+        } else if ((op & opMask) == opIndex) {
+            px = index[op];
+        } else if ((op & opMask) == opDiff) {
+            px.r += ((op >> 4) & 3) - 2;
+            px.g += ((op >> 2) & 3) - 2;
+            px.b += (op & 3) - 2;
+        } else if ((op & opMask) == opLuma) {
+            const int dg = (op & 0x3F) - 32;
+            const uint8_t next = *data++;
+            px.r += dg - 8 + (next >> 4);
+            px.g += dg;
+            px.b += dg - 8 + (next & 15);
+        } else {
+            run = (op & 0x3F) + 1;
+        }
+        index[px.Hash()] = px;
+
+        run = (int) std::min<size_t>(run, (dstEnd - dst) / NumChannels);
+        for (int i = 0; i < run; ++i, dst += NumChannels) {
+            dst[0] = px.r;
+            dst[1] = px.g;
+            dst[2] = px.b;
+            if constexpr (NumChannels == 4) dst[3] = px.a;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+bool ReadQoiHeader(const uint8_t* data, size_t size, QoiHeader& header) {
+    if (size < headerSize + sizeof(endMarker) || std::memcmp(data, "qoif", 4) != 0)
+        return false;
+    const uint32_t width = LoadBigEndian(data + 4), height = LoadBigEndian(data + 8);
+    if (width == 0 || height == 0 || width > (1u << 30) / height || (data[12] != 3 && data[12] != 4)
+        || data[13] > 1)
+        return false;
+    header = { (int) width, (int) height, data[12], data[13] == 1 };
+    return true;
+}
+
+bool EncodeQoi(const uint8_t* pixels, int width, int height, int numChannels, std::vector<uint8_t>& out,
+               int numThreads) {
+    if (width <= 0 || height <= 0 || numChannels < 1 || numChannels > 4) {
+        std::cerr << "ERROR: Cannot encode a " << width << "x" << height << " image with " << numChannels
+                  << " channels as .qoi" << std::endl;
+        return false;
+    }
+
+    const int rowsPerBlock = std::clamp(blockTargetPixels / width, 1, height);
+    const int numBlocks = (height + rowsPerBlock - 1) / rowsPerBlock;
+    const size_t blockPixels = (size_t) rowsPerBlock * width, numPixels = (size_t) width * height;
+
+    std::vector<std::vector<uint8_t>> blocks(numBlocks);
+    std::atomic<int> nextBlock = 0;
+    IOThreadPool().RunParallel(std::min(numThreads, numBlocks), [&] {
+        // Room for the worst case, an RGBA op for every pixel
+        std::vector<uint8_t> encoded(blockPixels * 5);
+        for (int i; (i = nextBlock++) < numBlocks; ) {
+            const size_t first = i * blockPixels, count = std::min(blockPixels, numPixels - first);
+            const uint8_t* start = pixels + first * numChannels;
+
+            // Blocks continue from the last pixel of the block above, which the decoder has in its index
+            Rgba prev = { 0, 0, 0, 255 };
+            size_t size;
+            switch (numChannels) {
+                case 1:
+                    if (i > 0) prev = LoadPixel<1>(start - 1);
+                    size = EncodeBlock<1>(start, count, prev, i == 0, encoded.data());
+                    break;
+                case 2:
+                    if (i > 0) prev = LoadPixel<2>(start - 2);
+                    size = EncodeBlock<2>(start, count, prev, i == 0, encoded.data());
+                    break;
+                case 3:
+                    if (i > 0) prev = LoadPixel<3>(start - 3);
+                    size = EncodeBlock<3>(start, count, prev, i == 0, encoded.data());
+                    break;
+                default:
+                    if (i > 0) prev = LoadPixel<4>(start - 4);
+                    size = EncodeBlock<4>(start, count, prev, i == 0, encoded.data());
+                    break;
+            }
+            blocks[i].assign(encoded.begin(), encoded.begin() + size);
+        }
+    });
+
+    size_t totalSize = headerSize + sizeof(endMarker);
+    for (auto& block : blocks) totalSize += block.size();
+    size_t offset = out.size();
+    out.resize(offset + totalSize);
+    uint8_t* dst = out.data() + offset;
+
+    std::memcpy(dst, "qoif", 4);
+    StoreBigEndian(dst + 4, (uint32_t) width);
+    StoreBigEndian(dst + 8, (uint32_t) height);
+    dst[12] = numChannels == 1 || numChannels == 3 ? 3 : 4;
+    dst[13] = 0; // sRGB with linear alpha
+    dst += headerSize;
+    for (auto& block : blocks) {
+        std::memcpy(dst, block.data(), block.size());
+        dst += block.size();
+    }
+    std::memcpy(dst, endMarker, sizeof(endMarker));
+    return true;
+}
+
+bool DecodeQoi(const uint8_t* data, size_t size, uint8_t* pixels) {
+    QoiHeader header;
+    if (!ReadQoiHeader(data, size, header))
+        return false;
+
+    // Valid files end with the 8 byte marker, so any op that starts 5 or more bytes before the end is complete
+    const uint8_t* begin = data + headerSize;
+    const uint8_t* end = data + size;
+    const size_t numPixels = (size_t) header.width * header.height;
+    if (header.numChannels == 3)
+        return DecodePixels<3>(begin, end, pixels, numPixels);
+    return DecodePixels<4>(begin, end, pixels, numPixels);
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// Metadata from the header of a .qoi file
+struct QoiHeader {
+    int width, height;
+    int numChannels;  // 3 (RGB) or 4 (RGBA)
+    bool isLinear;    // All channels are linear, otherwise the colors are sRGB and alpha is linear
+};
+
+/// Reads and validates the header of a .qoi file in memory. Returns false for anything else.
+bool ReadQoiHeader(const uint8_t* data, size_t size, QoiHeader& header);
+
+/// Encodes 8 bit sRGB pixels with linear alpha and one to four interleaved channels as a .qoi file ("The
+/// Quite OK Image Format"), appended to the output. Gray images are stored as RGB, gray + alpha as RGBA.
+/// Blocks of rows are encoded concurrently on up to numThreads threads of the I/O pool: each block starts
+/// with its own color index and the last pixel of the block above, so the blocks form one valid stream when
+/// concatenated. The file is the same for any number of threads. Errors are reported to stderr.
+bool EncodeQoi(const uint8_t* pixels, int width, int height, int numChannels, std::vector<uint8_t>& out,
+               int numThreads = 1);
+
+/// Decodes a .qoi file in memory to 8 bit pixels with the channel count of the header, written to pixels
+/// without gaps between rows. Returns false if the data ends early or does not start with a valid header.
+bool DecodeQoi(const uint8_t* data, size_t size, uint8_t* pixels);
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+float LinearToSrgb(float linear);
+float SrgbToLinear(float srgb);
+
+/// Converts linear values to sRGB and quantizes them to [0, 255], with exactly the same result as
+/// truncating the clamped value of 255 * LinearToSrgb(v), but without evaluating std::pow. Negative values
+/// and NaN map to 0.
+void LinearToSrgbBytes(const float* values, uint8_t* result, size_t count);
+
+/// Converts linear values to sRGB and maps them to [0, 65535], rounded to the nearest integer. Negative
+/// values and NaN map to 0.
+void LinearToSrgb16(const float* values, uint16_t* result, size_t count);
+
+/// Converts a row of linear pixels to 8 bit sRGB samples, like LinearToSrgbBytes(). If the channel count is
+/// even, the last channel is alpha, which is quantized linearly (rounded to the nearest value) instead. This
+/// is the inverse of SrgbToLinearRow().
+void LinearToSrgbRow(const float* src, uint8_t* dst, size_t numPixels, int numChannels);
+
+/// Same as above, for 16 bit samples
+void LinearToSrgbRow(const float* src, uint16_t* dst, size_t numPixels, int numChannels);
+
+/// Expands a row of 8 bit sRGB samples to linear floats via a lookup table. If the channel count is even,
+/// the last channel is alpha, which is mapped linearly to [0, 1] instead.
+void SrgbToLinearRow(const uint8_t* src, float* dst, size_t numPixels, int numChannels);
+
+/// Same as above, for 16 bit samples
+void SrgbToLinearRow(const uint16_t* src, float* dst, size_t numPixels, int numChannels);
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// Fixed set of worker threads that run tasks in the order they are submitted. The threads are started
+/// once and then reused, so submitting a task does not pay for creating a thread.
+class ThreadPool {
+public:
+    explicit ThreadPool(int numThreads) {
+        numThreads = std::max(numThreads, 1);
+        maxActive = numThreads;
+        for (int i = 0; i < numThreads; ++i)
+            workers.emplace_back([this] { Run(); });
+    }
+
+    /// Waits for all queued tasks to finish
+    ~ThreadPool() {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        wakeUp.notify_all();
+        for (auto& w : workers) w.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /// Queues a task, it is run by the next idle worker
+    void Submit(std::function<void()> task) {
+        {
+            std::lock_guard lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+        wakeUp.notify_one();
+    }
+
+    /// Runs work() on the calling thread and, concurrently, on up to numThreads - 1 workers, like an OpenMP
+    /// parallel region. The work is shared among the calls by the caller, e.g., via an atomic loop counter.
+    /// The helpers are queued as ordinary tasks (at most MaxActive() of them), so any worker that becomes
+    /// free while the caller is still busy joins in. Once the caller's own call returns, it only waits for
+    /// the helpers that have already started, the others return without calling work(). Hence, this can
+    /// also be called from within a task without waiting for other tasks.
+    void RunParallel(int numThreads, const std::function<void()>& work) {
+        struct Region {
+            std::mutex mutex;
+            std::condition_variable done;
+            int numRunning = 0;
+            bool closed = false;
+        };
+        auto region = std::make_shared<Region>();
+
+        int numHelpers = std::min(numThreads - 1, MaxActive());
+        for (int i = 0; i < numHelpers; ++i) {
+            Submit([region, &work] {
+                {
+                    std::lock_guard lock(region->mutex);
+                    if (region->closed) return; // The caller has already finished all the work
+                    region->numRunning++;
+                }
+                work();
+                {
+                    std::lock_guard lock(region->mutex);
+                    region->numRunning--;
+                }
+                region->done.notify_all();
+            });
+        }
+
+        work();
+
+        // Helpers that start after this point return right away, without touching the work function
+        std::unique_lock lock(region->mutex);
+        region->closed = true;
+        region->done.wait(lock, [&region] { return region->numRunning == 0; });
+    }
+
+    int NumThreads() const { return (int) workers.size(); }
+
+    /// Limits how many workers run tasks at the same time, values outside [1, NumThreads()] remove the limit
+    void SetMaxActive(int num) {
+        {
+            std::lock_guard lock(mutex);
+            maxActive = num < 1 || num > NumThreads() ? NumThreads() : num;
+        }
+        wakeUp.notify_all();
+    }
+
+    int MaxActive() {
+        std::lock_guard lock(mutex);
+        return maxActive;
+    }
+
+private:
+    void Run() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock lock(mutex);
+                wakeUp.wait(lock, [this] { return stopping || (!tasks.empty() && numActive < maxActive); });
+                if (tasks.empty()) return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+                numActive++;
+            }
+            task();
+            {
+                std::lock_guard lock(mutex);
+                numActive--;
+            }
+            wakeUp.notify_one();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    bool stopping = false;
+    int numActive = 0;
+    int maxActive = 0;
+};
+
+/// Shared worker threads for all image I/O, started on first use
+ThreadPool& IOThreadPool();
@@ -0,0 +1,556 @@
+#include "tiff.h"
+#include "half.h"
+#include "mappedfile.h"
+#include "srgb.h"
+#include "threadpool.h"
+
+#include "External/miniz.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+namespace {
+
+enum TiffTag : uint16_t {
+    ImageWidth = 256,
+    ImageLength = 257,
+    BitsPerSample = 258,
+    Compression = 259,
+    Photometric = 262,
+    StripOffsets = 273,
+    SamplesPerPixel = 277,
+    RowsPerStrip = 278,
+    StripByteCounts = 279,
+    XResolution = 282,
+    YResolution = 283,
+    PlanarConfiguration = 284,
+    ResolutionUnit = 296,
+    Predictor = 317,
+    TileWidth = 322,
+    ExtraSamples = 338,
+    SampleFormat = 339,
+};
+
+enum TiffType : uint16_t {
+    Short = 3,
+    Long = 4,
+    Rational = 5,
+};
+
+enum TiffPredictor : uint32_t {
+    NoPredictor = 1,
+    HorizontalPredictor = 2,
+    FloatingPointPredictor = 3,
+};
+
+uint16_t SwapBytes(uint16_t v) { return uint16_t(v << 8 | v >> 8); }
+
+/// Parses the first image file directory (IFD) of a classic (non-BigTIFF) TIFF file
+class TiffDirectory {
+public:
+    bool Parse(const uint8_t* data, size_t size) {
+        this->data = data;
+        this->size = size;
+        if (size < 8) return false;
+
+        if (data[0] == 'I' && data[1] == 'I') bigEndian = false;
+        else if (data[0] == 'M' && data[1] == 'M') bigEndian = true;
+        else return false;
+
+        if (U16(2) != 42) return false;
+
+        size_t ifd = U32(4);
+        if (ifd + 2 > size) return false;
+        int numEntries = U16(ifd);
+        if (ifd + 2 + 12 * (size_t) numEntries > size) return false;
+        entries = ifd + 2;
+        this->numEntries = numEntries;
+        return true;
+    }
+
+    bool Has(uint16_t tag) const { return Find(tag) != 0; }
+
+    /// Reads all values of a SHORT or LONG field, or returns a single default value if the field is missing
+    std::vector<uint32_t> Values(uint16_t tag, uint32_t defaultValue) const {
+        size_t entry = Find(tag);
+        if (!entry) return { defaultValue };
+
+        uint16_t type = U16(entry + 2);
+        uint32_t count = U32(entry + 4);
+        size_t typeSize = type == 3 ? 2 : (type == 4 ? 4 : 0);
+        if (typeSize == 0) return {};
+
+        size_t offset = count * typeSize <= 4 ? entry + 8 : U32(entry + 8);
+        if (offset + count * typeSize > size) return {};
+
+        std::vector<uint32_t> values(count);
+        for (uint32_t i = 0; i < count; ++i)
+            values[i] = typeSize == 2 ? U16(offset + 2 * i) : U32(offset + 4 * i);
+        return values;
+    }
+
+    uint32_t Value(uint16_t tag, uint32_t defaultValue) const {
+        auto values = Values(tag, defaultValue);
+        return values.empty() ? 0 : values[0];
+    }
+
+    bool BigEndian() const { return bigEndian; }
+
+private:
+    size_t Find(uint16_t tag) const {
+        for (int i = 0; i < numEntries; ++i) {
+            size_t entry = entries + 12 * i;
+            if (U16(entry) == tag) return entry;
+        }
+        return 0;
+    }
+
+    uint16_t U16(size_t offset) const {
+        const uint8_t* p = data + offset;
+        return bigEndian ? uint16_t(p[0] << 8 | p[1]) : uint16_t(p[1] << 8 | p[0]);
+    }
+
+    uint32_t U32(size_t offset) const {
+        const uint8_t* p = data + offset;
+        return bigEndian
+            ? (uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | p[3])
+            : (uint32_t(p[3]) << 24 | uint32_t(p[2]) << 16 | uint32_t(p[1]) << 8 | p[0]);
+    }
+
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    bool bigEndian = false;
+    size_t entries = 0;
+    int numEntries = 0;
+};
+
+} // namespace
+
+TiffStripReader::TiffStripReader() = default;
+TiffStripReader::~TiffStripReader() = default;
+
+TiffReadResult TiffStripReader::Open(const char* filename) {
+    file = std::make_unique<MappedFile>(filename);
+    if (!file->IsOpen()) {
+        std::cerr << "ERROR: Could not read file: " << filename << std::endl;
+        return TiffReadResult::Error;
+    }
+    return Open(file->Data(), file->Size(), filename);
+}
+
+TiffReadResult TiffStripReader::Open(const uint8_t* data, size_t size, const char* name) {
+    filename = name;
+    this->data = data;
+    this->size = size;
+
+    TiffDirectory dir;
+    if (!dir.Parse(data, size))
+        return TiffReadResult::Unsupported;
+
+    width = (int) dir.Value(ImageWidth, 0);
+    height = (int) dir.Value(ImageLength, 0);
+    channels = (int) dir.Value(SamplesPerPixel, 1);
+    rowsPerStrip = (int) std::min<uint32_t>(dir.Value(RowsPerStrip, height), height);
+    compression = dir.Value(Compression, 1);
+    predictor = dir.Value(Predictor, NoPredictor);
+    const auto bits = dir.Values(BitsPerSample, 1);
+    const auto formats = dir.Values(SampleFormat, 1);
+    offsets = dir.Values(StripOffsets, 0);
+    byteCounts = dir.Values(StripByteCounts, 0);
+
+    // Only accept what we can decode exactly, everything else is left to the full decoder
+    if (width <= 0 || height <= 0 || channels <= 0 || rowsPerStrip <= 0 || dir.Has(TileWidth)
+        || !dir.Has(StripOffsets) || !dir.Has(StripByteCounts)
+        || dir.Value(PlanarConfiguration, 1) != 1
+        || (compression != 1 && compression != 8 && compression != 32946)
+        || bits.empty() || formats.empty())
+        return TiffReadResult::Unsupported;
+
+    for (auto b : bits) if (b != bits[0]) return TiffReadResult::Unsupported;
+    for (auto f : formats) if (f != formats[0]) return TiffReadResult::Unsupported;
+    const bool isFloat = formats[0] == 3;
+    if (bits[0] == 8 && formats[0] == 1) sampleType = TiffSampleType::UInt8;
+    else if (bits[0] == 16 && formats[0] == 1) sampleType = TiffSampleType::UInt16;
+    else if (bits[0] == 16 && isFloat) sampleType = TiffSampleType::Half;
+    else if (bits[0] == 32 && isFloat) sampleType = TiffSampleType::Float;
+    else return TiffReadResult::Unsupported;
+    bytesPerSample = bits[0] / 8;
+
+    if (predictor != NoPredictor && predictor != (isFloat ? FloatingPointPredictor : HorizontalPredictor))
+        return TiffReadResult::Unsupported;
+
+    const int numStrips = (height + rowsPerStrip - 1) / rowsPerStrip;
+    if ((int) offsets.size() < numStrips || (int) byteCounts.size() < numStrips) {
+        std::cerr << "ERROR: Invalid strip offsets in file: " << filename << std::endl;
+        return TiffReadResult::Error;
+    }
+
+    // The floating point predictor stores the bytes of each sample from the most significant one, regardless
+    // of the byte order of the file
+    swapBytes = bytesPerSample > 1 && predictor != FloatingPointPredictor
+        && dir.BigEndian() != (std::endian::native == std::endian::big);
+    return TiffReadResult::Success;
+}
+
+void TiffStripReader::UnpackRow(const uint8_t* src, uint8_t* dst, uint8_t* tmp) const {
+    const size_t count = (size_t) width * channels;
+    if (predictor == FloatingPointPredictor) {
+        // Undo the differences between bytes, then gather the bytes of each sample from their planes
+        const size_t rowBytes = count * bytesPerSample;
+        std::copy_n(src, channels, tmp);
+        for (size_t i = channels; i < rowBytes; ++i)
+            tmp[i] = uint8_t(src[i] + tmp[i - channels]);
+
+        if (bytesPerSample == 4) {
+            for (size_t k = 0; k < count; ++k) {
+                uint32_t v = uint32_t(tmp[k]) << 24 | uint32_t(tmp[count + k]) << 16
+                           | uint32_t(tmp[2 * count + k]) << 8 | tmp[3 * count + k];
+                std::memcpy(dst + 4 * k, &v, 4);
+            }
+        } else {
+            for (size_t k = 0; k < count; ++k) {
+                uint16_t v = uint16_t(tmp[k] << 8 | tmp[count + k]);
+                std::memcpy(dst + 2 * k, &v, 2);
+            }
+        }
+        return;
+    }
+
+    if (bytesPerSample == 1) {
+        // Rows without predictor are used as they are, so this is horizontal differencing
+        std::copy_n(src, channels, dst);
+        for (size_t i = channels; i < count; ++i)
+            dst[i] = uint8_t(src[i] + dst[i - channels]);
+    } else if (bytesPerSample == 2) {
+        uint16_t* out = (uint16_t*) dst;
+        for (size_t i = 0; i < count; ++i) {
+            uint16_t v;
+            std::memcpy(&v, src + 2 * i, 2);
+            if (swapBytes) v = SwapBytes(v);
+            if (predictor == HorizontalPredictor && i >= (size_t) channels) v = uint16_t(v + out[i - channels]);
+            out[i] = v;
+        }
+    } else {
+        std::memcpy(dst, src, count * 4);
+        for (size_t i = 0; i < count; ++i) {
+            uint8_t* v = dst + 4 * i;
+            std::swap(v[0], v[3]);
+            std::swap(v[1], v[2]);
+        }
+    }
+}
+
+bool TiffStripReader::Read(const ImageRect& region, float* dst, size_t dstRowStride, int numThreads) const {
+    const size_t rowBytes = (size_t) width * channels * bytesPerSample;
+    const int firstStrip = region.y / rowsPerStrip;
+    const int lastStrip = (region.y + region.height - 1) / rowsPerStrip;
+
+    std::atomic<int> nextStrip = firstStrip;
+    std::atomic<bool> failed = false;
+    IOThreadPool().RunParallel(std::min(numThreads, lastStrip - firstStrip + 1), [&] {
+        std::vector<uint8_t> inflated, unpacked, tmp;
+        for (int strip; (strip = nextStrip++) <= lastStrip; ) {
+            const int stripY = strip * rowsPerStrip;
+            const int stripRows = std::min(rowsPerStrip, height - stripY);
+            const size_t offset = offsets[strip];
+            const size_t byteCount = byteCounts[strip];
+            if (offset + byteCount > size) {
+                failed = true;
+                continue;
+            }
+
+            const uint8_t* pixels = data + offset;
+            if (compression == 1) {
+                if (byteCount < stripRows * rowBytes) {
+                    failed = true;
+                    continue;
+                }
+            } else {
+                inflated.resize(stripRows * rowBytes);
+                mz_ulong len = (mz_ulong) inflated.size();
+                if (mz_uncompress(inflated.data(), &len, pixels, (mz_ulong) byteCount) != MZ_OK
+                    || len != inflated.size()) {
+                    failed = true;
+                    continue;
+                }
+                pixels = inflated.data();
+            }
+
+            int rowBegin = std::max(stripY, region.y);
+            int rowEnd = std::min(stripY + stripRows, region.y + region.height);
+            for (int row = rowBegin; row < rowEnd; ++row) {
+                // Rows are used in place unless they need a predictor or byte order undone, or their 16 bit
+                // samples are not aligned
+                const uint8_t* samples = pixels + (row - stripY) * rowBytes;
+                if (predictor != NoPredictor || swapBytes || (bytesPerSample == 2 && (uintptr_t) samples % 2)) {
+                    unpacked.resize(rowBytes);
+                    tmp.resize(rowBytes);
+                    UnpackRow(samples, unpacked.data(), tmp.data());
+                    samples = unpacked.data();
+                }
+
+                const uint8_t* src = samples + (size_t) region.x * channels * bytesPerSample;
+                float* out = dst + (size_t) (row - region.y) * dstRowStride;
+                size_t count = (size_t) region.width * channels;
+                switch (sampleType) {
+                    case TiffSampleType::UInt8:
+                        SrgbToLinearRow(src, out, region.width, channels);
+                        break;
+                    case TiffSampleType::UInt16:
+                        SrgbToLinearRow((const uint16_t*) src, out, region.width, channels);
+                        break;
+                    case TiffSampleType::Half:
+                        HalfToFloatRow((const uint16_t*) src, out, count);
+                        break;
+                    case TiffSampleType::Float:
+                        std::memcpy(out, src, count * sizeof(float));
+                        break;
+                }
+            }
+        }
+    });
+
+    if (failed) {
+        std::cerr << "ERROR: Invalid or corrupted strip data in file: " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool ProbeTiff(const char* filename, ImageInfo* info) {
+    MappedFile file(filename);
+    if (!file.IsOpen()) {
+        std::cerr << "ERROR: Could not read file: " << filename << std::endl;
+        return false;
+    }
+    return ProbeTiff(file.Data(), file.Size(), filename, info);
+}
+
+bool ProbeTiff(const uint8_t* data, size_t size, const char* filename, ImageInfo* info) {
+    TiffDirectory dir;
+    if (!dir.Parse(data, size)) {
+        std::cerr << "ERROR: Invalid or unsupported TIFF header in file: " << filename << std::endl;
+        return false;
+    }
+
+    const uint32_t bits = dir.Value(BitsPerSample, 1);
+    const bool isFloat = dir.Value(SampleFormat, 1) == 3;
+    if (bits == 8 && !isFloat) info->pixelType = (int) PixelType::UInt8;
+    else if (bits == 16) info->pixelType = (int) (isFloat ? PixelType::Half : PixelType::UInt16);
+    else if (bits == 32) info->pixelType = (int) (isFloat ? PixelType::Float : PixelType::UInt32);
+    else {
+        std::cerr << "ERROR: Unsupported TIFF sample format (" << bits << " bits) in file: " << filename << std::endl;
+        return false;
+    }
+
+    info->width = (int) dir.Value(ImageWidth, 0);
+    info->height = (int) dir.Value(ImageLength, 0);
+    info->numChannels = (int) dir.Value(SamplesPerPixel, 1);
+    info->numLayers = 0;
+    if (info->width <= 0 || info->height <= 0 || info->numChannels <= 0) {
+        std::cerr << "ERROR: Invalid image dimensions in file: " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+namespace {
+
+/// Strips are compressed independently, each from about this many bytes of samples. The layout does not
+/// depend on the number of threads, so neither does the file.
+constexpr size_t stripTargetSize = size_t(256) << 10;
+
+mz_bool AppendDeflated(const void* data, int len, void* user) {
+    auto& out = *(std::vector<uint8_t>*) user;
+    out.insert(out.end(), (const uint8_t*) data, (const uint8_t*) data + len);
+    return MZ_TRUE;
+}
+
+/// Converts a row to samples in native byte order and applies the predictor. Floats are split into planes
+/// of their bytes, from the most significant one, and the planes are differenced byte by byte. Integers
+/// are differenced with the same channel of the previous pixel. tmp is scratch space of the size of a row.
+void PackRow(const float* src, int width, int numChannels, TiffSampleType sampleType, uint8_t* dst,
+             uint8_t* tmp) {
+    const size_t count = (size_t) width * numChannels;
+    if (sampleType == TiffSampleType::UInt16) {
+        uint16_t* samples = (uint16_t*) tmp;
+        LinearToSrgbRow(src, samples, width, numChannels);
+        for (size_t i = count; i-- > (size_t) numChannels; )
+            samples[i] = uint16_t(samples[i] - samples[i - numChannels]);
+        std::memcpy(dst, samples, count * 2);
+        return;
+    }
+
+    size_t bytesPerSample;
+    if (sampleType == TiffSampleType::Half) {
+        uint16_t* halves = (uint16_t*) tmp;
+        FloatToHalfRow(src, halves, count);
+        for (size_t k = 0; k < count; ++k) {
+            dst[k] = uint8_t(halves[k] >> 8);
+            dst[count + k] = uint8_t(halves[k]);
+        }
+        bytesPerSample = 2;
+    } else {
+        for (size_t k = 0; k < count; ++k) {
+            uint32_t v;
+            std::memcpy(&v, src + k, 4);
+            dst[k] = uint8_t(v >> 24);
+            dst[count + k] = uint8_t(v >> 16);
+            dst[2 * count + k] = uint8_t(v >> 8);
+            dst[3 * count + k] = uint8_t(v);
+        }
+        bytesPerSample = 4;
+    }
+    for (size_t i = count * bytesPerSample; i-- > (size_t) numChannels; )
+        dst[i] = uint8_t(dst[i] - dst[i - numChannels]);
+}
+
+/// A field of an image file directory, rationals are stored as pairs of numerator and denominator
+struct TiffField {
+    uint16_t tag;
+    TiffType type;
+    std::vector<uint32_t> values;
+
+    uint32_t Count() const { return uint32_t(type == Rational ? values.size() / 2 : values.size()); }
+    size_t NumBytes() const { return values.size() * (type == Short ? 2 : 4); }
+};
+
+template<typename T>
+void Append(std::vector<uint8_t>& out, T value) {
+    uint8_t bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+void AppendValues(std::vector<uint8_t>& out, const TiffField& field) {
+    for (uint32_t v : field.values) {
+        if (field.type == Short) Append(out, uint16_t(v));
+        else Append(out, v);
+    }
+}
+
+} // namespace
+
+bool EncodeTiff(const float* data, size_t rowStride, int width, int height, int numChannels,
+                TiffSampleType sampleType, std::vector<uint8_t>& out, int numThreads) {
+    assert(out.empty());
+    if (width <= 0 || height <= 0 || numChannels < 1 || sampleType == TiffSampleType::UInt8) {
+        std::cerr << "ERROR: Cannot encode a " << width << "x" << height << " image with " << numChannels
+                  << " channels as .tif" << std::endl;
+        return false;
+    }
+
+    const bool isFloat = sampleType != TiffSampleType::UInt16;
+    const uint32_t bitsPerSample = sampleType == TiffSampleType::Float ? 32 : 16;
+    const size_t rowBytes = (size_t) width * numChannels * bitsPerSample / 8;
+    const int rowsPerStrip = (int) std::clamp<size_t>(stripTargetSize / rowBytes, 1, height);
+    const int numStrips = (height + rowsPerStrip - 1) / rowsPerStrip;
+
+    std::vector<std::vector<uint8_t>> strips(numStrips);
+    std::atomic<int> nextStrip = 0;
+    std::atomic<bool> failed = false;
+    IOThreadPool().RunParallel(std::min(numThreads, numStrips), [&] {
+        // The compressor state is several hundred KB, so every thread reuses its own
+        auto compressor = std::make_unique<tdefl_compressor>();
+        const mz_uint flags = tdefl_create_comp_flags_from_zip_params(MZ_BEST_SPEED, 15, MZ_DEFAULT_STRATEGY);
+        std::vector<uint8_t> packed, tmp(rowBytes);
+        for (int s; (s = nextStrip++) < numStrips; ) {
+            const int firstRow = s * rowsPerStrip;
+            const int numRows = std::min(rowsPerStrip, height - firstRow);
+            packed.resize(numRows * rowBytes);
+            for (int i = 0; i < numRows; ++i)
+                PackRow(data + (firstRow + i) * rowStride, width, numChannels, sampleType,
+                        packed.data() + i * rowBytes, tmp.data());
+
+            strips[s].reserve(packed.size() / 2);
+            if (tdefl_init(compressor.get(), AppendDeflated, &strips[s], flags) != TDEFL_STATUS_OKAY
+                || tdefl_compress_buffer(compressor.get(), packed.data(), packed.size(), TDEFL_FINISH)
+                    != TDEFL_STATUS_DONE)
+                failed = true;
+        }
+    });
+    if (failed) {
+        std::cerr << "ERROR: Compressing the .tif data failed" << std::endl;
+        return false;
+    }
+
+    // The fields must be sorted by their tag. The first extra channel of gray + alpha and RGBA images is
+    // unassociated alpha, any others are unspecified.
+    const uint32_t numColors = numChannels >= 3 ? 3 : 1;
+    std::vector<uint32_t> offsets(numStrips), byteCounts(numStrips);
+    for (int s = 0; s < numStrips; ++s) byteCounts[s] = (uint32_t) strips[s].size();
+    std::vector<TiffField> fields = {
+        { ImageWidth, Long, { (uint32_t) width } },
+        { ImageLength, Long, { (uint32_t) height } },
+        { BitsPerSample, Short, std::vector<uint32_t>(numChannels, bitsPerSample) },
+        { Compression, Short, { 8 } },
+        { Photometric, Short, { numColors == 3 ? 2u : 1u } },
+        { StripOffsets, Long, offsets },
+        { SamplesPerPixel, Short, { (uint32_t) numChannels } },
+        { RowsPerStrip, Long, { (uint32_t) rowsPerStrip } },
+        { StripByteCounts, Long, byteCounts },
+        { XResolution, Rational, { 1, 1 } },
+        { YResolution, Rational, { 1, 1 } },
+        { PlanarConfiguration, Short, { 1 } },
+        { ResolutionUnit, Short, { 1 } },
+        { Predictor, Short, { isFloat ? FloatingPointPredictor : HorizontalPredictor } },
+    };
+    if ((uint32_t) numChannels > numColors) {
+        std::vector<uint32_t> extra(numChannels - numColors, 0);
+        if (numChannels == 2 || numChannels == 4) extra[0] = 2;
+        fields.push_back({ ExtraSamples, Short, extra });
+    }
+    fields.push_back({ SampleFormat, Short, std::vector<uint32_t>(numChannels, isFloat ? 3 : 1) });
+
+    // Layout: header, directory, the values that do not fit into their field, and the strips. All parts
+    // have an even size, so every offset is word aligned as required.
+    const size_t directorySize = 2 + 12 * fields.size() + 4;
+    size_t valuesSize = 0;
+    for (auto& field : fields)
+        if (field.NumBytes() > 4) valuesSize += field.NumBytes();
+    size_t offset = 8 + directorySize + valuesSize;
+    for (int s = 0; s < numStrips; ++s) {
+        offsets[s] = (uint32_t) offset;
+        offset += strips[s].size();
+    }
+    if (offset > std::numeric_limits<uint32_t>::max()) {
+        std::cerr << "ERROR: The compressed image is too large for a .tif file" << std::endl;
+        return false;
+    }
+    for (auto& field : fields)
+        if (field.tag == StripOffsets) field.values = offsets;
+
+    out.reserve(offset);
+    const bool bigEndian = std::endian::native == std::endian::big;
+    out.push_back(bigEndian ? 'M' : 'I');
+    out.push_back(bigEndian ? 'M' : 'I');
+    Append(out, uint16_t(42));
+    Append(out, uint32_t(8));
+
+    Append(out, uint16_t(fields.size()));
+    size_t valueOffset = 8 + directorySize;
+    for (auto& field : fields) {
+        Append(out, field.tag);
+        Append(out, uint16_t(field.type));
+        Append(out, field.Count());
+        if (field.NumBytes() > 4) {
+            Append(out, uint32_t(valueOffset));
+            valueOffset += field.NumBytes();
+        } else {
+            AppendValues(out, field);
+            out.resize(out.size() + 4 - field.NumBytes());
+        }
+    }
+    Append(out, uint32_t(0)); // No further directories
+
+    for (auto& field : fields)
+        if (field.NumBytes() > 4) AppendValues(out, field);
+    for (auto& strip : strips)
+        out.insert(out.end(), strip.begin(), strip.end());
+    return out.size() == offset;
+}
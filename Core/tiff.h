@@ -0,0 +1,93 @@
+#pragma once
+
+#include "image.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class MappedFile;
+
+enum class TiffReadResult {
+    Success,
+
+    /// The file uses a TIFF feature that the reader does not handle, e.g., tiles or LZW compression
+    Unsupported,
+
+    Error
+};
+
+/// Type of the samples in a TIFF file
+enum class TiffSampleType {
+    UInt8,
+    UInt16,
+    Half,
+    Float,
+};
+
+/// Reads strip-based TIFF images. Supports uncompressed and deflate compressed files with 8 or 16 bit
+/// unsigned integer, or 16 or 32 bit float samples, with or without the horizontal (integer) or floating
+/// point predictor. Only the strips that overlap the requested rows are read and decompressed, and the
+/// pixels are written straight to the destination.
+class TiffStripReader {
+public:
+    TiffStripReader();
+    ~TiffStripReader();
+
+    TiffStripReader(const TiffStripReader&) = delete;
+    TiffStripReader& operator=(const TiffStripReader&) = delete;
+
+    /// Maps the file and parses the first image directory. Errors are reported to stderr, unsupported
+    /// files are not, so the caller can fall back to another decoder.
+    TiffReadResult Open(const char* filename);
+
+    /// Parses the first image directory of a file in memory, which must outlive the reader. The name is
+    /// only used in error messages.
+    TiffReadResult Open(const uint8_t* data, size_t size, const char* name);
+
+    int Width() const { return width; }
+    int Height() const { return height; }
+    int NumChannels() const { return channels; }
+
+    /// Decodes the pixels within a region, which must lie within the image, in interleaved layout. Row r of
+    /// the region starts at dst + r * dstRowStride. Integer values are mapped to [0, 1] and converted from
+    /// sRGB to linear (except for the alpha channel). The strips are decoded concurrently on up to numThreads
+    /// threads of the I/O pool. Errors are reported to stderr.
+    bool Read(const ImageRect& region, float* dst, size_t dstRowStride, int numThreads = 1) const;
+
+private:
+    std::string filename;
+    std::unique_ptr<MappedFile> file;
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    int width = 0, height = 0, channels = 0;
+    int rowsPerStrip = 0;
+    uint32_t compression = 1;
+    uint32_t predictor = 1;
+    TiffSampleType sampleType = TiffSampleType::UInt8;
+    size_t bytesPerSample = 1;
+    bool swapBytes = false;
+
+    /// Undoes the predictor and byte order of a row, so dst holds the samples in native byte order. tmp
+    /// is scratch space of the size of a row.
+    void UnpackRow(const uint8_t* src, uint8_t* dst, uint8_t* tmp) const;
+    std::vector<uint32_t> offsets, byteCounts;
+};
+
+/// Reads the metadata of the first image in a classic TIFF file from its header, without touching the
+/// pixel data. Errors are reported to stderr.
+bool ProbeTiff(const char* filename, ImageInfo* info);
+
+/// Reads the metadata of a TIFF file in memory, see above. The name is only used in error messages.
+bool ProbeTiff(const uint8_t* data, size_t size, const char* name, ImageInfo* info);
+
+/// Encodes an image as a classic TIFF file in native byte order. The output must be empty, since the offsets
+/// within the file count from its first byte. The samples are stored as 32 bit or 16 bit (half) floats, or
+/// as 16 bit unsigned integers after conversion to sRGB (except for the alpha channel). The rows are split
+/// into strips that are deflate compressed, after the floating point predictor (floats) or horizontal
+/// differencing (integers), concurrently on up to numThreads threads of the I/O pool. The file is the same
+/// for any number of threads. Errors are reported to stderr.
+bool EncodeTiff(const float* data, size_t rowStride, int width, int height, int numChannels,
+                TiffSampleType sampleType, std::vector<uint8_t>& out, int numThreads = 1);
@@ -1,6 +1,7 @@
 import simpleimageio as sio
 import base64
 import time
+import os
 import pyexr
 import cv2
 from figuregen.util import image
@@ -9,6 +10,23 @@ start = time.time()
 img = sio.read("dikhololo_night_4k.hdr")
 print(f"Reading .hdr took {time.time() - start} seconds")
 
+# .hdr scanlines are run-length decoded and encoded in parallel, OpenCV does it one after another
+start = time.time()
+sio.write("our.hdr", img)
+print(f"Writing .hdr with ours took {time.time() - start} seconds")
+
+start = time.time()
+cv2.imwrite("cv2.hdr", cv2.cvtColor(img, cv2.COLOR_RGB2BGR))
+print(f"Writing .hdr with OpenCV took {time.time() - start} seconds")
+
+start = time.time()
+cv2.imread("our.hdr", cv2.IMREAD_UNCHANGED)
+print(f"Reading .hdr with OpenCV took {time.time() - start} seconds")
+
+start = time.time()
+sio.read("cv2.hdr")
+print(f"Reading .hdr written by OpenCV with ours took {time.time() - start} seconds")
+
 # writing .exr
 start = time.time()
 pyexr.write("pyexr.exr", img)
@@ -51,6 +69,11 @@ start = time.time()
 sio.read("our.png")
 print(f"Reading .png with ours took {time.time() - start} seconds")
 
+# files from other encoders are decoded by stb_image instead of fpng
+start = time.time()
+sio.read("cv2.png")
+print(f"Reading .png written by OpenCV with ours took {time.time() - start} seconds")
+
 start = time.time()
 cv2img = cv2.imread("cv2.png")
 print(f"Reading .png with cv2 took {time.time() - start} seconds")
@@ -67,6 +90,16 @@ start = time.time()
 sio.base64_png(img)
 print(f"b64 in memory took {time.time() - start} seconds")
 
+# data URI for HTML, via Python's base64 and with the native encoder
+start = time.time()
+uri = "data:image/png;base64," + base64.b64encode(sio.write_to_memory(".png", img)).decode()
+print(f"Data URI via base64 module took {time.time() - start} seconds")
+
+start = time.time()
+uri_native = sio.data_uri(img)
+print(f"Data URI with the native encoder took {time.time() - start} seconds")
+assert uri == uri_native
+
 # read .pfm and export to .exr, then re-read for comparison
 start = time.time()
 img = sio.read("memorial.pfm")
@@ -82,4 +115,144 @@ print(f"Writing the .pfm to .exr took {time.time() - start} seconds")
 
 start = time.time()
 sio.read("memorial.exr")
-print(f"Reading the .pfm equivalent .exr took {time.time() - start} seconds")
\ No newline at end of file
+print(f"Reading the .pfm equivalent .exr took {time.time() - start} seconds")
+# .pfm throughput with the 4k image, the file is in the OS cache after writing it
+img = sio.read("dikhololo_night_4k.hdr")
+gigabytes = img.nbytes / 1e9
+
+start = time.time()
+sio.write("dikhololo_test.pfm", img)
+elapsed = time.time() - start
+print(f"Writing 4k .pfm took {elapsed} seconds ({gigabytes / elapsed:.2f} GB/s)")
+
+start = time.time()
+sio.read("dikhololo_test.pfm")
+elapsed = time.time() - start
+print(f"Reading 4k .pfm took {elapsed} seconds ({gigabytes / elapsed:.2f} GB/s)")
+
+start = time.time()
+mapped = sio.map_pfm("dikhololo_test.pfm")
+print(f"Mapping 4k .pfm took {time.time() - start} seconds")
+
+start = time.time()
+mapped.sum()
+elapsed = time.time() - start
+print(f"Summing the mapped 4k .pfm took {elapsed} seconds ({gigabytes / elapsed:.2f} GB/s)")
+del mapped
+
+# Speed and size of the .exr compression methods on the 4k image
+for precision, quality in [("half", 0), ("float", 100)]:
+    for compression in sio.EXR_COMPRESSIONS:
+        start = time.time()
+        sio.write("dikhololo_test.exr", img, quality, compression)
+        encode = time.time() - start
+
+        start = time.time()
+        sio.read("dikhololo_test.exr")
+        decode = time.time() - start
+
+        size = os.path.getsize("dikhololo_test.exr") / 1024
+        print(f".exr {precision:5} {compression:4}: encode {encode:.3f} s, decode {decode:.3f} s, {size:.0f} KB")
+
+# Many small files, one after another or as a batch on the native thread pool
+tile = img[:512, :512]
+files = { f"batch_test/{i}{['.exr', '.png', '.pfm', '.jpg'][i % 4]}": tile for i in range(200) }
+os.makedirs("batch_test", exist_ok=True)
+
+start = time.time()
+for filename, data in files.items():
+    sio.write(filename, data)
+sequential = time.time() - start
+start = time.time()
+sio.write_async(files).result()
+print(f"Writing {len(files)} files: {sequential:.3f} s one by one, {time.time() - start:.3f} s batched")
+
+start = time.time()
+for filename in files:
+    sio.read(filename)
+sequential = time.time() - start
+start = time.time()
+sio.read_async(list(files.keys())).result()
+print(f"Reading {len(files)} files: {sequential:.3f} s one by one, {time.time() - start:.3f} s batched")
+
+# A directory of small .exr files, the blocks of each are decoded on the shared native worker threads
+os.makedirs("small_exrs", exist_ok=True)
+small = [f"small_exrs/{i}.exr" for i in range(200)]
+for i, filename in enumerate(small):
+    y, x = i // 7 % 4 * 512, i % 7 * 512
+    sio.write(filename, img[y:y+512, x:x+512])
+
+start = time.time()
+for filename in small:
+    sio.read(filename)
+sequential = time.time() - start
+start = time.time()
+sio.read_async(small).result()
+print(f"Reading {len(small)} 512x512 .exr files: {sequential:.3f} s one by one, {time.time() - start:.3f} s batched")
+
+# Decoding received bytes straight from memory, instead of writing them to a temporary file first
+for ext in [".exr", ".png", ".jpg", ".hdr"]:
+    data = sio.write_to_memory(ext, img[:1024, :1024])
+    start = time.time()
+    for _ in range(20):
+        with open("from_memory" + ext, "wb") as f:
+            f.write(data)
+        sio.read("from_memory" + ext)
+    via_file = (time.time() - start) / 20
+    start = time.time()
+    for _ in range(20):
+        sio.read_from_memory(data)
+    print(f"Decoding 1k {ext}: {via_file * 1000:.2f} ms via a temporary file, "
+          f"{(time.time() - start) / 20 * 1000:.2f} ms from memory")
+
+# Single channel .png files, e.g., masks or depth previews, compared to OpenCV
+mono = sio.luminance(img)
+for bits, quality in [(8, 80), (16, 16)]:
+    start = time.time()
+    sio.write("mono.png", mono, quality)
+    ours = time.time() - start
+    start = time.time()
+    srgb = sio.lin_to_srgb(mono).clip(0, 1)
+    cv2.imwrite("mono_cv2.png", (srgb * 255).astype("uint8") if bits == 8 else (srgb * 65535).astype("uint16"))
+    print(f"Writing 4k mono {bits} bit .png: {ours:.3f} s with ours ({os.path.getsize('mono.png') // 1024} KB), "
+          f"{time.time() - start:.3f} s with OpenCV ({os.path.getsize('mono_cv2.png') // 1024} KB)")
+
+# Strips of rows are compressed in parallel (.png, .hdr) or separated by restart markers (.jpg), scaling with
+# the number of I/O threads
+for num_threads in [1, 2, 4, 8, 16, 32]:
+    if num_threads > os.cpu_count():
+        break
+    sio.set_io_thread_limit(num_threads)
+    for ext in [".png", ".jpg", ".hdr"]:
+        start = time.time()
+        for _ in range(5):
+            sio.write_to_memory(ext, img)
+        print(f"Encoding 4k RGB {ext} with a limit of {num_threads} threads: "
+              f"{(time.time() - start) / 5 * 1000:.1f} ms")
+sio.set_io_thread_limit(0)
+
+# Lossless 8 bit formats for intermediate dumps: .qoi and .ppm trade file size for speed compared to .png
+ldr = img.clip(0, 1)
+for ext in [".png", ".qoi", ".ppm"]:
+    start = time.time()
+    for _ in range(5):
+        data = sio.write_to_memory(ext, ldr)
+    encode = (time.time() - start) / 5
+    start = time.time()
+    for _ in range(5):
+        sio.read_from_memory(data)
+    decode = (time.time() - start) / 5
+    print(f"4k RGB {ext}: encode {encode * 1000:.1f} ms, decode {decode * 1000:.1f} ms, {len(data) // 1024} KB")
+
+# .tif strips are deflate compressed in parallel, with the floating point predictor for float and half
+for name, quality in [("float", 100), ("half", 0), ("16 bit", 16)]:
+    start = time.time()
+    sio.write("dikhololo_test.tif", img, quality)
+    encode = time.time() - start
+
+    start = time.time()
+    sio.read("dikhololo_test.tif")
+    decode = time.time() - start
+
+    size = os.path.getsize("dikhololo_test.tif") / 1024
+    print(f".tif {name:6}: encode {encode:.3f} s, decode {decode:.3f} s, {size:.0f} KB")
@@ -66,6 +66,7 @@ n = 10
 # Initialized just to suppress linter warnings
 m = 0
 m2 = 0
+m3 = 0
 
 start = time.time()
 
@@ -101,6 +102,15 @@ print(f"Linear to sRGB byte image with native for {n} images took {(time.time()
 
 assert(np.abs(np.sum(m2 - m)) < 0.000001 * np.sum(m))
 
+start = time.time()
+
+for i in range(n):
+    m3 = sio.lin_to_srgb_byte_image(testimg)
+
+print(f"Linear to sRGB byte image with native lookup table for {n} images took {(time.time() - start) * 1000:.0f}ms")
+
+assert(np.array_equal(m3, m2))
+
 ########################################
 
 start = time.time()
@@ -213,4 +223,43 @@ assert np.abs(np.sum(m2 - m)) < 0.1
 
 ########################################
 
+def rgb_to_rgbe(rgb):
+    maxcomp = np.max(rgb, axis=2)
+    rgbe = np.zeros((rgb.shape[0], rgb.shape[1], 4), dtype=np.uint8)
+    mask = maxcomp > 1e-32
+    mantissa, exponent = np.frexp(maxcomp[mask])
+    for c in range(3):
+        rgbe[mask, c] = rgb[mask, c] * mantissa * 256.0 / maxcomp[mask]
+    rgbe[mask, 3] = exponent + 128
+    return rgbe
+
+start = time.time()
+for i in range(n):
+    m = rgb_to_rgbe(testimg)
+print(f"Linear to RGBE with numpy for {n} images took {(time.time() - start) * 1000:.0f}ms")
+
+start = time.time()
+for i in range(n):
+    m2 = sio.lin_to_rgbe(testimg)
+print(f"Linear to RGBE for {n} images took {(time.time() - start) * 1000:.0f}ms")
+
+# numpy computes the scale factor in double precision, which can differ by one in the last bit
+assert np.max(np.abs(m2.astype(int) - m.astype(int))) <= 1
+
+########################################
+
+start = time.time()
+for i in range(n):
+    m = testimg.astype(np.float16)
+print(f"Float to half with numpy for {n} images took {(time.time() - start) * 1000:.0f}ms")
+
+start = time.time()
+for i in range(n):
+    m2 = sio.to_half(testimg)
+print(f"Float to half for {n} images took {(time.time() - start) * 1000:.0f}ms")
+
+assert np.array_equal(m, m2, equal_nan=True)
+
+########################################
+
 print("Successfully finished all benchmarks!")
\ No newline at end of file
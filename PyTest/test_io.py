@@ -54,6 +54,103 @@ class TestInputOutput(unittest.TestCase):
         self.assertEqual(px[1,2,2], 0.5)
         os.remove("image.exr")
 
+    def test_read_region(self):
+        img = np.random.rand(15, 10, 3).astype(np.float32)
+        for ext in [".exr", ".pfm", ".tif"]:
+            sio.write("image" + ext, img, 0)
+            region = sio.read_region("image" + ext, 6, 4, 8, 3)
+
+            # The region exceeds the image on the right and is clipped
+            self.assertEqual(region.shape, (3, 4, 3))
+            self.assertTrue(np.allclose(img[4:7, 6:10], region, atol=1e-3))
+            os.remove("image" + ext)
+
+    def test_pfm_strided_write_and_map(self):
+        img = np.random.rand(15, 10, 3).astype(np.float32)
+
+        # Writing a tile of a larger image uses the row stride of the full image
+        sio.write("image.pfm", img[4:12, 2:8])
+        self.assertTrue(np.array_equal(sio.read("image.pfm"), img[4:12, 2:8]))
+
+        mapped = sio.map_pfm("image.pfm")
+        self.assertTrue(np.array_equal(mapped, img[4:12, 2:8]))
+        self.assertFalse(mapped.flags.writeable)
+        del mapped
+        os.remove("image.pfm")
+
+    def test_hdr_strided_write(self):
+        img = np.random.rand(40, 30, 3).astype(np.float32) * 4
+
+        # A tile is written with the row stride of the full image, to a file and to memory alike
+        tile = img[4:36, 2:28]
+        sio.write("image.hdr", tile)
+        self.assertTrue(np.allclose(sio.read("image.hdr"), tile, rtol=0, atol=4 / 128))
+        with open("image.hdr", "rb") as f:
+            self.assertEqual(f.read(), sio.write_to_memory(".hdr", tile))
+        os.remove("image.hdr")
+
+    def test_exr_compression(self):
+        img = np.random.rand(15, 10, 3).astype(np.float32)
+        for compression in sio.EXR_COMPRESSIONS:
+            sio.write("image.exr", img, 100, compression)
+            self.assertTrue(np.array_equal(sio.read("image.exr"), img))
+
+            with open("image.exr", "rb") as f:
+                self.assertEqual(f.read(), sio.write_to_memory(".exr", img, 100, compression))
+            os.remove("image.exr")
+
+        sio.write_layered_exr("layers.exr", { "": img, "albedo": img }, False, "zips")
+        self.assertTrue(np.array_equal(sio.read_layered_exr("layers.exr")["albedo"], img))
+        os.remove("layers.exr")
+
+    def test_read_from_memory(self):
+        img = np.random.rand(15, 10, 3).astype(np.float32)
+        for ext in [".exr", ".pfm", ".hdr", ".png", ".jpg", ".tif", ".qoi", ".ppm"]:
+            sio.write("memory" + ext, img, 100)
+            with open("memory" + ext, "rb") as f:
+                data = f.read()
+            from_file = sio.read("memory" + ext)
+            self.assertTrue(np.array_equal(sio.read_from_memory(data), from_file))
+            self.assertTrue(np.array_equal(sio.read_from_memory(memoryview(data), ".png"), from_file))
+            os.remove("memory" + ext)
+
+        with self.assertRaises(IOError):
+            sio.read_from_memory(b"not an image", ".exr")
+
+    def test_batch_write_and_read(self):
+        images = { f"batch{i}{ext}": np.random.rand(5, 7, 3).astype(np.float32)
+            for i, ext in enumerate([".exr", ".pfm", ".png", ".tif"]) }
+        job = sio.write_async(images, 100)
+        job.result()
+        self.assertTrue(job.done())
+
+        loaded = sio.read_async(list(images.keys())).result()
+        for img, ref in zip(loaded, images.values()):
+            self.assertTrue(np.allclose(img, ref, atol=1e-2))
+
+        with self.assertRaises(IOError):
+            sio.read_async(["batch0.exr", "does-not-exist.exr"]).result()
+        for filename in images:
+            os.remove(filename)
+
+    def test_probe(self):
+        img = np.random.rand(15, 10, 3).astype(np.float32)
+        for ext in [".exr", ".pfm", ".hdr", ".png", ".jpg", ".tif", ".qoi", ".ppm"]:
+            sio.write("image" + ext, img, 100)
+            info = sio.probe("image" + ext)
+            loaded = sio.read("image" + ext)
+
+            self.assertEqual((info.height, info.width, info.num_channels), loaded.shape)
+            self.assertEqual(info.layer_names, [""] if ext == ".exr" else [])
+            os.remove("image" + ext)
+
+        depth = np.random.rand(15, 10).astype(np.float32)
+        sio.write_layered_exr("layers.exr", { "": img, "albedo": img, "depth": depth })
+        info = sio.probe("layers.exr")
+        self.assertEqual(info.pixel_type, "half")
+        self.assertEqual(sorted(info.layer_names), ["", "albedo", "depth"])
+        os.remove("layers.exr")
+
     def test_small_image_pfm(self):
         sio.write("image.pfm", [
             [[1.0,0.0,0.0], [0.0,1.0,0.0], [0.0,0.0,1.0]],
@@ -87,6 +184,49 @@ class TestInputOutput(unittest.TestCase):
         self.assertEqual(px[1,2,2], 0.5)
         os.remove("image.pfm")
 
+    def test_png_mono_and_16_bit(self):
+        img = np.linspace(0, 1, 150, dtype=np.float32).reshape(15, 10)
+        for quality, max_error in [(80, 0.01), (16, 0.0001)]:
+            sio.write("mono.png", img, quality)
+            loaded = sio.read("mono.png")
+            self.assertEqual(loaded.shape, (15, 10))
+            self.assertLess(np.max(np.abs(loaded - img)), max_error)
+        os.remove("mono.png")
+
+    def test_tif_sample_types_and_strides(self):
+        img = np.random.rand(300, 400, 3).astype(np.float32)
+        tile = img[50:250, 100:300]
+        for quality, expected in [(100, tile), (0, tile.astype(np.float16).astype(np.float32))]:
+            sio.write("strided.tif", tile, quality)
+            self.assertTrue(np.array_equal(sio.read("strided.tif"), expected))
+            with open("strided.tif", "rb") as f:
+                self.assertEqual(f.read(), sio.write_to_memory(".tif", tile, quality))
+
+        sio.write("strided.tif", tile, 16)
+        self.assertEqual(sio.probe("strided.tif").pixel_type, "uint16")
+        self.assertLess(np.max(np.abs(sio.read("strided.tif") - tile)), 0.0001)
+        os.remove("strided.tif")
+
+    def test_qoi_and_pnm(self):
+        img = np.random.rand(300, 400, 4).astype(np.float32)
+        for ext, quality, max_error in [(".qoi", 80, 0.01), (".pam", 80, 0.01), (".pam", 16, 0.0001)]:
+            sio.write("lossless" + ext, img, quality)
+            loaded = sio.read("lossless" + ext)
+            self.assertEqual(loaded.shape, img.shape)
+            self.assertLess(np.max(np.abs(loaded - img)), max_error)
+            with open("lossless" + ext, "rb") as f:
+                self.assertEqual(f.read(), sio.write_to_memory(ext, img, quality))
+            os.remove("lossless" + ext)
+
+        # Gray images are stored as RGB in .qoi, but keep their single channel in .pgm
+        mono = np.linspace(0, 1, 150, dtype=np.float32).reshape(15, 10)
+        sio.write("mono.qoi", mono)
+        self.assertEqual(sio.read("mono.qoi").shape, (15, 10, 3))
+        sio.write("mono.pgm", mono, 16)
+        self.assertLess(np.max(np.abs(sio.read("mono.pgm") - mono)), 0.0001)
+        os.remove("mono.qoi")
+        os.remove("mono.pgm")
+
     def test_alphapng(self):
         img = sio.read("ImageWithAlpha.png")
 
@@ -109,6 +249,16 @@ class TestInputOutput(unittest.TestCase):
         self.assertEqual(b64, read_b64)
         os.remove("image.png")
 
+    def test_data_uri(self):
+        img = np.random.rand(97, 131, 3).astype(np.float32)
+        uri = sio.data_uri(img)
+        self.assertEqual(uri, "data:image/png;base64," + base64.b64encode(sio.write_to_memory(".png", img)).decode())
+
+        uri = sio.data_uri(img[1:, 3:, :], "half")
+        self.assertTrue(uri.startswith("data:;base64,"))
+        half = np.frombuffer(base64.b64decode(uri[len("data:;base64,"):]), dtype=np.float16)
+        self.assertTrue(np.array_equal(half, img[1:, 3:, :].astype(np.float16).flatten()))
+
     def test_numpy_view(self):
         img = np.array([
             [[1.0,0.0,0.0], [0.0,1.0,0.0], [0.0,0.0,1.0]],
@@ -257,5 +407,24 @@ class TestInputOutput(unittest.TestCase):
 
         os.remove("layered.exr")
 
+    def test_write_layers_read_selected(self):
+        img = np.array([
+            [[1.0,0.0,0.0], [0.0,1.0,0.0]],
+            [[0.5,0.0,0.0], [0.0,0.5,0.0]]
+        ], dtype=np.float32)
+
+        depth = np.array([
+            [1.0, 0.5],
+            [0.1, 0.01]
+        ], dtype=np.float32)
+
+        sio.write_layered_exr("layered.exr", {"": img, "albedo": img, "depth": depth}, False)
+        layers = sio.read_layered_exr("layered.exr", layer_names=["depth", "doesnotexist"])
+
+        self.assertEqual(list(layers.keys()), ["depth"])
+        self.assertTrue(np.array_equal(depth, layers["depth"]))
+
+        os.remove("layered.exr")
+
 if __name__ == "__main__":
     unittest.main()
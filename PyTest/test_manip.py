@@ -41,6 +41,29 @@ class TestZoom(unittest.TestCase):
         self.assertEqual(b[0, 0, 1], 0)
         self.assertEqual(b[0, 0, 2], int(255 * 0.5))
 
+    def test_lin_to_srgb_byte_image(self):
+        img = np.array([[[1, -1, 0.5], [0.0031308, 1.5, 0.0001]]])
+        b = sio.lin_to_srgb_byte_image(img)
+        self.assertTrue(np.array_equal(b, sio.to_byte_image(sio.lin_to_srgb(img))))
+        self.assertEqual(b[0, 1, 1], 255)
+        self.assertEqual(b[0, 0, 1], 0)
+
+    def test_rgbe_round_trip(self):
+        img = np.array([[[1, 0.5, 0.25], [1e-40, 0, 0]], [[3000, 2, 1], [0.001, 0.003, 0.002]]])
+        rgbe = sio.lin_to_rgbe(img)
+        self.assertEqual(rgbe.shape, (2, 2, 4))
+        self.assertTrue(np.array_equal(rgbe[0, 0], [128, 64, 32, 129]))
+        self.assertTrue(np.array_equal(rgbe[0, 1], [0, 0, 0, 0]))
+        back = sio.rgbe_to_lin(rgbe)
+        self.assertTrue(np.allclose(back, img, rtol=1.0 / 128, atol=1e-5))
+
+    def test_half_matches_numpy(self):
+        img = np.array([[[1, -1, 0.1], [65520, 1e-6, np.inf]], [[np.nan, 0, 3.14159], [1e-8, -2, 70000]]])
+        h = sio.to_half(img)
+        self.assertTrue(np.array_equal(h, img.astype(np.float32).astype(np.float16), equal_nan=True))
+        back = sio.from_half(h)
+        self.assertTrue(np.array_equal(back, h.astype(np.float32), equal_nan=True))
+
     def test_pixel_to_gray_average(self):
         img = np.array([[[1, 2, 3]]])
         g = sio.average_color_channels(img)
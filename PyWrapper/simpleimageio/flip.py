@@ -1,34 +1,18 @@
 import pkgutil
-import numpy as np
 import uuid
-import base64
 from . import corelib
+from . import image
+from . import manip
 
 def make_header():
     js = pkgutil.get_data(__package__, 'flipbook.js').decode('utf-8')
     return "<script>" + js + "</script>"
 
 def _rgb_to_rgbe(rgb):
-    rgb = np.array(rgb, dtype=np.float32)
-    maxcomp = np.max(rgb, axis=2)
-
-    rgbe = np.zeros((rgb.shape[0], rgb.shape[1], 4), dtype=np.uint8)
-    mask = maxcomp > 1e-32
-    mantissa, exponent = np.frexp(maxcomp[mask])
-    rgbe[mask, 0] = rgb[mask,0] * mantissa * 256.0 / maxcomp[mask]
-    rgbe[mask, 1] = rgb[mask,1] * mantissa * 256.0 / maxcomp[mask]
-    rgbe[mask, 2] = rgb[mask,2] * mantissa * 256.0 / maxcomp[mask]
-    rgbe[mask, 3] = exponent + 128
-
-    return rgbe
+    return manip.lin_to_rgbe(rgb)
 
 def _rgbe_to_rgb(rgbe):
-    exponent = (np.array(rgbe[:,:,3], dtype=int) - (128 + 8))
-    rgb = np.zeros((rgbe.shape[0], rgbe.shape[1], 3), dtype=np.float32)
-    rgb[:,:,0] = np.ldexp(rgbe[:,:,0], exponent)
-    rgb[:,:,1] = np.ldexp(rgbe[:,:,1], exponent)
-    rgb[:,:,2] = np.ldexp(rgbe[:,:,2], exponent)
-    return rgb
+    return manip.rgbe_to_lin(rgbe)
 
 def make_flip_book(images, html_width=900, html_height=800):
     id = "flipbook-" + str(uuid.uuid4())
@@ -38,11 +22,8 @@ def make_flip_book(images, html_width=900, html_height=800):
     names = []
     types = []
     for name, img in images:
-        img, (_, _, _, num_channels) = corelib.get_numpy_data(img)
-        if num_channels == 1:
-            img = np.tile(img, (1, 1, 3))
-        rgbe = _rgb_to_rgbe(img)
-        encoded_images.append("data:;base64," + base64.b64encode(rgbe).decode())
+        # Gray images are expanded to RGB by the conversion
+        encoded_images.append(image.data_uri(img, "rgbe"))
         names.append(name)
         types.append("rgbe")
 
@@ -1,34 +1,60 @@
 from ctypes import *
 import numpy as np
 from . import corelib
-import base64
 import collections
 
 _write_image = corelib.core.WriteImage
-_write_image.argtypes = [POINTER(c_float), c_int, c_int, c_int, c_int, c_char_p, c_int]
+_write_image.argtypes = [POINTER(c_float), c_int, c_int, c_int, c_int, c_char_p, c_int, c_int]
 _write_image.restype = None
 
 _write_layered_exr = corelib.core.WriteLayeredExr
 _write_layered_exr.argtypes = [
-    POINTER(POINTER(c_float)), POINTER(c_int), c_int, c_int, POINTER(c_int), c_int, POINTER(c_char_p), c_char_p, c_bool]
+    POINTER(POINTER(c_float)), POINTER(c_int), c_int, c_int, POINTER(c_int), c_int, POINTER(c_char_p), c_char_p, c_bool,
+    c_int]
 _write_layered_exr.restype = None
 
 _cache_image = corelib.core.CacheImage
 _cache_image.argtypes = [POINTER(c_int), POINTER(c_int), POINTER(c_int), c_char_p]
 _cache_image.restype = c_int
 
+_cache_image_region = corelib.core.CacheImageRegion
+_cache_image_region.argtypes = [POINTER(c_int), POINTER(c_int), POINTER(c_int), c_char_p, c_int, c_int, c_int, c_int]
+_cache_image_region.restype = c_int
+
+_cache_image_from_memory = corelib.core.CacheImageFromMemory
+_cache_image_from_memory.argtypes = [POINTER(c_int), POINTER(c_int), POINTER(c_int), c_void_p, c_size_t, c_char_p]
+_cache_image_from_memory.restype = c_int
+
 _copy_cached_img = corelib.core.CopyCachedImage
 _copy_cached_img.argtypes = [c_int, POINTER(c_float)]
 _copy_cached_img.restype = None
 
 _write_to_mem = corelib.core.WriteToMemory
-_write_to_mem.argtypes = [POINTER(c_float), c_int, c_int, c_int, c_int, c_char_p, c_int, POINTER(c_int)]
-_write_to_mem.restype = POINTER(c_ubyte)
+_write_to_mem.argtypes = [POINTER(c_float), c_int, c_int, c_int, c_int, c_char_p, c_int, c_int,
+    POINTER(c_void_p), POINTER(c_int)]
+_write_to_mem.restype = c_void_p
+
+_write_base64_to_mem = corelib.core.WriteBase64ToMemory
+_write_base64_to_mem.argtypes = [POINTER(c_float), c_int, c_int, c_int, c_int, c_char_p, c_int, c_int, c_bool,
+    POINTER(c_void_p), POINTER(c_int)]
+_write_base64_to_mem.restype = c_void_p
 
 _free_mem = corelib.core.FreeMemory
-_free_mem.argtypes = [POINTER(c_ubyte)]
+_free_mem.argtypes = [c_void_p]
 _free_mem.restype = None
 
+_cache_exr_layers = corelib.core.CacheExrLayers
+_cache_exr_layers.argtypes = [POINTER(c_int), POINTER(c_int), c_char_p, POINTER(c_char_p), c_int]
+_cache_exr_layers.restype = c_int
+
+_open_exr_layers = corelib.core.OpenExrLayers
+_open_exr_layers.argtypes = [POINTER(c_int), POINTER(c_int), c_char_p, POINTER(c_char_p), c_int]
+_open_exr_layers.restype = c_int
+
+_read_exr_layers_into = corelib.core.ReadExrLayersInto
+_read_exr_layers_into.argtypes = [c_int, POINTER(POINTER(c_float)), POINTER(c_int)]
+_read_exr_layers_into.restype = c_bool
+
 _get_layer_count = corelib.core.GetExrLayerCount
 _get_layer_count.argtypes = [c_int]
 _get_layer_count.restype = c_int
@@ -43,7 +69,7 @@ _get_layer_name_len.restype = c_int
 
 _get_layer_name = corelib.core.GetExrLayerName
 _get_layer_name.argtypes = [c_int, c_int, POINTER(c_char)]
-_get_layer_name.restype = None
+_get_layer_name.restype = c_bool
 
 _get_channel_name_len = corelib.core.GetExrChannelNameLen
 _get_channel_name_len.argtypes = [c_int, c_char_p, c_int]
@@ -61,11 +87,170 @@ _delete_image = corelib.core.DeleteCachedImage
 _delete_image.argtypes = [c_int]
 _delete_image.restype = None
 
+class _ImageInfo(Structure):
+    _fields_ = [("width", c_int), ("height", c_int), ("num_channels", c_int), ("pixel_type", c_int),
+                ("num_layers", c_int)]
+
+_probe_image = corelib.core.ProbeImage
+_probe_image.argtypes = [c_char_p, POINTER(_ImageInfo), POINTER(POINTER(c_char_p))]
+_probe_image.restype = c_bool
+
+_read_image_into = corelib.core.ReadImageInto
+_read_image_into.argtypes = [c_char_p, POINTER(c_float), c_int]
+_read_image_into.restype = c_bool
+
+_delete_layer_names = corelib.core.DeleteExrLayerNames
+_delete_layer_names.argtypes = [c_int, POINTER(c_char_p)]
+_delete_layer_names.restype = None
+
+_map_pfm_image = corelib.core.MapPfmImage
+_map_pfm_image.argtypes = [POINTER(c_int), POINTER(c_int), POINTER(c_int), POINTER(POINTER(c_float)), c_char_p]
+_map_pfm_image.restype = c_int
+
+_submit_read = corelib.core.SubmitRead
+_submit_read.argtypes = [POINTER(c_char_p), c_int, c_void_p, c_void_p]
+_submit_read.restype = c_int
+
+_submit_write = corelib.core.SubmitWrite
+_submit_write.argtypes = [POINTER(POINTER(c_float)), POINTER(c_int), POINTER(c_int), POINTER(c_int), POINTER(c_int),
+    POINTER(c_char_p), POINTER(c_int), c_int, c_int, c_void_p, c_void_p]
+_submit_write.restype = c_int
+
+_set_io_thread_limit = corelib.core.SetIOThreadLimit
+_set_io_thread_limit.argtypes = [c_int]
+_set_io_thread_limit.restype = None
+
+_poll_job = corelib.core.PollJob
+_poll_job.argtypes = [c_int]
+_poll_job.restype = c_int
+
+_wait_job = corelib.core.WaitJob
+_wait_job.argtypes = [c_int]
+_wait_job.restype = c_bool
+
+_get_job_file_success = corelib.core.GetJobFileSuccess
+_get_job_file_success.argtypes = [c_int, c_int]
+_get_job_file_success.restype = c_bool
+
+_get_read_result = corelib.core.GetReadResult
+_get_read_result.argtypes = [c_int, c_int, POINTER(c_int), POINTER(c_int), POINTER(c_int), POINTER(c_int)]
+_get_read_result.restype = c_bool
+
+_delete_job = corelib.core.DeleteJob
+_delete_job.argtypes = [c_int]
+_delete_job.restype = None
+
+# Compression methods for .exr files, in the order of their ids in the file header
+EXR_COMPRESSIONS = ["none", "rle", "zips", "zip", "piz"]
+
+PIXEL_TYPES = ["uint8", "uint16", "half", "uint32", "float"]
+
+ImageInfo = collections.namedtuple("ImageInfo", ["width", "height", "num_channels", "pixel_type", "layer_names"])
+
 def read(filename: str):
+    info = probe(filename)
+    if info.num_channels == 1:
+        buffer = np.empty((info.height, info.width), dtype=np.float32)
+    else:
+        buffer = np.empty((info.height, info.width, info.num_channels), dtype=np.float32)
+
+    # The pixels are decoded straight into the numpy array
+    if info.num_channels > 0 and not _read_image_into(filename.encode('utf-8'),
+            buffer.ctypes.data_as(POINTER(c_float)), info.width * info.num_channels):
+        raise IOError(f"Could not read image from {filename}")
+
+    return buffer
+
+def read_from_memory(data, format_hint: str = None):
+    '''
+    Decodes an image file that is already in memory, e.g., bytes received over the network. The format is
+    identified from the signature at the start of the data.
+
+    Arguments:
+    data -- the file contents, any object that supports the buffer protocol (bytes, bytearray, memoryview, ...)
+    format_hint -- optional file extension of the format (e.g., ".exr"), only used if the signature is unknown
+    '''
+    # Works for read-only buffers as well, without a copy
+    view = np.frombuffer(data, dtype=np.uint8)
     w = c_int()
     h = c_int()
     c = c_int()
-    idx = _cache_image(byref(w), byref(h), byref(c), filename.encode('utf-8'))
+    idx = _cache_image_from_memory(byref(w), byref(h), byref(c), view.ctypes.data, view.size,
+        format_hint.encode('utf-8') if format_hint is not None else None)
+    if idx < 0:
+        raise IOError("Could not decode image from memory")
+    if c.value <= 0:
+        _delete_image(idx)
+        raise IOError("Could not decode image from memory")
+
+    if c.value == 1:
+        buffer = np.empty((h.value, w.value), dtype=np.float32)
+    else:
+        buffer = np.empty((h.value, w.value, c.value), dtype=np.float32)
+    _copy_cached_img(idx, buffer.ctypes.data_as(POINTER(c_float)))
+    return buffer
+
+def probe(filename: str) -> ImageInfo:
+    '''
+    Reads the metadata of an image from its file header, without decoding any pixels.
+
+    Returns an ImageInfo tuple with the width, height, and number of channels (as returned by read()),
+    the type of the stored values (one of PIXEL_TYPES), and the list of layer names (only for .exr files).
+    '''
+    info = _ImageInfo()
+    names = POINTER(c_char_p)()
+    if not _probe_image(filename.encode('utf-8'), byref(info), byref(names)):
+        raise IOError(f"Could not read image header from {filename}")
+    layer_names = [names[i].decode('utf-8') for i in range(info.num_layers)]
+    _delete_layer_names(info.num_layers, names)
+    return ImageInfo(info.width, info.height, info.num_channels, PIXEL_TYPES[info.pixel_type], layer_names)
+
+class _MappedPfm:
+    """ Exposes the pixels of a memory-mapped .pfm file to numpy and unmaps the file once it is released """
+    def __init__(self, idx, address, shape):
+        self.idx = idx
+        self.__array_interface__ = {
+            "shape": shape,
+            "typestr": np.dtype(np.float32).str,
+            "data": (address, True),
+            "version": 3
+        }
+
+    def __del__(self):
+        _delete_image(self.idx)
+
+def map_pfm(filename: str):
+    '''
+    Maps a .pfm file into memory and returns a read-only view of its pixels, without reading or copying
+    the data up front. The file stays mapped as long as the returned array (or any view of it) exists.
+
+    Returns None if the file cannot be read, or if it cannot be mapped because its byte order differs from
+    that of the system or its pixel data is not aligned (files written by this library always are). Use
+    read() for such files.
+    '''
+    w = c_int()
+    h = c_int()
+    c = c_int()
+    data = POINTER(c_float)()
+    idx = _map_pfm_image(byref(w), byref(h), byref(c), byref(data), filename.encode('utf-8'))
+    if idx < 0:
+        return None
+
+    shape = (h.value, w.value) if c.value == 1 else (h.value, w.value, c.value)
+    mapped = np.asarray(_MappedPfm(idx, cast(data, c_void_p).value, shape))
+
+    # The rows are stored from bottom to top
+    return mapped[::-1]
+
+def read_region(filename: str, x: int, y: int, width: int, height: int):
+    '''
+    Reads a rectangular region of an image. For .exr, .pfm, and .tiff files, only the parts of the file
+    that overlap the region are decoded. The region is clipped to the image boundaries.
+    '''
+    w = c_int()
+    h = c_int()
+    c = c_int()
+    idx = _cache_image_region(byref(w), byref(h), byref(c), filename.encode('utf-8'), x, y, width, height)
     chans = c.value
 
     if chans == 1:
@@ -77,21 +262,30 @@ def read(filename: str):
 
     return buffer
 
-def read_layered_exr(filename: str, layout = None):
+def read_layered_exr(filename: str, layout = None, layer_names = None):
     '''
     Reads all layers from an .exr file
 
     Arguments:
     filename -- the file to load
     layout -- optional dictionary that will be filled with the per-layer channel name configurations
+    layer_names -- optional list of layer names. If given, only these layers are decoded, missing ones are ignored.
     '''
     w = c_int()
     h = c_int()
-    c = c_int()
-    idx = _cache_image(byref(w), byref(h), byref(c), filename.encode('utf-8'))
+    if layer_names is None:
+        idx = _open_exr_layers(byref(w), byref(h), filename.encode('utf-8'), None, 0)
+    else:
+        names = [name.encode('utf-8') for name in layer_names]
+        idx = _open_exr_layers(byref(w), byref(h), filename.encode('utf-8'),
+            (c_char_p * len(names))(*names), len(names))
+    if idx < 0:
+        raise IOError(f"Could not read image from {filename}")
     num_layer = _get_layer_count(idx)
 
     layers = {}
+    buffers = (POINTER(c_float) * num_layer)()
+    strides = (c_int * num_layer)()
 
     for i in range(num_layer):
         num_char = _get_layer_name_len(idx, i)       # Returns the number of characters (NOT including null-termination)
@@ -101,11 +295,12 @@ def read_layered_exr(filename: str, layout = None):
 
         num_chans = _get_layer_chan_count(idx, name)
         if num_chans == 1:
-            buffer = np.zeros((h.value,w.value), dtype=np.float32)
+            buffer = np.empty((h.value,w.value), dtype=np.float32)
         else:
-            buffer = np.zeros((h.value,w.value,num_chans), dtype=np.float32)
+            buffer = np.empty((h.value,w.value,num_chans), dtype=np.float32)
 
-        _copy_layer(idx, name, buffer.ctypes.data_as(POINTER(c_float)))
+        buffers[i] = buffer.ctypes.data_as(POINTER(c_float))
+        strides[i] = w.value * num_chans
 
         # Read the channel names
         if layout is not None:
@@ -119,14 +314,70 @@ def read_layered_exr(filename: str, layout = None):
 
         layers[name.decode('utf-8')] = buffer
 
+    # Decodes all layers in a single pass over the file
+    success = _read_exr_layers_into(idx, buffers, strides)
     _delete_image(idx)
+    if not success:
+        raise IOError(f"Could not read image from {filename}")
 
     return layers
 
-def write(filename: str, data, jpeg_quality = 80):
-    corelib.invoke(_write_image, data, filename.encode('utf-8'), jpeg_quality)
+def write(filename: str, data, jpeg_quality = 80, exr_compression = "piz"):
+    '''
+    Writes an image to a file, the format is determined by the extension.
+
+    Arguments:
+    jpeg_quality -- depends on the format, for some lossless formats it selects the sample type:
+                    .jpg: compression quality between 1 and 100
+                    .exr: 0 writes half precision floats, other values 32 bit floats
+                    .png, .ppm, .pgm, .pam: 16 writes 16 bit per channel, other values 8 bit
+                    .tif: 0 writes half precision floats, 16 writes 16 bit integers, other values 32 bit floats
+                    Other formats ignore it.
+    exr_compression -- compression method of .exr files, one of EXR_COMPRESSIONS
+    '''
+    corelib.invoke(_write_image, data, filename.encode('utf-8'), jpeg_quality,
+        EXR_COMPRESSIONS.index(exr_compression))
+
+def write_to_memory(extension: str, data, jpeg_quality = 80, exr_compression = "piz") -> bytes:
+    '''
+    Encodes an image in the format given by the file extension (e.g., ".exr") and returns the file contents.
+    The arguments are the same as for write().
+    '''
+    return _encode_to_memory(extension, data, jpeg_quality, exr_compression, string_at)
 
-def write_layered_exr(filename: str, layers: dict, useHalfPrecision: bool = True):
+def _encode_to_memory(extension: str, data, quality, exr_compression, consume):
+    '''
+    Encodes an image and calls consume(address, num_bytes) on the native buffer that the encoder wrote to,
+    the buffer is released afterwards. Returns the result of consume.
+    '''
+    address = c_void_p()
+    numbytes = c_int()
+    buffer = corelib.invoke(_write_to_mem, data, extension.encode('utf-8'), quality,
+        EXR_COMPRESSIONS.index(exr_compression), byref(address), byref(numbytes))
+    if not buffer:
+        raise IOError(f"Could not encode image as {extension}")
+    try:
+        return consume(address.value, numbytes.value)
+    finally:
+        _free_mem(buffer)
+
+def _encode_base64(format: str, data, quality, exr_compression, data_uri: bool) -> bytes:
+    '''
+    Encodes an image and returns its base64 encoding as ASCII bytes. Both the file and the base64 text are
+    produced by the native encoder, so there is no intermediate copy of the file in Python.
+    '''
+    address = c_void_p()
+    numchars = c_int()
+    buffer = corelib.invoke(_write_base64_to_mem, data, format.encode('utf-8'), quality,
+        EXR_COMPRESSIONS.index(exr_compression), data_uri, byref(address), byref(numchars))
+    if not buffer:
+        raise IOError(f"Could not encode image as {format}")
+    try:
+        return string_at(address.value, numchars.value)
+    finally:
+        _free_mem(buffer)
+
+def write_layered_exr(filename: str, layers: dict, useHalfPrecision: bool = True, compression: str = "piz"):
     names = sorted(layers.keys())
 
     # Gather the data in the desired layout for the C-API
@@ -153,18 +404,131 @@ def write_layered_exr(filename: str, layers: dict, useHalfPrecision: bool = True
     _write_layered_exr((POINTER(c_float) * num_layers)(*images),
         (c_int * num_layers)(*strides), width, height,
         (c_int * num_layers)(*num_channels), num_layers, (c_char_p * num_layers)(*cstr_names),
-        filename.encode('utf-8'), useHalfPrecision)
+        filename.encode('utf-8'), useHalfPrecision, EXR_COMPRESSIONS.index(compression))
 
 def base64_png(img):
-    numbytes = c_int()
-    mem = corelib.invoke(_write_to_mem, img, ".png".encode('utf-8'), 0, byref(numbytes))
-    b64 = base64.b64encode(bytearray(mem[:numbytes.value]))
-    _free_mem(mem)
-    return b64
+    return _encode_base64(".png", img, 0, "none", False)
 
 def base64_jpg(img, quality = 80):
-    numbytes = c_int()
-    mem = corelib.invoke(_write_to_mem, img, ".jpg".encode('utf-8'), quality, byref(numbytes))
-    b64 = base64.b64encode(bytearray(mem[:numbytes.value]))
-    _free_mem(mem)
-    return b64
+    return _encode_base64(".jpg", img, quality, "none", False)
+
+def data_uri(img, format: str = ".png", quality = 80) -> str:
+    '''
+    Encodes an image as a base64 data URI for embedding in HTML, e.g., "data:image/png;base64,...".
+
+    Arguments:
+    format -- file extension of the desired format, e.g., ".png" or ".jpg". Alternatively, one of the raw
+              pixel payloads "rgbe", "half", or "float" of the flip book viewer, which have no media type.
+    quality -- same as jpeg_quality in write()
+    '''
+    return _encode_base64(format, img, quality, "piz", True).decode('ascii')
+
+class IOJob:
+    """
+    A batch of files that are read or written in the background by a pool of native threads, see
+    read_async() and write_async(). The files are processed concurrently, so the throughput scales with
+    the number of cores, and Python code can keep running in the meantime.
+    """
+    def __init__(self, idx, filenames, reading, keep_alive = None):
+        self._idx = idx
+        self._filenames = filenames
+        self._reading = reading
+        self._keep_alive = keep_alive
+        self._images = None
+
+    def num_done(self) -> int:
+        """ Number of files that have been read or written so far """
+        return _poll_job(self._idx)
+
+    def done(self) -> bool:
+        return self.num_done() == len(self._filenames)
+
+    def wait(self) -> bool:
+        """ Blocks until all files are done, returns True if all of them were read or written successfully """
+        return _wait_job(self._idx)
+
+    def result(self):
+        '''
+        Waits for all files and returns the list of images for a read_async() job, or None for a write_async()
+        job. Raises an IOError if any of the files could not be read or written.
+        '''
+        self.wait()
+        if not self._reading:
+            failed = [f for i, f in enumerate(self._filenames) if not _get_job_file_success(self._idx, i)]
+            if failed:
+                raise IOError(f"Could not write images to {', '.join(failed)}")
+            return None
+
+        if self._images is None:
+            self._images = []
+            for i in range(len(self._filenames)):
+                idx = c_int()
+                w = c_int()
+                h = c_int()
+                c = c_int()
+                if not _get_read_result(self._idx, i, byref(idx), byref(w), byref(h), byref(c)):
+                    self._images.append(None)
+                    continue
+                if c.value == 1:
+                    buffer = np.empty((h.value, w.value), dtype=np.float32)
+                else:
+                    buffer = np.empty((h.value, w.value, c.value), dtype=np.float32)
+                _copy_cached_img(idx.value, buffer.ctypes.data_as(POINTER(c_float)))
+                self._images.append(buffer)
+
+        failed = [f for f, img in zip(self._filenames, self._images) if img is None]
+        if failed:
+            raise IOError(f"Could not read images from {', '.join(failed)}")
+        return self._images
+
+    def __del__(self):
+        # Waits for the job to finish, so the arrays that are written stay alive until then
+        _delete_job(self._idx)
+
+def set_io_thread_limit(num_threads: int):
+    '''
+    Limits how many native worker threads encode and decode images at the same time. This applies to
+    read_async() and write_async(), to the compression and decompression of all .exr files, and to the
+    strip-wise encoding of .png and .jpg files.
+    A value of zero removes the limit.
+    '''
+    _set_io_thread_limit(num_threads)
+
+def read_async(filenames: list) -> IOJob:
+    '''
+    Starts reading a list of images in the background. Call result() on the returned job to get the images.
+    '''
+    names = [f.encode('utf-8') for f in filenames]
+    idx = _submit_read((c_char_p * len(names))(*names), len(names), None, None)
+    if idx < 0:
+        raise ValueError("No files to read")
+    return IOJob(idx, list(filenames), True)
+
+def write_async(images: dict, jpeg_quality = 80, exr_compression = "piz") -> IOJob:
+    '''
+    Starts writing images in the background. The arrays must not be modified until the returned job is done.
+
+    Arguments:
+    images -- dictionary with the file names as keys and the images as values
+    jpeg_quality, exr_compression -- same as for write()
+    '''
+    num = len(images)
+    arrays = []
+    datas = (POINTER(c_float) * num)()
+    strides = (c_int * num)()
+    widths = (c_int * num)()
+    heights = (c_int * num)()
+    num_channels = (c_int * num)()
+    for i, img in enumerate(images.values()):
+        buffer, (strides[i], widths[i], heights[i], num_channels[i]) = corelib.get_numpy_data(img)
+        datas[i] = buffer.ctypes.data_as(POINTER(c_float))
+        arrays.append(buffer)
+    names = [f.encode('utf-8') for f in images.keys()]
+
+    idx = _submit_write(datas, strides, widths, heights, num_channels, (c_char_p * num)(*names),
+        (c_int * num)(*([jpeg_quality] * num)), num, EXR_COMPRESSIONS.index(exr_compression), None, None)
+    if idx < 0:
+        raise ValueError("No images to write")
+
+    # The native threads read directly from the (possibly converted) arrays, so they must outlive the job
+    return IOJob(idx, list(images.keys()), False, arrays)
@@ -18,6 +18,26 @@ _to_byte_img = corelib.core.ToByteImage
 _to_byte_img.argtypes = (POINTER(c_float), c_int, POINTER(c_uint8), c_int, c_int, c_int, c_int)
 _to_byte_img.restype = None
 
+_lin_to_srgb_byte_img = corelib.core.LinearToSrgbByteImage
+_lin_to_srgb_byte_img.argtypes = (POINTER(c_float), c_int, POINTER(c_uint8), c_int, c_int, c_int, c_int)
+_lin_to_srgb_byte_img.restype = None
+
+_lin_to_rgbe = corelib.core.LinearToRgbe
+_lin_to_rgbe.argtypes = (POINTER(c_float), c_int, POINTER(c_uint8), c_int, c_int, c_int, c_int)
+_lin_to_rgbe.restype = None
+
+_rgbe_to_lin = corelib.core.RgbeToLinear
+_rgbe_to_lin.argtypes = (POINTER(c_uint8), c_int, POINTER(c_float), c_int, c_int, c_int)
+_rgbe_to_lin.restype = None
+
+_to_half = corelib.core.FloatToHalf
+_to_half.argtypes = (POINTER(c_float), c_int, POINTER(c_uint16), c_int, c_int, c_int, c_int)
+_to_half.restype = None
+
+_from_half = corelib.core.HalfToFloat
+_from_half.argtypes = (POINTER(c_uint16), c_int, POINTER(c_float), c_int, c_int, c_int, c_int)
+_from_half.restype = None
+
 _zoom = corelib.core.ZoomWithNearestInterp
 _zoom.argtypes = (POINTER(c_float), c_int, POINTER(c_float), c_int, c_int, c_int, c_int, c_int)
 _zoom.restype = None
@@ -49,6 +69,48 @@ def srgb_to_lin(img):
 def to_byte_image(img):
     return corelib.invoke_with_byte_output(_to_byte_img, img)
 
+def lin_to_srgb_byte_image(img):
+    """ Same result as to_byte_image(lin_to_srgb(img)), but in one pass and without evaluating pow() """
+    return corelib.invoke_with_byte_output(_lin_to_srgb_byte_img, img)
+
+def lin_to_rgbe(img):
+    """ Shared exponent RGBE bytes, as in Radiance .hdr files, with shape (height, width, 4).
+    Gray images are stored as gray, alpha is ignored. """
+    img, (stride, w, h, c) = corelib.get_numpy_data(img)
+    buf = np.zeros((h, w, 4), dtype=np.uint8)
+    _lin_to_rgbe(img.ctypes.data_as(POINTER(c_float)), stride,
+        buf.ctypes.data_as(POINTER(c_uint8)), buf.strides[0], w, h, c)
+    return buf
+
+def rgbe_to_lin(rgbe):
+    """ Inverse of lin_to_rgbe(), returns RGB floats """
+    rgbe = np.ascontiguousarray(rgbe, dtype=np.uint8)
+    h = rgbe.shape[0]
+    w = rgbe.shape[1]
+    buf = np.zeros((h, w, 3), dtype=np.float32)
+    _rgbe_to_lin(rgbe.ctypes.data_as(POINTER(c_uint8)), rgbe.strides[0],
+        buf.ctypes.data_as(POINTER(c_float)), int(buf.strides[0] / 4), w, h)
+    return buf
+
+def to_half(img):
+    """ Same as img.astype(np.float16), but vectorized and multi-threaded """
+    img, (stride, w, h, c) = corelib.get_numpy_data(img)
+    buf = np.zeros(img.shape, dtype=np.float16)
+    _to_half(img.ctypes.data_as(POINTER(c_float)), stride,
+        buf.ctypes.data_as(POINTER(c_uint16)), int(buf.strides[0] / 2), w, h, c)
+    return buf
+
+def from_half(img):
+    """ Same as img.astype(np.float32) for a float16 image, but vectorized and multi-threaded """
+    img = np.ascontiguousarray(img, dtype=np.float16)
+    h = img.shape[0]
+    w = img.shape[1]
+    c = 1 if len(img.shape) == 2 else img.shape[2]
+    buf = np.zeros(img.shape, dtype=np.float32)
+    _from_half(img.ctypes.data_as(POINTER(c_uint16)), int(img.strides[0] / 2),
+        buf.ctypes.data_as(POINTER(c_float)), int(buf.strides[0] / 4), w, h, c)
+    return buf
+
 def zoom(img, scale: int):
     img = np.asarray(img, dtype=np.float32)
     h = img.shape[0]
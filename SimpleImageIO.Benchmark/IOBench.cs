@@ -1,5 +1,8 @@
 using System;
 using System.Diagnostics;
+using System.IO;
+using System.Linq;
+using System.Threading.Tasks;
 
 namespace SimpleImageIO.Benchmark;
 
@@ -36,5 +39,426 @@ static class IOBench {
         stopwatch.Restart();
         string b64 = Convert.ToBase64String(img.WriteToMemory(".bmp"));
         Console.WriteLine($"To base64 in memory took {stopwatch.ElapsedMilliseconds} ms");
+
+        stopwatch.Restart();
+        string uri = img.AsDataUri(".bmp");
+        Console.WriteLine($"To base64 data URI with the native encoder took {stopwatch.ElapsedMilliseconds} ms");
+    }
+
+    public static void BenchParallelLayerLoad(int numLoads = 64) {
+        RgbImage img = new("../PyTest/dikhololo_night_4k.hdr");
+        Layers.WriteToExr("test-layers.exr", ("", img), ("albedo", img), ("normal", img), ("denoised", img));
+
+        Stopwatch stopwatch = Stopwatch.StartNew();
+        for (int i = 0; i < numLoads; ++i)
+            Layers.LoadFromFile("test-layers.exr");
+        long sequentialMs = stopwatch.ElapsedMilliseconds;
+        Console.WriteLine($"Loading {numLoads} layered .exr sequentially took {sequentialMs} ms");
+
+        stopwatch.Restart();
+        Parallel.For(0, numLoads, i => Layers.LoadFromFile("test-layers.exr"));
+        long parallelMs = stopwatch.ElapsedMilliseconds;
+        Console.WriteLine($"Loading {numLoads} layered .exr in parallel took {parallelMs} ms " +
+            $"(speedup {sequentialMs / (float)parallelMs:F2}x on {Environment.ProcessorCount} cores)");
+    }
+
+    public static void BenchLayerExtraction() {
+        RgbImage img = new("../PyTest/dikhololo_night_4k.hdr");
+        MonochromeImage mono = new(img, MonochromeImage.RgbConvertMode.Average);
+        Layers.WriteToExr("test-layers.exr", ("", img), ("albedo", img), ("normal", img), ("depth", mono));
+
+        Stopwatch stopwatch = Stopwatch.StartNew();
+        int id = SimpleImageIOCore.CacheExrLayers(out int width, out int height, "test-layers.exr", null, 0);
+        Console.WriteLine($"Decoding layered .exr took {stopwatch.ElapsedMilliseconds} ms");
+
+        stopwatch.Restart();
+        foreach (var (name, numChannels) in new[] { ("", 3), ("albedo", 3), ("normal", 3), ("depth", 1) }) {
+            Image layer = new(width, height, numChannels);
+            SimpleImageIOCore.CopyCachedLayer(id, name, layer.DataPointer);
+        }
+        Console.WriteLine($"Extracting the layers (SoA to AoS) took {stopwatch.ElapsedMilliseconds} ms");
+        SimpleImageIOCore.DeleteCachedImage(id);
+
+        stopwatch.Restart();
+        Layers.LoadFromFile("test-layers.exr", "albedo");
+        Console.WriteLine($"Loading only the albedo layer took {stopwatch.ElapsedMilliseconds} ms");
+    }
+
+    public static void BenchStreamingLayerLoad() {
+        RgbImage img = new("../PyTest/dikhololo_night_4k.hdr");
+        Layers.WriteToExr("test-layers.exr", ("", img), ("albedo", img), ("normal", img), ("denoised", img),
+            ("variance", img), ("position", img));
+
+        // The peak working set only ever grows, so the streaming load runs first: its peak is not hidden by
+        // that of the fully cached load.
+        using var process = Process.GetCurrentProcess();
+        process.Refresh();
+        long basePeak = process.PeakWorkingSet64;
+
+        Stopwatch stopwatch = Stopwatch.StartNew();
+        var layers = Layers.LoadFromFile("test-layers.exr");
+        long streamMs = stopwatch.ElapsedMilliseconds;
+        process.Refresh();
+        long streamPeak = process.PeakWorkingSet64;
+        foreach (var layer in layers.Values) layer.Dispose();
+
+        stopwatch.Restart();
+        int id = SimpleImageIOCore.CacheExrLayers(out int width, out int height, "test-layers.exr", null, 0);
+        foreach (var name in layers.Keys) {
+            Image layer = new(width, height, 3);
+            SimpleImageIOCore.CopyCachedLayer(id, name, layer.DataPointer);
+            layer.Dispose();
+        }
+        SimpleImageIOCore.DeleteCachedImage(id);
+        long cacheMs = stopwatch.ElapsedMilliseconds;
+        process.Refresh();
+
+        Console.WriteLine($"Streaming {layers.Count} .exr layers took {streamMs} ms, " +
+            $"peak memory +{(streamPeak - basePeak) / (1024 * 1024)} MB");
+        Console.WriteLine($"Caching and copying {layers.Count} .exr layers took {cacheMs} ms, " +
+            $"peak memory {process.PeakWorkingSet64 / (1024 * 1024)} MB " +
+            $"(streaming: {streamPeak / (1024 * 1024)} MB)");
+    }
+
+    public static void BenchLayeredWrite(int numLayers = 30) {
+        RgbImage img = new("../PyTest/dikhololo_night_4k.hdr");
+        var layers = new (string, Image)[numLayers];
+        for (int i = 0; i < numLayers; ++i)
+            layers[i] = ($"aov{i}", img);
+
+        using var process = Process.GetCurrentProcess();
+        process.Refresh();
+        long basePeak = process.PeakWorkingSet64;
+
+        Stopwatch stopwatch = Stopwatch.StartNew();
+        Layers.WriteToExr("test-many-layers.exr", true, ExrCompression.ZIP, layers);
+        long writeMs = stopwatch.ElapsedMilliseconds;
+        process.Refresh();
+
+        Console.WriteLine($"Writing {numLayers} .exr layers took {writeMs} ms, " +
+            $"peak memory +{(process.PeakWorkingSet64 - basePeak) / (1024 * 1024)} MB");
+    }
+
+    public static void BenchRegionLoad() {
+        RgbImage img = new("../PyTest/dikhololo_night_4k.hdr");
+        foreach (var ext in new[] { ".exr", ".pfm", ".tif" }) {
+            img.WriteToFile("test-region" + ext);
+
+            Stopwatch stopwatch = Stopwatch.StartNew();
+            Image full = new("test-region" + ext);
+            long fullMs = stopwatch.ElapsedMilliseconds;
+
+            stopwatch.Restart();
+            Image crop = Image.LoadRegion("test-region" + ext, img.Width / 2, img.Height / 2, 256, 256);
+            Console.WriteLine($"Loading {ext}: full image took {fullMs} ms, 256x256 region took " +
+                $"{stopwatch.Elapsed.TotalMilliseconds:F2} ms");
+        }
+    }
+
+    public static void BenchPfmThroughput(int numRepetitions = 10) {
+        RgbImage img = new("../PyTest/dikhololo_night_4k.hdr");
+        double gigabytes = numRepetitions * img.Width * img.Height * img.NumChannels * sizeof(float) / 1e9;
+
+        // The file is in the OS cache after the first write, so this measures the cost of our code
+        Stopwatch stopwatch = Stopwatch.StartNew();
+        for (int i = 0; i < numRepetitions; ++i)
+            img.WriteToFile("test-throughput.pfm");
+        double writeSeconds = stopwatch.Elapsed.TotalSeconds;
+
+        stopwatch.Restart();
+        for (int i = 0; i < numRepetitions; ++i)
+            new RgbImage("test-throughput.pfm").Dispose();
+        double readSeconds = stopwatch.Elapsed.TotalSeconds;
+
+        Console.WriteLine($"Writing 4k .pfm: {gigabytes / writeSeconds:F2} GB/s, " +
+            $"reading: {gigabytes / readSeconds:F2} GB/s");
+    }
+
+    public static void BenchExrCompression() {
+        RgbImage img = new("../PyTest/dikhololo_night_4k.hdr");
+        foreach (bool half in new[] { true, false }) {
+            foreach (var compression in Enum.GetValues<ExrCompression>()) {
+                Stopwatch stopwatch = Stopwatch.StartNew();
+                img.WriteToFile("test-compression.exr", half ? 0 : 1, compression);
+                long encodeMs = stopwatch.ElapsedMilliseconds;
+
+                stopwatch.Restart();
+                new RgbImage("test-compression.exr").Dispose();
+                long decodeMs = stopwatch.ElapsedMilliseconds;
+
+                long sizeKb = new System.IO.FileInfo("test-compression.exr").Length / 1024;
+                Console.WriteLine($".exr {(half ? "half" : "float"),-5} {compression,-4}: encode {encodeMs,4} ms, " +
+                    $"decode {decodeMs,4} ms, {sizeKb,6} KB");
+            }
+        }
+    }
+
+    public static void BenchBatchIO(int numFiles = 200) {
+        RgbImage full = new("../PyTest/dikhololo_night_4k.hdr");
+        RgbImage img = new(512, 512);
+        for (int y = 0; y < img.Height; ++y)
+            for (int x = 0; x < img.Width; ++x)
+                img.SetPixel(x, y, full.GetPixel(x, y));
+
+        string[] extensions = { ".exr", ".png", ".pfm", ".jpg" };
+        var files = Enumerable.Range(0, numFiles)
+            .Select(i => (img as Image, $"test-batch/{i}{extensions[i % extensions.Length]}")).ToArray();
+
+        Stopwatch stopwatch = Stopwatch.StartNew();
+        foreach (var (image, filename) in files)
+            image.WriteToFile(filename);
+        long writeSequentialMs = stopwatch.ElapsedMilliseconds;
+
+        stopwatch.Restart();
+        BatchIO.WriteAsync(files).Wait();
+        long writeBatchMs = stopwatch.ElapsedMilliseconds;
+
+        stopwatch.Restart();
+        foreach (var (_, filename) in files)
+            new Image(filename).Dispose();
+        long readSequentialMs = stopwatch.ElapsedMilliseconds;
+
+        stopwatch.Restart();
+        foreach (var image in BatchIO.ReadAsync(files.Select(f => f.Item2)).Result)
+            image.Dispose();
+        long readBatchMs = stopwatch.ElapsedMilliseconds;
+
+        Console.WriteLine($"Writing {numFiles} files: {writeSequentialMs} ms one by one, {writeBatchMs} ms batched; " +
+            $"reading: {readSequentialMs} ms one by one, {readBatchMs} ms batched");
+    }
+
+    public static void BenchSmallExrs(int numFiles = 200) {
+        RgbImage full = new("../PyTest/dikhololo_night_4k.hdr");
+        Directory.CreateDirectory("test-small-exrs");
+        string[] filenames = Enumerable.Range(0, numFiles).Select(i => $"test-small-exrs/{i}.exr").ToArray();
+
+        Stopwatch stopwatch = Stopwatch.StartNew();
+        Parallel.For(0, numFiles, i => {
+            RgbImage tile = new(512, 512);
+            int x0 = i % 7 * 512, y0 = i / 7 % 4 * 512;
+            for (int y = 0; y < 512; ++y)
+                for (int x = 0; x < 512; ++x)
+                    tile.SetPixel(x, y, full.GetPixel(x0 + x, y0 + y));
+            tile.WriteToFile(filenames[i]);
+        });
+        Console.WriteLine($"Writing {numFiles} 512x512 .exr in Parallel.For: {stopwatch.ElapsedMilliseconds} ms");
+
+        stopwatch.Restart();
+        foreach (var filename in filenames)
+            new RgbImage(filename).Dispose();
+        long sequentialMs = stopwatch.ElapsedMilliseconds;
+
+        stopwatch.Restart();
+        Parallel.For(0, numFiles, i => new RgbImage(filenames[i]).Dispose());
+        long parallelMs = stopwatch.ElapsedMilliseconds;
+
+        stopwatch.Restart();
+        foreach (var image in BatchIO.ReadAsync(filenames).Result)
+            image.Dispose();
+        long batchMs = stopwatch.ElapsedMilliseconds;
+
+        BatchIO.SetThreadLimit(Math.Max(Environment.ProcessorCount / 2, 1));
+        stopwatch.Restart();
+        Parallel.For(0, numFiles, i => new RgbImage(filenames[i]).Dispose());
+        long limitedMs = stopwatch.ElapsedMilliseconds;
+        BatchIO.SetThreadLimit(0);
+
+        Console.WriteLine($"Reading {numFiles} 512x512 .exr: {sequentialMs} ms one by one, {parallelMs} ms in " +
+            $"Parallel.For, {batchMs} ms batched, {limitedMs} ms in Parallel.For with half the worker threads");
+    }
+
+    public static void BenchDecodeFromMemory(int numRepetitions = 20) {
+        RgbImage full = new("../PyTest/dikhololo_night_4k.hdr");
+        RgbImage img = new(1024, 1024);
+        for (int y = 0; y < img.Height; ++y)
+            for (int x = 0; x < img.Width; ++x)
+                img.SetPixel(x, y, full.GetPixel(x, y));
+
+        foreach (string extension in new[] { ".exr", ".png", ".jpg", ".hdr" }) {
+            byte[] bytes = img.WriteToMemory(extension);
+
+            // What had to be done before: write the received bytes to a temporary file, then load that
+            Stopwatch stopwatch = Stopwatch.StartNew();
+            for (int i = 0; i < numRepetitions; ++i) {
+                File.WriteAllBytes("test-from-memory" + extension, bytes);
+                new Image("test-from-memory" + extension).Dispose();
+            }
+            double viaFileMs = stopwatch.Elapsed.TotalMilliseconds / numRepetitions;
+
+            stopwatch.Restart();
+            for (int i = 0; i < numRepetitions; ++i)
+                Image.LoadFromMemory(bytes).Dispose();
+            double fromMemoryMs = stopwatch.Elapsed.TotalMilliseconds / numRepetitions;
+
+            Console.WriteLine($"Decoding 1k {extension}: {viaFileMs:F2} ms via a temporary file, " +
+                $"{fromMemoryMs:F2} ms from memory");
+        }
+    }
+
+    public static void BenchMonoPng(int numRepetitions = 5) {
+        RgbImage img = new("../PyTest/dikhololo_night_4k.hdr");
+        MonochromeImage mono = new(img, MonochromeImage.RgbConvertMode.Luminance);
+
+        // Single channel images used to take stb_image_write's much slower encoder, RGB is the fpng reference
+        foreach (var (name, image, quality) in new (string, Image, int)[] {
+            ("4k mono", mono, 80), ("4k mono 16 bit", mono, 16), ("4k RGB", img, 80)
+        }) {
+            int size = image.WriteToMemory(".png", quality).Length;
+            Stopwatch stopwatch = Stopwatch.StartNew();
+            for (int i = 0; i < numRepetitions; ++i)
+                image.WriteToMemory(".png", quality);
+            Console.WriteLine($"Encoding {name} .png took {stopwatch.ElapsedMilliseconds / numRepetitions} ms, " +
+                $"{size / 1024} KB");
+        }
+    }
+
+    public static void BenchPngReload(int numRepetitions = 10) {
+        RgbImage img = new("../PyTest/dikhololo_night_4k.hdr");
+        Image withAlpha = new(img.Width, img.Height, 4);
+        for (int y = 0; y < img.Height; ++y)
+            for (int x = 0; x < img.Width; ++x) {
+                var rgb = img.GetPixel(x, y);
+                withAlpha.SetPixelChannels(x, y, rgb.R, rgb.G, rgb.B, 0.5f);
+            }
+
+        // Files written by this library are decoded by fpng, others by stb_image
+        foreach (var (name, image) in new (string, Image)[] { ("RGB", img), ("RGBA", withAlpha) }) {
+            image.WriteToFile("test-reload.png");
+            Stopwatch stopwatch = Stopwatch.StartNew();
+            for (int i = 0; i < numRepetitions; ++i)
+                new Image("test-reload.png").Dispose();
+            Console.WriteLine($"Reloading a 4k {name} .png took {stopwatch.ElapsedMilliseconds / numRepetitions} ms");
+        }
+    }
+
+    public static void BenchParallelPng(int numRepetitions = 5) {
+        RgbImage img = new("../PyTest/dikhololo_night_4k.hdr");
+        MonochromeImage mono = new(img, MonochromeImage.RgbConvertMode.Luminance);
+
+        // Strips of rows are compressed on the I/O threads, the limit caps how many of them take part
+        foreach (int numThreads in new[] { 1, 2, 4, 8, 16, 32 }) {
+            if (numThreads > Environment.ProcessorCount) break;
+            BatchIO.SetThreadLimit(numThreads);
+            foreach (var (name, image) in new (string, Image)[] { ("4k RGB", img), ("4k mono", mono) }) {
+                image.WriteToMemory(".png");
+                Stopwatch stopwatch = Stopwatch.StartNew();
+                for (int i = 0; i < numRepetitions; ++i)
+                    image.WriteToMemory(".png");
+                Console.WriteLine($"Encoding {name} .png with a limit of {numThreads} threads took " +
+                    $"{stopwatch.ElapsedMilliseconds / numRepetitions} ms");
+            }
+        }
+        BatchIO.SetThreadLimit(0);
+    }
+
+    public static void BenchParallelJpeg(int numRepetitions = 5) {
+        RgbImage img = new("../PyTest/dikhololo_night_4k.hdr");
+
+        // Stripes of MCU rows are separated by restart markers and encoded on the I/O threads
+        foreach (int numThreads in new[] { 1, 2, 4, 8, 16, 32 }) {
+            if (numThreads > Environment.ProcessorCount) break;
+            BatchIO.SetThreadLimit(numThreads);
+            foreach (int quality in new[] { 90, 100 }) {
+                img.WriteToMemory(".jpg", quality);
+                Stopwatch stopwatch = Stopwatch.StartNew();
+                for (int i = 0; i < numRepetitions; ++i)
+                    img.WriteToMemory(".jpg", quality);
+                Console.WriteLine($"Encoding 4k RGB .jpg with quality {quality} and a limit of {numThreads} " +
+                    $"threads took {stopwatch.ElapsedMilliseconds / numRepetitions} ms");
+            }
+        }
+        BatchIO.SetThreadLimit(0);
+    }
+
+    public static void BenchHdr(int numRepetitions = 5) {
+        RgbImage img = new("../PyTest/dikhololo_night_4k.hdr");
+        byte[] bytes = img.WriteToMemory(".hdr");
+
+        // Blocks of scanlines are run-length decoded and encoded on the I/O threads
+        foreach (int numThreads in new[] { 1, 2, 4, 8, 16, 32 }) {
+            if (numThreads > Environment.ProcessorCount) break;
+            BatchIO.SetThreadLimit(numThreads);
+
+            Stopwatch stopwatch = Stopwatch.StartNew();
+            for (int i = 0; i < numRepetitions; ++i)
+                Image.LoadFromMemory(bytes).Dispose();
+            long decodeMs = stopwatch.ElapsedMilliseconds / numRepetitions;
+
+            stopwatch.Restart();
+            for (int i = 0; i < numRepetitions; ++i)
+                img.WriteToMemory(".hdr");
+            long encodeMs = stopwatch.ElapsedMilliseconds / numRepetitions;
+
+            Console.WriteLine($"4k .hdr with a limit of {numThreads} threads: decoding took {decodeMs} ms, " +
+                $"encoding took {encodeMs} ms");
+        }
+        BatchIO.SetThreadLimit(0);
+    }
+
+    public static void BenchTiff(int numRepetitions = 5) {
+        RgbImage img = new("../PyTest/dikhololo_night_4k.hdr");
+
+        // Strips are deflate compressed on the I/O threads and decompressed in parallel
+        foreach (int numThreads in new[] { 1, 2, 4, 8, 16, 32 }) {
+            if (numThreads > Environment.ProcessorCount) break;
+            BatchIO.SetThreadLimit(numThreads);
+            foreach (var (name, quality) in new[] { ("float", 1), ("half", 0), ("16 bit", 16) }) {
+                byte[] bytes = img.WriteToMemory(".tif", quality);
+                Stopwatch stopwatch = Stopwatch.StartNew();
+                for (int i = 0; i < numRepetitions; ++i)
+                    img.WriteToMemory(".tif", quality);
+                long encodeMs = stopwatch.ElapsedMilliseconds / numRepetitions;
+
+                stopwatch.Restart();
+                for (int i = 0; i < numRepetitions; ++i)
+                    Image.LoadFromMemory(bytes).Dispose();
+                long decodeMs = stopwatch.ElapsedMilliseconds / numRepetitions;
+
+                Console.WriteLine($"4k {name} .tif with a limit of {numThreads} threads: encoding took " +
+                    $"{encodeMs} ms, decoding took {decodeMs} ms, {bytes.Length / 1024} KB");
+            }
+        }
+        BatchIO.SetThreadLimit(0);
+    }
+
+    public static void BenchLosslessLdr(int numRepetitions = 5) {
+        RgbImage img = new("../PyTest/dikhololo_night_4k.hdr");
+
+        // .qoi encodes blocks of rows in parallel and decodes in a single pass, .ppm is an uncompressed dump.
+        // Both are meant for intermediate LDR images where .png spends most of its time compressing.
+        foreach (string extension in new[] { ".png", ".qoi", ".ppm" }) {
+            byte[] bytes = img.WriteToMemory(extension);
+            Stopwatch stopwatch = Stopwatch.StartNew();
+            for (int i = 0; i < numRepetitions; ++i)
+                img.WriteToMemory(extension);
+            long encodeMs = stopwatch.ElapsedMilliseconds / numRepetitions;
+
+            stopwatch.Restart();
+            for (int i = 0; i < numRepetitions; ++i)
+                Image.LoadFromMemory(bytes).Dispose();
+            long decodeMs = stopwatch.ElapsedMilliseconds / numRepetitions;
+
+            Console.WriteLine($"4k RGB {extension}: encoding took {encodeMs} ms, decoding took {decodeMs} ms, " +
+                $"{bytes.Length / 1024} KB");
+        }
+    }
+
+    public static void BenchProbe() {
+        RgbImage img = new("../PyTest/dikhololo_night_4k.hdr");
+        Layers.WriteToExr("test-probe.exr", ("", img), ("albedo", img), ("normal", img));
+        foreach (var ext in new[] { ".exr", ".pfm", ".tif", ".hdr", ".png", ".jpg", ".bmp", ".tga" }) {
+            if (ext != ".exr") img.WriteToFile("test-probe" + ext);
+
+            int num = 1000;
+            Stopwatch stopwatch = Stopwatch.StartNew();
+            for (int i = 0; i < num; ++i)
+                ImageInfo.FromFile("test-probe" + ext);
+            double probeUs = stopwatch.Elapsed.TotalMicroseconds / num;
+
+            stopwatch.Restart();
+            new Image("test-probe" + ext).Dispose();
+            Console.WriteLine($"Probing {ext} took {probeUs:F1} us per file, loading it took " +
+                $"{stopwatch.ElapsedMilliseconds} ms");
+        }
     }
-}
\ No newline at end of file
+}
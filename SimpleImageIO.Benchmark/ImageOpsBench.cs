@@ -145,4 +145,47 @@ static class ImageOpsBench {
         stopwatch.Stop();
         Console.WriteLine($"Computing 90-percentile took {stopwatch.ElapsedMilliseconds / num}ms");
     }
-}
\ No newline at end of file
+
+    public static void BenchFlipBookPayload(int numRepetitions = 5) {
+        RgbImage image = new("../PyTest/dikhololo_night_4k.hdr");
+
+        // The per-pixel managed conversions that were used before the native packers
+        Stopwatch stopwatch = Stopwatch.StartNew();
+        for (int i = 0; i < numRepetitions; ++i) {
+            byte[] bytes = new byte[image.Width * image.Height * 4];
+            for (int row = 0; row < image.Height; ++row) {
+                for (int col = 0; col < image.Width; ++col) {
+                    RGBE clr = image.GetPixel(col, row);
+                    int idx = 4 * (col + row * image.Width);
+                    bytes[idx] = clr.R; bytes[idx + 1] = clr.G; bytes[idx + 2] = clr.B; bytes[idx + 3] = clr.E;
+                }
+            }
+        }
+        Console.WriteLine($"Managed RGBE conversion took {stopwatch.ElapsedMilliseconds / numRepetitions}ms");
+
+        stopwatch.Restart();
+        for (int i = 0; i < numRepetitions; ++i)
+            FlipBook.CompressImageAsRGBE(image);
+        Console.WriteLine($"RGBE payload took {stopwatch.ElapsedMilliseconds / numRepetitions}ms");
+
+        stopwatch.Restart();
+        for (int i = 0; i < numRepetitions; ++i) {
+            byte[] bytes = new byte[image.Width * image.Height * 3 * 2];
+            for (int row = 0; row < image.Height; ++row) {
+                for (int col = 0; col < image.Width; ++col) {
+                    for (int chan = 0; chan < 3; ++chan) {
+                        ushort bits = BitConverter.HalfToUInt16Bits((Half)image[col, row, chan]);
+                        int idx = 2 * (chan + 3 * (col + row * image.Width));
+                        bytes[idx] = (byte)bits; bytes[idx + 1] = (byte)(bits >> 8);
+                    }
+                }
+            }
+        }
+        Console.WriteLine($"Managed half conversion took {stopwatch.ElapsedMilliseconds / numRepetitions}ms");
+
+        stopwatch.Restart();
+        for (int i = 0; i < numRepetitions; ++i)
+            FlipBook.WriteImageAsFloat16(image);
+        Console.WriteLine($"Half payload took {stopwatch.ElapsedMilliseconds / numRepetitions}ms");
+    }
+}
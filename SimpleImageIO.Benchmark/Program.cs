@@ -3,11 +3,30 @@
 ColorBench.BenchLerp(1000000);
 
 IOBench.BenchIO();
+IOBench.BenchParallelLayerLoad();
+IOBench.BenchLayerExtraction();
+IOBench.BenchStreamingLayerLoad();
+IOBench.BenchLayeredWrite();
+IOBench.BenchRegionLoad();
+IOBench.BenchProbe();
+IOBench.BenchPfmThroughput();
+IOBench.BenchExrCompression();
+IOBench.BenchBatchIO();
+IOBench.BenchSmallExrs();
+IOBench.BenchDecodeFromMemory();
+IOBench.BenchMonoPng();
+IOBench.BenchParallelPng();
+IOBench.BenchParallelJpeg();
+IOBench.BenchHdr();
+IOBench.BenchLosslessLdr();
+IOBench.BenchTiff();
+IOBench.BenchPngReload();
 
 ImageOpsBench.BenchComputePercentile();
 ImageOpsBench.BenchGetSetPixel();
 ImageOpsBench.BenchErrors();
 ImageOpsBench.BenchSplatting();
+ImageOpsBench.BenchFlipBookPayload();
 
 FiltersBench.BenchBoxFilter();
 FiltersBench.BenchBoxFilter3();
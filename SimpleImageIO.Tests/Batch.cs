@@ -0,0 +1,56 @@
+using System.IO;
+using System.Linq;
+using System.Threading.Tasks;
+using Xunit;
+
+namespace SimpleImageIO.Tests {
+    public class Batch {
+        [Fact]
+        public async Task WriteThenRead_ShouldMatch() {
+            string[] filenames = { "batch/a.exr", "batch/b.pfm", "batch/c.png", "batch/d.tif", "batch/e.exr" };
+            var images = filenames.Select((name, i) => {
+                RgbImage image = new(7, 5);
+                for (int row = 0; row < 5; ++row)
+                    for (int col = 0; col < 7; ++col)
+                        image.SetPixel(col, row, new((row * 7 + col + i) / 50.0f));
+                return image;
+            }).ToArray();
+
+            await BatchIO.WriteAsync(images.Zip(filenames, (img, name) => (img as Image, name)), 100);
+            var loaded = await BatchIO.ReadAsync(filenames);
+
+            Assert.Equal(filenames.Length, loaded.Length);
+            for (int i = 0; i < filenames.Length; ++i) {
+                Assert.Equal(7, loaded[i].Width);
+                Assert.Equal(5, loaded[i].Height);
+                Assert.Equal(3, loaded[i].NumChannels);
+                Assert.Equal(images[i].GetPixel(6, 4).R, loaded[i].GetPixelChannel(6, 4, 0), 2);
+                Assert.Equal(images[i].GetPixel(2, 1).G, loaded[i].GetPixelChannel(2, 1, 1), 2);
+            }
+        }
+
+        [Fact]
+        public async Task ThreadLimit_ShouldStillWriteAndRead() {
+            RgbImage image = new(16, 40);
+            image.SetPixel(3, 35, new(1, 2, 3));
+
+            BatchIO.SetThreadLimit(1);
+            try {
+                await BatchIO.WriteAsync(new[] { (image as Image, "batch-limited.exr") }, 1, ExrCompression.ZIPS);
+                RgbImage loaded = new("batch-limited.exr");
+                Assert.Equal(2.0f, loaded.GetPixel(3, 35).G);
+            } finally {
+                BatchIO.SetThreadLimit(0);
+            }
+        }
+
+        [Fact]
+        public async Task ReadMissingFile_ShouldThrow() {
+            RgbImage image = new(2, 2);
+            image.WriteToFile("batch-existing.exr");
+
+            await Assert.ThrowsAsync<IOException>(
+                () => BatchIO.ReadAsync(new[] { "batch-existing.exr", "batch-does-not-exist.exr" }));
+        }
+    }
+}
@@ -157,6 +157,47 @@ public class Channels {
         File.Delete("layered.exr");
     }
 
+    [Fact]
+    public void MultiLayerExr_SelectedLayersOnly() {
+        RgbImage image = new(2, 2);
+        image.SetPixel(0, 0, new(1, 2, 3));
+        image.SetPixel(1, 1, new(2, 2, 2));
+
+        MonochromeImage otherImage = new(2, 2);
+        otherImage.SetPixel(0, 1, 0.5f);
+        otherImage.SetPixel(1, 0, 0.1f);
+
+        Layers.WriteToExr("layered.exr", false, ("normal", image), ("depth", otherImage), ("", image));
+        var layers = Layers.LoadFromFile("layered.exr", "depth", "doesnotexist");
+
+        Assert.Single(layers);
+        MonochromeImage depth = MonochromeImage.StealData(layers["depth"]);
+        Assert.Equal(otherImage.GetPixel(0, 0), depth.GetPixel(0, 0));
+        Assert.Equal(otherImage.GetPixel(0, 1), depth.GetPixel(0, 1));
+        Assert.Equal(otherImage.GetPixel(1, 0), depth.GetPixel(1, 0));
+        Assert.Equal(otherImage.GetPixel(1, 1), depth.GetPixel(1, 1));
+
+        File.Delete("layered.exr");
+    }
+
+    [Fact]
+    public void MultiLayerExr_ProbeListsLayers() {
+        RgbImage image = new(3, 2);
+        MonochromeImage otherImage = new(3, 2);
+
+        Layers.WriteToExr("probedlayers.exr", true, ("", image), ("albedo", image), ("depth", otherImage));
+        var info = ImageInfo.FromFile("probedlayers.exr");
+
+        Assert.Equal(3, info.Width);
+        Assert.Equal(2, info.Height);
+        Assert.Equal(3, info.NumChannels);
+        Assert.Equal(PixelType.Half, info.PixelType);
+        Assert.Equal(new[] { "", "albedo", "depth" }, info.LayerNames.Order());
+        Assert.Equal(info.LayerNames.Order(), Layers.GetLayerNames("probedlayers.exr").Order());
+
+        File.Delete("probedlayers.exr");
+    }
+
     [Fact]
     public void MultiLayerExr_NamesReadCorrectly() {
         RgbImage image = new(2, 2);
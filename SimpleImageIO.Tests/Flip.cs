@@ -1,3 +1,4 @@
+using System;
 using Xunit;
 
 namespace SimpleImageIO.Tests;
@@ -8,4 +9,57 @@ public class Flip {
         FlipBook.New.Add("test", new RgbImage(64, 64), FlipBook.DataType.Float16).ToString();
         string h = FlipBook.Header;
     }
-}
\ No newline at end of file
+
+    static RgbImage MakeHdrImage() {
+        RgbImage img = new(37, 5);
+        Random rng = new(1337);
+        for (int row = 0; row < img.Height; ++row) {
+            for (int col = 0; col < img.Width; ++col) {
+                float scale = MathF.Pow(2, rng.Next(-30, 30));
+                img.SetPixel(col, row, new(rng.NextSingle() * scale, rng.NextSingle() * scale, rng.NextSingle()));
+            }
+        }
+        img.SetPixel(0, 0, new(0));
+        img.SetPixel(1, 0, new(1e-35f, 0, 0));
+        img.SetPixel(2, 0, new(70000, 65504, 1e-7f));
+        return img;
+    }
+
+    static byte[] DecodePayload(string dataUrl) {
+        Assert.StartsWith("data:;base64,", dataUrl);
+        return Convert.FromBase64String(dataUrl["data:;base64,".Length..]);
+    }
+
+    [Fact]
+    public void RgbePayload_MatchesManagedConversion() {
+        var img = MakeHdrImage();
+        byte[] bytes = DecodePayload(FlipBook.CompressImageAsRGBE(img));
+        Assert.Equal(img.Width * img.Height * 4, bytes.Length);
+
+        for (int row = 0; row < img.Height; ++row) {
+            for (int col = 0; col < img.Width; ++col) {
+                RGBE expected = img.GetPixel(col, row);
+                int i = 4 * (col + row * img.Width);
+                for (int k = 0; k < 4; ++k)
+                    Assert.Equal(expected[k], bytes[i + k]);
+            }
+        }
+    }
+
+    [Fact]
+    public void HalfPayload_MatchesManagedConversion() {
+        var img = MakeHdrImage();
+        byte[] bytes = DecodePayload(FlipBook.WriteImageAsFloat16(img));
+        Assert.Equal(img.Width * img.Height * 3 * 2, bytes.Length);
+
+        for (int row = 0; row < img.Height; ++row) {
+            for (int col = 0; col < img.Width; ++col) {
+                for (int chan = 0; chan < 3; ++chan) {
+                    int i = 2 * (chan + 3 * (col + row * img.Width));
+                    ushort expected = BitConverter.HalfToUInt16Bits((Half)img[col, row, chan]);
+                    Assert.Equal(expected, BitConverter.ToUInt16(bytes, i));
+                }
+            }
+        }
+    }
+}
@@ -20,6 +20,54 @@ namespace SimpleImageIO.Tests {
 
             // compare
             Assert.Equal(read, gen);
+            Assert.Equal(read, image.AsBase64());
+        }
+
+        [Theory]
+        [InlineData(".png", "image/png")]
+        [InlineData(".jpg", "image/jpeg")]
+        [InlineData(".jpeg", "image/jpeg")]
+        [InlineData(".bmp", "image/bmp")]
+        [InlineData(".tif", "image/tiff")]
+        [InlineData(".qoi", "image/qoi")]
+        [InlineData(".tga", "image/x-tga")]
+        public void DataUri_ShouldMatchManagedBase64(string format, string mediaType) {
+            // Large enough for the base64 text to be encoded in several chunks
+            RgbImage image = new(401, 333);
+            Random rng = new(42);
+            for (int row = 0; row < image.Height; ++row)
+                for (int col = 0; col < image.Width; ++col)
+                    image.SetPixel(col, row, new(rng.NextSingle(), rng.NextSingle(), rng.NextSingle()));
+
+            string expected = $"data:{mediaType};base64," + Convert.ToBase64String(image.WriteToMemory(format));
+            Assert.Equal(expected, image.AsDataUri(format));
+
+            using MemoryStream stream = new();
+            image.WriteDataUri(stream, format);
+            Assert.Equal(expected, System.Text.Encoding.ASCII.GetString(stream.ToArray()));
+        }
+
+        [Theory]
+        [InlineData(1, 1)]
+        [InlineData(7, 5)]
+        [InlineData(1000, 100)]
+        public void RawPayloadDataUri_ShouldMatchPixels(int width, int height) {
+            Image image = new(width, height, 2);
+            Random rng = new(7);
+            for (int row = 0; row < height; ++row)
+                for (int col = 0; col < width; ++col)
+                    for (int chan = 0; chan < 2; ++chan)
+                        image[col, row, chan] = rng.NextSingle() * 100;
+
+            string uri = image.AsDataUri("float");
+            Assert.StartsWith("data:;base64,", uri);
+            byte[] bytes = Convert.FromBase64String(uri["data:;base64,".Length..]);
+            Assert.Equal(width * height * 2 * sizeof(float), bytes.Length);
+            for (int row = 0; row < height; ++row)
+                for (int col = 0; col < width; ++col)
+                    for (int chan = 0; chan < 2; ++chan)
+                        Assert.Equal(image[col, row, chan],
+                            BitConverter.ToSingle(bytes, 4 * (chan + 2 * (col + row * width))));
         }
     }
 }
\ No newline at end of file
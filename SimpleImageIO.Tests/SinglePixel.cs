@@ -1,3 +1,5 @@
+using System;
+using System.IO;
 using System.Numerics;
 using Xunit;
 
@@ -63,6 +65,26 @@ namespace SimpleImageIO.Tests {
             Assert.Equal(0.0f, pixel.B, 4);
         }
 
+        [Fact]
+        public void ReadBigEndianPfm() {
+            // A positive scale factor marks big endian data, the rows are stored from bottom to top
+            using (var stream = File.Create("testbigendian.pfm")) {
+                stream.Write(System.Text.Encoding.ASCII.GetBytes("Pf\n1 2\n1.0\n"));
+                foreach (float value in new[] { 2.0f, 1.0f }) {
+                    var bytes = BitConverter.GetBytes(value);
+                    if (BitConverter.IsLittleEndian) Array.Reverse(bytes);
+                    stream.Write(bytes);
+                }
+            }
+
+            MonochromeImage loaded = new("testbigendian.pfm");
+
+            Assert.Equal(1, loaded.Width);
+            Assert.Equal(2, loaded.Height);
+            Assert.Equal(1.0f, loaded.GetPixel(0, 0));
+            Assert.Equal(2.0f, loaded.GetPixel(0, 1));
+        }
+
         [Fact]
         public void WriteThenReadPng() {
             RgbImage image = new(1, 1);
@@ -79,6 +101,24 @@ namespace SimpleImageIO.Tests {
             Assert.Equal(0.0f, pixel.B, 1);
         }
 
+        [Fact]
+        public void WriteThenReadPng_ShouldInvertSrgb() {
+            RgbColor color = new(0.5f, 0.2f, 0.001f);
+            RgbImage image = new(1, 1);
+            image.SetPixel(0, 0, color);
+            image.WriteToFile("testpixelsrgb.png");
+
+            RgbImage loaded = new("testpixelsrgb.png");
+            var pixel = loaded.GetPixel(0, 0);
+
+            // The file stores the truncated 8 bit sRGB values, reading applies the exact inverse curve
+            var (r, g, b) = RgbColor.LinearToSrgb(color);
+            var expected = RgbColor.SrgbToLinear((byte)(r * 255), (byte)(g * 255), (byte)(b * 255));
+            Assert.Equal(expected.R, pixel.R, 5);
+            Assert.Equal(expected.G, pixel.G, 5);
+            Assert.Equal(expected.B, pixel.B, 5);
+        }
+
         [Fact]
         public void WriteThenReadJpg() {
             RgbImage image = new(1, 1);
@@ -1,3 +1,4 @@
+using System;
 using Xunit;
 
 namespace SimpleImageIO.Tests {
@@ -9,6 +10,8 @@ namespace SimpleImageIO.Tests {
         [InlineData("png")]
         [InlineData("jpg")]
         [InlineData("tif")]
+        [InlineData("qoi")]
+        [InlineData("ppm")]
         public void WriteThenRead(string extension) {
             RgbImage image = new(10, 15);
             for (int row = 0; row < 15; ++row)
@@ -33,12 +36,332 @@ namespace SimpleImageIO.Tests {
             Assert.Equal(14.0f / 15.0f, pixel.B, 2);
         }
 
+        [Theory]
+        [InlineData("exr")]
+        [InlineData("pfm")]
+        [InlineData("tif")]
+        public void LoadRegion_ShouldBeCropped(string extension) {
+            RgbImage image = new(10, 15);
+            for (int row = 0; row < 15; ++row)
+                for (int col = 0; col < 10; ++col)
+                    image.SetPixel(col, row, new(row / 15.0f, col / 10.0f, 1.0f));
+
+            image.WriteToFile("testregion." + extension, 100);
+
+            // The region exceeds the image on the right and is clipped
+            Image loaded = Image.LoadRegion("testregion." + extension, 6, 4, 8, 3);
+
+            Assert.Equal(4, loaded.Width);
+            Assert.Equal(3, loaded.Height);
+
+            for (int row = 0; row < 3; ++row) {
+                for (int col = 0; col < 4; ++col) {
+                    Assert.Equal((row + 4) / 15.0f, loaded.GetPixelChannel(col, row, 0), 2);
+                    Assert.Equal((col + 6) / 10.0f, loaded.GetPixelChannel(col, row, 1), 2);
+                }
+            }
+        }
+
+        [Theory]
+        [InlineData("exr", PixelType.Float)]
+        [InlineData("pfm", PixelType.Float)]
+        [InlineData("hdr", PixelType.Float)]
+        [InlineData("png", PixelType.UInt8)]
+        [InlineData("jpg", PixelType.UInt8)]
+        [InlineData("bmp", PixelType.UInt8)]
+        [InlineData("tga", PixelType.UInt8)]
+        [InlineData("tif", PixelType.Float)]
+        [InlineData("qoi", PixelType.UInt8)]
+        [InlineData("ppm", PixelType.UInt8)]
+        public void Probe_ShouldMatchLoaded(string extension, PixelType pixelType) {
+            RgbImage image = new(10, 15);
+            image.WriteToFile("testprobe." + extension, 100);
+
+            var info = ImageInfo.FromFile("testprobe." + extension);
+            Image loaded = new("testprobe." + extension);
+
+            Assert.Equal(loaded.Width, info.Width);
+            Assert.Equal(loaded.Height, info.Height);
+            Assert.Equal(loaded.NumChannels, info.NumChannels);
+            Assert.Equal(pixelType, info.PixelType);
+        }
+
+        [Theory]
+        [InlineData(1, 8)]
+        [InlineData(2, 8)]
+        [InlineData(4, 8)]
+        [InlineData(1, 16)]
+        [InlineData(2, 16)]
+        [InlineData(3, 16)]
+        [InlineData(4, 16)]
+        public void WriteThenReadPng_AnyLayout(int numChannels, int bitDepth) {
+            Image image = new(10, 15, numChannels);
+            for (int row = 0; row < 15; ++row)
+                for (int col = 0; col < 10; ++col)
+                    for (int chan = 0; chan < numChannels; ++chan)
+                        image.SetPixelChannel(col, row, chan, (row * 10 + col) / 150.0f);
+
+            string filename = $"testpng-{numChannels}-{bitDepth}.png";
+            image.WriteToFile(filename, bitDepth);
+
+            var info = ImageInfo.FromFile(filename);
+            Image loaded = new(filename);
+
+            Assert.Equal(numChannels, loaded.NumChannels);
+            Assert.Equal(bitDepth == 16 ? PixelType.UInt16 : PixelType.UInt8, info.PixelType);
+
+            // 8 bit values are truncated, 16 bit values are rounded. Alpha is stored linearly.
+            float maxError = bitDepth == 16 ? 0.0001f : 0.01f;
+            for (int row = 0; row < 15; ++row)
+                for (int col = 0; col < 10; ++col)
+                    for (int chan = 0; chan < numChannels; ++chan)
+                        Assert.True(MathF.Abs(image.GetPixelChannel(col, row, chan) - loaded.GetPixelChannel(col, row, chan)) < maxError);
+        }
+
+        [Theory]
+        [InlineData(1, 8)]
+        [InlineData(3, 8)]
+        [InlineData(1, 16)]
+        public void WriteThenReadPng_ManyStrips(int numChannels, int bitDepth) {
+            // Large enough that the rows are compressed as several strips, which are concatenated
+            int width = 1200, height = 700;
+            Image image = new(width, height, numChannels);
+            for (int row = 0; row < height; ++row)
+                for (int col = 0; col < width; ++col)
+                    for (int chan = 0; chan < numChannels; ++chan)
+                        image.SetPixelChannel(col, row, chan, ((row * 7 + col * 3 + chan) % 256) / 255.0f);
+
+            string filename = $"testpng-strips-{numChannels}-{bitDepth}.png";
+            image.WriteToFile(filename, bitDepth);
+            Image loaded = new(filename);
+
+            Assert.Equal(numChannels, loaded.NumChannels);
+            float maxError = bitDepth == 16 ? 0.0001f : 0.01f;
+            for (int row = 0; row < height; ++row)
+                for (int col = 0; col < width; ++col)
+                    for (int chan = 0; chan < numChannels; ++chan)
+                        Assert.True(MathF.Abs(image.GetPixelChannel(col, row, chan) - loaded.GetPixelChannel(col, row, chan)) < maxError);
+        }
+
+        [Theory]
+        [InlineData(1)]
+        [InlineData(3)]
+        [InlineData(4)]
+        public void WriteThenReadJpg_ManyStripes(int numChannels) {
+            // Large enough that the image is encoded as several stripes, separated by restart markers
+            int width = 1000, height = 700;
+            Image image = new(width, height, numChannels);
+            for (int row = 0; row < height; ++row)
+                for (int col = 0; col < width; ++col)
+                    for (int chan = 0; chan < numChannels; ++chan)
+                        image.SetPixelChannel(col, row, chan, (row + col) / (float)(width + height));
+
+            image.WriteToFile($"testjpg-stripes-{numChannels}.jpg", 100);
+            Image loaded = new($"testjpg-stripes-{numChannels}.jpg");
+
+            Assert.Equal(width, loaded.Width);
+            Assert.Equal(height, loaded.Height);
+            for (int row = 0; row < height; ++row)
+                for (int col = 0; col < width; ++col)
+                    Assert.Equal(image.GetPixelChannel(col, row, 0), loaded.GetPixelChannel(col, row, 0), 1);
+        }
+
+        [Fact]
+        public void WriteJpg_LongExtension() {
+            RgbImage image = new(10, 15);
+            for (int row = 0; row < 15; ++row)
+                for (int col = 0; col < 10; ++col)
+                    image.SetPixel(col, row, new(row / 15.0f));
+
+            System.IO.File.Delete("testjpg-ext.jpeg");
+            image.WriteToFile("testjpg-ext.jpeg");
+            byte[] read = System.IO.File.ReadAllBytes("testjpg-ext.jpeg");
+
+            Assert.Equal(image.WriteToMemory(".jpg"), read);
+            Assert.Equal(image.WriteToMemory(".jpeg"), read);
+        }
+
+        [Theory]
+        [InlineData(5)]
+        [InlineData(1200)]
+        public void WriteThenReadHdr_ManyBlocks(int width) {
+            // Tall enough that the scanlines are split into several blocks. Narrow images are stored flat,
+            // wide ones run-length encoded.
+            int height = 300;
+            RgbImage image = new(width, height);
+            for (int row = 0; row < height; ++row)
+                for (int col = 0; col < width; ++col)
+                    image.SetPixel(col, row, new((col % 50) / 5.0f, row / 30.0f, (row + col) % 3));
+
+            image.WriteToFile($"testhdr-blocks-{width}.hdr");
+            RgbImage loaded = new($"testhdr-blocks-{width}.hdr");
+
+            // The 8 bit mantissas are truncated, the error is below 1/128 of the largest component
+            for (int row = 0; row < height; ++row) {
+                for (int col = 0; col < width; ++col) {
+                    var expected = image.GetPixel(col, row);
+                    var actual = loaded.GetPixel(col, row);
+                    float maxError = MathF.Max(expected.R, MathF.Max(expected.G, expected.B)) / 128;
+                    Assert.True(MathF.Abs(expected.R - actual.R) <= maxError);
+                    Assert.True(MathF.Abs(expected.G - actual.G) <= maxError);
+                    Assert.True(MathF.Abs(expected.B - actual.B) <= maxError);
+                }
+            }
+        }
+
+        [Theory]
+        [InlineData(1, 1, PixelType.Float)]
+        [InlineData(3, 1, PixelType.Float)]
+        [InlineData(4, 0, PixelType.Half)]
+        [InlineData(3, 0, PixelType.Half)]
+        [InlineData(1, 16, PixelType.UInt16)]
+        [InlineData(4, 16, PixelType.UInt16)]
+        public void WriteThenReadTif_ManyStrips(int numChannels, int quality, PixelType pixelType) {
+            // Large enough that the rows are compressed as several strips
+            int width = 700, height = 300;
+            Image image = new(width, height, numChannels);
+            for (int row = 0; row < height; ++row)
+                for (int col = 0; col < width; ++col)
+                    for (int chan = 0; chan < numChannels; ++chan)
+                        image.SetPixelChannel(col, row, chan, ((row * 7 + col * 3 + chan) % 256) / 255.0f);
+
+            string filename = $"testtif-strips-{numChannels}-{quality}.tif";
+            image.WriteToFile(filename, quality);
+
+            var info = ImageInfo.FromFile(filename);
+            Image loaded = new(filename);
+            Image region = Image.LoadRegion(filename, 100, 150, 300, 100);
+
+            Assert.Equal(pixelType, info.PixelType);
+            Assert.Equal(numChannels, loaded.NumChannels);
+            for (int row = 0; row < height; ++row) {
+                for (int col = 0; col < width; ++col) {
+                    for (int chan = 0; chan < numChannels; ++chan) {
+                        float expected = image.GetPixelChannel(col, row, chan);
+                        if (pixelType == PixelType.Float)
+                            Assert.Equal(expected, loaded.GetPixelChannel(col, row, chan));
+                        else if (pixelType == PixelType.Half)
+                            Assert.Equal((float)(Half)expected, loaded.GetPixelChannel(col, row, chan));
+                        else // 16 bit integers, colors in sRGB and alpha linear
+                            Assert.True(MathF.Abs(expected - loaded.GetPixelChannel(col, row, chan)) < 0.0001f);
+                    }
+                }
+            }
+            for (int row = 0; row < 100; ++row)
+                for (int col = 0; col < 300; ++col)
+                    for (int chan = 0; chan < numChannels; ++chan)
+                        Assert.Equal(loaded.GetPixelChannel(col + 100, row + 150, chan), region.GetPixelChannel(col, row, chan));
+        }
+
+        [Fact]
+        public void WriteToTif_ShouldBeCompressed() {
+            RgbImage image = new(256, 256);
+            for (int row = 0; row < 256; ++row)
+                for (int col = 0; col < 256; ++col)
+                    image.SetPixel(col, row, new(row / 256.0f, col / 256.0f, 0.5f));
+
+            // Smooth floats compress well with the floating point predictor
+            byte[] bytes = image.WriteToMemory(".tif");
+            Assert.True(bytes.Length < 256 * 256 * 3 * sizeof(float) / 2);
+        }
+
+        [Theory]
+        [InlineData(1, 40)]
+        [InlineData(2, 40)]
+        [InlineData(3, 40)]
+        [InlineData(4, 40)]
+        [InlineData(3, 1200)]
+        [InlineData(4, 1200)]
+        public void WriteThenReadQoi_AnyLayout(int numChannels, int width) {
+            // Wide images are encoded as several blocks of rows, which are concatenated. Gray is stored as RGB.
+            int height = 300;
+            Image image = new(width, height, numChannels);
+            for (int row = 0; row < height; ++row)
+                for (int col = 0; col < width; ++col)
+                    for (int chan = 0; chan < numChannels; ++chan)
+                        image.SetPixelChannel(col, row, chan, ((row / 4 * 7 + col / 3 + chan * 50) % 256) / 255.0f);
+
+            string filename = $"testqoi-{numChannels}-{width}.qoi";
+            image.WriteToFile(filename);
+            Image loaded = new(filename);
+            Image fromMemory = Image.LoadFromMemory(image.WriteToMemory(".qoi"));
+
+            int expectedChannels = numChannels == 1 ? 3 : numChannels == 2 ? 4 : numChannels;
+            Assert.Equal(expectedChannels, loaded.NumChannels);
+            for (int row = 0; row < height; ++row) {
+                for (int col = 0; col < width; ++col) {
+                    for (int chan = 0; chan < expectedChannels; ++chan) {
+                        int srcChan = numChannels >= 3 ? chan : (chan < 3 ? 0 : 1);
+                        Assert.True(MathF.Abs(image.GetPixelChannel(col, row, srcChan) - loaded.GetPixelChannel(col, row, chan)) < 0.01f);
+                        Assert.Equal(loaded.GetPixelChannel(col, row, chan), fromMemory.GetPixelChannel(col, row, chan));
+                    }
+                }
+            }
+        }
+
+        [Theory]
+        [InlineData("pgm", 1, 8)]
+        [InlineData("pam", 2, 8)]
+        [InlineData("ppm", 3, 8)]
+        [InlineData("pam", 4, 8)]
+        [InlineData("pgm", 1, 16)]
+        [InlineData("pam", 2, 16)]
+        [InlineData("ppm", 3, 16)]
+        [InlineData("pam", 4, 16)]
+        public void WriteThenReadPnm_AnyLayout(string extension, int numChannels, int bitDepth) {
+            Image image = new(10, 15, numChannels);
+            for (int row = 0; row < 15; ++row)
+                for (int col = 0; col < 10; ++col)
+                    for (int chan = 0; chan < numChannels; ++chan)
+                        image.SetPixelChannel(col, row, chan, (row * 10 + col) / 150.0f);
+
+            string filename = $"testpnm-{numChannels}-{bitDepth}.{extension}";
+            image.WriteToFile(filename, bitDepth);
+
+            var info = ImageInfo.FromFile(filename);
+            Image loaded = new(filename);
+
+            Assert.Equal(numChannels, loaded.NumChannels);
+            Assert.Equal(bitDepth == 16 ? PixelType.UInt16 : PixelType.UInt8, info.PixelType);
+
+            // Alpha is stored linearly
+            float maxError = bitDepth == 16 ? 0.0001f : 0.01f;
+            for (int row = 0; row < 15; ++row)
+                for (int col = 0; col < 10; ++col)
+                    for (int chan = 0; chan < numChannels; ++chan)
+                        Assert.True(MathF.Abs(image.GetPixelChannel(col, row, chan) - loaded.GetPixelChannel(col, row, chan)) < maxError);
+        }
+
+        [Fact]
+        public void ReadPnm_WithCommentsAndOtherRange() {
+            // Written by other tools: comments in the header and a maximum value other than 255 or 65535
+            byte[] header = System.Text.Encoding.ASCII.GetBytes("P5\n# a comment\n3 2\n# another\n1023\n");
+            byte[] pixels = { 0, 0, 3, 255, 1, 0, 0, 0, 2, 0, 3, 255 };
+            byte[] bytes = new byte[header.Length + pixels.Length];
+            header.CopyTo(bytes, 0);
+            pixels.CopyTo(bytes, header.Length);
+            System.IO.File.WriteAllBytes("testpnm-comments.pgm", bytes);
+
+            Image loaded = new("testpnm-comments.pgm");
+            Assert.Equal(3, loaded.Width);
+            Assert.Equal(2, loaded.Height);
+            Assert.Equal(1, loaded.NumChannels);
+            Assert.Equal(0.0f, loaded.GetPixelChannel(0, 0, 0));
+            Assert.Equal(1.0f, loaded.GetPixelChannel(1, 0, 0), 4);
+            Assert.Equal(1.0f, loaded.GetPixelChannel(2, 1, 0), 4);
+            Assert.Equal(MathF.Pow((512 / 1023.0f + 0.055f) / 1.055f, 2.4f), loaded.GetPixelChannel(1, 1, 0), 3);
+        }
+
         [Theory]
         [InlineData(".hdr")]
         [InlineData(".png")]
         [InlineData(".jpg")]
         [InlineData(".bmp")]
         [InlineData(".exr")]
+        [InlineData(".qoi")]
+        [InlineData(".ppm")]
+        [InlineData(".pam")]
+        [InlineData(".tif")]
         public void WriteToMemory_ShouldBeSame(string extension) {
             RgbImage image = new(10, 15);
             for (int row = 0; row < 15; ++row)
@@ -52,6 +375,76 @@ namespace SimpleImageIO.Tests {
             Assert.Equal(read, generated);
         }
 
+        [Theory]
+        [InlineData("exr")]
+        [InlineData("pfm")]
+        [InlineData("hdr")]
+        [InlineData("png")]
+        [InlineData("jpg")]
+        [InlineData("bmp")]
+        [InlineData("tif")]
+        [InlineData("qoi")]
+        [InlineData("ppm")]
+        public void LoadFromMemory_ShouldMatchFile(string extension) {
+            RgbImage image = new(10, 15);
+            for (int row = 0; row < 15; ++row)
+                for (int col = 0; col < 10; ++col)
+                    image.SetPixel(col, row, new(row / 15.0f, col / 10.0f, 1.0f));
+            image.WriteToFile("frommemory." + extension, 100);
+
+            Image fromFile = new("frommemory." + extension);
+            byte[] bytes = System.IO.File.ReadAllBytes("frommemory." + extension);
+
+            // The format is identified from the data, a missing or wrong hint makes no difference
+            foreach (string hint in new[] { null, extension, ".png" }) {
+                Image fromMemory = Image.LoadFromMemory(bytes, hint);
+                Assert.Equal(fromFile.Width, fromMemory.Width);
+                Assert.Equal(fromFile.Height, fromMemory.Height);
+                Assert.Equal(fromFile.NumChannels, fromMemory.NumChannels);
+                for (int row = 0; row < 15; ++row)
+                    for (int col = 0; col < 10; ++col)
+                        for (int chan = 0; chan < 3; ++chan)
+                            Assert.Equal(fromFile.GetPixelChannel(col, row, chan),
+                                fromMemory.GetPixelChannel(col, row, chan));
+            }
+        }
+
+        [Fact]
+        public void LoadFromMemory_Invalid_ShouldThrow() {
+            byte[] bytes = System.Text.Encoding.ASCII.GetBytes("This is not an image");
+            Assert.Throws<System.IO.IOException>(() => Image.LoadFromMemory(bytes));
+            Assert.Throws<System.IO.IOException>(() => Image.LoadFromMemory(bytes, ".exr"));
+        }
+
+        [Fact]
+        public void WriteToMemory_Unsupported_ShouldThrow() {
+            RgbImage image = new(2, 2);
+            Assert.Throws<System.IO.IOException>(() => image.WriteToMemory(".pfm"));
+        }
+
+        [Theory]
+        [InlineData(ExrCompression.None)]
+        [InlineData(ExrCompression.RLE)]
+        [InlineData(ExrCompression.ZIPS)]
+        [InlineData(ExrCompression.ZIP)]
+        [InlineData(ExrCompression.PIZ)]
+        public void WriteToExr_Compressed_ShouldBeLossless(ExrCompression compression) {
+            RgbImage image = new(10, 15);
+            for (int row = 0; row < 15; ++row)
+                for (int col = 0; col < 10; ++col)
+                    image.SetPixel(col, row, new(row / 15.0f, col / 10.0f, 1.0f));
+            image.WriteToFile("testcompression.exr", 1, compression);
+
+            RgbImage loaded = new("testcompression.exr");
+            byte[] generated = image.WriteToMemory(".exr", 1, compression);
+            byte[] read = System.IO.File.ReadAllBytes("testcompression.exr");
+
+            for (int row = 0; row < 15; ++row)
+                for (int col = 0; col < 10; ++col)
+                    Assert.Equal(image.GetPixel(col, row), loaded.GetPixel(col, row));
+            Assert.Equal(read, generated);
+        }
+
         [Fact]
         public void WriteToExr_AsHalf_ShouldBeSmaller() {
             RgbImage image = new(10, 15);
@@ -0,0 +1,126 @@
+using System.Linq;
+using System.Runtime.InteropServices;
+
+namespace SimpleImageIO;
+
+/// <summary>
+/// Reads and writes many image files at once. The files are decoded and encoded concurrently on a
+/// persistent pool of native threads, the returned tasks complete once all files are done. That way,
+/// I/O can overlap with other work, and throughput scales with the number of cores.
+/// </summary>
+public static class BatchIO {
+    // Kept in a static field, so the delegate is never garbage collected while native code holds it
+    static readonly SimpleImageIOCore.IOJobCallback onJobDone = OnJobDone;
+
+    static void OnJobDone(int job, int fileIndex, bool success, IntPtr userData) {
+        // Only the final call, after all files are done, is of interest here
+        if (fileIndex >= 0) return;
+        var handle = GCHandle.FromIntPtr(userData);
+        var completion = (TaskCompletionSource)handle.Target;
+        handle.Free();
+
+        // Continuations run on the .NET thread pool, not on the native I/O thread that invoked us
+        completion.SetResult();
+    }
+
+    static (TaskCompletionSource, IntPtr) NewCompletion() {
+        TaskCompletionSource completion = new(TaskCreationOptions.RunContinuationsAsynchronously);
+        return (completion, GCHandle.ToIntPtr(GCHandle.Alloc(completion)));
+    }
+
+    /// <summary>
+    /// Limits how many native worker threads encode and decode images at the same time. This applies to the
+    /// batches started here, to the block-wise compression and decompression of all .exr files, and to the
+    /// strip-wise encoding of .png and .jpg files, e.g., to leave cores free for other work.
+    /// </summary>
+    /// <param name="numThreads">Maximum number of worker threads, zero removes the limit</param>
+    public static void SetThreadLimit(int numThreads) => SimpleImageIOCore.SetIOThreadLimit(numThreads);
+
+    /// <summary>
+    /// Passes the file names to native code as UTF-8 strings. They are copied before the submit call returns.
+    /// </summary>
+    static int SubmitWithNames(string[] names, Func<IntPtr[], int> submit) {
+        IntPtr[] utf8Names = names.Select(Marshal.StringToCoTaskMemUTF8).ToArray();
+        try {
+            return submit(utf8Names);
+        } finally {
+            foreach (var name in utf8Names) Marshal.FreeCoTaskMem(name);
+        }
+    }
+
+    /// <summary>
+    /// Loads a list of image files concurrently
+    /// </summary>
+    /// <param name="filenames">Names of the files to load, any of the supported formats</param>
+    /// <returns>The images, in the same order as the file names</returns>
+    /// <exception cref="IOException">If any of the files could not be loaded</exception>
+    public static async Task<Image[]> ReadAsync(IEnumerable<string> filenames) {
+        string[] names = filenames.ToArray();
+        if (names.Length == 0) return Array.Empty<Image>();
+
+        var (completion, userData) = NewCompletion();
+        int job = SubmitWithNames(names,
+            utf8Names => SimpleImageIOCore.SubmitRead(utf8Names, names.Length, onJobDone, userData));
+        await completion.Task;
+
+        // Move the decoded images out of the native cache, the copies are done in parallel as well
+        Image[] images = new Image[names.Length];
+        Parallel.For(0, names.Length, i => {
+            if (SimpleImageIOCore.GetReadResult(job, i, out int id, out int w, out int h, out int c))
+                images[i] = Image.FromCachedImage(id, w, h, c);
+        });
+        SimpleImageIOCore.DeleteJob(job);
+
+        var failed = names.Where((_, i) => images[i] == null).ToList();
+
+        if (failed.Count > 0) {
+            foreach (var img in images) img?.Dispose();
+            throw new IOException($"ERROR: Could not load image files: '{string.Join("', '", failed)}'");
+        }
+        return images;
+    }
+
+    /// <summary>
+    /// Writes a list of images to files concurrently. The images must not be modified or disposed before
+    /// the returned task has completed.
+    /// </summary>
+    /// <param name="images">The images and the names of the files to write them to</param>
+    /// <param name="lossyQuality">Compression quality, see <see cref="Image.WriteToFile"/></param>
+    /// <param name="exrCompression">Compression method for the ".exr" files, ignored for all others</param>
+    /// <exception cref="IOException">If any of the files could not be written</exception>
+    public static async Task WriteAsync(IEnumerable<(Image Image, string Filename)> images,
+                                        int? lossyQuality = null,
+                                        ExrCompression exrCompression = ExrCompression.PIZ) {
+        var items = images.ToArray();
+        if (items.Length == 0) return;
+
+        foreach (var item in items)
+            Image.EnsureDirectory(item.Filename);
+
+        var (completion, userData) = NewCompletion();
+        int job = SubmitWithNames(items.Select(i => i.Filename).ToArray(),
+            utf8Names => SimpleImageIOCore.SubmitWrite(
+                items.Select(i => i.Image.DataPointer).ToArray(),
+                items.Select(i => i.Image.Width * i.Image.NumChannels).ToArray(),
+                items.Select(i => i.Image.Width).ToArray(),
+                items.Select(i => i.Image.Height).ToArray(),
+                items.Select(i => i.Image.NumChannels).ToArray(),
+                utf8Names,
+                items.Select(i => lossyQuality ?? (i.Filename.EndsWith(".exr") ? 0 : 80)).ToArray(),
+                items.Length, exrCompression, onJobDone, userData));
+        await completion.Task;
+
+        List<string> failed = new();
+        for (int i = 0; i < items.Length; ++i) {
+            if (!SimpleImageIOCore.GetJobFileSuccess(job, i))
+                failed.Add(items[i].Filename);
+        }
+        SimpleImageIOCore.DeleteJob(job);
+
+        // The native threads read from the images until here
+        GC.KeepAlive(items);
+
+        if (failed.Count > 0)
+            throw new IOException($"ERROR: Could not write image files: '{string.Join("', '", failed)}'");
+    }
+}
@@ -0,0 +1,22 @@
+namespace SimpleImageIO;
+
+/// <summary>
+/// Compression method of an .exr file. All of them are lossless, but they trade encoding and decoding
+/// time against file size differently. Values match the compression ids in the .exr header.
+/// </summary>
+public enum ExrCompression {
+    /// <summary> Raw pixel data, fastest to write and read but largest </summary>
+    None = 0,
+
+    /// <summary> Run-length encoding, very fast but only effective on flat regions </summary>
+    RLE = 1,
+
+    /// <summary> Deflate, one scanline per block. Fast to decode </summary>
+    ZIPS = 2,
+
+    /// <summary> Deflate, 16 scanlines per block. Usually smaller than ZIPS </summary>
+    ZIP = 3,
+
+    /// <summary> Wavelet + Huffman, typically the smallest for noisy images but slowest to encode (default) </summary>
+    PIZ = 4,
+}
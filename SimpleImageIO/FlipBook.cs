@@ -156,53 +156,19 @@ public class FlipBook
     /// <param name="Id">ID of the HTML element defined in <see cref="Html"/></param>
     public record struct GeneratedCode(string Html, string Data, string ScriptFn, string Id) { }
 
-    static unsafe string CompressImageAsRGBE(Image img)
+    internal static string CompressImageAsRGBE(Image img)
     {
         Debug.Assert(img.NumChannels == 3);
-
-        List<byte> rgbeBytes = new();
-        for (int row = 0; row < img.Height; ++row)
-        {
-            for (int col = 0; col < img.Width; ++col)
-            {
-                RGBE clr = new RgbColor(img[col, row, 0], img[col, row, 1], img[col, row, 2]);
-                rgbeBytes.AddRange(new[] { clr.R, clr.G, clr.B, clr.E });
-            }
-        }
-        return "data:;base64," + Convert.ToBase64String(rgbeBytes.ToArray());
+        return img.AsDataUri("rgbe");
     }
 
-    static unsafe string WriteImageAsFloat32(Image img)
-    {
-        var bytePtr = (byte*)img.DataPointer.ToPointer();
-        Span<byte> bytes = new(bytePtr, img.Width * img.Height * img.NumChannels * sizeof(float));
-        return "data:;base64," + Convert.ToBase64String(bytes.ToArray());
-    }
+    static string WriteImageAsFloat32(Image img) => img.AsDataUri("float");
 
-    static unsafe string WriteImageAsFloat16(Image img)
-    {
-        var bytes = new List<byte>();
-        void AddHalf(float v)
-        {
-            ushort bits = BitConverter.HalfToUInt16Bits((Half)v);
-            bytes.Add((byte)(bits & 0xFF));
-            bytes.Add((byte)(bits >> 8));
-        }
-        for (int row = 0; row < img.Height; ++row)
-        {
-            for (int col = 0; col < img.Width; ++col)
-            {
-                for (int chan = 0; chan < img.NumChannels; ++chan)
-                    AddHalf(img[col, row, chan]);
-            }
-        }
-        return "data:;base64," + Convert.ToBase64String(bytes.ToArray());
-    }
+    internal static string WriteImageAsFloat16(Image img) => img.AsDataUri("half");
 
-    static string CompressImageAsPNG(Image img) => "data:image/png;base64," + img.AsBase64();
+    static string CompressImageAsPNG(Image img) => img.AsDataUri(".png");
 
-    static string CompressImageAsJPEG(Image img, int quality = 90) =>
-        "data:image/jpeg;base64," + img.AsBase64(".jpg", quality);
+    static string CompressImageAsJPEG(Image img, int quality = 90) => img.AsDataUri(".jpg", quality);
 
     /// <summary>
     /// HTML code that should be added once to each webpage / notebook that displays flip books.
@@ -1,6 +1,7 @@
 using System.Runtime.InteropServices;
 using System.Runtime.CompilerServices;
 using System.Globalization;
+using System.Text;
 
 namespace SimpleImageIO;
 
@@ -47,6 +48,8 @@ public unsafe class Image : IDisposable {
         ".tga",
         ".pfm",
         ".tif", ".tiff",
+        ".qoi",
+        ".ppm", ".pgm", ".pam", ".pnm",
     };
 
     /// <summary>
@@ -313,15 +316,23 @@ public unsafe class Image : IDisposable {
     /// </summary>
     /// <param name="filename">Name of the file to write, extension must be one of the supported formats</param>
     /// <param name="lossyQuality">
-    /// If the format is ".jpeg", this number between 0 and 100 determines the compression quality (default: 80).
-    /// For .exr, numbers != 0 write 32 bit floats, == 0 writes 16 bit half precision floats (default: 0).
-    /// Otherwise, it is ignored.
+    /// Depends on the format, for some lossless formats it selects the sample type:
+    /// <list type="bullet">
+    /// <item>.jpg: the compression quality between 1 and 100 (default: 80)</item>
+    /// <item>.exr: 0 writes 16 bit half precision floats, other values 32 bit floats (default: 0)</item>
+    /// <item>.png, .ppm, .pgm, .pam: 16 writes 16 bit per channel, other values 8 bit (default: 8 bit)</item>
+    /// <item>.tif: 0 writes 16 bit half precision floats, 16 writes 16 bit integers, other values 32 bit
+    /// floats (default: 32 bit floats)</item>
+    /// </list>
+    /// Other formats ignore it.
     /// </param>
-    public void WriteToFile(string filename, int? lossyQuality = null) {
+    /// <param name="exrCompression">Compression method if the format is ".exr", ignored otherwise</param>
+    public void WriteToFile(string filename, int? lossyQuality = null,
+                            ExrCompression exrCompression = ExrCompression.PIZ) {
         int quality = lossyQuality ?? (filename.EndsWith(".exr") ? 0 : 80);
         EnsureDirectory(filename);
         SimpleImageIOCore.WriteImage(DataPointer, NumChannels * Width, Width, Height, NumChannels,
-            filename, quality);
+            filename, quality, exrCompression);
     }
 
     /// <summary>
@@ -330,47 +341,176 @@ public unsafe class Image : IDisposable {
     /// <param name="extension">
     /// The file name extension of the desired format, e.g., ".exr" or ".png".
     /// </param>
-    /// <param name="lossyQuality">
-    /// If the format is ".jpeg", this number between 0 and 100 determines the compression quality (default: 80).
-    /// For .exr, numbers != 0 write 32 bit floats, == 0 writes 16 bit half precision floats (default: 0).
-    /// Otherwise, it is ignored.
-    /// </param>
+    /// <param name="lossyQuality">Same as for <see cref="WriteToFile" /></param>
+    /// <param name="exrCompression">Compression method if the format is ".exr", ignored otherwise</param>
     /// <returns>The memory contents of the image file</returns>
-    public byte[] WriteToMemory(string extension, int? lossyQuality = null) {
+    /// <exception cref="IOException">If the format cannot be written to memory, e.g., .pfm</exception>
+    public byte[] WriteToMemory(string extension, int? lossyQuality = null,
+                                ExrCompression exrCompression = ExrCompression.PIZ)
+    => EncodeToMemory(extension, lossyQuality, exrCompression, bytes => bytes.ToArray());
+
+    delegate T EncodedBytesFunc<T>(ReadOnlySpan<byte> bytes);
+
+    /// <summary>
+    /// Encodes the image and passes a view of the file contents to a function, straight from the native
+    /// buffer that the encoder wrote to. The buffer is released once the function returns.
+    /// </summary>
+    T EncodeToMemory<T>(string extension, int? lossyQuality, ExrCompression exrCompression,
+                        EncodedBytesFunc<T> consume) {
         int quality = lossyQuality ?? (extension == ".exr" ? 0 : 80);
-        IntPtr mem = SimpleImageIOCore.WriteToMemory(DataPointer, NumChannels * Width, Width, Height,
-            NumChannels, extension, quality, out int numBytes);
+        IntPtr buffer = SimpleImageIOCore.WriteToMemory(DataPointer, NumChannels * Width, Width, Height,
+            NumChannels, extension, quality, exrCompression, out IntPtr bytes, out int numBytes);
+        if (buffer == IntPtr.Zero)
+            throw new IOException($"ERROR: Could not encode image as '{extension}'");
+
+        try {
+            return consume(new ReadOnlySpan<byte>((void*)bytes, numBytes));
+        } finally {
+            SimpleImageIOCore.FreeMemory(buffer);
+        }
+    }
 
-        byte[] bytes = new byte[numBytes];
-        Marshal.Copy(mem, bytes, 0, numBytes);
-        SimpleImageIOCore.FreeMemory(mem);
+    /// <summary>
+    /// Encodes the image and passes a view of its base64 encoding, as ASCII characters, to a function. The
+    /// file and its base64 text are both produced by the native encoder, the text buffer is released once
+    /// the function returns.
+    /// </summary>
+    T EncodeBase64<T>(string format, int? lossyQuality, bool dataUri, EncodedBytesFunc<T> consume) {
+        int quality = lossyQuality ?? (format == ".exr" ? 0 : 80);
+        IntPtr buffer = SimpleImageIOCore.WriteBase64ToMemory(DataPointer, NumChannels * Width, Width, Height,
+            NumChannels, format, quality, ExrCompression.PIZ, dataUri, out IntPtr text, out int numChars);
+        if (buffer == IntPtr.Zero)
+            throw new IOException($"ERROR: Could not encode image as '{format}'");
 
-        return bytes;
+        try {
+            return consume(new ReadOnlySpan<byte>((void*)text, numChars));
+        } finally {
+            SimpleImageIOCore.FreeMemory(buffer);
+        }
     }
 
     /// <summary>
-    /// Calls <see cref="WriteToMemory" /> and converts the output bytes to a base64 string.
+    /// Encodes the image like <see cref="WriteToMemory" /> and returns the file contents as a base64 string.
     /// </summary>
     /// <param name="extension">The file extension that specifies the format, including the .</param>
-    /// <param name="lossyQuality">
-    /// If the format is ".jpeg", this number between 0 and 100 determines the compression quality (default: 80).
-    /// For .exr, numbers != 0 write 32 bit floats, == 0 writes 16 bit half precision floats (default: 0).
-    /// Otherwise, it is ignored.
-    /// </param>
+    /// <param name="lossyQuality">Same as for <see cref="WriteToFile" /></param>
     /// <returns>The base64 encoded image as a string</returns>
     public string AsBase64(string extension = ".png", int? lossyQuality = null)
-    => Convert.ToBase64String(WriteToMemory(extension, lossyQuality));
+    => EncodeBase64(extension, lossyQuality, false, Encoding.ASCII.GetString);
+
+    /// <summary>
+    /// Encodes the image as a base64 data URI, e.g., "data:image/png;base64,...", that can be embedded in
+    /// HTML. The encoding to base64 happens in native code, without intermediate managed copies of the file.
+    /// </summary>
+    /// <param name="format">
+    /// The file extension of the desired format, e.g., ".png" or ".jpg". Alternatively, one of the raw pixel
+    /// payloads "rgbe" (shared exponent bytes), "half" (16 bit floats), or "float" (32 bit floats) that are
+    /// read by the flip book viewer. These have no media type ("data:;base64,...").
+    /// </param>
+    /// <param name="lossyQuality">Same as for <see cref="AsBase64" /></param>
+    /// <returns>The data URI as a string</returns>
+    public string AsDataUri(string format = ".png", int? lossyQuality = null)
+    => EncodeBase64(format, lossyQuality, true, Encoding.ASCII.GetString);
+
+    /// <summary>
+    /// Writes the same ASCII text as <see cref="AsDataUri" /> to a stream, e.g., an HTML report that is
+    /// being generated, without creating a string first.
+    /// </summary>
+    /// <param name="stream">The stream to write to</param>
+    /// <param name="format">Same as for <see cref="AsDataUri" /></param>
+    /// <param name="lossyQuality">Same as for <see cref="AsBase64" /></param>
+    public void WriteDataUri(Stream stream, string format = ".png", int? lossyQuality = null)
+    => EncodeBase64(format, lossyQuality, true, text => { stream.Write(text); return 0; });
 
     /// <summary>
     /// Loads an image from one of the supported formats into this object
     /// </summary>
     /// <param name="filename">Filename with supported extension</param>
-    protected void LoadFromFile(string filename) {
+    protected void LoadFromFile(string filename) => LoadFromFile(filename, null);
+
+    /// <summary>
+    /// Loads a rectangular region of an image file. For .exr, .pfm, and .tiff images, only the parts of
+    /// the file that overlap the region are read and decoded.
+    /// </summary>
+    /// <param name="filename">Filename with supported extension</param>
+    /// <param name="x">Column of the top left corner of the region</param>
+    /// <param name="y">Row of the top left corner of the region</param>
+    /// <param name="width">Width of the region in pixels</param>
+    /// <param name="height">Height of the region in pixels</param>
+    /// <returns>The pixels within the region, clipped to the boundaries of the image</returns>
+    public static Image LoadRegion(string filename, int x, int y, int width, int height) {
+        Image image = new();
+        image.LoadFromFile(filename, (x, y, width, height));
+        return image;
+    }
+
+    /// <summary>
+    /// Decodes an image file that is already in memory, e.g., because it was downloaded or read from an
+    /// archive. The format is identified from the signature at the start of the data.
+    /// </summary>
+    /// <param name="data">The contents of the image file</param>
+    /// <param name="formatHint">
+    /// Optional file name extension of the format, e.g., ".exr" or "png". Only used if the data has no
+    /// signature that we recognize.
+    /// </param>
+    /// <returns>The decoded image</returns>
+    /// <exception cref="IOException">If the data could not be decoded</exception>
+    public static Image LoadFromMemory(ReadOnlySpan<byte> data, string formatHint = null) {
+        int id, w, h, n;
+        fixed (byte* ptr = data) {
+            id = SimpleImageIOCore.CacheImageFromMemory(out w, out h, out n, (IntPtr)ptr, (nuint)data.Length,
+                formatHint);
+        }
+        if (id >= 0 && (w <= 0 || h <= 0 || n <= 0)) {
+            SimpleImageIOCore.DeleteCachedImage(id);
+            id = -1;
+        }
+        if (id < 0)
+            throw new IOException("ERROR: Could not decode image from memory");
+        return FromCachedImage(id, w, h, n);
+    }
+
+    /// <summary>
+    /// Moves an image from the native cache into a new image object. The cache entry is removed.
+    /// </summary>
+    internal static Image FromCachedImage(int id, int width, int height, int numChannels) {
+        Image image = new() {
+            Width = width,
+            Height = height,
+            NumChannels = numChannels,
+            ChannelNames = new string[numChannels]
+        };
+        image.Alloc();
+        SimpleImageIOCore.CopyCachedImage(id, image.DataPointer);
+        return image;
+    }
+
+    void LoadFromFile(string filename, (int X, int Y, int Width, int Height)? region) {
         if (!File.Exists(filename))
             throw new FileNotFoundException("Image file does not exist.", filename);
 
-        // Read the image from the file, it is cached in native memory
-        int id = SimpleImageIOCore.CacheImage(out int w, out int h, out int n, filename);
+        if (!region.HasValue) {
+            // Query the size, then decode straight into our own memory
+            if (!SimpleImageIOCore.ProbeImage(filename, out var info, out nint layerNames))
+                throw new IOException($"ERROR: Could not load image file '{filename}'");
+            SimpleImageIOCore.DeleteExrLayerNames(info.NumLayers, layerNames);
+
+            Width = info.Width;
+            Height = info.Height;
+            NumChannels = info.NumChannels;
+            ChannelNames = new string[NumChannels];
+            Alloc();
+            if (NumChannels > 0 && !SimpleImageIOCore.ReadImageInto(filename, DataPointer, Width * NumChannels)) {
+                Free();
+                throw new IOException($"ERROR: Could not load image file '{filename}'");
+            }
+            return;
+        }
+
+        // Read the region from the file, it is cached in native memory
+        int w, h, n;
+        int id = SimpleImageIOCore.CacheImageRegion(out w, out h, out n, filename,
+            region.Value.X, region.Value.Y, region.Value.Width, region.Value.Height);
         Width = w;
         Height = h;
         NumChannels = n;
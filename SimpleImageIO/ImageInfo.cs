@@ -0,0 +1,55 @@
+using System.Runtime.InteropServices;
+
+namespace SimpleImageIO;
+
+/// <summary>
+/// Type of the values stored in an image file. Images are always loaded as 32 bit float, irrespective
+/// of this type.
+/// </summary>
+public enum PixelType {
+    /// <summary> 8 bit unsigned integer, e.g., .png, .jpg, .bmp, .tga, or 8 bit .tiff </summary>
+    UInt8 = 0,
+
+    /// <summary> 16 bit unsigned integer, e.g., 16 bit .png or .tiff </summary>
+    UInt16 = 1,
+
+    /// <summary> 16 bit floating point, e.g., half precision .exr or .tiff </summary>
+    Half = 2,
+
+    /// <summary> 32 bit unsigned integer, e.g., object ids in an .exr </summary>
+    UInt32 = 3,
+
+    /// <summary> 32 bit floating point, e.g., .pfm or .hdr </summary>
+    Float = 4,
+}
+
+/// <summary>
+/// Image metadata as read from the header of a file, without decoding any pixels.
+/// </summary>
+/// <param name="Width">Width of the image in pixels</param>
+/// <param name="Height">Height of the image in pixels</param>
+/// <param name="NumChannels">
+/// Number of channels that will be loaded by <see cref="Image(string)"/>. For .exr files, these are
+/// the channels of the layer without a name, which can be zero if the file only has named layers.
+/// </param>
+/// <param name="PixelType">Type of the stored values (the widest one, if an .exr mixes types)</param>
+/// <param name="LayerNames">Names of all layers in an .exr file, empty for all other formats</param>
+public record ImageInfo(int Width, int Height, int NumChannels, PixelType PixelType, string[] LayerNames) {
+    /// <summary>
+    /// Reads the metadata of an image from its file header. This is orders of magnitude cheaper than
+    /// loading the image, typically a few microseconds per file.
+    /// </summary>
+    /// <param name="filename">Path to an image in any of the <see cref="Image.SupportedExtensions"/></param>
+    /// <exception cref="IOException">If the file does not exist or its header is invalid</exception>
+    public static unsafe ImageInfo FromFile(string filename) {
+        if (!SimpleImageIOCore.ProbeImage(filename, out var info, out nint names))
+            throw new IOException($"Could not read image header from {filename}");
+
+        var layerNames = new string[info.NumLayers];
+        for (int i = 0; i < info.NumLayers; ++i)
+            layerNames[i] = Marshal.PtrToStringUTF8(((nint*)names)[i]);
+        SimpleImageIOCore.DeleteExrLayerNames(info.NumLayers, names);
+
+        return new(info.Width, info.Height, info.NumChannels, (PixelType)info.PixelType, layerNames);
+    }
+}
@@ -14,18 +14,33 @@ public static class Layers {
     /// </summary>
     /// <param name="filename">Name of an existing .exr image with one or more layers</param>
     /// <returns>A dictionary where layer names are the keys, and the layer images are the values</returns>
-    public static Dictionary<string, Image> LoadFromFile(string filename) {
+    public static Dictionary<string, Image> LoadFromFile(string filename)
+    => LoadFromFile(filename, null);
+
+    /// <summary>
+    /// Loads some of the layers from a multi-layer .exr file. Only the channels of these layers are
+    /// decoded, which is faster and requires less memory than loading all of them.
+    /// </summary>
+    /// <param name="filename">Name of an existing .exr image with one or more layers</param>
+    /// <param name="layerNames">
+    /// Names of the layers to load, or null to load all. Names of layers that do not exist are ignored.
+    /// </param>
+    /// <returns>A dictionary where layer names are the keys, and the layer images are the values</returns>
+    public static Dictionary<string, Image> LoadFromFile(string filename, params string[] layerNames) {
         if (!File.Exists(filename))
             throw new FileNotFoundException("Image file does not exist.", filename);
 
-        // Read the image from the file, it is cached in native memory
-        int id = SimpleImageIOCore.CacheImage(out int width, out int height, out _, filename);
+        // Read the header, the pixels are decoded straight into our images at the end
+        int id = SimpleImageIOCore.OpenExrLayers(out int width, out int height, filename, layerNames,
+            layerNames?.Length ?? 0);
         if (id < 0 || width <= 0 || height <= 0)
             throw new IOException($"ERROR: Could not load image file '{filename}'");
 
         Dictionary<string, Image> layers = new();
 
         int numLayers = SimpleImageIOCore.GetExrLayerCount(id);
+        IntPtr[] buffers = new IntPtr[numLayers];
+        int[] strides = new int[numLayers];
         for (int i = 0; i < numLayers; ++i) {
             int len = SimpleImageIOCore.GetExrLayerNameLen(id, i);
             StringBuilder nameBuilder = new(len);
@@ -49,10 +64,17 @@ public static class Layers {
                 layers[name].ChannelNames[c] = chanNameBuilder.ToString();
             }
 
-            SimpleImageIOCore.CopyCachedLayer(id, name, layers[name].DataPointer);
+            buffers[i] = layers[name].DataPointer;
+            strides[i] = width * numChans;
         }
 
+        // Decode all layers in a single pass over the file
+        bool success = SimpleImageIOCore.ReadExrLayersInto(id, buffers, strides);
         SimpleImageIOCore.DeleteCachedImage(id);
+        if (!success) {
+            foreach (var layer in layers.Values) layer.Dispose();
+            throw new IOException($"ERROR: Could not load image file '{filename}'");
+        }
 
         return layers;
     }
@@ -77,8 +99,24 @@ public static class Layers {
     /// <param name="layers">
     /// Pairs of layer names and layer images to write to the .exr. Must have equal resolutions.
     /// </param>
-    public static void WriteToExr(string filename, IEnumerable<(string Name, Image Image)> layers, bool halfPrecision = true)
-    => WriteToExr(filename, halfPrecision, [.. layers]);
+    /// <param name="compression">Compression method of the file</param>
+    public static void WriteToExr(string filename, IEnumerable<(string Name, Image Image)> layers, bool halfPrecision = true,
+                                  ExrCompression compression = ExrCompression.PIZ)
+    => WriteToExr(filename, halfPrecision, compression, [.. layers]);
+
+    /// <summary>
+    /// Writes a multi-layer .exr file where each layer is represented by a separate image with one or
+    /// more channels
+    /// </summary>
+    /// <param name="filename">Name of the output .exr file, extension should be .exr</param>
+    /// <param name="halfPrecision">If false, write 32 bit float, else 16 bit.</param>
+    /// <param name="layers">
+    /// Pairs of layer names and layer images to write to the .exr. Must have equal resolutions.
+    /// </param>
+    /// <param name="compression">Compression method of the file</param>
+    public static void WriteToExr(string filename, IEnumerable<KeyValuePair<string, Image>> layers, bool halfPrecision = true,
+                                  ExrCompression compression = ExrCompression.PIZ)
+    => WriteToExr(filename, halfPrecision, compression, layers.Select(kv => (kv.Key, kv.Value)).ToArray());
 
     /// <summary>
     /// Writes a multi-layer .exr file where each layer is represented by a separate image with one or
@@ -89,8 +127,8 @@ public static class Layers {
     /// <param name="layers">
     /// Pairs of layer names and layer images to write to the .exr. Must have equal resolutions.
     /// </param>
-    public static void WriteToExr(string filename, IEnumerable<KeyValuePair<string, Image>> layers, bool halfPrecision = true)
-    => WriteToExr(filename, halfPrecision, layers.Select(kv => (kv.Key, kv.Value)).ToArray());
+    public static void WriteToExr(string filename, bool halfPrecision, params (string Name, Image Image)[] layers)
+    => WriteToExr(filename, halfPrecision, ExrCompression.PIZ, layers);
 
     /// <summary>
     /// Writes a multi-layer .exr file where each layer is represented by a separate image with one or
@@ -98,10 +136,12 @@ public static class Layers {
     /// </summary>
     /// <param name="filename">Name of the output .exr file, extension should be .exr</param>
     /// <param name="halfPrecision">If false, write 32 bit float, else 16 bit.</param>
+    /// <param name="compression">Compression method of the file</param>
     /// <param name="layers">
     /// Pairs of layer names and layer images to write to the .exr. Must have equal resolutions.
     /// </param>
-    public static void WriteToExr(string filename, bool halfPrecision, params (string Name, Image Image)[] layers) {
+    public static void WriteToExr(string filename, bool halfPrecision, ExrCompression compression,
+                                  params (string Name, Image Image)[] layers) {
         Image.EnsureDirectory(filename);
 
         // Assemble the raw data in a C-API compatible format
@@ -121,7 +161,7 @@ public static class Layers {
         }
 
         SimpleImageIOCore.WriteLayeredExr(dataPointers.ToArray(), strides.ToArray(), Width, Height,
-            NumChannels.ToArray(), dataPointers.Count, names.ToArray(), filename, halfPrecision);
+            NumChannels.ToArray(), dataPointers.Count, names.ToArray(), filename, halfPrecision, compression);
     }
 
     /// <summary>
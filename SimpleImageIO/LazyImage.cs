@@ -32,7 +32,7 @@ public class LazyImage {
     public Image Image {
         get {
             if (layerName != null) {
-                image ??= Layers.LoadFromFile(path)[layerName];
+                image ??= Layers.LoadFromFile(path, layerName)[layerName];
             } else {
                 image ??= new Image(path) switch {
                     Image { NumChannels: 3} img => RgbImage.StealData(img),
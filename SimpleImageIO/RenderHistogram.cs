@@ -85,7 +85,7 @@ public static class HistogramRenderer {
     /// <returns>HTML code as a string</returns>
     public static string RenderHtml(Image img, int width, int height) {
         var h = Render((img), width, height);
-        string url = "data:image/png;base64," + h.Image.AsBase64();
+        string url = h.Image.AsDataUri();
         string lineStyle =
             $"""
             width: 2pt;
@@ -10,6 +10,30 @@ static internal partial class SimpleImageIOCore {
     public static extern int CacheImage(out int width, out int height, out int numChannels,
                                         [MarshalAs(UnmanagedType.LPUTF8Str)] string filename);
 
+    [DllImport("SimpleImageIOCore", CallingConvention = CallingConvention.Cdecl)]
+    public static extern int CacheImageRegion(out int width, out int height, out int numChannels,
+                                              [MarshalAs(UnmanagedType.LPUTF8Str)] string filename,
+                                              int x, int y, int regionWidth, int regionHeight);
+
+    [DllImport("SimpleImageIOCore", CallingConvention = CallingConvention.Cdecl)]
+    public static extern int CacheImageFromMemory(out int width, out int height, out int numChannels,
+                                                  IntPtr data, nuint numBytes,
+                                                  [MarshalAs(UnmanagedType.LPUTF8Str)] string formatHint);
+
+    [DllImport("SimpleImageIOCore", CallingConvention = CallingConvention.Cdecl)]
+    public static extern int CacheExrLayers(out int width, out int height,
+                                            [MarshalAs(UnmanagedType.LPUTF8Str)] string filename,
+                                            string[] layerNames, int numLayers);
+
+    [DllImport("SimpleImageIOCore", CallingConvention = CallingConvention.Cdecl)]
+    public static extern int OpenExrLayers(out int width, out int height,
+                                           [MarshalAs(UnmanagedType.LPUTF8Str)] string filename,
+                                           string[] layerNames, int numLayers);
+
+    [DllImport("SimpleImageIOCore", CallingConvention = CallingConvention.Cdecl)]
+    [return: MarshalAs(UnmanagedType.I1)]
+    public static extern bool ReadExrLayersInto(int id, IntPtr[] buffers, int[] rowStrides);
+
     [DllImport("SimpleImageIOCore", CallingConvention = CallingConvention.Cdecl)]
     public static extern int GetExrLayerCount(int id);
 
@@ -26,7 +50,8 @@ static internal partial class SimpleImageIOCore {
     public static extern int GetExrLayerNameLen(int id, int layerIdx);
 
     [DllImport("SimpleImageIOCore", CallingConvention = CallingConvention.Cdecl)]
-    public static extern void GetExrLayerName(int id, int layerIdx, StringBuilder name);
+    [return: MarshalAs(UnmanagedType.I1)]
+    public static extern bool GetExrLayerName(int id, int layerIdx, StringBuilder name);
 
     [DllImport("SimpleImageIOCore", CallingConvention = CallingConvention.Cdecl)]
     public static extern void CopyCachedLayer(int id, string name, IntPtr data);
@@ -43,27 +68,90 @@ static internal partial class SimpleImageIOCore {
     [DllImport("SimpleImageIOCore", CallingConvention = CallingConvention.Cdecl)]
     public static extern void DeleteExrLayerNames(int num, nint names);
 
+    [StructLayout(LayoutKind.Sequential)]
+    public struct ImageInfo {
+        public int Width, Height, NumChannels, PixelType, NumLayers;
+    }
+
+    [DllImport("SimpleImageIOCore", CallingConvention = CallingConvention.Cdecl)]
+    [return: MarshalAs(UnmanagedType.I1)]
+    public static extern bool ProbeImage([MarshalAs(UnmanagedType.LPUTF8Str)] string filename,
+                                         out ImageInfo info, out nint layerNames);
+
+    [DllImport("SimpleImageIOCore", CallingConvention = CallingConvention.Cdecl)]
+    [return: MarshalAs(UnmanagedType.I1)]
+    public static extern bool ReadImageInto([MarshalAs(UnmanagedType.LPUTF8Str)] string filename,
+                                            IntPtr data, int rowStride);
+
     #endregion
 
     #region WritingImages
 
     [DllImport("SimpleImageIOCore", CallingConvention = CallingConvention.Cdecl)]
     public static extern void WriteImage(IntPtr data, int rowStride, int width, int height, int numChannels,
-                                         [MarshalAs(UnmanagedType.LPUTF8Str)] string filename, int lossyQuality);
+                                         [MarshalAs(UnmanagedType.LPUTF8Str)] string filename, int lossyQuality,
+                                         ExrCompression exrCompression);
 
     [DllImport("SimpleImageIOCore", CallingConvention = CallingConvention.Cdecl)]
     public static extern void WriteLayeredExr(IntPtr[] datas, int[] strides, int width, int height,
                                               int[] numChannels, int numLayers, string[] names,
                                               [MarshalAs(UnmanagedType.LPUTF8Str)] string filename,
-                                              [MarshalAs(UnmanagedType.I1)] bool writeHalf);
+                                              [MarshalAs(UnmanagedType.I1)] bool writeHalf,
+                                              ExrCompression exrCompression);
 
     [DllImport("SimpleImageIOCore", CallingConvention = CallingConvention.Cdecl)]
     public static extern IntPtr WriteToMemory(IntPtr data, int rowStride, int width, int height,
                                               int numChannels, string extension, int lossyQuality,
-                                              out int len);
+                                              ExrCompression exrCompression, out IntPtr bytes, out int len);
 
     [DllImport("SimpleImageIOCore", CallingConvention = CallingConvention.Cdecl)]
-    public static extern void FreeMemory(IntPtr mem);
+    public static extern IntPtr WriteBase64ToMemory(IntPtr data, int rowStride, int width, int height,
+                                                    int numChannels, string format, int lossyQuality,
+                                                    ExrCompression exrCompression,
+                                                    [MarshalAs(UnmanagedType.I1)] bool dataUri,
+                                                    out IntPtr text, out int len);
+
+    [DllImport("SimpleImageIOCore", CallingConvention = CallingConvention.Cdecl)]
+    public static extern void FreeMemory(IntPtr buffer);
+
+    #endregion
+
+    #region AsyncIO
+
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+    public delegate void IOJobCallback(int job, int fileIndex, [MarshalAs(UnmanagedType.I1)] bool success,
+                                       IntPtr userData);
+
+    [DllImport("SimpleImageIOCore", CallingConvention = CallingConvention.Cdecl)]
+    public static extern int SubmitRead(IntPtr[] filenames, int numFiles, IOJobCallback callback, IntPtr userData);
+
+    [DllImport("SimpleImageIOCore", CallingConvention = CallingConvention.Cdecl)]
+    public static extern int SubmitWrite(IntPtr[] datas, int[] rowStrides, int[] widths, int[] heights,
+                                         int[] numChannels, IntPtr[] filenames, int[] lossyQualities,
+                                         int numFiles, ExrCompression exrCompression, IOJobCallback callback,
+                                         IntPtr userData);
+
+    [DllImport("SimpleImageIOCore", CallingConvention = CallingConvention.Cdecl)]
+    public static extern void SetIOThreadLimit(int numThreads);
+
+    [DllImport("SimpleImageIOCore", CallingConvention = CallingConvention.Cdecl)]
+    public static extern int PollJob(int job);
+
+    [DllImport("SimpleImageIOCore", CallingConvention = CallingConvention.Cdecl)]
+    [return: MarshalAs(UnmanagedType.I1)]
+    public static extern bool WaitJob(int job);
+
+    [DllImport("SimpleImageIOCore", CallingConvention = CallingConvention.Cdecl)]
+    [return: MarshalAs(UnmanagedType.I1)]
+    public static extern bool GetJobFileSuccess(int job, int fileIndex);
+
+    [DllImport("SimpleImageIOCore", CallingConvention = CallingConvention.Cdecl)]
+    [return: MarshalAs(UnmanagedType.I1)]
+    public static extern bool GetReadResult(int job, int fileIndex, out int cacheId, out int width, out int height,
+                                            out int numChannels);
+
+    [DllImport("SimpleImageIOCore", CallingConvention = CallingConvention.Cdecl)]
+    public static extern void DeleteJob(int job);
 
     #endregion
 
@@ -99,6 +187,22 @@ static internal partial class SimpleImageIOCore {
     public static extern void RgbToMonoLuminance(IntPtr image, int imgRowStride, IntPtr result, int resRowStride,
                                                  int width, int height, int numChannels);
 
+    [DllImport("SimpleImageIOCore", CallingConvention = CallingConvention.Cdecl)]
+    public static extern void LinearToRgbe(IntPtr image, int imgRowStride, IntPtr result, int resRowStride,
+                                           int width, int height, int numChannels);
+
+    [DllImport("SimpleImageIOCore", CallingConvention = CallingConvention.Cdecl)]
+    public static extern void RgbeToLinear(IntPtr image, int imgRowStride, IntPtr result, int resRowStride,
+                                           int width, int height);
+
+    [DllImport("SimpleImageIOCore", CallingConvention = CallingConvention.Cdecl)]
+    public static extern void FloatToHalf(IntPtr image, int imgRowStride, IntPtr result, int resRowStride,
+                                          int width, int height, int numChannels);
+
+    [DllImport("SimpleImageIOCore", CallingConvention = CallingConvention.Cdecl)]
+    public static extern void HalfToFloat(IntPtr image, int imgRowStride, IntPtr result, int resRowStride,
+                                          int width, int height, int numChannels);
+
     [DllImport("SimpleImageIOCore", CallingConvention = CallingConvention.Cdecl)]
     public static extern void ZoomWithNearestInterp(IntPtr image, int imgRowStride, IntPtr result,
                                                     int resRowStride, int origWidth, int origHeight,